@@ -0,0 +1,418 @@
+//
+// Created by Aaron Gill-Braun on 2026-10-18.
+//
+
+#include "virtio_blk.h"
+
+#include <kernel/blkdev.h>
+#include <kernel/device.h>
+#include <kernel/irq.h>
+#include <kernel/mm.h>
+#include <kernel/panic.h>
+#include <kernel/printf.h>
+
+#include <kernel/bus/pci.h>
+
+#include <fs/devfs/devfs.h>
+
+#define ASSERT(x) kassert(x)
+#define LOG_TAG virtio
+#include <kernel/log.h>
+#define EPRINTF(fmt, ...) kprintf("virtio-blk: ERROR: " fmt, ##__VA_ARGS__)
+
+#define VIRTIO_BLK_DEFAULT_QUEUE_SZ 128
+#define VIRTIO_BLK_MAX_QUEUES       8
+
+// per-virtqueue state, one for each blk hardware queue
+typedef struct virtio_blk_vq {
+  virtio_queue_t vq;
+  blk_hw_queue_t *hctx;
+  virtio_blk_req_hdr_t *hdrs;   // request headers indexed by head descriptor
+  uint8_t *status;              // status bytes indexed by head descriptor
+  request_t **rqs;              // in-flight requests indexed by head descriptor
+} virtio_blk_vq_t;
+
+typedef struct virtio_blk_priv {
+  virtio_pci_t vdev;                         // virtio pci transport
+  volatile virtio_blk_config_t *device_cfg;  // device specific config
+  blkdev_t *bdev;                            // registered block device
+
+  uint8_t irq;                               // assigned interrupt line
+  uint16_t num_queues;                       // number of request queues
+  virtio_blk_vq_t *vqs;                      // request queues
+
+  struct virtio_blk_priv *next_on_irq;       // linked list for shared IRQ
+} virtio_blk_priv_t;
+
+static int virtio_blk_next_unit = 0;
+static virtio_blk_priv_t *virtio_blk_irq_devices[256] = {NULL};
+
+static void virtio_blk_free_queues(virtio_blk_priv_t *priv) {
+  if (!priv->vqs) {
+    return;
+  }
+
+  for (uint16_t i = 0; i < priv->num_queues; i++) {
+    virtio_blk_vq_t *bvq = &priv->vqs[i];
+    virtio_free_queue(&bvq->vq);
+    kfree(bvq->hdrs);
+    kfree(bvq->status);
+    kfree(bvq->rqs);
+  }
+  kfree(priv->vqs);
+  priv->vqs = NULL;
+}
+
+static int virtio_blk_setup_queues(virtio_blk_priv_t *priv) {
+  priv->vqs = kmallocz(sizeof(virtio_blk_vq_t) * priv->num_queues);
+  if (!priv->vqs) {
+    return -ENOMEM;
+  }
+
+  for (uint16_t i = 0; i < priv->num_queues; i++) {
+    virtio_blk_vq_t *bvq = &priv->vqs[i];
+    char name[32];
+    ksnprintf(name, sizeof(name), "virtio-blk-rq%u", i);
+
+    int ret = virtio_setup_queue(&priv->vdev, &bvq->vq, i, VIRTIO_BLK_DEFAULT_QUEUE_SZ, true, name);
+    if (ret < 0) {
+      virtio_blk_free_queues(priv);
+      return ret;
+    }
+
+    bvq->hdrs = kmallocz(sizeof(virtio_blk_req_hdr_t) * bvq->vq.size);
+    bvq->status = kmallocz(sizeof(uint8_t) * bvq->vq.size);
+    bvq->rqs = kmallocz(sizeof(request_t *) * bvq->vq.size);
+    if (!bvq->hdrs || !bvq->status || !bvq->rqs) {
+      virtio_blk_free_queues(priv);
+      return -ENOMEM;
+    }
+  }
+
+  DPRINTF("configured %u request queues (size=%u)\n", priv->num_queues, priv->vqs[0].vq.size);
+  return 0;
+}
+
+//
+// MARK: Request Queue
+//
+
+static int virtio_blk_queue_rq(blk_hw_queue_t *hctx, request_t *rq) {
+  virtio_blk_vq_t *bvq = hctx->driver_data;
+  virtio_queue_t *vq = &bvq->vq;
+
+  uint16_t ndesc = rq->nr_segs + 2; // header + data + status
+  if (ndesc > vq->size) {
+    return -EINVAL;
+  }
+  if (vq->num_free < ndesc) {
+    return -EBUSY;
+  }
+
+  uint16_t head;
+  virtqueue_alloc_desc(vq, &head);
+
+  virtio_blk_req_hdr_t *hdr = &bvq->hdrs[head];
+  hdr->reserved = 0;
+  hdr->sector = rq->sector;
+  switch (rq->op) {
+    case BIO_READ: hdr->type = VIRTIO_BLK_T_IN; break;
+    case BIO_WRITE: hdr->type = VIRTIO_BLK_T_OUT; break;
+    case BIO_FLUSH: hdr->type = VIRTIO_BLK_T_FLUSH; break;
+    default: unreachable;
+  }
+
+  virtq_desc_t *desc = &vq->desc[head];
+  desc->addr = virt_to_phys(hdr);
+  desc->len = sizeof(*hdr);
+  desc->flags = VIRTQ_DESC_F_NEXT;
+
+  // data descriptors (device writable for reads)
+  uint16_t data_flags = VIRTQ_DESC_F_NEXT | (rq->op == BIO_READ ? VIRTQ_DESC_F_WRITE : 0);
+  for (bio_t *bio = rq->bio; bio != NULL; bio = bio->next) {
+    for (uint8_t i = 0; i < bio->vcnt; i++) {
+      uint16_t idx;
+      virtqueue_alloc_desc(vq, &idx);
+      desc->next = idx;
+      desc = &vq->desc[idx];
+      desc->addr = bio->vecs[i].phys;
+      desc->len = bio->vecs[i].len;
+      desc->flags = data_flags;
+    }
+  }
+
+  // status descriptor
+  uint16_t idx;
+  virtqueue_alloc_desc(vq, &idx);
+  desc->next = idx;
+  desc = &vq->desc[idx];
+  bvq->status[head] = 0xFF;
+  desc->addr = virt_to_phys(&bvq->status[head]);
+  desc->len = sizeof(uint8_t);
+  desc->flags = VIRTQ_DESC_F_WRITE;
+  desc->next = 0;
+
+  bvq->rqs[head] = rq;
+  vq->desc_state[head].cookie = rq;
+  vq->desc_state[head].chain_len = ndesc;
+  vq->desc_state[head].in_use = true;
+
+  barrier();
+  virtqueue_submit(vq, head);
+  return 0;
+}
+
+static void virtio_blk_commit_rqs(blk_hw_queue_t *hctx) {
+  virtio_blk_vq_t *bvq = hctx->driver_data;
+  barrier();
+  virtqueue_notify(&bvq->vq);
+}
+
+static struct blk_queue_ops virtio_blk_queue_ops = {
+  .queue_rq = virtio_blk_queue_rq,
+  .commit_rqs = virtio_blk_commit_rqs,
+};
+
+// reap completed requests from a virtqueue
+static void virtio_blk_handle_vq(virtio_blk_vq_t *bvq) {
+  virtio_queue_t *vq = &bvq->vq;
+  blk_hw_queue_t *hctx = bvq->hctx;
+  LIST_HEAD(request_t) done = LIST_HEAD_INITR;
+
+  mtx_spin_lock(&hctx->lock);
+  while (vq->last_used_idx != vq->used->idx) {
+    barrier();
+    uint16_t used_idx = vq->last_used_idx % vq->size;
+    uint16_t head = vq->used->ring[used_idx].id;
+
+    request_t *rq = bvq->rqs[head];
+    ASSERT(rq != NULL);
+    switch (bvq->status[head]) {
+      case VIRTIO_BLK_S_OK: rq->status = 0; break;
+      case VIRTIO_BLK_S_UNSUPP:
+        // a flush is a no-op for devices without a write cache
+        rq->status = rq->op == BIO_FLUSH ? 0 : -EOPNOTSUPP;
+        break;
+      default: rq->status = -EIO; break;
+    }
+
+    bvq->rqs[head] = NULL;
+    vq->desc_state[head].cookie = NULL;
+    vq->desc_state[head].chain_len = 0;
+    vq->desc_state[head].in_use = false;
+    virtqueue_free_chain(vq, head);
+
+    LIST_ADD(&done, rq, list);
+    vq->last_used_idx++;
+  }
+  bool stopped = hctx->stopped;
+  mtx_spin_unlock(&hctx->lock);
+
+  request_t *rq;
+  while ((rq = LIST_FIRST(&done)) != NULL) {
+    LIST_REMOVE(&done, rq, list);
+    blk_complete_request(rq, rq->status);
+  }
+
+  if (stopped) {
+    // descriptors were freed so the queue can make progress again
+    blk_run_hw_queue(hctx);
+  }
+}
+
+static void virtio_blk_irq_handler(struct trapframe *frame) {
+  uint8_t irq = (uint8_t)(frame->vector - 32);
+  virtio_blk_priv_t *priv = virtio_blk_irq_devices[irq];
+
+  while (priv) {
+    uint8_t isr = *priv->vdev.isr_status;
+    if (isr & 0x1) {
+      for (uint16_t i = 0; i < priv->num_queues; i++) {
+        virtio_blk_handle_vq(&priv->vqs[i]);
+      }
+    }
+    priv = priv->next_on_irq;
+  }
+}
+
+//
+// MARK: PCI Device Driver
+//
+
+static struct device_ops virtio_blk_device_ops = {
+  .d_open = NULL,
+  .d_close = NULL,
+  .d_read = NULL,
+  .d_write = NULL,
+  .d_getpage = NULL,
+  .d_putpage = NULL,
+};
+
+static bool virtio_blk_check_device(struct device_driver *drv, struct device *dev) {
+  (void) drv;
+  pci_device_t *pci_dev = dev->bus_device;
+  if (!pci_dev) {
+    return false;
+  }
+  if (pci_dev->vendor_id != VIRTIO_VENDOR_ID) {
+    return false;
+  }
+  return pci_dev->device_id == VIRTIO_BLK_DEVICE_ID_MODERN ||
+         pci_dev->device_id == VIRTIO_BLK_DEVICE_ID_LEGACY;
+}
+
+// bind the pci function and register a block device
+static int virtio_blk_setup_device(struct device *dev) {
+  pci_device_t *pci_dev = dev->bus_device;
+  virtio_blk_priv_t *priv = kmallocz(sizeof(virtio_blk_priv_t));
+  int ret;
+
+  DPRINTF("setting up %02x:%02x.%x\n", pci_dev->bus, pci_dev->device, pci_dev->function);
+  if ((ret = virtio_pci_init(&priv->vdev, pci_dev, "virtio-blk")) < 0) {
+    goto error;
+  }
+  priv->device_cfg = priv->vdev.device_cfg;
+
+  virtio_pci_reset(&priv->vdev);
+  priv->vdev.common_cfg->device_status = VIRTIO_STATUS_ACKNOWLEDGE;
+  priv->vdev.common_cfg->device_status |= VIRTIO_STATUS_DRIVER;
+
+  uint64_t features = (1ULL << VIRTIO_BLK_F_SEG_MAX) |
+                      (1ULL << VIRTIO_BLK_F_SIZE_MAX) |
+                      (1ULL << VIRTIO_BLK_F_RO) |
+                      (1ULL << VIRTIO_BLK_F_FLUSH) |
+                      (1ULL << VIRTIO_BLK_F_MQ);
+  if ((ret = virtio_pci_negotiate(&priv->vdev, features)) < 0) {
+    EPRINTF("feature negotiation failed {:err}\n", ret);
+    goto error_reset;
+  }
+  priv->vdev.common_cfg->msix_config = 0xFFFF;
+
+  // one request queue per cpu up to what the device offers
+  priv->num_queues = 1;
+  if (virtio_has_feature(&priv->vdev, VIRTIO_BLK_F_MQ)) {
+    uint16_t max_queues = min(priv->device_cfg->num_queues, virtio_pci_num_queues(&priv->vdev));
+    priv->num_queues = max(1, min(min(max_queues, system_num_cpus), VIRTIO_BLK_MAX_QUEUES));
+  }
+
+  if ((ret = virtio_blk_setup_queues(priv)) < 0) {
+    EPRINTF("queue setup failed {:err}\n", ret);
+    goto error_reset;
+  }
+
+  char name[16];
+  ksnprintf(name, sizeof(name), "vd%c", 'a' + virtio_blk_next_unit++);
+  blkdev_t *bdev = blkdev_alloc(name, &virtio_blk_queue_ops, priv->num_queues, priv);
+  bdev->nr_sectors = priv->device_cfg->capacity;
+  bdev->readonly = virtio_has_feature(&priv->vdev, VIRTIO_BLK_F_RO);
+  // leave room for the header and status descriptors
+  bdev->limits.max_segments = min(BIO_MAX_VECS, priv->vqs[0].vq.size - 2);
+  if (virtio_has_feature(&priv->vdev, VIRTIO_BLK_F_SEG_MAX) && priv->device_cfg->seg_max > 0) {
+    bdev->limits.max_segments = min(bdev->limits.max_segments, priv->device_cfg->seg_max);
+  }
+  for (uint16_t i = 0; i < priv->num_queues; i++) {
+    priv->vqs[i].hctx = &bdev->hw_queues[i];
+    bdev->hw_queues[i].driver_data = &priv->vqs[i];
+  }
+  priv->bdev = bdev;
+
+  priv->irq = pci_dev->int_line;
+  if (priv->irq == 0 || priv->irq == 0xFF) {
+    int irq = irq_alloc_hardware_irqnum();
+    if (irq < 0) {
+      ret = irq;
+      goto error_queues;
+    }
+    priv->irq = (uint8_t) irq;
+  }
+
+  bool is_first_on_irq = (virtio_blk_irq_devices[priv->irq] == NULL);
+  priv->next_on_irq = virtio_blk_irq_devices[priv->irq];
+  virtio_blk_irq_devices[priv->irq] = priv;
+  if (is_first_on_irq) {
+    if ((ret = irq_register_handler(priv->irq, virtio_blk_irq_handler, priv)) < 0) {
+      virtio_blk_irq_devices[priv->irq] = priv->next_on_irq;
+      goto error_queues;
+    }
+  }
+
+  irq_enable_interrupt(priv->irq);
+  priv->vdev.common_cfg->device_status |= VIRTIO_STATUS_DRIVER_OK;
+  barrier();
+
+  if ((ret = blkdev_register(bdev, "vblk")) < 0) {
+    irq_disable_interrupt(priv->irq);
+    virtio_blk_irq_devices[priv->irq] = priv->next_on_irq;
+    if (virtio_blk_irq_devices[priv->irq] == NULL) {
+      irq_unregister_handler(priv->irq);
+    }
+    goto error_queues;
+  }
+
+  pci_dev->registered = true;
+  dev->data = priv;
+  DPRINTF("registered {:str} on %02x:%02x.%x (irq=%u, queues=%u)\n", &bdev->name,
+          pci_dev->bus, pci_dev->device, pci_dev->function, priv->irq, priv->num_queues);
+  return 0;
+
+LABEL(error_queues);
+  if (priv->bdev) {
+    blkdev_free(priv->bdev);
+  }
+  virtio_blk_free_queues(priv);
+LABEL(error_reset);
+  virtio_pci_reset(&priv->vdev);
+LABEL(error);
+  kfree(priv);
+  return ret;
+}
+
+// unbind device and release all resources
+static int virtio_blk_remove_device(struct device *dev) {
+  virtio_blk_priv_t *priv = dev->data;
+  if (!priv) {
+    return 0;
+  }
+
+  DPRINTF("removing {:str}\n", &priv->bdev->name);
+  // unlink from the shared irq list
+  virtio_blk_priv_t **pp = &virtio_blk_irq_devices[priv->irq];
+  while (*pp && *pp != priv) {
+    pp = &(*pp)->next_on_irq;
+  }
+  if (*pp) {
+    *pp = priv->next_on_irq;
+  }
+  if (virtio_blk_irq_devices[priv->irq] == NULL) {
+    irq_disable_interrupt(priv->irq);
+    irq_unregister_handler(priv->irq);
+  }
+  virtio_pci_reset(&priv->vdev);
+
+  if (priv->bdev->device) {
+    unregister_dev(priv->bdev->device);
+  }
+  blkdev_free(priv->bdev);
+  virtio_blk_free_queues(priv);
+  kfree(priv);
+  dev->data = NULL;
+  return 0;
+}
+
+static device_driver_t virtio_blk_driver = {
+  .name = "virtio-blk",
+  .data = NULL,
+  .ops = &virtio_blk_device_ops,
+  .f_ops = NULL,
+  .check_device = virtio_blk_check_device,
+  .setup_device = virtio_blk_setup_device,
+  .remove_device = virtio_blk_remove_device,
+};
+
+static void virtio_blk_init_module(void) {
+  devfs_register_class(dev_major_by_name("vblk"), -1, "vd", DEVFS_LETTERED);
+  if (register_driver("pci", &virtio_blk_driver) < 0) {
+    panic("virtio-blk: failed to register driver");
+  }
+}
+MODULE_INIT(virtio_blk_init_module);
@@ -0,0 +1,58 @@
+//
+// Created by Aaron Gill-Braun on 2026-10-18.
+//
+
+#ifndef DRIVERS_BLOCK_VIRTIO_BLK_H
+#define DRIVERS_BLOCK_VIRTIO_BLK_H
+
+#include <drivers/virtio/virtio.h>
+
+#define VIRTIO_BLK_DEVICE_ID_MODERN    0x1042
+#define VIRTIO_BLK_DEVICE_ID_LEGACY    0x1001
+
+typedef struct virtio_blk_config {
+  uint64_t capacity;            // capacity in 512 byte sectors
+  uint32_t size_max;            // max size of a single segment
+  uint32_t seg_max;             // max number of segments in a request
+  struct {
+    uint16_t cylinders;
+    uint8_t heads;
+    uint8_t sectors;
+  } geometry;                   // legacy geometry
+  uint32_t blk_size;            // optimal block size
+  struct {
+    uint8_t physical_block_exp;
+    uint8_t alignment_offset;
+    uint16_t min_io_size;
+    uint32_t opt_io_size;
+  } topology;                   // device topology
+  uint8_t writeback;            // cache mode
+  uint8_t unused0;
+  uint16_t num_queues;          // number of request queues
+} packed virtio_blk_config_t;
+
+typedef struct virtio_blk_req_hdr {
+  uint32_t type;                // request type
+  uint32_t reserved;
+  uint64_t sector;              // starting sector
+} packed virtio_blk_req_hdr_t;
+
+#define VIRTIO_BLK_F_SIZE_MAX          1
+#define VIRTIO_BLK_F_SEG_MAX           2
+#define VIRTIO_BLK_F_GEOMETRY          4
+#define VIRTIO_BLK_F_RO                5
+#define VIRTIO_BLK_F_BLK_SIZE          6
+#define VIRTIO_BLK_F_FLUSH             9
+#define VIRTIO_BLK_F_TOPOLOGY          10
+#define VIRTIO_BLK_F_CONFIG_WCE        11
+#define VIRTIO_BLK_F_MQ                12
+
+#define VIRTIO_BLK_T_IN                0
+#define VIRTIO_BLK_T_OUT               1
+#define VIRTIO_BLK_T_FLUSH             4
+
+#define VIRTIO_BLK_S_OK                0
+#define VIRTIO_BLK_S_IOERR             1
+#define VIRTIO_BLK_S_UNSUPP            2
+
+#endif // DRIVERS_BLOCK_VIRTIO_BLK_H
@@ -34,13 +34,11 @@ static int loopback_tx(netdev_t *dev, sk_buff_t *skb) {
     return -EINVAL;
   }
 
+  // the packet never leaves memory so the sent skb is passed up as is
+  // instead of being copied, and its checksums do not need to be verified
   skb->pkt_type = PACKET_LOOPBACK;
-  sk_buff_t *rx_skb = skb_copy(skb);
-  if (!rx_skb) {
-    return -ENOMEM;
-  }
-
-  netdev_rx(dev, rx_skb);
+  skb->ip_summed = CHECKSUM_UNNECESSARY;
+  netdev_rx(dev, skb);
   return 0;
 }
 
@@ -83,6 +81,7 @@ void loopback_init() {
 
   loopback_dev->type = ARPHRD_LOOPBACK;
   loopback_dev->flags = NETDEV_LOOPBACK;
+  loopback_dev->features = NETDEV_F_NO_CSUM;
   loopback_dev->mtu = 65536;  // large MTU for loopback
   loopback_dev->netdev_ops = &loopback_ops;
 
@@ -28,6 +28,8 @@
 #include <kernel/log.h>
 #define EPRINTF(fmt, ...) kprintf("pty: %s: " fmt, __func__, ##__VA_ARGS__)
 
+#define PTY_WRITE_CHUNK 512
+
 // =========================================================================
 // Global state
 // =========================================================================
@@ -257,15 +259,29 @@ static ssize_t ptmx_f_write(file_t *file, kio_t *kio) {
   }
 
   ssize_t total = 0;
-  char ch;
-  while (kio_read_ch(&ch, kio) > 0) {
-    int res = ttydisc_rint(tty, (uint8_t)ch, 0);
-    if (res < 0) {
-      if (total == 0)
-        total = res;
-      break;
+  if (ttydisc_can_bypass(tty)) {
+    // raw mode input is copied into the input queue as a block
+    char buf[PTY_WRITE_CHUNK];
+    while (kio_remaining(kio) > 0) {
+      size_t len = min(sizeof(buf), ttyinq_space(tty->inq));
+      if (len == 0) {
+        break; // input queue is full
+      }
+
+      len = kio_read_out(buf, len, 0, kio);
+      total += (ssize_t) ttydisc_rint_bypass(tty, buf, len);
+    }
+  } else {
+    char ch;
+    while (kio_read_ch(&ch, kio) > 0) {
+      int res = ttydisc_rint(tty, (uint8_t)ch, 0);
+      if (res < 0) {
+        if (total == 0)
+          total = res;
+        break;
+      }
+      total++;
     }
-    total++;
   }
 
   if (total > 0) {
@@ -11,6 +11,8 @@
 #include <kernel/irq.h>
 #include <kernel/proc.h>
 #include <kernel/params.h>
+#include <kernel/atomic.h>
+#include <kernel/string.h>
 
 #include <kernel/printf.h>
 #include <kernel/panic.h>
@@ -36,14 +38,48 @@
 #define UART_LINE_STATUS 5
 #define UART_MODEM_STATUS 6
 
+#define UART_IER_RDA  0x01 // received data available
+#define UART_IER_THRE 0x02 // transmitter holding register empty
+#define UART_LSR_DR   0x01 // data ready
+#define UART_LSR_THRE 0x20 // transmit fifo (or holding register) empty
+
+#define UART_FIFO_SIZE 16     // 16550A transmit fifo depth
+#define UART_TX_RING_SIZE 4096
+
 KERNEL_PARAM("console.uart.port", str_t, console_uart_port_param, str_null);
 static int console_uart_port;
 
 struct uart_dev {
   int number;
   int port;
-  pid_t tx_tid;
-  cond_t tx_cond; // signaled when tx buffer is empty
+};
+
+/*
+ * The transmitter is only ever written when it reports the fifo as empty, and
+ * then it is filled with up to fifo_size bytes at once. Whoever holds tx_lock
+ * does the filling: the THRE interrupt, the tty outwakeup or a console write
+ * that finds the transmitter idle.
+ *
+ * Kernel console writes go through tx_ring once it is turned on. The ring is
+ * single producer (writes to a port are serialized by the caller) and single
+ * consumer (the tx_lock holder), so neither side takes a lock to use it. The
+ * THRE interrupt sends console data directly and only passes the event on to
+ * the softirq handler, which needs the tty lock to get at the tty output queue,
+ * when the ring is empty.
+ */
+struct uart_tx_ring {
+  uint32_t head; // next byte to queue, only advanced by the producer
+  uint32_t tail; // next byte to send, only advanced by the consumer
+  char buf[UART_TX_RING_SIZE];
+};
+
+struct uart_port {
+  int port;
+  int fifo_size;    // transmit fifo depth (1 without working fifos)
+  uint8_t fcr;      // fifo control register value
+  bool tx_ring_on;  // console writes are queued to tx_ring
+  mtx_t tx_lock;    // held while filling the transmit fifo
+  struct uart_tx_ring tx_ring;
 };
 
 struct uart_irq {
@@ -63,10 +99,25 @@ static inline volatile uint8_t io_inb(int port) {
   return value;
 }
 
+static inline int uart_port_index(int port) {
+  switch (port) {
+    case COM1: return 0;
+    case COM2: return 1;
+    case COM3: return 2;
+    case COM4: return 3;
+    default: unreachable;
+  }
+}
+
+static inline int uart_port_irq(int port) {
+  return (port == COM1 || port == COM3) ? UART_COM13_IRQ : UART_COM24_IRQ;
+}
+
 static void uart_irq_handler(struct trapframe *frame);
 static int uart_softirq_handler();
 
 static mtx_t irq_lock;
+static struct uart_port uart_ports[4];
 static void (*uart_irq_handlers[4])(int, int, void *) = {0};
 static void *uart_irq_handler_data[4] = {0};
 static chan_t *uart_softirq_chan = {0};
@@ -89,6 +140,9 @@ static void uart_static_init() {
   // initialize static variables
   mtx_init(&irq_lock, MTX_SPIN, "uart_irq_lock");
   memset(uart_irq_handlers, 0, ARRAY_SIZE(uart_irq_handlers));
+  for (int i = 0; i < ARRAY_SIZE(uart_ports); i++) {
+    mtx_init(&uart_ports[i].tx_lock, MTX_SPIN, "uart_tx_lock");
+  }
 
   irq_must_reserve_irqnum(UART_COM13_IRQ);
   irq_must_reserve_irqnum(UART_COM24_IRQ);
@@ -109,6 +163,108 @@ static void start_softirq_handler() {
 }
 MODULE_INIT(start_softirq_handler);
 
+//
+// MARK: Transmit
+//
+
+static size_t tx_ring_put(struct uart_tx_ring *ring, const char *buf, size_t len) {
+  uint32_t head = ring->head;
+  uint32_t tail = atomic_load(&ring->tail);
+  len = min(len, UART_TX_RING_SIZE - (head - tail));
+
+  size_t off = head % UART_TX_RING_SIZE;
+  size_t n = min(len, UART_TX_RING_SIZE - off);
+  memcpy(ring->buf + off, buf, n);
+  memcpy(ring->buf, buf + n, len - n);
+  atomic_store_release(&ring->head, head + (uint32_t) len);
+  return len;
+}
+
+static size_t tx_ring_get(struct uart_tx_ring *ring, char *buf, size_t len) {
+  uint32_t tail = ring->tail;
+  uint32_t head = atomic_load(&ring->head);
+  len = min(len, head - tail);
+
+  size_t off = tail % UART_TX_RING_SIZE;
+  size_t n = min(len, UART_TX_RING_SIZE - off);
+  memcpy(buf, ring->buf + off, n);
+  memcpy(buf + n, ring->buf, len - n);
+  atomic_store_release(&ring->tail, tail + (uint32_t) len);
+  return len;
+}
+
+static inline bool tx_ring_empty(struct uart_tx_ring *ring) {
+  return atomic_load(&ring->head) == atomic_load(&ring->tail);
+}
+
+static inline void uart_fifo_write(int port, const char *buf, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    io_outb(port + UART_DATA, buf[i]);
+  }
+}
+
+// fills the transmit fifo if it is empty, console data first and then data
+// from the tty output queue if a tty is given. tx_lock must be held.
+static size_t uart_tx_fill(struct uart_port *up, tty_t *tty) {
+  if (!(io_inb(up->port + UART_LINE_STATUS) & UART_LSR_THRE)) {
+    return 0; // the THRE interrupt will come when the fifo drains
+  }
+
+  char buf[UART_FIFO_SIZE];
+  size_t n = tx_ring_get(&up->tx_ring, buf, up->fifo_size);
+  if (n == 0 && tty != NULL) {
+    n = ttyoutq_read_buf(tty->outq, buf, up->fifo_size);
+  }
+  uart_fifo_write(up->port, buf, n);
+  return n;
+}
+
+// sends console data queued while tx_lock was held by someone else. the holder
+// calls this after unlocking so that data queued after its last fill is not
+// left waiting for an interrupt that will not come.
+static void uart_tx_kick(struct uart_port *up) {
+  atomic_thread_fence(); // order the unlock or ring update before the checks
+  while (!tx_ring_empty(&up->tx_ring) && mtx_spin_trylock(&up->tx_lock)) {
+    size_t n = uart_tx_fill(up, NULL);
+    mtx_spin_unlock(&up->tx_lock);
+    if (n == 0) {
+      break; // the transmitter is busy and will interrupt when done
+    }
+  }
+}
+
+static size_t uart_tx_start(struct uart_port *up, tty_t *tty) {
+  mtx_spin_lock(&up->tx_lock);
+  size_t n = uart_tx_fill(up, tty);
+  mtx_spin_unlock(&up->tx_lock);
+  uart_tx_kick(up);
+  return n;
+}
+
+// writes directly to the fifo one batch at a time under tx_lock so that the
+// writes do not interleave with the THRE interrupt filling it
+static void uart_tx_write(struct uart_port *up, const char *buf, size_t len) {
+  size_t fifo_size = max(up->fifo_size, 1);
+  while (len > 0) {
+    size_t n = 0;
+    mtx_spin_lock(&up->tx_lock);
+    if (io_inb(up->port + UART_LINE_STATUS) & UART_LSR_THRE) {
+      n = min(len, fifo_size);
+      uart_fifo_write(up->port, buf, n);
+    }
+    mtx_spin_unlock(&up->tx_lock);
+
+    if (n == 0) {
+      cpu_pause(); // wait for the fifo to drain
+    }
+    buf += n;
+    len -= n;
+  }
+}
+
+//
+// MARK: Interrupts
+//
 
 static void uart_irq_port_handler(int port, int index, int irr) {
   // DPRINTF("irq: port %d: irr = 0x%x\n", port, irr);
@@ -127,8 +283,11 @@ static void uart_irq_port_handler(int port, int index, int irr) {
       }
       break;
     case 1: // transmitter holding register empty
-//      DPRINTF("port %d: transmitter holding register empty\n", port);
-      event = UART_IRQ_TX;
+      // send any console data from here and leave the tty data to the softirq
+      // handler only when there is none
+      if (uart_tx_start(&uart_ports[index], NULL) == 0) {
+        event = UART_IRQ_TX;
+      }
       break;
     case 2: // data received
       DPRINTF("port %d: data received\n", port);
@@ -176,17 +335,21 @@ static void uart_irq_handler(struct trapframe *frame) {
   int port = (int)frame->data; // this narrows down to one set of ports
   // DPRINTF("uart irq handler: port %d\n", port);
 
+  // both ports sharing the irq are checked since a missed THRE interrupt
+  // would stall the transmitter
   int irr;
   if (port == 1) { // irq could have come from COM1 or COM3
     if (!((irr = io_inb(COM1 + UART_FIFO_CTRL)) & 0x01)) {
       uart_irq_port_handler(COM1, 0, irr); // interrupt for COM1
-    } else if (!((irr = io_inb(COM3 + UART_FIFO_CTRL)) & 0x01)) {
+    }
+    if (!((irr = io_inb(COM3 + UART_FIFO_CTRL)) & 0x01)) {
       uart_irq_port_handler(COM3, 2, irr); // interrupt for COM3
     }
   } else if (port == 2) { // irq could have come from COM2 or COM4
-    if (!(irr = (io_inb(COM2 + UART_FIFO_CTRL)) & 0x01)) {
+    if (!((irr = io_inb(COM2 + UART_FIFO_CTRL)) & 0x01)) {
       uart_irq_port_handler(COM2, 1, irr); // interrupt for COM2
-    } else if (!((irr = io_inb(COM4 + UART_FIFO_CTRL)) & 0x01)) {
+    }
+    if (!((irr = io_inb(COM4 + UART_FIFO_CTRL)) & 0x01)) {
       uart_irq_port_handler(COM4, 3, irr); // interrupt for COM4
     }
   } else {
@@ -223,6 +386,11 @@ bool uart_hw_init_probe(int port) {
     return false;
   }
 
+  struct uart_port *up = &uart_ports[uart_port_index(port)];
+  if (up->tx_ring_on) {
+    return true; // already set up and in use by the kernel console
+  }
+
   io_outb(port + UART_INTR_EN, 0x00);     // disable interrupts
 
   // enable DLAB to set baud rate divisor
@@ -231,7 +399,20 @@ bool uart_hw_init_probe(int port) {
   io_outb(port + 1, 0x00);                // divisor MSB
 
   io_outb(port + UART_LINE_CTRL, 0x03);   // 8 bits, no parity, one stop bit, DLAB = 0
-  io_outb(port + UART_FIFO_CTRL, 0xC1);   // enable FIFO, clear RX/TX, 1-byte threshold
+  io_outb(port + UART_FIFO_CTRL, 0xC1);   // enable FIFO, 14-byte rx threshold
+
+  // a 16550A reports working fifos in bits 6-7 of the iir. the fifos of the
+  // original 16550 are broken and older parts have none.
+  up->port = port;
+  if ((io_inb(port + UART_FIFO_CTRL) & 0xC0) == 0xC0) {
+    up->fifo_size = UART_FIFO_SIZE;
+    up->fcr = 0xC1;
+  } else {
+    up->fifo_size = 1;
+    up->fcr = 0x00;
+    io_outb(port + UART_FIFO_CTRL, up->fcr);
+  }
+
   io_outb(port + UART_MODEM_CTRL, 0x1E);  // loopback mode, set OUT2
 
   io_outb(port + UART_DATA, 0xAE);        // send test byte
@@ -315,8 +496,8 @@ int uart_hw_configure(int port, const struct termios *tio) {
   // restore interrupt enable register
   io_outb(port + UART_INTR_EN, ier);
 
-  // enable FIFO, clear TX/RX queues, 1-byte threshold
-  io_outb(port + UART_FIFO_CTRL, 0xC1);
+  // restore the fifo setup found by the probe
+  io_outb(port + UART_FIFO_CTRL, uart_ports[uart_port_index(port)].fcr);
 
   // modem control: DTR, RTS, OUT2
   io_outb(port + UART_MODEM_CTRL, 0xf);
@@ -354,7 +535,7 @@ int uart_hw_set_irq_handler(int port, void (*handler)(int ev, int ev_data, void
   irq_enable_interrupt(port_irq);
 
   // enable data available/can transmit irqs (no modem status - causes IRQ storm in QEMU)
-  io_outb(port + UART_INTR_EN, 0b0011);
+  io_outb(port + UART_INTR_EN, UART_IER_RDA | UART_IER_THRE);
   // io_outb(port + UART_INTR_EN, 0b1101);
   mtx_spin_unlock(&irq_lock);
   return 0;
@@ -389,12 +570,13 @@ void uart_hw_unset_irq_handler(int port) {
   mtx_spin_lock(&irq_lock);
   uart_irq_handlers[index] = NULL;
   uart_irq_handler_data[index] = NULL;
-  if (uart_irq_handlers[index_compl] == NULL) {
+  if (uart_irq_handlers[index_compl] == NULL &&
+      !uart_ports[index].tx_ring_on && !uart_ports[index_compl].tx_ring_on) {
     irq_disable_interrupt(port_irq);
   }
 
-  // disable interrupts for the port
-  io_outb(port + UART_INTR_EN, 0x00); // disable all interrupts
+  // disable interrupts for the port except those driving the console ring
+  io_outb(port + UART_INTR_EN, uart_ports[index].tx_ring_on ? UART_IER_THRE : 0x00);
   mtx_spin_unlock(&irq_lock);
 }
 
@@ -404,16 +586,94 @@ int uart_hw_busy_read_ch(int port) {
     return -1;
   }
 
-  while (!(io_inb(port + UART_LINE_STATUS) & 0x01)); // wait for rx buffer to be full
+  while (!(io_inb(port + UART_LINE_STATUS) & UART_LSR_DR)); // wait for rx buffer to be full
   return io_inb(port);
 }
 
-void uart_hw_busy_write_ch(int port, char c) {
+void uart_hw_busy_write(int port, const char *buf, size_t len) {
   if (!IS_VALID_PORT(port)) {
     EPRINTF("invalid port: %d\n", port);
+    return;
+  }
+
+  // wait for the fifo to drain and then fill it in one go
+  size_t fifo_size = max(uart_ports[uart_port_index(port)].fifo_size, 1);
+  while (len > 0) {
+    while (!(io_inb(port + UART_LINE_STATUS) & UART_LSR_THRE)) {
+      cpu_pause();
+    }
+
+    size_t n = min(len, fifo_size);
+    uart_fifo_write(port, buf, n);
+    buf += n;
+    len -= n;
+  }
+}
+
+void uart_hw_write(int port, const char *buf, size_t len) {
+  if (!IS_VALID_PORT(port)) {
+    EPRINTF("invalid port: %d\n", port);
+    return;
+  }
+
+  struct uart_port *up = &uart_ports[uart_port_index(port)];
+  if (mtx_owner(&up->tx_lock) == curthread) {
+    // write directly if we were called while filling the fifo (e.g. a panic)
+    // since the lock would never be released
+    uart_hw_busy_write(port, buf, len);
+    return;
+  }
+
+  if (!up->tx_ring_on) {
+    uart_tx_write(up, buf, len);
+    return;
+  }
+
+  while (true) {
+    size_t n = tx_ring_put(&up->tx_ring, buf, len);
+    buf += n;
+    len -= n;
+
+    uart_tx_kick(up);
+    if (len == 0) {
+      break;
+    }
+    // the ring is full so we keep kicking the transmitter until there is room
+    cpu_pause();
+  }
+}
+
+int uart_hw_start_tx_ring(int port) {
+  if (!IS_VALID_PORT(port)) {
+    EPRINTF("invalid port: %d\n", port);
+    return -1;
+  }
+
+  struct uart_port *up = &uart_ports[uart_port_index(port)];
+  mtx_spin_lock(&irq_lock);
+  up->tx_ring_on = true;
+  irq_enable_interrupt(uart_port_irq(port));
+  io_outb(port + UART_INTR_EN, io_inb(port + UART_INTR_EN) | UART_IER_THRE);
+  mtx_spin_unlock(&irq_lock);
+  return 0;
+}
+
+void uart_hw_stop_tx_ring(int port) {
+  if (!IS_VALID_PORT(port)) {
+    EPRINTF("invalid port: %d\n", port);
+    return;
+  }
+
+  // this is used when interrupts will no longer be serviced (on panic) so the
+  // ring is drained without tx_lock since its holder may have been stopped
+  struct uart_port *up = &uart_ports[uart_port_index(port)];
+  up->tx_ring_on = false;
+
+  char buf[UART_FIFO_SIZE];
+  size_t n;
+  while ((n = tx_ring_get(&up->tx_ring, buf, sizeof(buf))) > 0) {
+    uart_hw_busy_write(port, buf, n);
   }
-  while (!(io_inb(port + UART_LINE_STATUS) & 0x20)); // wait for tx buffer to be empty
-  io_outb(port, c);
 }
 
 bool uart_hw_can_read(int port) {
@@ -421,7 +681,7 @@ bool uart_hw_can_read(int port) {
     EPRINTF("invalid port: %d\n", port);
     return -1;
   }
-  return (io_inb(port + UART_LINE_STATUS) & 0x01) != 0; // check if data is available
+  return (io_inb(port + UART_LINE_STATUS) & UART_LSR_DR) != 0; // check if data is available
 }
 
 bool uart_hw_can_write(int port) {
@@ -429,7 +689,7 @@ bool uart_hw_can_write(int port) {
     EPRINTF("invalid port: %d\n", port);
     return 0;
   }
-  return (io_inb(port + UART_LINE_STATUS) & 0x20) != 0; // check if tx buffer is empty
+  return (io_inb(port + UART_LINE_STATUS) & UART_LSR_THRE) != 0; // check if tx buffer is empty
 }
 
 int uart_hw_modem(int port, int command, int arg) {
@@ -476,44 +736,6 @@ int uart_hw_modem(int port, int command, int arg) {
 
 static void uart_tty_outwakeup(tty_t *tty);
 
-static int uart_tty_transmit_thread(tty_t *tty) {
-  struct uart_dev *uart_dev = tty->dev_data;
-  DPRINTF("transmit thread started for tty on port %d\n", uart_dev->port);
-
-  if (!tty_lock(tty)) {
-    EPRINTF("tty device is gone\n");
-    return -ENXIO;
-  }
-
-  int res = 0;
-  while (true) {
-    if (ttyoutq_peek_ch(tty->outq) < 0) {
-      // no data available, wait for it
-      DPRINTF("transmit thread: no data, waiting on out_wait condition\n");
-      if ((res = tty_wait_cond(tty, &tty->out_data_cond)) < 0) {
-        DPRINTF("transmit thread: tty_wait_cond failed: {:err}\n", res);
-        break; // device is done
-      }
-      DPRINTF("transmit thread: woken up from out_wait\n");
-      continue;
-    }
-
-    if (!uart_hw_can_write(uart_dev->port)) {
-      // wait for tx buffer to be empty
-      DPRINTF("transmit thread: uart tx buffer full, waiting on tx_cond\n");
-      cond_wait(&uart_dev->tx_cond, &tty->lock);
-    }
-
-    // write data to the uart
-    DPRINTF("transmit thread: data available, calling outwakeup\n");
-    uart_tty_outwakeup(tty);
-  }
-
-  DPRINTF("transmit thread exiting\n");
-  tty_unlock(tty);
-  return res;
-}
-
 // this is run in a softirq context, so it may block
 static void uart_tty_irq_handler(int ev, int ev_data, void *data) {
   tty_t *tty = data;
@@ -547,12 +769,14 @@ static void uart_tty_irq_handler(int ev, int ev_data, void *data) {
     }
     ttydisc_rint_done(tty);
   } else if (ev == UART_IRQ_TX) {
-    cond_signal(&uart_dev->tx_cond);
+    // the fifo is empty, refill it from the output queue
+    uart_tty_outwakeup(tty);
   } else if (ev == UART_IRQ_DCD) {
     DPRINTF("data carrier detect changed (dcd=%d)\n", ev_data);
-    if (data) {
-      // data carrier connected
+    if (ev_data) {
+      // data carrier connected, start sending any held output
       tty->flags |= TTYF_DCDRDY;
+      uart_tty_outwakeup(tty);
     } else {
       // data carrier disconnected
       tty->flags &= ~TTYF_DCDRDY;
@@ -567,7 +791,6 @@ LABEL(done);
 static int uart_tty_open(tty_t *tty) {
   struct uart_dev *uart_dev = tty->dev_data;
   DPRINTF("opening tty on port %d\n", uart_dev->port);
-  ASSERT(uart_dev->tx_tid == -1);
   uart_hw_set_irq_handler(uart_dev->port, uart_tty_irq_handler, tty);
   uart_hw_modem(uart_dev->port, TTY_MODEM_DTR, 1);
 
@@ -577,67 +800,25 @@ static int uart_tty_open(tty_t *tty) {
     // data carrier detect is ready
     tty->flags |= TTYF_DCDRDY;
   }
-
-  // start a new thread under the uart process to handle transmission
-  thread_t *thread = thread_alloc(TDF_KTHREAD, SIZE_16KB);
-  thread_setup_name(thread, cstr_make("uart_tty_transmit"));
-  thread_setup_entry(thread, (uintptr_t) uart_tty_transmit_thread, 1, tty);
-
-  __ref proc_t *uart_proc = proc_lookup(uart_softirq_pid);
-  ASSERT(uart_proc != NULL);
-  proc_add_thread(uart_proc, thread);
-  uart_dev->tx_tid = thread->tid;
-  pr_putref(&uart_proc);
   return 0;
 }
 
 static void uart_tty_close(tty_t *tty) {
   struct uart_dev *uart_dev = tty->dev_data;
-  ASSERT(uart_dev->tx_tid != -1);
   uart_hw_unset_irq_handler(uart_dev->port);
   uart_hw_modem(uart_dev->port, TTY_MODEM_DTR, 0);
-
-  __ref proc_t *uart_proc = proc_lookup(uart_softirq_pid);
-  ASSERT(uart_proc != NULL);
-  proc_kill_tid(uart_proc, uart_dev->tx_tid, 0, SIGTERM);
-  pr_putref(&uart_proc);
-
-  uart_dev->tx_tid = -1;
 }
 
 static void uart_tty_outwakeup(tty_t *tty) {
-  // this function is called when the output queue has data to write.
+  // this function is called when the output queue has data to write and from
+  // the THRE interrupt. it sends as much as fits in the transmit fifo and the
+  // rest is sent as the interrupts for it come in.
   struct uart_dev *uart_dev = tty->dev_data;
-  int chars_written = 0;
-
-  DPRINTF("outwakeup: starting to drain output queue\n");
-  while (ttyoutq_peek_ch(tty->outq) >= 0) {
-    if (!uart_hw_can_write(uart_dev->port)) {
-      DPRINTF("outwakeup: uart hardware cannot accept more data, drained %d chars\n", chars_written);
-      break;
-    }
-
-    int ch = ttyoutq_get_ch(tty->outq);
-    if (ch < 0) {
-      EPRINTF("error reading from output queue\n");
-      break;
-    }
-
-    uart_hw_busy_write_ch(uart_dev->port, (char)ch);
-    chars_written++;
-  }
-
-  if (ttyoutq_bytes(tty->outq) > 0) {
-    // there are still remaining bytes in the tty output queue but the uart
-    // cannot accept more data right now, so we signal the transmit thread
-    // that there is data for it to write.
-    tty_signal_cond(tty, &tty->out_data_cond);
-  } else if (!ttyoutq_isfull(tty->outq)) {
+  size_t n = uart_tx_start(&uart_ports[uart_port_index(uart_dev->port)], tty);
+  if (n > 0) {
     // the output queue has space so we signal anything waiting to write to it
     tty_signal_cond(tty, &tty->outready_cond);
   }
-
-  DPRINTF("outwakeup: drained %d characters from output queue\n", chars_written);
 }
 
 static int uart_tty_ioctl(tty_t *tty, unsigned long request, void *arg) {
@@ -698,13 +879,15 @@ static ssize_t uart_dev_read(device_t *dev, _unused size_t off, size_t nmax, kio
 
 static ssize_t uart_dev_write(device_t *dev, _unused size_t off, size_t nmax, kio_t *kio) {
   struct uart_dev *uart_dev = dev->data;
-  ssize_t n = 0;
-  char ch;
-  while (nmax-- && kio_read_ch(&ch, kio) > 0) {
-    uart_hw_busy_write_ch(uart_dev->port, ch);
-    n++;
-  }
-  return n;
+  struct uart_port *up = &uart_ports[uart_port_index(uart_dev->port)];
+  size_t n = 0;
+  char buf[UART_FIFO_SIZE];
+  size_t len;
+  while ((len = kio_read_out(buf, min(nmax - n, sizeof(buf)), 0, kio)) > 0) {
+    uart_tx_write(up, buf, len);
+    n += len;
+  }
+  return (ssize_t) n;
 }
 
 static struct device_ops uart_ops = {
@@ -726,8 +909,6 @@ static void register_serial_devices() {
     struct uart_dev *uart_dev = kmallocz(sizeof(struct uart_dev));
     uart_dev->number = i + 1; // COM1 is 1, COM2 is 2, etc.
     uart_dev->port = ports[i];
-    uart_dev->tx_tid = -1;
-    cond_init(&uart_dev->tx_cond, "uart_tx_cond");
 
     tty_t *tty = tty_alloc(&uart_ttydev_ops, uart_dev);
     if (tty == NULL) {
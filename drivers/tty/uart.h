@@ -31,9 +31,19 @@ int uart_hw_set_irq_handler(int port, void (*handler)(int ev, int ev_data, void
 void uart_hw_unset_irq_handler(int port);
 
 int uart_hw_busy_read_ch(int port);
-void uart_hw_busy_write_ch(int port, char c);
+void uart_hw_busy_write(int port, const char *buf, size_t len);
 bool uart_hw_can_read(int port);
 bool uart_hw_can_write(int port);
 int uart_hw_modem(int port, int command, int arg);
 
+/// Writes kernel console output to the port. Once the tx ring is started the
+/// data is queued and sent from the transmit interrupt, otherwise it is written
+/// out directly. Writes to a port must be serialized by the caller.
+void uart_hw_write(int port, const char *buf, size_t len);
+/// Starts sending uart_hw_write data from the transmit interrupt.
+int uart_hw_start_tx_ring(int port);
+/// Writes out anything left in the tx ring and goes back to direct writes. This
+/// is for when interrupts will no longer be serviced.
+void uart_hw_stop_tx_ring(int port);
+
 #endif
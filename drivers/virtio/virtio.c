@@ -0,0 +1,416 @@
+//
+// Created by Aaron Gill-Braun on 2026-10-18.
+//
+
+#include "virtio.h"
+
+#include <kernel/mm.h>
+#include <kernel/panic.h>
+#include <kernel/printf.h>
+
+#include <kernel/bus/pci.h>
+#include <kernel/bus/pci_hw.h>
+
+#define ASSERT(x) kassert(x)
+#define LOG_TAG virtio
+#include <kernel/log.h>
+#define EPRINTF(fmt, ...) kprintf("virtio: ERROR: " fmt, ##__VA_ARGS__)
+
+
+static uint16_t virtio_round_down_pow2(uint16_t value) {
+  if (value <= 1) {
+    return 1;
+  }
+  uint16_t result = 1;
+  while ((uint16_t)(result << 1) != 0 && (uint16_t)(result << 1) <= value) {
+    result <<= 1;
+  }
+  return result;
+}
+
+// allocate and map shared virtqueue memory
+int virtio_alloc_region(virtio_mem_region_t *region, size_t size, const char *name) {
+  size_t total_size = align(size, PAGE_SIZE);
+  __ref page_t *pages = alloc_pages(SIZE_TO_PAGES(total_size));
+  if (!pages) {
+    EPRINTF("failed to allocate pages for %s\n", name);
+    return -ENOMEM;
+  }
+
+  uintptr_t vaddr = vmap_pages(moveref(pages), 0, total_size, VM_RDWR | VM_NOCACHE, name);
+  if (vaddr == 0) {
+    EPRINTF("failed to map region %s\n", name);
+    return -ENOMEM;
+  }
+
+  memset((void *) vaddr, 0, total_size);
+  region->vaddr = vaddr;
+  region->size = total_size;
+  region->paddr = virt_to_phys(vaddr);
+  DPRINTF("mapped %s: virt=%p phys=0x%llx size=%zu\n", name, (void *) vaddr,
+          (unsigned long long) region->paddr, total_size);
+  return 0;
+}
+
+void virtio_free_region(virtio_mem_region_t *region) {
+  if (region->vaddr && region->size) {
+    DPRINTF("unmapping region virt=%p size=%zu\n", (void *) region->vaddr, region->size);
+    vmap_free(region->vaddr, region->size);
+  }
+  region->vaddr = 0;
+  region->paddr = 0;
+  region->size = 0;
+}
+
+//
+// MARK: PCI Transport
+//
+
+static pci_bar_t *virtio_pci_get_bar(virtio_pci_t *vdev, uint8_t index) {
+  pci_bar_t *bar = vdev->pci_dev->bars;
+  while (bar) {
+    if (bar->num == index) {
+      return bar;
+    }
+    bar = bar->next;
+  }
+  return NULL;
+}
+
+static void *virtio_pci_map_cap(virtio_pci_t *vdev, const virtio_pci_cap_t *cap) {
+  pci_bar_t *bar = virtio_pci_get_bar(vdev, cap->bar);
+  if (!bar) {
+    EPRINTF("missing BAR%u for capability\n", cap->bar);
+    return NULL;
+  }
+  if (bar->kind != 0) {
+    EPRINTF("BAR%u is not memory mapped\n", cap->bar);
+    return NULL;
+  }
+
+  if (bar->virt_addr == 0) {
+    size_t map_size = align(bar->size, PAGE_SIZE);
+    uintptr_t mapped = vmap_phys(bar->phys_addr, 0, map_size, VM_RDWR | VM_NOCACHE, vdev->name);
+    if (mapped == 0) {
+      EPRINTF("failed to map BAR%u\n", cap->bar);
+      return NULL;
+    }
+    bar->virt_addr = mapped;
+  }
+
+  if ((uint64_t) cap->offset + cap->length > bar->size) {
+    EPRINTF("capability region outside BAR%u\n", cap->bar);
+    return NULL;
+  }
+
+  return (void *)(uintptr_t)(bar->virt_addr + cap->offset);
+}
+
+// enumerate virtio pci capabilities and map required regions
+static int virtio_pci_discover_caps(virtio_pci_t *vdev) {
+  pci_device_t *pci_dev = vdev->pci_dev;
+  bool have_common = false;
+  bool have_notify = false;
+  bool have_isr = false;
+  bool have_device = false;
+
+  vdev->notify_off_multiplier = 1;
+
+  DPRINTF("discovering capabilities for %02x:%02x.%x\n",
+          pci_dev->bus, pci_dev->device, pci_dev->function);
+
+  for (pci_cap_t *cap = pci_dev->caps; cap; cap = cap->next) {
+    if (cap->id != 0x09) {
+      continue;
+    }
+
+    const virtio_pci_cap_t *cfg = (const virtio_pci_cap_t *) cap->offset;
+    DPRINTF("  cap type=%u bar=%u offset=0x%x length=0x%x\n",
+            cfg->cfg_type, cfg->bar, cfg->offset, cfg->length);
+    switch (cfg->cfg_type) {
+      case VIRTIO_PCI_CAP_COMMON_CFG: {
+        void *ptr = virtio_pci_map_cap(vdev, cfg);
+        if (!ptr) {
+          return -ENODEV;
+        }
+        vdev->common_cfg = ptr;
+        have_common = true;
+        break;
+      }
+      case VIRTIO_PCI_CAP_NOTIFY_CFG: {
+        const virtio_pci_notify_cap_t *notify_cap = (const virtio_pci_notify_cap_t *) cfg;
+        void *ptr = virtio_pci_map_cap(vdev, cfg);
+        if (!ptr) {
+          return -ENODEV;
+        }
+        vdev->notify_base = ptr;
+        vdev->notify_off_multiplier = notify_cap->notify_off_multiplier ? notify_cap->notify_off_multiplier : 1;
+        have_notify = true;
+        break;
+      }
+      case VIRTIO_PCI_CAP_ISR_CFG: {
+        void *ptr = virtio_pci_map_cap(vdev, cfg);
+        if (!ptr) {
+          return -ENODEV;
+        }
+        vdev->isr_status = ptr;
+        have_isr = true;
+        break;
+      }
+      case VIRTIO_PCI_CAP_DEVICE_CFG: {
+        void *ptr = virtio_pci_map_cap(vdev, cfg);
+        if (!ptr) {
+          return -ENODEV;
+        }
+        vdev->device_cfg = ptr;
+        have_device = true;
+        break;
+      }
+      default:
+        break;
+    }
+  }
+
+  if (!have_common || !have_notify || !have_isr || !have_device) {
+    EPRINTF("missing required virtio capabilities (common=%d notify=%d isr=%d device=%d)\n",
+            have_common, have_notify, have_isr, have_device);
+    return -ENODEV;
+  }
+
+  DPRINTF("mapped required capabilities (notify mult=%u)\n", vdev->notify_off_multiplier);
+  return 0;
+}
+
+// enable the pci function and map the virtio configuration structures
+int virtio_pci_init(virtio_pci_t *vdev, pci_device_t *pci_dev, const char *name) {
+  vdev->pci_dev = pci_dev;
+  vdev->name = name;
+  vdev->notify_off_multiplier = 1;
+
+  struct pci_segment_group *seg = get_segment_group_for_bus_number(pci_dev->bus);
+  if (seg) {
+    struct pci_header *header = pci_device_address(seg, pci_dev->bus, pci_dev->device, pci_dev->function);
+    header->command.mem_space = 1;
+    header->command.bus_master = 1;
+    header->command.int_disable = 0;
+    DPRINTF("enabled bus mastering and interrupts\n");
+  }
+
+  return virtio_pci_discover_caps(vdev);
+}
+
+void virtio_pci_reset(virtio_pci_t *vdev) {
+  if (!vdev->common_cfg) {
+    return;
+  }
+  vdev->common_cfg->device_status = 0;
+  barrier();
+}
+
+// negotiate the requested feature bits with the device
+int virtio_pci_negotiate(virtio_pci_t *vdev, uint64_t features) {
+  if (!vdev->common_cfg) {
+    return -ENODEV;
+  }
+
+  vdev->common_cfg->device_feature_select = 0;
+  uint64_t device_features = vdev->common_cfg->device_feature;
+  vdev->common_cfg->device_feature_select = 1;
+  device_features |= ((uint64_t) vdev->common_cfg->device_feature) << 32;
+  vdev->device_features = device_features;
+
+  if (!(device_features & (1ULL << VIRTIO_F_VERSION_1))) {
+    EPRINTF("device does not support VirtIO 1.0\n");
+    return -ENOTSUP;
+  }
+
+  uint64_t driver_features = (1ULL << VIRTIO_F_VERSION_1) | (features & device_features);
+  vdev->common_cfg->driver_feature_select = 0;
+  vdev->common_cfg->driver_feature = (uint32_t) driver_features;
+  vdev->common_cfg->driver_feature_select = 1;
+  vdev->common_cfg->driver_feature = (uint32_t) (driver_features >> 32);
+
+  vdev->common_cfg->device_status |= VIRTIO_STATUS_FEATURES_OK;
+  if (!(vdev->common_cfg->device_status & VIRTIO_STATUS_FEATURES_OK)) {
+    EPRINTF("device rejected negotiated features\n");
+    return -EIO;
+  }
+
+  vdev->driver_features = driver_features;
+  DPRINTF("device features=0x%llx driver features=0x%llx\n",
+          (unsigned long long) device_features, (unsigned long long) driver_features);
+  return 0;
+}
+
+uint16_t virtio_pci_num_queues(virtio_pci_t *vdev) {
+  if (!vdev->common_cfg) {
+    return 0;
+  }
+  return vdev->common_cfg->num_queues;
+}
+
+//
+// MARK: Virtqueues
+//
+
+// configure a single virtqueue and map its rings
+int virtio_setup_queue(virtio_pci_t *vdev, virtio_queue_t *vq, uint16_t index,
+                       uint16_t requested_size, bool use_free_list, const char *name) {
+  if (!vdev->common_cfg || !vdev->notify_base) {
+    return -ENODEV;
+  }
+
+  memset(vq, 0, sizeof(*vq));
+  vq->index = index;
+  vq->use_free_list = use_free_list;
+
+  vdev->common_cfg->queue_select = index;
+  uint16_t max_size = vdev->common_cfg->queue_size;
+  if (max_size == 0) {
+    EPRINTF("queue %u not available\n", index);
+    return -ENODEV;
+  }
+
+  uint16_t actual_size = requested_size ? min(requested_size, max_size) : max_size;
+  if (!is_pow2(actual_size)) {
+    actual_size = virtio_round_down_pow2(actual_size);
+  }
+  if (actual_size < VIRTIO_MIN_QUEUE_SIZE) {
+    actual_size = VIRTIO_MIN_QUEUE_SIZE;
+  }
+  if (actual_size > max_size) {
+    actual_size = max_size;
+  }
+  vq->size = actual_size;
+
+  vq->desc_state = kmallocz(sizeof(virtio_desc_state_t) * vq->size);
+  if (!vq->desc_state) {
+    return -ENOMEM;
+  }
+
+  if (use_free_list) {
+    vq->free_list = kmalloc(sizeof(uint16_t) * vq->size);
+    if (!vq->free_list) {
+      kfree(vq->desc_state);
+      vq->desc_state = NULL;
+      return -ENOMEM;
+    }
+    for (uint16_t i = 0; i < vq->size; i++) {
+      vq->free_list[i] = vq->size - 1 - i;
+    }
+    vq->num_free = vq->size;
+  }
+
+  char region_name[32];
+  ksnprintf(region_name, sizeof(region_name), "%s-desc", name);
+  int ret = virtio_alloc_region(&vq->desc_region, sizeof(virtq_desc_t) * vq->size, region_name);
+  if (ret < 0) {
+    virtio_free_queue(vq);
+    return ret;
+  }
+
+  ksnprintf(region_name, sizeof(region_name), "%s-avail", name);
+  ret = virtio_alloc_region(&vq->avail_region,
+                            sizeof(virtq_avail_t) + (sizeof(uint16_t) * vq->size + sizeof(uint16_t)),
+                            region_name);
+  if (ret < 0) {
+    virtio_free_queue(vq);
+    return ret;
+  }
+
+  ksnprintf(region_name, sizeof(region_name), "%s-used", name);
+  ret = virtio_alloc_region(&vq->used_region,
+                            sizeof(virtq_used_t) + (sizeof(virtq_used_elem_t) * vq->size + sizeof(uint16_t)),
+                            region_name);
+  if (ret < 0) {
+    virtio_free_queue(vq);
+    return ret;
+  }
+
+  vq->desc = (virtq_desc_t *) vq->desc_region.vaddr;
+  vq->avail = (virtq_avail_t *) vq->avail_region.vaddr;
+  vq->used = (virtq_used_t *) vq->used_region.vaddr;
+  vq->last_used_idx = 0;
+
+  vdev->common_cfg->queue_select = index;
+  vdev->common_cfg->queue_size = vq->size;
+  vdev->common_cfg->queue_desc = vq->desc_region.paddr;
+  vdev->common_cfg->queue_driver = vq->avail_region.paddr;
+  vdev->common_cfg->queue_device = vq->used_region.paddr;
+  vdev->common_cfg->queue_msix_vector = 0xFFFF;
+
+  uint16_t notify_off = vdev->common_cfg->queue_notify_off;
+  size_t notify_offset = (size_t) notify_off * vdev->notify_off_multiplier;
+  vq->notify = (volatile uint16_t *)(vdev->notify_base + notify_offset);
+
+  vdev->common_cfg->queue_enable = 1;
+  DPRINTF("queue %u configured size=%u desc=0x%llx avail=0x%llx used=0x%llx notify_off=%u\n",
+          index, vq->size, (unsigned long long) vq->desc_region.paddr,
+          (unsigned long long) vq->avail_region.paddr, (unsigned long long) vq->used_region.paddr,
+          notify_off);
+  return 0;
+}
+
+void virtio_free_queue(virtio_queue_t *vq) {
+  uint16_t index = vq->index;
+
+  virtio_free_region(&vq->desc_region);
+  virtio_free_region(&vq->avail_region);
+  virtio_free_region(&vq->used_region);
+
+  if (vq->free_list) {
+    kfree(vq->free_list);
+  }
+  if (vq->desc_state) {
+    kfree(vq->desc_state);
+  }
+
+  memset(vq, 0, sizeof(*vq));
+  DPRINTF("queue %u released\n", index);
+}
+
+// ring the doorbell for the given queue
+void virtqueue_notify(virtio_queue_t *vq) {
+  if (vq->notify) {
+    *vq->notify = vq->index;
+  }
+}
+
+int virtqueue_alloc_desc(virtio_queue_t *vq, uint16_t *idx) {
+  if (!vq->use_free_list || !vq->free_list || vq->num_free == 0) {
+    return -ENOSPC;
+  }
+  vq->num_free--;
+  *idx = vq->free_list[vq->num_free];
+  return 0;
+}
+
+void virtqueue_free_desc(virtio_queue_t *vq, uint16_t idx) {
+  if (!vq->use_free_list || !vq->free_list) {
+    return;
+  }
+  ASSERT(vq->num_free < vq->size);
+  vq->free_list[vq->num_free++] = idx;
+}
+
+void virtqueue_free_chain(virtio_queue_t *vq, uint16_t head) {
+  uint16_t idx = head;
+  while (true) {
+    virtq_desc_t *desc = &vq->desc[idx];
+    uint16_t next = desc->next;
+    uint16_t flags = desc->flags;
+    memset(desc, 0, sizeof(*desc));
+    virtqueue_free_desc(vq, idx);
+    if (!(flags & VIRTQ_DESC_F_NEXT)) {
+      break;
+    }
+    idx = next;
+  }
+}
+
+void virtqueue_submit(virtio_queue_t *vq, uint16_t head) {
+  uint16_t avail_idx = vq->avail->idx % vq->size;
+  vq->avail->ring[avail_idx] = head;
+  barrier();
+  vq->avail->idx++;
+}
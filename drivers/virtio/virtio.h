@@ -0,0 +1,173 @@
+//
+// Created by Aaron Gill-Braun on 2026-10-18.
+//
+
+#ifndef DRIVERS_VIRTIO_VIRTIO_H
+#define DRIVERS_VIRTIO_VIRTIO_H
+
+#include <kernel/base.h>
+
+struct pci_device;
+
+#define VIRTIO_VENDOR_ID               0x1AF4
+#define VIRTIO_MIN_QUEUE_SIZE          2
+
+enum {
+  VIRTIO_PCI_CAP_COMMON_CFG = 1,
+  VIRTIO_PCI_CAP_NOTIFY_CFG = 2,
+  VIRTIO_PCI_CAP_ISR_CFG    = 3,
+  VIRTIO_PCI_CAP_DEVICE_CFG = 4,
+  VIRTIO_PCI_CAP_PCI_CFG    = 5,
+};
+
+// generic pci capability descriptor
+typedef struct virtio_pci_cap {
+  uint8_t  cap_vndr;     // pci capability id (0x09 for virtio)
+  uint8_t  cap_next;     // offset to next capability
+  uint8_t  cap_len;      // total size of this capability
+  uint8_t  cfg_type;     // virtio capability type selector
+  uint8_t  bar;          // bar index hosting the structure
+  uint8_t  padding[3];   // reserved padding
+  uint32_t offset;       // byte offset within the bar
+  uint32_t length;       // size of the capability payload
+} virtio_pci_cap_t;
+
+typedef struct virtio_pci_notify_cap {
+  virtio_pci_cap_t cap;      // embedded capability header
+  uint32_t notify_off_multiplier; // multiplier applied to notify offsets
+} packed virtio_pci_notify_cap_t;
+
+typedef struct virtio_pci_common_cfg {
+  uint32_t device_feature_select; // selects device feature word
+  uint32_t device_feature;        // device feature bits for selected word
+  uint32_t driver_feature_select; // selects driver feature word
+  uint32_t driver_feature;        // driver feature bits for selected word
+  uint16_t msix_config;           // shared msix vector for config changes
+  uint16_t num_queues;            // total queues exposed by device
+  uint8_t  device_status;         // device status register
+  uint8_t  config_generation;     // config generation counter
+
+  uint16_t queue_select;          // queue selector/register index
+  uint16_t queue_size;            // queue depth reported or programmed
+  uint16_t queue_msix_vector;     // per-queue msix vector
+  uint16_t queue_enable;          // enables the currently selected queue
+  uint16_t queue_notify_off;      // notify offset for selected queue
+  uint64_t queue_desc;            // physical address of descriptor table
+  uint64_t queue_driver;          // physical address of driver area (avail)
+  uint64_t queue_device;          // physical address of device area (used)
+} packed virtio_pci_common_cfg_t;
+
+#define VIRTIO_STATUS_ACKNOWLEDGE      0x01
+#define VIRTIO_STATUS_DRIVER           0x02
+#define VIRTIO_STATUS_DRIVER_OK        0x04
+#define VIRTIO_STATUS_FEATURES_OK      0x08
+#define VIRTIO_STATUS_DEVICE_NEEDS_RESET 0x40
+#define VIRTIO_STATUS_FAILED           0x80
+
+#define VIRTIO_F_RING_INDIRECT_DESC    28
+#define VIRTIO_F_RING_EVENT_IDX        29
+#define VIRTIO_F_VERSION_1             32
+#define VIRTIO_F_ACCESS_PLATFORM       33
+#define VIRTIO_F_RING_PACKED           34
+
+#define VIRTQ_DESC_F_NEXT              0x0001
+#define VIRTQ_DESC_F_WRITE             0x0002
+#define VIRTQ_DESC_F_INDIRECT          0x0004
+
+typedef struct virtq_desc {
+  uint64_t addr;   // guest physical buffer address
+  uint32_t len;    // buffer length in bytes
+  uint16_t flags;  // descriptor flags
+  uint16_t next;   // next descriptor in chain when flag is set
+} packed virtq_desc_t;
+
+typedef struct virtq_avail {
+  uint16_t flags;  // driver to device flags
+  uint16_t idx;    // available ring producer index
+  uint16_t ring[]; // descriptor indices ready for device
+} packed virtq_avail_t;
+
+typedef struct virtq_used_elem {
+  uint32_t id;   // head descriptor id completed by device
+  uint32_t len;  // total bytes written or read by device
+} packed virtq_used_elem_t;
+
+typedef struct virtq_used {
+  uint16_t flags;           // device to driver flags
+  uint16_t idx;             // used ring producer index
+  virtq_used_elem_t ring[]; // completion records from device
+} packed virtq_used_t;
+
+// tracks a contiguous memory mapping shared with the device
+typedef struct virtio_mem_region {
+  uintptr_t vaddr;
+  uint64_t paddr;
+  size_t size;
+} virtio_mem_region_t;
+
+typedef struct virtio_desc_state {
+  void *cookie;
+  uint16_t chain_len;
+  bool in_use;
+} virtio_desc_state_t;
+
+// per-queue tracking for descriptor tables and notify region
+typedef struct virtio_queue {
+  uint16_t index;
+  uint16_t size;
+  bool use_free_list;
+
+  virtq_desc_t *desc;
+  virtq_avail_t *avail;
+  virtq_used_t *used;
+
+  virtio_mem_region_t desc_region;
+  virtio_mem_region_t avail_region;
+  virtio_mem_region_t used_region;
+
+  virtio_desc_state_t *desc_state;
+  uint16_t *free_list;
+  uint16_t num_free;
+  uint16_t last_used_idx;
+
+  volatile uint16_t *notify;
+} virtio_queue_t;
+
+// modern virtio pci transport shared by the virtio device drivers
+typedef struct virtio_pci {
+  struct pci_device *pci_dev;                   // backing pci device
+  const char *name;                             // name used for mappings
+
+  volatile virtio_pci_common_cfg_t *common_cfg; // mapped common config
+  volatile uint8_t *isr_status;                 // isr status byte
+  volatile uint8_t *notify_base;                // notify base pointer
+  volatile void *device_cfg;                    // device specific config
+
+  uint32_t notify_off_multiplier;               // notify multiplier from capability
+  uint64_t device_features;                     // raw device features
+  uint64_t driver_features;                     // negotiated feature mask
+} virtio_pci_t;
+
+static inline bool virtio_has_feature(virtio_pci_t *vdev, int bit) {
+  return (vdev->driver_features & (1ULL << bit)) != 0;
+}
+
+int virtio_alloc_region(virtio_mem_region_t *region, size_t size, const char *name);
+void virtio_free_region(virtio_mem_region_t *region);
+
+int virtio_pci_init(virtio_pci_t *vdev, struct pci_device *pci_dev, const char *name);
+void virtio_pci_reset(virtio_pci_t *vdev);
+int virtio_pci_negotiate(virtio_pci_t *vdev, uint64_t features);
+uint16_t virtio_pci_num_queues(virtio_pci_t *vdev);
+
+int virtio_setup_queue(virtio_pci_t *vdev, virtio_queue_t *vq, uint16_t index,
+                       uint16_t requested_size, bool use_free_list, const char *name);
+void virtio_free_queue(virtio_queue_t *vq);
+
+void virtqueue_notify(virtio_queue_t *vq);
+int virtqueue_alloc_desc(virtio_queue_t *vq, uint16_t *idx);
+void virtqueue_free_desc(virtio_queue_t *vq, uint16_t idx);
+void virtqueue_free_chain(virtio_queue_t *vq, uint16_t head);
+void virtqueue_submit(virtio_queue_t *vq, uint16_t head);
+
+#endif // DRIVERS_VIRTIO_VIRTIO_H
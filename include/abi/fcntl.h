@@ -31,6 +31,14 @@ struct flock {
 #define F_OFD_SETLKW 38
 
 #define F_DUPFD_CLOEXEC 1030
+#define F_ADD_SEALS 1033
+#define F_GET_SEALS 1034
+
+#define F_SEAL_SEAL         0x0001
+#define F_SEAL_SHRINK       0x0002
+#define F_SEAL_GROW         0x0004
+#define F_SEAL_WRITE        0x0008
+#define F_SEAL_FUTURE_WRITE 0x0010
 
 #define F_RDLCK 0
 #define F_WRLCK 1
@@ -53,6 +61,11 @@ struct flock {
 #define POSIX_FADV_NOREUSE    5
 #endif
 
+#define SPLICE_F_MOVE     1
+#define SPLICE_F_NONBLOCK 2
+#define SPLICE_F_MORE     4
+#define SPLICE_F_GIFT     8
+
 #define SEEK_SET 0
 #define SEEK_CUR 1
 #define SEEK_END 2
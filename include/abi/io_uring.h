@@ -0,0 +1,164 @@
+//
+// Created by Aaron Gill-Braun on 2026-10-18.
+//
+
+#ifndef INCLUDE_ABI_IO_URING_H
+#define INCLUDE_ABI_IO_URING_H
+
+#include <stdint.h>
+
+// layout and values match the linux io_uring abi
+
+struct io_uring_sqe {
+  uint8_t opcode;           // type of operation
+  uint8_t flags;            // IOSQE_ flags
+  uint16_t ioprio;          // request priority
+  int32_t fd;               // file descriptor to do io on
+  union {
+    uint64_t off;           // offset into file
+    uint64_t addr2;
+  };
+  uint64_t addr;            // pointer to buffer or iovecs
+  uint32_t len;             // buffer size or number of iovecs
+  union {
+    uint32_t rw_flags;
+    uint16_t poll_events;
+    uint32_t poll32_events;
+    uint32_t msg_flags;
+    uint32_t timeout_flags;
+    uint32_t accept_flags;
+  };
+  uint64_t user_data;       // passed back in the completion
+  uint16_t buf_index;
+  uint16_t personality;
+  int32_t splice_fd_in;
+  uint64_t __pad2[2];
+};
+_Static_assert(sizeof(struct io_uring_sqe) == 64, "io_uring_sqe size");
+
+struct io_uring_cqe {
+  uint64_t user_data;       // sqe user_data
+  int32_t res;              // result code
+  uint32_t flags;
+};
+
+#define IOSQE_FIXED_FILE    (1U << 0)
+#define IOSQE_IO_DRAIN      (1U << 1)
+#define IOSQE_IO_LINK       (1U << 2)
+#define IOSQE_IO_HARDLINK   (1U << 3)
+#define IOSQE_ASYNC         (1U << 4)
+
+#define IORING_SETUP_IOPOLL (1U << 0)
+#define IORING_SETUP_SQPOLL (1U << 1)
+#define IORING_SETUP_SQ_AFF (1U << 2)
+#define IORING_SETUP_CQSIZE (1U << 3)
+#define IORING_SETUP_CLAMP  (1U << 4)
+
+enum {
+  IORING_OP_NOP,
+  IORING_OP_READV,
+  IORING_OP_WRITEV,
+  IORING_OP_FSYNC,
+  IORING_OP_READ_FIXED,
+  IORING_OP_WRITE_FIXED,
+  IORING_OP_POLL_ADD,
+  IORING_OP_POLL_REMOVE,
+  IORING_OP_SYNC_FILE_RANGE,
+  IORING_OP_SENDMSG,
+  IORING_OP_RECVMSG,
+  IORING_OP_TIMEOUT,
+  IORING_OP_TIMEOUT_REMOVE,
+  IORING_OP_ACCEPT,
+  IORING_OP_ASYNC_CANCEL,
+  IORING_OP_LINK_TIMEOUT,
+  IORING_OP_CONNECT,
+  IORING_OP_FALLOCATE,
+  IORING_OP_OPENAT,
+  IORING_OP_CLOSE,
+  IORING_OP_FILES_UPDATE,
+  IORING_OP_STATX,
+  IORING_OP_READ,
+  IORING_OP_WRITE,
+  IORING_OP_FADVISE,
+  IORING_OP_MADVISE,
+  IORING_OP_SEND,
+  IORING_OP_RECV,
+
+  IORING_OP_LAST,
+};
+
+#define IORING_TIMEOUT_ABS  (1U << 0)
+
+// mmap offsets
+#define IORING_OFF_SQ_RING  0ULL
+#define IORING_OFF_CQ_RING  0x8000000ULL
+#define IORING_OFF_SQES     0x10000000ULL
+
+struct io_sqring_offsets {
+  uint32_t head;
+  uint32_t tail;
+  uint32_t ring_mask;
+  uint32_t ring_entries;
+  uint32_t flags;
+  uint32_t dropped;
+  uint32_t array;
+  uint32_t resv1;
+  uint64_t resv2;
+};
+
+#define IORING_SQ_NEED_WAKEUP (1U << 0)
+
+struct io_cqring_offsets {
+  uint32_t head;
+  uint32_t tail;
+  uint32_t ring_mask;
+  uint32_t ring_entries;
+  uint32_t overflow;
+  uint32_t cqes;
+  uint32_t flags;
+  uint32_t resv1;
+  uint64_t resv2;
+};
+
+#define IORING_ENTER_GETEVENTS  (1U << 0)
+#define IORING_ENTER_SQ_WAKEUP  (1U << 1)
+#define IORING_ENTER_SQ_WAIT    (1U << 2)
+
+struct io_uring_params {
+  uint32_t sq_entries;
+  uint32_t cq_entries;
+  uint32_t flags;
+  uint32_t sq_thread_cpu;
+  uint32_t sq_thread_idle;
+  uint32_t features;
+  uint32_t wq_fd;
+  uint32_t resv[3];
+  struct io_sqring_offsets sq_off;
+  struct io_cqring_offsets cq_off;
+};
+
+#define IORING_FEAT_SINGLE_MMAP   (1U << 0)
+#define IORING_FEAT_NODROP        (1U << 1)
+#define IORING_FEAT_SUBMIT_STABLE (1U << 2)
+#define IORING_FEAT_RW_CUR_POS    (1U << 3)
+
+#define IORING_REGISTER_PROBE 8
+
+struct io_uring_probe_op {
+  uint8_t op;
+  uint8_t resv;
+  uint16_t flags;           // IO_URING_OP_ flags
+  uint32_t resv2;
+};
+
+#define IO_URING_OP_SUPPORTED (1U << 0)
+
+struct io_uring_probe {
+  uint8_t last_op;          // last opcode supported
+  uint8_t ops_len;          // length of ops[]
+  uint16_t resv;
+  uint32_t resv2[3];
+  struct io_uring_probe_op ops[];
+};
+
+#endif
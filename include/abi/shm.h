@@ -0,0 +1,70 @@
+//
+// Created by Aaron Gill-Braun on 2026-10-18.
+//
+
+#ifndef INCLUDE_ABI_SHM_H
+#define INCLUDE_ABI_SHM_H
+
+#define __NEED_key_t
+#define __NEED_uid_t
+#define __NEED_gid_t
+#define __NEED_mode_t
+#define __NEED_pid_t
+#define __NEED_time_t
+#define __NEED_size_t
+#include <bits/alltypes.h>
+
+// layout and values match the linux x86_64 sysv ipc abi
+
+#define IPC_PRIVATE ((key_t) 0)
+
+#define IPC_CREAT  01000
+#define IPC_EXCL   02000
+#define IPC_NOWAIT 04000
+
+#define IPC_RMID 0
+#define IPC_SET  1
+#define IPC_STAT 2
+#define IPC_INFO 3
+#define IPC_64   0x100
+
+#define SHM_RDONLY 010000
+#define SHM_RND    020000
+#define SHM_REMAP  040000
+#define SHM_EXEC   0100000
+
+#define SHM_LOCK   11
+#define SHM_UNLOCK 12
+#define SHM_STAT   13
+#define SHM_INFO   14
+
+#define SHM_DEST   01000 // segment is marked for removal (shm_perm.mode)
+
+#define SHMLBA 4096
+
+struct ipc_perm {
+  key_t __ipc_perm_key;
+  uid_t uid;
+  gid_t gid;
+  uid_t cuid;
+  gid_t cgid;
+  mode_t mode;
+  int __ipc_perm_seq;
+  long __pad1;
+  long __pad2;
+};
+
+struct shmid_ds {
+  struct ipc_perm shm_perm;
+  size_t shm_segsz;
+  time_t shm_atime;
+  time_t shm_dtime;
+  time_t shm_ctime;
+  pid_t shm_cpid;
+  pid_t shm_lpid;
+  unsigned long shm_nattch;
+  unsigned long __pad1;
+  unsigned long __pad2;
+};
+
+#endif
@@ -0,0 +1,177 @@
+//
+// Created by Aaron Gill-Braun on 2026-10-18.
+//
+
+#ifndef KERNEL_BLKDEV_H
+#define KERNEL_BLKDEV_H
+
+#include <kernel/base.h>
+#include <kernel/queue.h>
+#include <kernel/mutex.h>
+#include <kernel/ref.h>
+#include <kernel/str.h>
+
+struct device;
+struct page;
+struct file_ra;
+struct kio;
+struct blkdev;
+struct blk_hw_queue;
+struct blk_cache;
+
+#define SECTOR_SHIFT    9
+#define SECTOR_SIZE     (1 << SECTOR_SHIFT)
+
+#define BIO_MAX_VECS    32
+
+// bio operations
+#define BIO_READ        0
+#define BIO_WRITE       1
+#define BIO_FLUSH       2
+
+/// A physically contiguous piece of a bio buffer.
+struct bio_vec {
+  struct page *page;  // page ref (if added with bio_add_page)
+  void *base;         // kernel virtual address
+  uint64_t phys;      // physical address
+  uint32_t len;       // length in bytes
+};
+
+/**
+ * A block i/o operation.
+ *
+ * A bio describes a single read or write of a sector range on a block device.
+ * Bios are submitted with `blk_submit_bio` and complete asynchronously; the
+ * `end_io` callback is invoked with the final status once the transfer is done,
+ * possibly from interrupt context.
+ */
+typedef struct bio {
+  uint8_t op;                   // bio operation
+  uint8_t vcnt;                 // number of vecs in use
+  int status;                   // completion status (0 or -errno)
+  uint64_t sector;              // starting sector
+  uint32_t size;                // total size in bytes
+  struct blkdev *bdev;          // target device
+  void (*end_io)(struct bio *bio);
+  void *private;                // end_io data
+  struct bio *next;             // next bio in the request
+  struct bio_vec vecs[BIO_MAX_VECS];
+} bio_t;
+
+/**
+ * A block device request.
+ *
+ * Requests are made up of one or more bios for adjacent sector ranges that
+ * are issued to the device as a single transfer.
+ */
+typedef struct request {
+  uint8_t op;                   // request operation
+  int status;                   // completion status
+  uint64_t sector;              // starting sector
+  uint32_t nr_bytes;            // total size in bytes
+  uint16_t nr_segs;             // total number of bio vecs
+  struct blkdev *bdev;          // target device
+  struct blk_hw_queue *hctx;    // hardware queue (once dispatched)
+  bio_t *bio;                   // first bio
+  bio_t *biotail;               // last bio
+  void *driver_data;            // private data for the driver
+  LIST_ENTRY(struct request) list;
+} request_t;
+
+/**
+ * A block plug.
+ *
+ * While a plug is active on the current thread, submitted bios are held back
+ * and merged with each other. They are sent to the device when the plug is
+ * finished, when it fills up, or before the thread waits on i/o.
+ */
+struct blk_plug {
+  LIST_HEAD(struct request) requests;
+  size_t count;
+};
+
+struct blk_queue_ops {
+  /**
+   * Issues a request to a hardware queue.
+   *
+   * Called with the hardware queue lock held. The driver must call
+   * `blk_complete_request` once the request is done.
+   *
+   * @return 0 if the request was accepted, -EBUSY if the hardware queue is
+   *         full and the request should be retried after a completion, or
+   *         any other error to fail the request.
+   */
+  int (*queue_rq)(struct blk_hw_queue *hctx, request_t *rq);
+
+  /// Notifies the hardware after a batch of requests was queued (optional).
+  void (*commit_rqs)(struct blk_hw_queue *hctx);
+};
+
+/// A hardware submission queue.
+typedef struct blk_hw_queue {
+  struct blkdev *bdev;
+  uint16_t index;
+  bool stopped;                 // hardware is full, wait for a completion
+  mtx_t lock;
+  LIST_HEAD(struct request) dispatch; // requests not yet given to the hardware
+  void *driver_data;
+
+  uint64_t dispatched;
+  uint64_t completed;
+} blk_hw_queue_t;
+
+struct blk_queue_limits {
+  uint32_t max_sectors;         // max sectors per request
+  uint16_t max_segments;        // max bio vecs per request
+};
+
+/// A block device and its request queue.
+typedef struct blkdev {
+  str_t name;
+  struct device *device;        // registered device
+  uint64_t nr_sectors;          // capacity in sectors
+  bool readonly;
+  struct blk_queue_limits limits;
+  struct blk_queue_ops *ops;
+  void *data;                   // private data for the driver
+
+  uint16_t nr_hw_queues;
+  blk_hw_queue_t *hw_queues;
+
+  uint64_t merges;              // bios merged into existing requests
+  struct blk_cache *cache;      // page cache
+} blkdev_t;
+
+// bios
+bio_t *bio_alloc(blkdev_t *bdev, int op, uint64_t sector);
+void bio_free(bio_t *bio);
+size_t bio_add_buf(bio_t *bio, void *buf, size_t len);
+bool bio_add_page(bio_t *bio, __move struct page *page, uint32_t len);
+void bio_endio(bio_t *bio, int status);
+
+// block devices
+blkdev_t *blkdev_alloc(const char *name, struct blk_queue_ops *ops, uint16_t nr_hw_queues, void *data);
+void blkdev_free(blkdev_t *bdev);
+int blkdev_register(blkdev_t *bdev, const char *dev_type);
+
+// i/o submission
+void blk_submit_bio(bio_t *bio);
+int blk_submit_bio_wait(bio_t *bio);
+void blk_start_plug(struct blk_plug *plug);
+void blk_finish_plug(struct blk_plug *plug);
+void blk_flush_plug(struct blk_plug *plug);
+
+// driver interface
+void blk_complete_request(request_t *rq, int status);
+void blk_run_hw_queue(blk_hw_queue_t *hctx);
+
+ssize_t blkdev_read(blkdev_t *bdev, uint64_t off, void *buf, size_t len);
+ssize_t blkdev_write(blkdev_t *bdev, uint64_t off, const void *buf, size_t len);
+
+// page cache
+void blk_cache_init(blkdev_t *bdev);
+void blk_cache_destroy(blkdev_t *bdev);
+ssize_t blk_cache_read(blkdev_t *bdev, struct file_ra *ra, uint64_t off, size_t nmax, struct kio *kio);
+void blk_cache_invalidate(blkdev_t *bdev, uint64_t off, size_t len);
+
+#endif
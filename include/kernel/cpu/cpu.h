@@ -175,6 +175,7 @@ typedef struct cpu_irq_stack {
 })
 
 extern uint8_t cpu_bsp_id;
+extern uint64_t cpu_tsc_khz; // calibrated tsc frequency
 
 void cpu_early_init();
 void cpu_late_init();
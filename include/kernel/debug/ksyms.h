@@ -0,0 +1,34 @@
+//
+// Created by Aaron Gill-Braun on 2026-10-18.
+//
+
+#ifndef KERNEL_DEBUG_KSYMS_H
+#define KERNEL_DEBUG_KSYMS_H
+
+#include <kernel/base.h>
+
+/*
+ * Kernel symbol table
+ *
+ * A compact table of kernel function symbols sorted by address. It is generated
+ * at build time by scripts/gen_syms.py (--kallsyms) from a first link of the
+ * kernel and linked into the final image. Lookups are a binary search and do not
+ * allocate or take locks, so unlike the dwarf based functions in debug.h they
+ * can be used from interrupt context.
+ *
+ * Kernels linked without the table (the first link) have no symbols and every
+ * lookup fails.
+ */
+
+struct ksym {
+  uint32_t offset;  // offset of the symbol from __kernel_code_start
+  uint32_t name;    // offset of the name in __ksym_names
+};
+
+/// Returns the name of the function containing addr, or NULL if the address
+/// is not in the table. If out_off is non-null the offset of addr from the
+/// start of the symbol is written to it.
+const char *ksym_lookup(uintptr_t addr, __out size_t *out_off);
+size_t ksym_count();
+
+#endif
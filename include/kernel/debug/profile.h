@@ -0,0 +1,50 @@
+//
+// Created by Aaron Gill-Braun on 2026-10-18.
+//
+
+#ifndef KERNEL_DEBUG_PROFILE_H
+#define KERNEL_DEBUG_PROFILE_H
+
+#include <kernel/base.h>
+#include <kernel/cpu/cpu.h>
+
+/*
+ * Sampling profiler.
+ *
+ * Each cpu programs its local apic timer to interrupt at the profiling rate and
+ * the interrupt handler records the interrupted kernel stack and the user stack
+ * of the current thread into a per-cpu buffer. Stacks are walked using frame
+ * pointers and the handler takes no locks. When a buffer is full further samples
+ * on that cpu are dropped until the profile is cleared.
+ *
+ * Profiling is started by writing a rate in Hz to /proc/profile (or with the
+ * `profile` kernel parameter), and stopped by writing "stop". Reading the file
+ * returns the samples in folded stack format with kernel frames resolved using
+ * the builtin symbol table (see ksyms.h). User frames are left as addresses
+ * which can be resolved with scripts/resolve_profile.py.
+ *
+ * Cpus apply changes to the profiling state the next time they go through the
+ * scheduler, so there is no need to interrupt other cpus to start or stop it.
+ */
+
+#define PROFILE_MAX_DEPTH   32          // max frames per stack (kernel + user)
+#define PROFILE_BUF_SIZE    SIZE_2MB    // per-cpu sample buffer size
+#define PROFILE_DEFAULT_HZ  1000
+#define PROFILE_MAX_HZ      10000
+
+extern volatile uint32_t profile_generation;
+extern uint32_t profile_cpu_generation[MAX_CPUS];
+
+void __profile_sync_cpu();
+
+/// Applies any pending change to the profiling state on the current cpu.
+static inline void profile_sync_cpu() {
+  if (__expect_false(profile_cpu_generation[curcpu_id] != profile_generation))
+    __profile_sync_cpu();
+}
+
+int profile_start(uint32_t hz);
+void profile_stop();
+void profile_clear();
+
+#endif
@@ -40,12 +40,16 @@ __ref struct page *fs_getpage(int fd, off_t off);
 __ref struct page *fs_getpage_cow(int fd, off_t off);
 ssize_t fs_kread(int fd, kio_t *kio);
 ssize_t fs_kwrite(int fd, kio_t *kio);
+ssize_t fs_kpread(int fd, kio_t *kio, off_t offset);
+ssize_t fs_kpwrite(int fd, kio_t *kio, off_t offset);
 ssize_t fs_read(int fd, void *buf, size_t len);
 ssize_t fs_write(int fd, const void *buf, size_t len);
 ssize_t fs_readv(int fd, const struct iovec *iov, int iovcnt);
 ssize_t fs_writev(int fd, const struct iovec *iov, int iovcnt);
 ssize_t fs_pread(int fd, void *buf, size_t len, off_t offset);
 ssize_t fs_pwrite(int fd, const void *buf, size_t len, off_t offset);
+ssize_t fs_preadv(int fd, const struct iovec *iov, int iovcnt, off_t offset);
+ssize_t fs_pwritev(int fd, const struct iovec *iov, int iovcnt, off_t offset);
 ssize_t fs_readdir(int fd, void *dirp, size_t len);
 off_t fs_lseek(int fd, off_t offset, int whence);
 int fs_ioctl(int fd, unsigned int request, void *argp);
@@ -56,6 +60,10 @@ int fs_dup(int fd);
 int fs_dup2(int fd, int newfd);
 int fs_pipe(int pipefd[2]);
 int fs_pipe2(int pipefd[2], int flags);
+ssize_t fs_splice(int fd_in, off_t *off_in, int fd_out, off_t *off_out, size_t len, unsigned int flags);
+ssize_t fs_tee(int fd_in, int fd_out, size_t len, unsigned int flags);
+ssize_t fs_vmsplice(int fd, const struct iovec *iov, size_t nr_segs, unsigned int flags);
+ssize_t fs_sendfile(int out_fd, int in_fd, off_t *offset, size_t count);
 int fs_poll(struct pollfd *fds, size_t nfds, struct timespec *timeout);
 int fs_utimensat(int dirfd, cstr_t filename, struct timespec *utimes, int flags);
 
@@ -322,6 +322,8 @@ void apic_init();
 void apic_init_periodic(uint64_t ms);
 void apic_init_oneshot();
 void apic_oneshot(uint64_t ms);
+void apic_timer_start_periodic(uint8_t vector, uint32_t hz);
+void apic_timer_stop();
 void apic_udelay(uint64_t us);
 void apic_mdelay(uint64_t ms);
 void apic_send_eoi();
@@ -0,0 +1,42 @@
+//
+// Created by Aaron Gill-Braun on 2026-10-18.
+//
+
+#ifndef KERNEL_IO_URING_H
+#define KERNEL_IO_URING_H
+
+#include <kernel/base.h>
+#include <kernel/vfs_types.h>
+
+#include <abi/io_uring.h>
+#include <abi/signal.h>
+
+/*
+ * Asynchronous I/O rings.
+ *
+ * An io_uring instance is a pair of rings shared with userspace: the process
+ * fills submission queue entries and advances the sq tail, the kernel posts
+ * completion queue entries and advances the cq tail. Both rings live in pages
+ * that are mapped into the kernel and into the process (through mmap of the
+ * ring fd) so no copies are needed to pass requests and results.
+ *
+ * Submitted requests are first tried without blocking in the submitting
+ * context. Requests that would block are handed to a small per-ring pool of
+ * worker threads that run in the owning process. With IORING_SETUP_SQPOLL a
+ * dedicated kernel thread polls the sq ring so the process can submit
+ * without making any system calls.
+ */
+
+#define IORING_MAX_ENTRIES    4096
+#define IORING_MAX_CQ_ENTRIES (2 * IORING_MAX_ENTRIES)
+#define IORING_MAX_WORKERS    8
+
+struct vm_file;
+
+struct vm_file *io_uring_get_vmfile(file_t *file, size_t off, size_t len);
+
+int io_uring_setup(uint32_t entries, struct io_uring_params *params);
+int io_uring_enter(int fd, uint32_t to_submit, uint32_t min_complete, uint32_t flags, const sigset_t *sig, size_t sigsz);
+int io_uring_register(int fd, uint32_t opcode, void *arg, uint32_t nr_args);
+
+#endif
@@ -2,6 +2,7 @@
 #define KERNEL_LOG_H
 
 #include <kernel/printf.h>
+#include <kernel/trace.h>
 
 // LOG_TAG must be defined before including this header.
 // Example: #define LOG_TAG tcp
@@ -15,8 +16,16 @@
 #include _LOG_TAG_HEADER(LOG_TAG)
 
 #if defined(LOG_ENABLE_ALL) || _LOG_CHECK(LOG_TAG)
-#define DPRINTF(fmt, ...) kprintf(_LOG_XSTR(LOG_TAG) ": " fmt, ##__VA_ARGS__)
-#define DPRINTF_FUNC(fmt, ...) kprintf(_LOG_XSTR(LOG_TAG) ": %s: " fmt, __func__, ##__VA_ARGS__)
+// messages go to the trace ring instead of the console while the tag is traced
+TRACE_LOG_TAG(__log_trace_tag, _LOG_XSTR(LOG_TAG));
+#define _LOG_PRINTF(fmt, ...) ({ \
+  if (__expect_false(__log_trace_tag.enabled)) \
+    TRACE_LOG(fmt, ##__VA_ARGS__); \
+  else \
+    kprintf(fmt, ##__VA_ARGS__); \
+})
+#define DPRINTF(fmt, ...) _LOG_PRINTF(_LOG_XSTR(LOG_TAG) ": " fmt, ##__VA_ARGS__)
+#define DPRINTF_FUNC(fmt, ...) _LOG_PRINTF(_LOG_XSTR(LOG_TAG) ": %s: " fmt, __func__, ##__VA_ARGS__)
 #else
 #define DPRINTF(fmt, ...)
 #define DPRINTF_FUNC(fmt, ...)
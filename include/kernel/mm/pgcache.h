@@ -8,6 +8,7 @@
 #include <kernel/mm_types.h>
 
 #include <kernel/ref.h>
+#include <kernel/mutex.h>
 
 #define PGCACHE_MAX_ORDER   8
 #define PGCACHE_FANOUT      16 // TODO: make fanout adaptive
@@ -41,6 +42,7 @@ struct pgcache {
   uint32_t pg_size;       // size of each page
   size_t max_capacity;    // the maximum cachable memory capacity
   size_t count;           // number of pages in the cache
+  mtx_t lock;             // serializes page lookups/fills through vm_files
   _refcount;              // reference count
 
   struct pgcache_node *root;
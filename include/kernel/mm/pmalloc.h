@@ -101,6 +101,8 @@ typedef struct page_list {
 
 void init_mem_zones();
 void get_pmem_info(size_t *total_bytes, size_t *free_bytes);
+size_t get_pmem_free();
+void get_pmem_watermarks(size_t *low_bytes, size_t *high_bytes);
 int reserve_pages(enum pg_rsrv_kind kind, uintptr_t address, size_t count, size_t pagesize);
 
 // page allocation api
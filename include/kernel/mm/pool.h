@@ -42,6 +42,7 @@ typedef struct pool {
 #define POOL_NOCACHE    0x01  // disable per-cpu caches
 #define POOL_NOSTATS    0x02  // disable statistics tracking
 #define POOL_LAZY       0x04  // lazy slab initialization
+#define POOL_NOZERO     0x08  // do not zero allocated objects
 
 // api
 
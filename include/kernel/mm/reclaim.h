@@ -0,0 +1,17 @@
+//
+// Created by Aaron Gill-Braun on 2026-10-18.
+//
+
+#ifndef KERNEL_MM_RECLAIM_H
+#define KERNEL_MM_RECLAIM_H
+
+#include <kernel/base.h>
+
+struct vnode;
+
+void reclaim_track_vnode(struct vnode *vn);
+void reclaim_untrack_vnode(struct vnode *vn);
+size_t reclaim_pages(size_t target);
+void reclaim_wakeup();
+
+#endif
@@ -12,6 +12,7 @@
 
 struct vnode;
 struct seqfile;
+struct pgcache;
 
 void switch_address_space(address_space_t *new_space) _used;
 
@@ -59,8 +60,12 @@ void *vm_mmap(uintptr_t addr, size_t len, int prot, int flags, int fd, off_t off
 int vmap_free(uintptr_t vaddr, size_t size);
 int vmap_protect(uintptr_t vaddr, size_t len, uint32_t vm_prot);
 int vmap_resize(uintptr_t vaddr, size_t old_size, size_t new_size, bool allow_move, uintptr_t *new_vaddr);
+int vmap_move(uintptr_t vaddr, size_t old_size, size_t new_size, uintptr_t new_vaddr);
+int vmap_advise(uintptr_t vaddr, size_t len, int advice);
+int vmap_get_file(uintptr_t vaddr, __out struct pgcache **out_pgcache, __out size_t *out_size);
 
 __ref page_t *vm_getpage(uintptr_t vaddr);
+__ref page_t *vm_getpage_writable(uintptr_t vaddr);
 int vm_validate_ptr(uintptr_t ptr, bool write);
 uintptr_t vm_virt_to_phys(uintptr_t vaddr);
 #define virt_to_phys(virt_addr) vm_virt_to_phys((uintptr_t)(virt_addr))
@@ -68,6 +68,11 @@ typedef struct page {
 #define PG_OWNING     (1 << 2)
 #define PG_HEAD       (1 << 3)
 #define PG_COW        (1 << 4)
+// page cache state
+#define PG_BUSY       (1 << 5)  // i/o in progress
+#define PG_ERROR      (1 << 6)  // i/o failed
+#define PG_READAHEAD  (1 << 7)  // read ahead and not yet accessed
+#define PG_REFERENCED (1 << 8)  // accessed since the last eviction scan
 
 #define PG_SIZE_MASK  (PG_BIGPAGE | PG_HUGEPAGE)
 
@@ -177,6 +182,8 @@ typedef struct vm_mapping {
 #define VM_MAPPED     (1 << 17) // mapping is currently active
 #define VM_LINKED     (1 << 18) // mapping was split and is linked to the following mapping
 #define VM_SPLIT      (1 << 19) // mapping was split and is the second half of the split
+#define VM_SEQ_READ   (1 << 20) // mapping is accessed sequentially (madvise)
+#define VM_RAND_READ  (1 << 21) // mapping is accessed randomly (madvise)
 
 #define VM_PROT_MASK  0xF    // mask of protection flags
 #define VM_MODE_MASK  0x30   // mask of mode flags
@@ -26,12 +26,15 @@ struct arp_entry;
 #define ARP_STATE_REACHABLE     1   // Valid entry
 #define ARP_STATE_STALE         2   // Needs revalidation
 #define ARP_STATE_FAILED        3   // Resolution failed
+#define ARP_STATE_PROBE         4   // Usable, revalidation in progress
 
 // ARP cache timeouts (in seconds)
 #define ARP_CACHE_TIMEOUT       300     // 5 minutes
+#define ARP_REACHABLE_TIMEOUT   30      // time an entry is reachable after confirmation
 #define ARP_INCOMPLETE_TIMEOUT  3       // 3 seconds for response
 #define ARP_RETRY_INTERVAL      1       // 1 second between retries
 #define ARP_MAX_RETRIES         3       // Maximum retries
+#define ARP_MAX_PENDING         16      // Maximum packets queued on an entry
 
 /**
  * An ARP header.
@@ -0,0 +1,87 @@
+//
+// Created by Aaron Gill-Braun on 2026-10-18.
+//
+
+#ifndef KERNEL_NET_CHECKSUM_H
+#define KERNEL_NET_CHECKSUM_H
+
+#include <kernel/base.h>
+
+/*
+ * Internet checksum (RFC 1071).
+ *
+ * Partial sums are 32-bit ones' complement sums of the data taken as 16-bit
+ * words in memory order. They can be combined with csum_add/csum_block_add and
+ * are turned into a checksum by csum_fold, which returns the value that is
+ * stored into the header as-is (no byte swapping needed).
+ *
+ * The data is summed 64 bits at a time with a single carry chain, so unlike a
+ * byte or word loop the cost is close to that of reading the buffer. There is
+ * no vector path since the kernel does not save the fpu state of kernel code.
+ */
+
+/// Returns the partial sum of buf added to sum.
+uint32_t csum_partial(const void *buf, size_t len, uint32_t sum);
+/// Copies len bytes from src to dst and returns the partial sum of the data
+/// added to sum.
+uint32_t csum_partial_copy(void *dst, const void *src, size_t len, uint32_t sum);
+/// Returns the partial sum of the ipv4 tcp/udp pseudo header added to sum.
+/// The addresses are in network byte order and len in host byte order.
+uint32_t csum_tcpudp_nofold(uint32_t saddr, uint32_t daddr, uint16_t len, uint8_t proto, uint32_t sum);
+
+static inline uint32_t csum_add(uint32_t a, uint32_t b) {
+  uint32_t res = a + b;
+  return res + (res < a);
+}
+
+static inline uint32_t csum_sub(uint32_t a, uint32_t b) {
+  return csum_add(a, ~b);
+}
+
+/// Adds the partial sum of a block which starts at the given byte offset
+/// from the start of the data the first sum covers.
+static inline uint32_t csum_block_add(uint32_t sum, uint32_t sum2, size_t offset) {
+  if (offset & 1) {
+    sum2 = (sum2 >> 8) | (sum2 << 24);
+  }
+  return csum_add(sum, sum2);
+}
+
+/// Folds a partial sum into a checksum.
+static inline uint16_t csum_fold(uint32_t sum) {
+  sum = (sum & 0xFFFF) + (sum >> 16);
+  sum = (sum & 0xFFFF) + (sum >> 16);
+  return (uint16_t) ~sum;
+}
+
+/// Returns the tcp/udp checksum given the partial sum of the segment.
+static inline uint16_t csum_tcpudp_magic(uint32_t saddr, uint32_t daddr, uint16_t len, uint8_t proto, uint32_t sum) {
+  return csum_fold(csum_tcpudp_nofold(saddr, daddr, len, proto, sum));
+}
+
+/// Returns the checksum of a header (e.g. ip or icmp) with its checksum field
+/// cleared, or zero if the header has a valid checksum.
+static inline uint16_t ip_checksum(const void *data, size_t len) {
+  return csum_fold(csum_partial(data, len, 0));
+}
+
+//
+// Incremental updates (RFC 1624)
+//
+// These update a checksum after a field covered by it changes without summing
+// the rest of the data again: HC' = ~(~HC + ~m + m').
+//
+
+/// Updates a checksum for a 16-bit field changing from `from` to `to`.
+static inline void csum_replace2(uint16_t *check, uint16_t from, uint16_t to) {
+  uint32_t sum = csum_add(csum_add((uint16_t) ~*check, (uint16_t) ~from), to);
+  *check = csum_fold(sum);
+}
+
+/// Updates a checksum for a 32-bit field changing from `from` to `to`.
+static inline void csum_replace4(uint16_t *check, uint32_t from, uint32_t to) {
+  uint32_t sum = csum_add(csum_sub((uint16_t) ~*check, from), to);
+  *check = csum_fold(sum);
+}
+
+#endif
@@ -0,0 +1,37 @@
+//
+// Created by Aaron Gill-Braun on 2026-10-18.
+//
+
+#ifndef KERNEL_NET_GRO_H
+#define KERNEL_NET_GRO_H
+
+#include <kernel/base.h>
+
+typedef struct netdev netdev_t;
+typedef struct sk_buff sk_buff_t;
+
+/*
+ * Generic receive offload.
+ *
+ * On devices with NETDEV_F_GRO, received ipv4 tcp segments are held on the
+ * device instead of being passed up right away. Following in-order segments
+ * of the same flow are appended to the held packet so that ip and tcp process
+ * a single large segment (one socket wakeup and one ack) instead of one per
+ * frame. Held packets are passed up when a segment cannot be merged, when the
+ * packet is full, on PSH, and at the end of the receive batch.
+ *
+ * A driver that sets NETDEV_F_GRO must call netdev_rx_flush after each batch
+ * of netdev_rx calls, and must not call netdev_rx for the device from more
+ * than one context at a time.
+ */
+
+#define GRO_MAX_SIZE    (64 * SIZE_1KB - 1) // max merged ip packet size
+#define GRO_MAX_HELD    8                   // max flows held per device
+
+/// Holds or merges a received ip packet. Returns true if the packet was
+/// consumed, otherwise it should be passed up as usual.
+bool gro_receive(netdev_t *dev, sk_buff_t *skb);
+/// Passes up all packets held on the device.
+void gro_flush(netdev_t *dev);
+
+#endif
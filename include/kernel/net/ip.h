@@ -8,6 +8,7 @@
 #include <kernel/base.h>
 #include <kernel/ref.h>
 #include <kernel/queue.h>
+#include <kernel/net/checksum.h>
 
 typedef struct netdev netdev_t;
 typedef struct sk_buff sk_buff_t;
@@ -89,7 +90,6 @@ int ip_route_iterate(int (*callback)(route_t *route, void *data), void *data);
 int ip_register_protocol(uint8_t protocol, int (*handler)(sk_buff_t *skb));
 void ip_unregister_protocol(uint8_t protocol);
 
-uint16_t ip_checksum(const void *data, size_t len);
 int ip_rcv(sk_buff_t *skb);
 int ip_output(sk_buff_t *skb, uint32_t saddr, uint32_t daddr, uint8_t protocol, netdev_t *dev);
 
@@ -75,6 +75,7 @@ typedef struct netdev {
   uint16_t type;                    // hardware type (ARPHRD_*)
   uint16_t flags;                   // device flags (NETDEV_*)
   uint32_t mtu;                     // maximum transmission unit
+  uint32_t features;                // device features (NETDEV_F_*)
 
   uint8_t dev_addr[6];              // hardware address (MAC)
   uint8_t addr_len;                 // hardware address length
@@ -87,6 +88,10 @@ typedef struct netdev {
   mtx_t lock;                       // protects device state
   _refcount;
 
+  /* receive offload (only used from the driver receive path) */
+  LIST_HEAD(struct sk_buff) gro_list;  // held packets (one per flow)
+  uint16_t gro_count;               // number of held packets
+
   /* registration */
   int ifindex;                      // interface index
   LIST_ENTRY(struct netdev) list;   // device list linkage
@@ -106,6 +111,10 @@ struct netdev_ops {
 #define NETDEV_RUNNING  0x0002  // device is running
 #define NETDEV_LOOPBACK 0x0004  // loopback device
 
+// network device features
+#define NETDEV_F_GRO     0x0001 // merge received tcp segments (see gro.h)
+#define NETDEV_F_NO_CSUM 0x0002 // packets cannot be corrupted, tcp/udp checksums are not needed
+
 #define netdev_getref(dev) ({ \
   ASSERT_IS_TYPE(netdev_t *, dev); \
   netdev_t *__dev = (dev); \
@@ -147,6 +156,7 @@ int netdev_close(netdev_t *dev);
 int netdev_tx(netdev_t *dev, sk_buff_t *skb);
 int netdev_rx(netdev_t *dev, sk_buff_t *skb);
 int netdev_receive_skb(sk_buff_t *skb);
+void netdev_rx_flush(netdev_t *dev);
 int netdev_ioctl(unsigned long request, uintptr_t argp);
 
 typedef int (*netdev_iter_func_t)(netdev_t *dev, void *data);
@@ -40,7 +40,7 @@ typedef struct sk_buff {
   uint8_t *network_header;  // pointer to network header (IP)
   uint8_t *transport_header; // pointer to transport header (UDP/TCP)
   /* checksum info */
-  uint16_t csum;        // checksum
+  uint32_t csum;        // checksum (partial sum of the data if CHECKSUM_COMPLETE)
   uint8_t ip_summed;    // checksum status
   /* timestamps */
   uint64_t timestamp;   // packet timestamp
@@ -62,6 +62,12 @@ typedef struct sk_buff {
 #define CHECKSUM_COMPLETE   2  // checksum provided
 #define CHECKSUM_PARTIAL    3  // partial checksum
 
+// default buffer sizes
+#define SKB_DEFAULT_HEADROOM 64
+#define SKB_DEFAULT_SIZE    1536  // ethernet MTU + headers
+// largest size that can be passed to skb_alloc (a full ip datagram)
+#define SKB_MAX_ALLOC       (64 * SIZE_1KB)
+
 //
 // Socket Buffer API
 //
@@ -69,6 +75,12 @@ typedef struct sk_buff {
 sk_buff_t *skb_alloc(size_t size);
 void skb_free(sk_buff_t **skbp);
 
+// bulk operations for drivers. skb_alloc_bulk fills skbs with up to count new
+// skbs of the given size and returns the number allocated. skb_free_bulk frees
+// all non-null entries and sets them to null.
+size_t skb_alloc_bulk(size_t size, sk_buff_t **skbs, size_t count);
+void skb_free_bulk(sk_buff_t **skbs, size_t count);
+
 sk_buff_t *skb_clone(sk_buff_t *skb);
 sk_buff_t *skb_copy(sk_buff_t *skb);
 size_t skb_headroom(sk_buff_t *skb);
@@ -81,6 +93,7 @@ void skb_trim(sk_buff_t *skb, size_t len);
 
 // iovec operations
 size_t skb_copy_from_iovec(sk_buff_t *skb, const struct iovec *iov, size_t offset, size_t len);
+size_t skb_copy_from_iovec_csum(sk_buff_t *skb, const struct iovec *iov, size_t offset, size_t len);
 size_t skb_copy_to_iovec(sk_buff_t *skb, struct iovec *iov, size_t offset, size_t len, bool consume);
 
 static inline void skb_set_network_header(sk_buff_t *skb, int offset) {
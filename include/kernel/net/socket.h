@@ -11,6 +11,8 @@
 
 #include <sys/socket.h>
 
+#define SOCK_MMSG_MAX   1024 // max messages per sendmmsg/recvmmsg call
+
 #define SS_FREE         0   // not allocated
 #define SS_UNCONNECTED  1   // unconnected to any socket
 #define SS_CONNECTING   2   // in process of connecting
@@ -19,6 +21,7 @@
 
 struct sock;
 struct proto_ops;
+struct timespec;
 
 
 /**
@@ -46,6 +49,8 @@ struct proto_ops {
   int (*accept)(struct sock *sock, struct sock *newsock, int flags);
   int (*sendmsg)(struct sock *sock, struct msghdr *msg, size_t len, int flags);
   int (*recvmsg)(struct sock *sock, struct msghdr *msg, size_t len, int flags);
+  int (*sendmmsg)(struct sock *sock, struct mmsghdr *vec, unsigned int vlen, int flags);
+  int (*recvmmsg)(struct sock *sock, struct mmsghdr *vec, unsigned int vlen, int flags, struct timespec *timeout);
   int (*shutdown)(struct sock *sock, int how);
   int (*setsockopt)(struct sock *sock, int level, int optname, const void *optval, socklen_t optlen);
   int (*getsockopt)(struct sock *sock, int level, int optname, void *optval, socklen_t *optlen);
@@ -92,6 +97,8 @@ ssize_t net_sendto(int sockfd, const void *buf, size_t len, int flags, const str
 ssize_t net_recvfrom(int sockfd, void *buf, size_t len, int flags, struct sockaddr *src_addr, socklen_t *addrlen);
 ssize_t net_sendmsg(int sockfd, const struct msghdr *msg, int flags);
 ssize_t net_recvmsg(int sockfd, struct msghdr *msg, int flags);
+int net_sendmmsg(int sockfd, struct mmsghdr *vec, unsigned int vlen, unsigned int flags);
+int net_recvmmsg(int sockfd, struct mmsghdr *vec, unsigned int vlen, unsigned int flags, struct timespec *timeout);
 int net_shutdown(int sockfd, int how);
 int net_setsockopt(int sockfd, int level, int optname, const void *optval, socklen_t optlen);
 int net_getsockopt(int sockfd, int level, int optname, void *optval, socklen_t *optlen);
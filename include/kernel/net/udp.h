@@ -16,6 +16,8 @@ typedef struct sock sock_t;
 typedef struct netdev netdev_t;
 typedef struct sk_buff sk_buff_t;
 struct msghdr;
+struct mmsghdr;
+struct timespec;
 
 #include <linux/socket.h>
 #include <linux/udp.h>
@@ -32,6 +34,7 @@ typedef struct udp_sock {
 
   bool bound;         // socket is bound to address
   bool connected;     // socket is connected
+  uint16_t gso_size;  // UDP_SEGMENT size (0 = disabled)
   mtx_t lock;         // protects socket state
 
   // receive queue
@@ -67,6 +70,8 @@ typedef struct udp_sock {
 #define UDP_EPHEMERAL_MIN 32768
 #define UDP_EPHEMERAL_MAX 65535
 
+#define UDP_MAX_SEGMENTS 64 // max datagrams built from one UDP_SEGMENT send
+
 //
 // MARK: UDP Socket API
 //
@@ -79,5 +84,7 @@ int udp_connect(udp_sock_t *udp_sk, uint32_t addr, uint16_t port);
 int udp_rcv(sk_buff_t *skb);
 int udp_sendmsg(sock_t *sock, struct msghdr *msg, size_t len, int flags);
 int udp_recvmsg(sock_t *sock, struct msghdr *msg, size_t len, int flags);
+int udp_sendmmsg(sock_t *sock, struct mmsghdr *vec, unsigned int vlen, int flags);
+int udp_recvmmsg(sock_t *sock, struct mmsghdr *vec, unsigned int vlen, int flags, struct timespec *timeout);
 
 #endif
@@ -10,6 +10,9 @@
 #include <stdarg.h>
 
 void kprintf_early_init();
+/// Writes out any queued output and makes all further output synchronous.
+/// This is used on panic when interrupts will no longer be serviced.
+void kprintf_sync();
 
 void kprintf_kputs(const char *str);
 void kprintf_kputl(long val);
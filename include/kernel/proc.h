@@ -235,6 +235,7 @@ typedef struct thread {
   sigset_t sigmask;                     // signal mask
   stack_t sigstack;                     // signal stack
   int *clear_child_tid;                 // clear and futex wake on exit (CLONE_CHILD_CLEARTID)
+  struct blk_plug *plug;                // active block i/o plug
 
   struct runqueue *runq;                // runqueue (if ready)
   struct lock_object *contested_lock;   // contested lock (if blocked)
@@ -471,6 +472,7 @@ void cpuset_set(struct cpuset *set, int cpu);
 void cpuset_reset(struct cpuset *set, int cpu);
 bool cpuset_test(struct cpuset *set, int cpu);
 int cpuset_next_set(struct cpuset *set, int cpu);
+size_t cpuset_count(struct cpuset *set);
 
 void critical_enter();
 void critical_exit();
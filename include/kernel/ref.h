@@ -23,6 +23,16 @@ static inline void ref_get(refcount_t *ref) { // NOLINT(*-non-const-parameter)
   atomic_fetch_add(ref, 1);
 }
 
+static inline bool ref_tryget(refcount_t *ref) { // NOLINT(*-non-const-parameter)
+  // only takes a reference if the object is not already on its way out
+  int count = atomic_load(ref);
+  while (count > 0) {
+    if (__atomic_compare_exchange_n(ref, &count, count + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+      return true;
+  }
+  return false;
+}
+
 static inline int ref_put(refcount_t *ref) { // NOLINT(*-non-const-parameter)
   if (atomic_fetch_sub(ref, 1) == 1) // value was 1 -> now 0
     return 1; // last reference
@@ -22,6 +22,7 @@ void sched_init();
 void sched_submit_new_thread(__locked thread_t *td);
 void sched_submit_ready_thread(__locked thread_t *td);
 void sched_remove_ready_thread(__locked thread_t *td);
+void sched_migrate_thread(__locked thread_t *td);
 
 void sched_again(sched_reason_t reason);
 void sched_cpu(int cpu, sched_reason_t reason);
@@ -0,0 +1,43 @@
+//
+// Created by Aaron Gill-Braun on 2026-10-18.
+//
+
+#ifndef KERNEL_SHM_H
+#define KERNEL_SHM_H
+
+#include <kernel/base.h>
+#include <kernel/vfs_types.h>
+#include <kernel/kio.h>
+
+#include <abi/shm.h>
+
+#define MEMFD_NAME_MAX  249       // max length of a memfd name (excluding prefix)
+#define SHM_MAX_SEGS    4096      // max number of sysv segments (SHMMNI)
+#define SHM_MAX_SIZE    (1ULL << 32) // max size of a shared memory object (SHMMAX)
+
+struct vm_file;
+
+/*
+ * Shared memory objects
+ *
+ * Both memfd files and sysv shared memory segments are backed by an anonymous
+ * vm_file. Every mapping of the object gets a copy of that vm_file which shares
+ * its page cache, so a page written through one mapping (or through write(2)
+ * on a memfd) is immediately visible in all others. Nothing is ever copied to
+ * hand memory between processes - only the fd or segment id is passed.
+ */
+
+struct vm_file *memfd_get_vmfile(file_t *file, size_t off, size_t len, int mmap_flags, int prot);
+int memfd_add_seals(file_t *file, int seals);
+int memfd_get_seals(file_t *file);
+ssize_t memfd_kpread(file_t *file, kio_t *kio, off_t off);
+ssize_t memfd_kpwrite(file_t *file, kio_t *kio, off_t off);
+
+int memfd_create(const char *name, unsigned int flags);
+
+int shm_get(key_t key, size_t size, int shmflg);
+void *shm_at(int shmid, const void *shmaddr, int shmflg);
+int shm_dt(const void *shmaddr);
+int shm_ctl(int shmid, int cmd, struct shmid_ds *buf);
+
+#endif
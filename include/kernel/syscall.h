@@ -10,4 +10,6 @@
 
 extern void syscall_handler();
 
+const char *syscall_name(uint64_t syscall);
+
 #endif
@@ -0,0 +1,114 @@
+//
+// Created by Aaron Gill-Braun on 2026-10-18.
+//
+
+#ifndef KERNEL_TRACE_H
+#define KERNEL_TRACE_H
+
+#include <kernel/base.h>
+
+/*
+ * Kernel event tracing.
+ *
+ * Tracepoints write fixed-size binary records into a per-cpu ring buffer.
+ * Recording takes no locks and does no formatting so it can be used from any
+ * context including the scheduler and interrupt handlers. Records are
+ * formatted when /proc/trace is read. When a ring is full the oldest records
+ * are overwritten.
+ *
+ * Tracing is enabled per tag at runtime by writing to /proc/trace_tags (or
+ * with the `trace` kernel parameter). A disabled tracepoint costs one load
+ * and a branch.
+ *
+ * The same switch takes the LOG_TAG of any file built with its DPRINTFs
+ * enabled. While a log tag is traced its DPRINTFs are recorded into the ring
+ * instead of being printed. Messages whose arguments are all scalars are
+ * formatted when the trace is read. Any others are formatted when they are
+ * recorded since the data they point to may be gone by then, but they still
+ * skip the console.
+ */
+
+enum trace_tag {
+  TRACE_TAG_SCHED,
+  TRACE_TAG_FAULT,
+  TRACE_TAG_SYSCALL,
+  TRACE_TAG_IRQ,
+  TRACE_TAG_ALARM,
+  TRACE_TAG_MAX
+};
+
+enum trace_event {
+  TRACE_SCHED_SWITCH,   // prev tid, next tid, reason
+  TRACE_PAGE_FAULT,     // address, error code, rip
+  TRACE_SYSCALL_ENTER,  // syscall, arg1, arg2, arg3
+  TRACE_SYSCALL_EXIT,   // syscall, result
+  TRACE_IRQ_ENTER,      // vector
+  TRACE_IRQ_EXIT,       // vector
+  TRACE_ALARM_EXPIRE,   // alarm id, expiry ns, lateness ns
+  TRACE_PRINTF,         // fmt, up to 4 args
+  TRACE_TEXT,           // formatted text (40 bytes)
+  TRACE_TEXT_CONT,      // formatted text continued from the previous record
+  TRACE_EVENT_MAX
+};
+
+struct trace_record {
+  uint64_t seq;         // ring position + 1 once the record is complete
+  uint64_t tsc;         // timestamp counter
+  uint16_t event;       // trace event
+  uint16_t cpu;         // cpu id
+  int32_t tid;          // current thread id
+  uint64_t args[5];     // event arguments
+};
+_Static_assert(sizeof(struct trace_record) == 64, "trace_record size");
+
+extern volatile uint64_t trace_enabled_tags;
+
+#define trace_enabled(tag) __expect_false(trace_enabled_tags & (1ULL << (tag)))
+
+void __trace_record(uint16_t event, uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4);
+
+/// Records an event if its tag is enabled.
+#define TRACE_EVENT(tag, event, a0, a1, a2, a3) ({ \
+  if (trace_enabled(TRACE_TAG_##tag)) \
+    __trace_record(event, (uint64_t)(a0), (uint64_t)(a1), (uint64_t)(a2), (uint64_t)(a3), 0); \
+})
+
+// expands to exactly four arguments, padding with zeros
+#define _TRACE_ARGS4(_, a0, a1, a2, a3, ...) (uint64_t)(a0), (uint64_t)(a1), (uint64_t)(a2), (uint64_t)(a3)
+// expands to the number of arguments (up to 16)
+#define _TRACE_NARGS(...) _TRACE_NARGS_(0, ##__VA_ARGS__, 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define _TRACE_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, n, ...) n
+
+/**
+ * Records a log message.
+ *
+ * The format string must be a string literal. Whether the message can be
+ * formatted later is worked out once per call site on first use.
+ */
+#define TRACE_LOG(fmt, ...) ({ \
+  static int8_t __trace_deferred = -1; \
+  if (__expect_false(__trace_deferred < 0)) \
+    __trace_deferred = _TRACE_NARGS(__VA_ARGS__) <= 4 && trace_fmt_is_deferrable(fmt); \
+  if (__trace_deferred) \
+    __trace_record(TRACE_PRINTF, (uint64_t)("" fmt), _TRACE_ARGS4(0, ##__VA_ARGS__, 0, 0, 0, 0)); \
+  else \
+    __trace_text(fmt, ##__VA_ARGS__); \
+})
+
+// the trace switch of a LOG_TAG in one file
+struct trace_log_tag {
+  const char *name;
+  volatile bool enabled;
+};
+
+#define TRACE_LOG_TAG(_var, _name) \
+  static struct trace_log_tag _var = { .name = (_name) }; \
+  static _used __attribute__((section(".trace_log_tags"))) struct trace_log_tag *_var ## _ptr = &_var
+
+bool trace_fmt_is_deferrable(const char *fmt);
+void __trace_text(const char *fmt, ...);
+
+int trace_set_tags(uint64_t mask);
+void trace_clear();
+
+#endif
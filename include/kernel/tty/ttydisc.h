@@ -20,6 +20,8 @@ void ttydisc_close(tty_t *tty);
 size_t ttydisc_bytesavail(tty_t *tty);
 int ttydisc_rint(tty_t *tty, uint8_t ch, int flags);
 void ttydisc_rint_done(tty_t *tty);
+bool ttydisc_can_bypass(tty_t *tty);
+size_t ttydisc_rint_bypass(tty_t *tty, const void *buf, size_t len);
 ssize_t ttydisc_read(tty_t *tty, kio_t *kio);
 int	ttydisc_write_ch(tty_t *tty, char ch);
 ssize_t	ttydisc_write(tty_t *tty, kio_t *kio);
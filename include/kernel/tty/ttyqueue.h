@@ -27,19 +27,34 @@ void ttyinq_flush(struct ttyinq *inq);
 void ttyinq_canonizalize(struct ttyinq *inq);
 size_t ttyinq_find_ch(struct ttyinq *inq, const char *chars, char *lastc);
 int ttyinq_write_ch(struct ttyinq *inq, char ch, bool quote);
+size_t ttyinq_write_buf(struct ttyinq *inq, const void *buf, size_t len, bool quote);
 ssize_t ttyinq_write(struct ttyinq *inq, kio_t *kio, bool quote);
 ssize_t ttyinq_read(struct ttyinq *inq, kio_t *kio, size_t n);
 size_t ttyinq_drop(struct ttyinq *inq, size_t n);
 int ttyinq_del_ch(struct ttyinq *inq);
 
+// the queues are ring buffers which keep one slot free to tell a full queue
+// from an empty one. the block functions copy runs of bytes in at most two
+// pieces (up to the end of the buffer and from the start) and return the
+// number of bytes copied, which is less than requested if the queue fills up
+// or runs out.
+
 static inline size_t ttyinq_canonbytes(struct ttyinq *inq) {
-  kassert(inq->read_pos <= inq->next_line);
-  return inq->next_line - inq->read_pos;
+  if (inq->data_size == 0)
+    return 0;
+  return (inq->next_line + inq->data_size - inq->read_pos) % inq->data_size;
 }
 
 static inline size_t ttyinq_linebytes(struct ttyinq *inq) {
-  kassert(inq->read_pos <= inq->write_pos);
-  return inq->write_pos - inq->read_pos;
+  if (inq->data_size == 0)
+    return 0;
+  return (inq->write_pos + inq->data_size - inq->read_pos) % inq->data_size;
+}
+
+static inline size_t ttyinq_space(struct ttyinq *inq) {
+  if (inq->data_size == 0)
+    return 0;
+  return inq->data_size - 1 - ttyinq_linebytes(inq);
 }
 
 static inline char tty_inq_peek_ch(struct ttyinq *inq) {
@@ -67,13 +82,22 @@ int ttyoutq_setsize(struct ttyoutq *outq, size_t size);
 void ttyoutq_flush(struct ttyoutq *outq);
 int ttyoutq_peek_ch(struct ttyoutq *outq);
 int ttyoutq_get_ch(struct ttyoutq *outq);
+size_t ttyoutq_read_buf(struct ttyoutq *outq, void *buf, size_t len);
 int ttyoutq_read(struct ttyoutq *outq, kio_t *kio);
 int ttyoutq_write_ch(struct ttyoutq *outq, char ch);
+size_t ttyoutq_write_buf(struct ttyoutq *outq, const void *buf, size_t len);
 int ttyoutq_write(struct ttyoutq *outq, kio_t *kio);
 
 static inline size_t ttyoutq_bytes(struct ttyoutq *outq) {
-  kassert(outq->read_pos <= outq->write_pos);
-  return outq->write_pos - outq->read_pos;
+  if (outq->data_size == 0)
+    return 0;
+  return (outq->write_pos + outq->data_size - outq->read_pos) % outq->data_size;
+}
+
+static inline size_t ttyoutq_space(struct ttyoutq *outq) {
+  if (outq->data_size == 0)
+    return 0;
+  return outq->data_size - 1 - ttyoutq_bytes(outq);
 }
 
 static inline bool ttyoutq_isfull(struct ttyoutq *outq) {
@@ -14,24 +14,45 @@
 
 // pipe buffer size - 64KB (16 pages)
 #define PIPE_BUFFER_SIZE PAGES_TO_SIZE(16)
+// number of buffer slots in a pipe
+#define PIPE_MAX_BUFS 16
 
 // pipe flags
 #define PIPE_READ_CLOSED  0x01  // read end closed
 #define PIPE_WRITE_CLOSED 0x02  // write end closed
+#define PIPE_READ_BUSY    0x04  // a splice read owns the buffers (lock dropped)
+
+// pipe buffer flags
+#define PIPE_BUF_PAGE     0x01  // buffer references a page owned by someone else
+
+/*
+ * A pipe buffer.
+ *
+ * Data written to a pipe is copied into the page that backs the buffer's slot
+ * in the pipe's buffer mapping. Data spliced into a pipe is not copied, the
+ * buffer holds a reference to the source page and the range of it to use.
+ */
+struct pipe_buf {
+  page_t *page;                 // referenced page (PIPE_BUF_PAGE)
+  uint32_t offset;              // offset of the data in the page
+  uint32_t len;                 // length of the data
+  uint32_t flags;               // pipe buffer flags
+};
 
 typedef struct pipe {
   uint32_t flags;               // pipe flags
-  size_t buffer_size;           // size of buffer
-  void *buffer;                 // pipe buffer
+  size_t buffer_size;           // max bytes buffered
+  void *buffer;                 // backing pages for slots (one page per slot)
   struct timespec ctime;        // creation time
-  
-  size_t read_pos;              // read position
-  size_t write_pos;             // write position
+
+  struct pipe_buf bufs[PIPE_MAX_BUFS]; // buffer ring
+  uint32_t head;                // slot of the first buffer
+  uint32_t nbufs;               // number of buffers in the ring
   size_t count;                 // bytes in buffer
-  
+
   uint32_t readers;             // number of readers
   uint32_t writers;             // number of writers
-  
+
   mtx_t lock;                   // pipe lock
   cond_t read_cond;             // readers wait here
   cond_t write_cond;            // writers wait here
@@ -40,10 +61,21 @@ typedef struct pipe {
   _refcount;                    // reference count
 } pipe_t;
 
+/**
+ * Called by pipe_splice_read for each contiguous run of data in the pipe.
+ * Returns the number of bytes consumed or a negative error.
+ */
+typedef ssize_t (*pipe_actor_t)(void *data, const void *buf, size_t len);
+
 // pipe operations
 __ref pipe_t *pipe_alloc(size_t buffer_size);
 void _pipe_cleanup(__move pipe_t **piperef);
 
+// splice operations
+ssize_t pipe_add_page(file_t *file, page_t *page, uint32_t offset, uint32_t len, bool nonblock);
+ssize_t pipe_splice_read(file_t *file, size_t len, bool nonblock, pipe_actor_t actor, void *data);
+ssize_t pipe_splice_move(file_t *in, file_t *out, size_t len, bool nonblock, bool consume);
+
 // pipe file operations
 __ref file_t *pipe_create_read_file(pipe_t *pipe, int flags);
 __ref file_t *pipe_create_write_file(pipe_t *pipe, int flags);
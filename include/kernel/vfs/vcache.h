@@ -20,4 +20,13 @@ int vcache_invalidate(vcache_t *vcache, cstr_t path);
 int vcache_invalidate_all(vcache_t *vcache);
 void vcache_dump(vcache_t *vcache);
 
+// component cache api
+//   the component cache maps (parent ventry, name) pairs to child ventries
+//   and is shared by all vcache instances. lookups are lock-free and a
+//   missing entry can be cached as a negative result.
+int vcache_lookup_child(ventry_t *dve, cstr_t name, __move ventry_t **result);
+void vcache_put_child(ventry_t *dve, cstr_t name, ventry_t *ve);
+void vcache_invalidate_child(ventry_t *dve, cstr_t name);
+void vcache_invalidate_children(ventry_t *dve);
+
 #endif
@@ -216,6 +216,7 @@ typedef struct vnode {
   struct knlist knlist;           // knote list
   rb_node_v2_t vtable_node;      // vtable tree node (keyed by id)
   LIST_ENTRY(struct vnode) list;  // vfs vnode list (non-ref)
+  LIST_ENTRY(struct vnode) lru;   // page cache reclaim list (non-ref)
 } vnode_t;
 
 // vnode flags
@@ -341,6 +342,8 @@ enum ftype {
   FT_SOCK,    // socket file
   FT_EPOLL,   // epoll instance file
   FT_EVENTFD, // eventfd file
+  FT_IOURING, // io_uring instance file
+  FT_MEMFD,   // memfd shared memory file
 };
 
 #define F_ISVNODE(f) ((f)->type == FT_VNODE)
@@ -349,6 +352,16 @@ enum ftype {
 #define F_ISSOCK(f) ((f)->type == FT_SOCK)
 #define F_ISEPOLL(f) ((f)->type == FT_EPOLL)
 #define F_ISEVENTFD(f) ((f)->type == FT_EVENTFD)
+#define F_ISIOURING(f) ((f)->type == FT_IOURING)
+#define F_ISMEMFD(f) ((f)->type == FT_MEMFD)
+
+/// Per-file readahead state (in pages).
+struct file_ra {
+  uint64_t start;       // first page of the current window
+  size_t size;          // pages in the current window
+  size_t async_size;    // pages left in the window when the next one is read
+  uint64_t prev_page;   // last page read
+};
 
 /*
  * A file backing a file descriptor.
@@ -370,6 +383,7 @@ typedef struct file {
   _refcount;            // reference count
   mtx_t lock;           // file lock
   off_t offset;         // current file offset
+  struct file_ra ra;    // readahead state
   uint32_t nopen;       // number of open file descriptors
   bool closed;          // file is closed
 } file_t;
@@ -404,7 +418,6 @@ typedef struct fd_entry {
   struct file *file;    // file reference
   _refcount;            // reference count
   mtx_t lock;           // protects flags field
-  rb_node_v2_t fd_node; // ftable tree node (keyed by fd)
 } fd_entry_t;
 
 
@@ -11,6 +11,7 @@
 
 #include <kernel/mm/pool.h>
 #include <kernel/string.h>
+#include <kernel/trace.h>
 #include <kernel/printf.h>
 #include <kernel/panic.h>
 
@@ -136,6 +137,7 @@ static inline void handle_expired_alarms(uint64_t clock_now, uint64_t *next_expi
     mtx_spin_unlock(&alarm_lock);
 
     DPRINTF("alarm %d expired\n", alarm->id);
+    TRACE_EVENT(ALARM, TRACE_ALARM_EXPIRE, alarm->id, alarm->expires_ns, clock_now - alarm->expires_ns, 0);
     uint64_t old_expiry = alarm->expires_ns;
     HANDLER_FN(alarm->function)(alarm, alarm->args[0], alarm->args[1], alarm->args[2]);
     if (alarm->expires_ns > old_expiry) {
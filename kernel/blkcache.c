@@ -0,0 +1,482 @@
+//
+// Created by Aaron Gill-Braun on 2026-10-18.
+//
+
+#include <kernel/blkdev.h>
+#include <kernel/cond.h>
+#include <kernel/mm.h>
+#include <kernel/mm/pgcache.h>
+#include <kernel/mm/pgtable.h>
+#include <kernel/vfs_types.h>
+#include <kernel/kio.h>
+
+#include <kernel/panic.h>
+#include <kernel/printf.h>
+
+#include <fs/procfs/procfs.h>
+
+#define ASSERT(x) kassert(x)
+#define LOG_TAG blkcache
+#include <kernel/log.h>
+#define EPRINTF(fmt, ...) kprintf("blkcache: %s: " fmt, __func__, ##__VA_ARGS__)
+
+#define BLK_CACHE_MAX_PAGES   4096  // per device limit (16MB)
+#define BLK_EVICT_BATCH       32    // pages evicted at once when the cache is full
+#define BLK_RA_MIN_PAGES      4     // initial readahead window
+#define BLK_RA_MAX_PAGES      64    // largest readahead window (256KB)
+
+/*
+ * A block device page cache.
+ *
+ * Device pages are kept in a pgcache indexed by device offset. A page is
+ * inserted with PG_BUSY set before its read is submitted and the flag is
+ * cleared from the bio completion, so readers that find a busy page wait on
+ * the cache condition instead of issuing the read again. A page whose read
+ * failed is left in the cache with PG_ERROR and is replaced by the next read.
+ *
+ * The pgcache tree is protected by its own (sleepable) lock since inserting
+ * may allocate. The page state flags, the clock and the counters are protected
+ * by the cache spin lock which is also taken from the bio completion.
+ *
+ * Eviction uses a clock over the page indices in insertion order. Pages that
+ * were accessed since the last pass get a second chance.
+ */
+struct blk_cache {
+  blkdev_t *bdev;
+  mtx_t lock;                 // spin lock (taken from i/o completion)
+  cond_t cond;                // broadcast when cache i/o completes
+  struct pgcache *pages;      // cached device pages
+  uint64_t nr_pages;          // device size in pages
+  size_t count;               // number of cached pages
+  size_t max_count;           // cache size limit
+
+  uint32_t *clock;            // ring of cached page indices
+  size_t clock_head;
+  size_t clock_len;
+  size_t clock_size;
+
+  // stats
+  uint64_t hits;              // pages found in the cache
+  uint64_t misses;            // pages that had to be read on demand
+  uint64_t ra_pages;          // pages submitted by readahead
+  uint64_t ra_hits;           // readahead pages that were later read
+  uint64_t evictions;
+
+  LIST_ENTRY(struct blk_cache) list;
+};
+
+static LIST_HEAD(struct blk_cache) blk_caches;
+static mtx_t blk_caches_lock;
+
+static void blk_cache_static_init() {
+  mtx_init(&blk_caches_lock, MTX_SPIN, "blk_caches_lock");
+}
+STATIC_INIT(blk_cache_static_init);
+
+static inline size_t pgidx_to_off(uint64_t idx) {
+  return (size_t) idx << PAGE_SHIFT;
+}
+
+// adds a page index to the clock. if the ring is full the oldest index is
+// dropped to make room and true is returned with it in `victim`.
+static bool clock_push(struct blk_cache *bc, uint64_t idx, uint64_t *victim) {
+  bool full = bc->clock_len == bc->clock_size;
+  if (full) {
+    *victim = bc->clock[bc->clock_head];
+    bc->clock_head = (bc->clock_head + 1) % bc->clock_size;
+    bc->clock_len--;
+  }
+  bc->clock[(bc->clock_head + bc->clock_len) % bc->clock_size] = (uint32_t) idx;
+  bc->clock_len++;
+  return full;
+}
+
+static uint64_t clock_pop(struct blk_cache *bc) {
+  ASSERT(bc->clock_len > 0);
+  uint64_t idx = bc->clock[bc->clock_head];
+  bc->clock_head = (bc->clock_head + 1) % bc->clock_size;
+  bc->clock_len--;
+  return idx;
+}
+
+// removes the page at `idx` from the cache and returns it. the pgcache lock
+// must be held.
+static page_t *blk_cache_remove(struct blk_cache *bc, uint64_t idx, bool evict) {
+  page_t *page = NULL;
+  pgcache_remove(bc->pages, pgidx_to_off(idx), &page);
+  if (page != NULL) {
+    mtx_spin_lock(&bc->lock);
+    bc->count--;
+    if (evict)
+      bc->evictions++;
+    mtx_spin_unlock(&bc->lock);
+  }
+  return page;
+}
+
+// evicts up to BLK_EVICT_BATCH idle pages. the pgcache lock must be held.
+static void blk_cache_shrink(struct blk_cache *bc) {
+  size_t n = 0;
+  size_t scan = bc->clock_len;
+  while (n < BLK_EVICT_BATCH && scan-- > 0) {
+    mtx_spin_lock(&bc->lock);
+    if (bc->clock_len == 0) {
+      mtx_spin_unlock(&bc->lock);
+      break;
+    }
+    uint64_t idx = clock_pop(bc);
+    mtx_spin_unlock(&bc->lock);
+
+    page_t *page = pgcache_lookup(bc->pages, pgidx_to_off(idx));
+    if (page == NULL) {
+      continue; // already invalidated
+    }
+
+    // the cache and our lookup hold two references, any more are readers
+    mtx_spin_lock(&bc->lock);
+    bool busy = (page->flags & (PG_BUSY | PG_REFERENCED)) || ref_count(&page->refcount) > 2;
+    if (busy) {
+      uint64_t victim;
+      page->flags &= ~PG_REFERENCED;
+      clock_push(bc, idx, &victim); // there is room for the index we popped
+    }
+    mtx_spin_unlock(&bc->lock);
+    pg_putref(&page);
+    if (busy) {
+      continue;
+    }
+
+    page = blk_cache_remove(bc, idx, true);
+    pg_putref(&page);
+    n++;
+  }
+}
+
+//
+// MARK: Page I/O
+//
+
+static void blk_cache_end_io(bio_t *bio) {
+  // called from interrupt context
+  struct blk_cache *bc = bio->private;
+
+  mtx_spin_lock(&bc->lock);
+  for (uint8_t i = 0; i < bio->vcnt; i++) {
+    page_t *page = bio->vecs[i].page;
+    page->flags &= ~PG_BUSY;
+    if (bio->status < 0) {
+      // the next reader replaces the page and retries the read
+      page->flags |= PG_ERROR;
+    }
+  }
+  cond_broadcast(&bc->cond);
+  mtx_spin_unlock(&bc->lock);
+
+  if (bio->status < 0) {
+    EPRINTF("read of {:str} failed at sector %llu {:err}\n", &bc->bdev->name, bio->sector, bio->status);
+  }
+
+  for (uint8_t i = 0; i < bio->vcnt; i++) {
+    pg_putref(&bio->vecs[i].page);
+  }
+  bio_free(bio);
+}
+
+// reads the pages [start, start+count) that are not already cached. pages
+// at or after `ra_from` are marked as readahead. the bios are submitted to
+// the current plug if there is one.
+static void blk_cache_readpages(struct blk_cache *bc, uint64_t start, size_t count, uint64_t ra_from) {
+  blkdev_t *bdev = bc->bdev;
+  uint64_t dev_size = bdev->nr_sectors << SECTOR_SHIFT;
+  bio_t *bio = NULL;
+
+  if (start >= bc->nr_pages)
+    return;
+  count = min(count, bc->nr_pages - start);
+
+  mtx_lock(&bc->pages->lock);
+  for (uint64_t idx = start; idx < start + count; idx++) {
+    page_t *page = pgcache_lookup(bc->pages, pgidx_to_off(idx));
+    if (page != NULL && !(page->flags & PG_ERROR)) {
+      // already cached or in flight, end the current bio here
+      pg_putref(&page);
+      if (bio != NULL) {
+        blk_submit_bio(bio);
+        bio = NULL;
+      }
+      continue;
+    }
+
+    if (page != NULL) {
+      // replace a page whose read failed
+      pg_putref(&page);
+      page = blk_cache_remove(bc, idx, false);
+      pg_putref(&page);
+    }
+
+    if ((page = alloc_pages(1)) == NULL) {
+      break;
+    }
+
+    mtx_spin_lock(&bc->lock);
+    bool full = bc->count >= bc->max_count;
+    mtx_spin_unlock(&bc->lock);
+    if (full) {
+      blk_cache_shrink(bc);
+    }
+
+    // the page is not visible until it is inserted so its flags are set first
+    page->flags |= PG_BUSY;
+    if (idx >= ra_from) {
+      page->flags |= PG_READAHEAD;
+    }
+    pgcache_insert(bc->pages, pgidx_to_off(idx), pg_getref(page), NULL);
+
+    uint64_t victim;
+    mtx_spin_lock(&bc->lock);
+    bc->count++;
+    if (idx >= ra_from) {
+      bc->ra_pages++;
+    }
+    bool dropped = clock_push(bc, idx, &victim);
+    mtx_spin_unlock(&bc->lock);
+
+    if (dropped) {
+      // the clock is full of stale indices, evict the oldest page so the
+      // cache does not grow past what the clock can track
+      page_t *evicted = blk_cache_remove(bc, victim, true);
+      pg_putref(&evicted);
+    }
+
+    if (bio != NULL && bio->vcnt == BIO_MAX_VECS) {
+      blk_submit_bio(bio);
+      bio = NULL;
+    }
+    if (bio == NULL) {
+      bio = bio_alloc(bdev, BIO_READ, idx << (PAGE_SHIFT - SECTOR_SHIFT));
+      bio->end_io = blk_cache_end_io;
+      bio->private = bc;
+    }
+
+    // the last page of the device may be partial
+    uint32_t len = (uint32_t) min(PAGE_SIZE, dev_size - pgidx_to_off(idx));
+    bio_add_page(bio, moveref(page), len);
+  }
+  mtx_unlock(&bc->pages->lock);
+
+  if (bio != NULL) {
+    blk_submit_bio(bio);
+  }
+}
+
+static int blk_cache_wait(struct blk_cache *bc, page_t *page) {
+  mtx_spin_lock(&bc->lock);
+  while (page->flags & PG_BUSY) {
+    cond_wait(&bc->cond, &bc->lock);
+  }
+  int res = (page->flags & PG_ERROR) ? -EIO : 0;
+  mtx_spin_unlock(&bc->lock);
+  return res;
+}
+
+//
+// MARK: Readahead
+//
+
+// returns a reference to the cached page at `idx`, submitting the read for it
+// and any readahead on a miss. the page may still be busy.
+static page_t *blk_cache_getpage(struct blk_cache *bc, struct file_ra *ra, uint64_t idx, uint64_t last, bool seq) {
+  mtx_lock(&bc->pages->lock);
+  page_t *page = pgcache_lookup(bc->pages, pgidx_to_off(idx));
+  mtx_unlock(&bc->pages->lock);
+
+  mtx_spin_lock(&bc->lock);
+  if (page != NULL && (page->flags & PG_ERROR)) {
+    pg_putref(&page); // read it again
+  }
+  if (page != NULL) {
+    if (page->flags & PG_READAHEAD) {
+      page->flags &= ~PG_READAHEAD;
+      bc->ra_hits++;
+    } else {
+      bc->hits++;
+    }
+    page->flags |= PG_REFERENCED;
+    mtx_spin_unlock(&bc->lock);
+
+    if (seq && ra->size > 0 && idx == ra->start + ra->size - ra->async_size) {
+      // the reader reached the async mark, read the next window while
+      // it is still consuming this one
+      ra->start += ra->size;
+      ra->size = min(ra->size * 2, BLK_RA_MAX_PAGES);
+      ra->async_size = ra->size;
+      blk_cache_readpages(bc, ra->start, ra->size, ra->start);
+    }
+    return page;
+  }
+  bc->misses++;
+  mtx_spin_unlock(&bc->lock);
+
+  size_t count = last - idx + 1;
+  if (seq) {
+    // sequential miss, start a new window here. the window grows while the
+    // reader stays sequential and is reset by the first random access.
+    size_t size = ra->size > 0 ? ra->size * 2 : max(count * 2, BLK_RA_MIN_PAGES);
+    size = max(min(size, BLK_RA_MAX_PAGES), count);
+    ra->start = idx;
+    ra->size = size;
+    ra->async_size = size - count;
+    blk_cache_readpages(bc, idx, size, idx + count);
+  } else {
+    blk_cache_readpages(bc, idx, count, UINT64_MAX);
+  }
+
+  mtx_lock(&bc->pages->lock);
+  page = pgcache_lookup(bc->pages, pgidx_to_off(idx));
+  mtx_unlock(&bc->pages->lock);
+  return page;
+}
+
+//
+// MARK: Public API
+//
+
+void blk_cache_init(blkdev_t *bdev) {
+  ASSERT(bdev->cache == NULL);
+  uint64_t size = bdev->nr_sectors << SECTOR_SHIFT;
+
+  struct blk_cache *bc = kmallocz(sizeof(struct blk_cache));
+  bc->bdev = bdev;
+  mtx_init(&bc->lock, MTX_SPIN, "blk_cache_lock");
+  cond_init(&bc->cond, "blk_cache");
+  bc->nr_pages = SIZE_TO_PAGES(size);
+  bc->pages = pgcache_alloc(pgcache_size_to_order(max(page_align(size), PAGE_SIZE), PAGE_SIZE), PAGE_SIZE);
+  bc->max_count = max(min(BLK_CACHE_MAX_PAGES, bc->nr_pages), 1);
+
+  // leave room for stale entries of invalidated pages
+  bc->clock_size = bc->max_count * 2;
+  bc->clock = kmalloc(sizeof(uint32_t) * bc->clock_size);
+
+  mtx_spin_lock(&blk_caches_lock);
+  LIST_ADD(&blk_caches, bc, list);
+  mtx_spin_unlock(&blk_caches_lock);
+  bdev->cache = bc;
+}
+
+void blk_cache_destroy(blkdev_t *bdev) {
+  // the device must not have any i/o in flight
+  struct blk_cache *bc = moveptr(bdev->cache);
+  if (bc == NULL)
+    return;
+
+  mtx_spin_lock(&blk_caches_lock);
+  LIST_REMOVE(&blk_caches, bc, list);
+  mtx_spin_unlock(&blk_caches_lock);
+
+  pgcache_free(&bc->pages);
+  kfree(bc->clock);
+  cond_destroy(&bc->cond);
+  mtx_destroy(&bc->lock);
+  kfree(bc);
+}
+
+// copies len bytes of the page at pgoff straight into the kio
+static size_t blk_cache_copy_page(page_t *page, size_t pgoff, size_t len, kio_t *kio) {
+  size_t size = kio->size;
+  kio->size = min(size, kio_transfered(kio) + len);
+  size_t n = rw_unmapped_page(page, pgoff, kio);
+  kio->size = size;
+  return n;
+}
+
+ssize_t blk_cache_read(blkdev_t *bdev, struct file_ra *ra, uint64_t off, size_t nmax, kio_t *kio) {
+  struct blk_cache *bc = bdev->cache;
+  uint64_t size = bdev->nr_sectors << SECTOR_SHIFT;
+  if (off >= size)
+    return 0;
+
+  size_t len = kio_remaining(kio);
+  if (nmax > 0 && len > nmax)
+    len = nmax;
+  len = min(len, size - off);
+  if (len == 0)
+    return 0;
+
+  uint64_t first = off >> PAGE_SHIFT;
+  uint64_t last = (off + len - 1) >> PAGE_SHIFT;
+  bool seq = false;
+  if (ra != NULL) {
+    seq = first == ra->prev_page || first == ra->prev_page + 1;
+    if (!seq) {
+      // random access collapses the window
+      ra->size = 0;
+      ra->async_size = 0;
+    }
+  }
+
+  struct blk_plug plug;
+  blk_start_plug(&plug);
+
+  size_t total = 0;
+  int res = 0;
+  for (uint64_t idx = first; idx <= last; idx++) {
+    page_t *page = blk_cache_getpage(bc, ra, idx, last, seq);
+    if (page == NULL) {
+      res = -ENOMEM;
+      break;
+    }
+
+    // send everything queued so far before waiting on the page
+    blk_flush_plug(&plug);
+    if ((res = blk_cache_wait(bc, page)) == 0) {
+      size_t pgoff = (idx == first) ? (off & (PAGE_SIZE - 1)) : 0;
+      size_t n = min(PAGE_SIZE - pgoff, len - total);
+      total += blk_cache_copy_page(page, pgoff, n, kio);
+    }
+    pg_putref(&page);
+    if (res < 0)
+      break;
+  }
+
+  blk_finish_plug(&plug);
+
+  if (ra != NULL && total > 0) {
+    ra->prev_page = (off + total - 1) >> PAGE_SHIFT;
+  }
+  if (total == 0 && res < 0)
+    return res;
+  return (ssize_t) total;
+}
+
+void blk_cache_invalidate(blkdev_t *bdev, uint64_t off, size_t len) {
+  struct blk_cache *bc = bdev->cache;
+  if (bc == NULL || len == 0)
+    return;
+
+  uint64_t first = off >> PAGE_SHIFT;
+  uint64_t last = (off + len - 1) >> PAGE_SHIFT;
+  for (uint64_t idx = first; idx <= last && idx < bc->nr_pages; idx++) {
+    mtx_lock(&bc->pages->lock);
+    page_t *page = blk_cache_remove(bc, idx, false);
+    mtx_unlock(&bc->pages->lock);
+    pg_putref(&page);
+  }
+}
+
+//
+// MARK: procfs
+//
+
+static int blk_cache_stats_show(seqfile_t *sf, void *_) {
+  mtx_spin_lock(&blk_caches_lock);
+  LIST_FOR_IN(bc, &blk_caches, list) {
+    uint64_t lookups = bc->hits + bc->ra_hits + bc->misses;
+    uint64_t hit_pct = lookups ? ((bc->hits + bc->ra_hits) * 100) / lookups : 0;
+    seq_printf(sf, "%-8s  pages=%zu/%zu  hits=%llu  misses=%llu  hit%%=%llu  ra_pages=%llu  ra_hits=%llu  evictions=%llu\n",
+      str_cptr(bc->bdev->name), bc->count, bc->max_count, bc->hits, bc->misses, hit_pct,
+      bc->ra_pages, bc->ra_hits, bc->evictions);
+  }
+  mtx_spin_unlock(&blk_caches_lock);
+  return 0;
+}
+PROCFS_REGISTER_SIMPLE(blkcache, "/blkcache", blk_cache_stats_show, NULL, 0444);
@@ -0,0 +1,604 @@
+//
+// Created by Aaron Gill-Braun on 2026-10-18.
+//
+
+#include <kernel/blkdev.h>
+#include <kernel/device.h>
+#include <kernel/cond.h>
+#include <kernel/mm.h>
+#include <kernel/mm/pool.h>
+#include <kernel/proc.h>
+#include <kernel/kio.h>
+#include <kernel/vfs_types.h>
+#include <kernel/vfs/file.h>
+#include <kernel/vfs/vnode.h>
+
+#include <kernel/panic.h>
+#include <kernel/printf.h>
+
+#define ASSERT(x) kassert(x)
+#define LOG_TAG blkdev
+#include <kernel/log.h>
+#define EPRINTF(fmt, ...) kprintf("blkdev: %s: " fmt, __func__, ##__VA_ARGS__)
+
+#define BLK_PLUG_MAX      32          // requests held by a plug before it is flushed
+#define BLK_XFER_MAX      (64 * SIZE_1KB)  // bounce buffer size for device file i/o
+
+#define BLK_DEFAULT_MAX_SECTORS 256
+
+static pool_t *bio_pool;
+static pool_t *request_pool;
+
+static void blkdev_static_init() {
+  bio_pool = pool_create("bio", pool_sizes(sizeof(bio_t)), 0);
+  request_pool = pool_create("request", pool_sizes(sizeof(request_t)), 0);
+}
+STATIC_INIT(blkdev_static_init);
+
+static inline uint64_t bio_end_sector(bio_t *bio) {
+  return bio->sector + (bio->size >> SECTOR_SHIFT);
+}
+
+static inline blk_hw_queue_t *blk_map_queue(blkdev_t *bdev) {
+  return &bdev->hw_queues[curcpu_id % bdev->nr_hw_queues];
+}
+
+static request_t *blk_alloc_request(bio_t *bio) {
+  request_t *rq = pool_alloc(request_pool, sizeof(request_t));
+  memset(rq, 0, sizeof(request_t));
+  rq->op = bio->op;
+  rq->sector = bio->sector;
+  rq->nr_bytes = bio->size;
+  rq->nr_segs = bio->vcnt;
+  rq->bdev = bio->bdev;
+  rq->bio = bio;
+  rq->biotail = bio;
+  return rq;
+}
+
+static bool blk_try_merge(request_t *rq, bio_t *bio) {
+  // merges the bio into the request if it extends it at either end
+  blkdev_t *bdev = rq->bdev;
+  if (rq->bdev != bio->bdev || rq->op != bio->op || bio->op == BIO_FLUSH)
+    return false;
+  if (((rq->nr_bytes + bio->size) >> SECTOR_SHIFT) > bdev->limits.max_sectors)
+    return false;
+  if (rq->nr_segs + bio->vcnt > bdev->limits.max_segments)
+    return false;
+
+  if (rq->sector + (rq->nr_bytes >> SECTOR_SHIFT) == bio->sector) {
+    // back merge
+    rq->biotail->next = bio;
+    rq->biotail = bio;
+  } else if (bio_end_sector(bio) == rq->sector) {
+    // front merge
+    bio->next = rq->bio;
+    rq->bio = bio;
+    rq->sector = bio->sector;
+  } else {
+    return false;
+  }
+
+  rq->nr_bytes += bio->size;
+  rq->nr_segs += bio->vcnt;
+  atomic_fetch_add(&bdev->merges, 1);
+  return true;
+}
+
+//
+// MARK: Bios
+//
+
+bio_t *bio_alloc(blkdev_t *bdev, int op, uint64_t sector) {
+  bio_t *bio = pool_alloc(bio_pool, sizeof(bio_t));
+  memset(bio, 0, sizeof(bio_t));
+  bio->op = op;
+  bio->sector = sector;
+  bio->bdev = bdev;
+  return bio;
+}
+
+void bio_free(bio_t *bio) {
+  if (bio == NULL)
+    return;
+  pool_free(bio_pool, bio);
+}
+
+size_t bio_add_buf(bio_t *bio, void *buf, size_t len) {
+  // adds a kernel buffer to the bio and returns the number of bytes added.
+  // the buffer is split into physically contiguous pieces.
+  uintptr_t ptr = (uintptr_t) buf;
+  size_t added = 0;
+  while (added < len) {
+    size_t chunk = min(len - added, PAGE_SIZE - (ptr & (PAGE_SIZE - 1)));
+    uint64_t phys = virt_to_phys(ptr);
+
+    struct bio_vec *last = bio->vcnt > 0 ? &bio->vecs[bio->vcnt - 1] : NULL;
+    if (last && last->phys + last->len == phys && (uintptr_t) last->base + last->len == ptr) {
+      last->len += chunk;
+    } else if (bio->vcnt < BIO_MAX_VECS) {
+      bio->vecs[bio->vcnt++] = (struct bio_vec) {
+        .base = (void *) ptr,
+        .phys = phys,
+        .len = chunk,
+      };
+    } else {
+      break;
+    }
+
+    ptr += chunk;
+    added += chunk;
+  }
+
+  bio->size += added;
+  return added;
+}
+
+bool bio_add_page(bio_t *bio, __move page_t *page, uint32_t len) {
+  // the bio takes over the page reference, it is released by the end_io
+  // callback through bio->vecs[i].page
+  if (bio->vcnt >= BIO_MAX_VECS)
+    return false;
+
+  bio->vecs[bio->vcnt++] = (struct bio_vec) {
+    .page = page,
+    .base = NULL,
+    .phys = page->address,
+    .len = len,
+  };
+  bio->size += len;
+  return true;
+}
+
+void bio_endio(bio_t *bio, int status) {
+  bio->status = status;
+  if (bio->end_io) {
+    bio->end_io(bio);
+  }
+}
+
+//
+// MARK: Block Devices
+//
+
+blkdev_t *blkdev_alloc(const char *name, struct blk_queue_ops *ops, uint16_t nr_hw_queues, void *data) {
+  ASSERT(ops != NULL && ops->queue_rq != NULL);
+  ASSERT(nr_hw_queues > 0);
+
+  blkdev_t *bdev = kmallocz(sizeof(blkdev_t));
+  bdev->name = str_from(name);
+  bdev->ops = ops;
+  bdev->data = data;
+  bdev->limits.max_sectors = BLK_DEFAULT_MAX_SECTORS;
+  bdev->limits.max_segments = BIO_MAX_VECS;
+
+  bdev->nr_hw_queues = nr_hw_queues;
+  bdev->hw_queues = kmallocz(sizeof(blk_hw_queue_t) * nr_hw_queues);
+  for (uint16_t i = 0; i < nr_hw_queues; i++) {
+    blk_hw_queue_t *hctx = &bdev->hw_queues[i];
+    hctx->bdev = bdev;
+    hctx->index = i;
+    mtx_init(&hctx->lock, MTX_SPIN, "blk_hw_queue_lock");
+    LIST_INIT(&hctx->dispatch);
+  }
+  return bdev;
+}
+
+void blkdev_free(blkdev_t *bdev) {
+  if (bdev->cache != NULL) {
+    blk_cache_destroy(bdev);
+  }
+  for (uint16_t i = 0; i < bdev->nr_hw_queues; i++) {
+    ASSERT(LIST_FIRST(&bdev->hw_queues[i].dispatch) == NULL);
+    mtx_destroy(&bdev->hw_queues[i].lock);
+  }
+  str_free(&bdev->name);
+  kfree(bdev->hw_queues);
+  kfree(bdev);
+}
+
+//
+// MARK: Request Queue
+//
+
+void blk_submit_bio(bio_t *bio) {
+  blkdev_t *bdev = bio->bdev;
+  ASSERT(bdev != NULL);
+  bio->next = NULL;
+
+  if (bio->op != BIO_FLUSH) {
+    if ((bio->size & (SECTOR_SIZE - 1)) != 0 || bio->size == 0 || bio_end_sector(bio) > bdev->nr_sectors) {
+      bio_endio(bio, -EINVAL);
+      return;
+    }
+    if (bio->op == BIO_WRITE && bdev->readonly) {
+      bio_endio(bio, -EROFS);
+      return;
+    }
+  }
+
+  struct blk_plug *plug = curthread->plug;
+  if (plug != NULL) {
+    // hold the bio back until the plug is flushed
+    LIST_FOR_IN(rq, &plug->requests, list) {
+      if (blk_try_merge(rq, bio))
+        return;
+    }
+
+    LIST_ADD(&plug->requests, blk_alloc_request(bio), list);
+    if (++plug->count >= BLK_PLUG_MAX)
+      blk_flush_plug(plug);
+    return;
+  }
+
+  request_t *rq = blk_alloc_request(bio);
+  blk_hw_queue_t *hctx = blk_map_queue(bdev);
+  mtx_spin_lock(&hctx->lock);
+  // requests still on the dispatch list have not been given to the
+  // hardware and can be extended
+  request_t *last = LIST_LAST(&hctx->dispatch);
+  if (last != NULL && blk_try_merge(last, bio)) {
+    mtx_spin_unlock(&hctx->lock);
+    pool_free(request_pool, rq);
+    return;
+  }
+  LIST_ADD(&hctx->dispatch, rq, list);
+  bool stopped = hctx->stopped;
+  mtx_spin_unlock(&hctx->lock);
+
+  if (!stopped)
+    blk_run_hw_queue(hctx);
+}
+
+struct bio_waiter {
+  mtx_t lock;
+  cond_t cond;
+  bool done;
+};
+
+static void bio_wait_end_io(bio_t *bio) {
+  struct bio_waiter *waiter = bio->private;
+  mtx_spin_lock(&waiter->lock);
+  waiter->done = true;
+  cond_signal(&waiter->cond);
+  mtx_spin_unlock(&waiter->lock);
+}
+
+int blk_submit_bio_wait(bio_t *bio) {
+  struct bio_waiter waiter = {0};
+  mtx_init(&waiter.lock, MTX_SPIN, "bio_wait_lock");
+  cond_init(&waiter.cond, "bio_wait");
+
+  bio->end_io = bio_wait_end_io;
+  bio->private = &waiter;
+  blk_submit_bio(bio);
+
+  // never sleep on i/o that is still sitting in our own plug
+  if (curthread->plug != NULL)
+    blk_flush_plug(curthread->plug);
+
+  mtx_spin_lock(&waiter.lock);
+  while (!waiter.done) {
+    cond_wait(&waiter.cond, &waiter.lock);
+  }
+  mtx_spin_unlock(&waiter.lock);
+
+  cond_destroy(&waiter.cond);
+  mtx_destroy(&waiter.lock);
+  return bio->status;
+}
+
+void blk_start_plug(struct blk_plug *plug) {
+  LIST_INIT(&plug->requests);
+  plug->count = 0;
+  if (curthread->plug == NULL) {
+    // only the outermost plug is used
+    curthread->plug = plug;
+  }
+}
+
+void blk_finish_plug(struct blk_plug *plug) {
+  blk_flush_plug(plug);
+  if (curthread->plug == plug) {
+    curthread->plug = NULL;
+  }
+}
+
+void blk_flush_plug(struct blk_plug *plug) {
+  blk_hw_queue_t *touched[BLK_PLUG_MAX];
+  size_t ntouched = 0;
+
+  request_t *rq;
+  while ((rq = LIST_FIRST(&plug->requests)) != NULL) {
+    LIST_REMOVE(&plug->requests, rq, list);
+    blk_hw_queue_t *hctx = blk_map_queue(rq->bdev);
+    mtx_spin_lock(&hctx->lock);
+    LIST_ADD(&hctx->dispatch, rq, list);
+    mtx_spin_unlock(&hctx->lock);
+
+    size_t i;
+    for (i = 0; i < ntouched; i++) {
+      if (touched[i] == hctx)
+        break;
+    }
+    if (i == ntouched && ntouched < BLK_PLUG_MAX)
+      touched[ntouched++] = hctx;
+  }
+  plug->count = 0;
+
+  // kick each hardware queue once for the whole batch
+  for (size_t i = 0; i < ntouched; i++) {
+    blk_run_hw_queue(touched[i]);
+  }
+}
+
+void blk_run_hw_queue(blk_hw_queue_t *hctx) {
+  // issues as many pending requests to the hardware as it will take
+  blkdev_t *bdev = hctx->bdev;
+  LIST_HEAD(request_t) failed = LIST_HEAD_INITR;
+  size_t queued = 0;
+  request_t *rq;
+
+  mtx_spin_lock(&hctx->lock);
+  hctx->stopped = false;
+  while ((rq = LIST_FIRST(&hctx->dispatch)) != NULL) {
+    LIST_REMOVE(&hctx->dispatch, rq, list);
+    rq->hctx = hctx;
+
+    int res = bdev->ops->queue_rq(hctx, rq);
+    if (res == -EBUSY) {
+      // out of hardware slots, the next completion restarts the queue
+      LIST_ADD_FRONT(&hctx->dispatch, rq, list);
+      hctx->stopped = true;
+      break;
+    } else if (res < 0) {
+      rq->status = res;
+      LIST_ADD(&failed, rq, list);
+      continue;
+    }
+
+    hctx->dispatched++;
+    queued++;
+  }
+
+  if (queued > 0 && bdev->ops->commit_rqs) {
+    bdev->ops->commit_rqs(hctx);
+  }
+  mtx_spin_unlock(&hctx->lock);
+
+  while ((rq = LIST_FIRST(&failed)) != NULL) {
+    LIST_REMOVE(&failed, rq, list);
+    blk_complete_request(rq, rq->status);
+  }
+}
+
+void blk_complete_request(request_t *rq, int status) {
+  // may be called from interrupt context. drivers should call this without
+  // holding the hardware queue lock and then restart the queue with
+  // blk_run_hw_queue if it was stopped.
+  if (rq->hctx != NULL) {
+    atomic_fetch_add(&rq->hctx->completed, 1);
+  }
+
+  bio_t *bio = rq->bio;
+  while (bio != NULL) {
+    bio_t *next = bio->next;
+    bio->next = NULL;
+    bio_endio(bio, status);
+    bio = next;
+  }
+  pool_free(request_pool, rq);
+}
+
+//
+// MARK: Synchronous I/O
+//
+
+static int blkdev_xfer(blkdev_t *bdev, int op, uint64_t sector, void *buf, size_t len) {
+  bio_t *bio = bio_alloc(bdev, op, sector);
+  if (bio_add_buf(bio, buf, len) != len) {
+    bio_free(bio);
+    return -EINVAL;
+  }
+
+  int res = blk_submit_bio_wait(bio);
+  bio_free(bio);
+  return res;
+}
+
+static ssize_t blkdev_kio_read(blkdev_t *bdev, uint64_t off, size_t nmax, kio_t *kio) {
+  uint64_t size = bdev->nr_sectors << SECTOR_SHIFT;
+  if (off >= size)
+    return 0;
+
+  size_t len = kio_remaining(kio);
+  if (nmax > 0 && len > nmax)
+    len = nmax;
+  len = min(len, size - off);
+
+  void *buf = kmalloc(BLK_XFER_MAX);
+  size_t total = 0;
+  int res = 0;
+  while (total < len) {
+    uint64_t pos = off + total;
+    uint64_t start = align_down(pos, SECTOR_SIZE);
+    size_t skip = pos - start;
+    size_t n = min(len - total, BLK_XFER_MAX - skip);
+    size_t xfer = align(skip + n, SECTOR_SIZE);
+
+    if ((res = blkdev_xfer(bdev, BIO_READ, start >> SECTOR_SHIFT, buf, xfer)) < 0)
+      break;
+    total += kio_nwrite_in(kio, buf, xfer, skip, n);
+  }
+
+  kfree(buf);
+  if (total == 0 && res < 0)
+    return res;
+  return (ssize_t) total;
+}
+
+static ssize_t blkdev_kio_write(blkdev_t *bdev, uint64_t off, size_t nmax, kio_t *kio) {
+  uint64_t size = bdev->nr_sectors << SECTOR_SHIFT;
+  if (bdev->readonly)
+    return -EROFS;
+  if (off >= size)
+    return 0;
+
+  size_t len = kio_remaining(kio);
+  if (nmax > 0 && len > nmax)
+    len = nmax;
+  len = min(len, size - off);
+
+  void *buf = kmalloc(BLK_XFER_MAX);
+  size_t total = 0;
+  int res = 0;
+  while (total < len) {
+    uint64_t pos = off + total;
+    uint64_t start = align_down(pos, SECTOR_SIZE);
+    size_t skip = pos - start;
+    size_t n = min(len - total, BLK_XFER_MAX - skip);
+    size_t xfer = align(skip + n, SECTOR_SIZE);
+    uint64_t sector = start >> SECTOR_SHIFT;
+
+    // read back partially overwritten sectors at either end
+    if (skip != 0) {
+      if ((res = blkdev_xfer(bdev, BIO_READ, sector, buf, SECTOR_SIZE)) < 0)
+        break;
+    }
+    if (((skip + n) & (SECTOR_SIZE - 1)) != 0 && (skip == 0 || xfer > SECTOR_SIZE)) {
+      void *tail = offset_ptr(buf, xfer - SECTOR_SIZE);
+      if ((res = blkdev_xfer(bdev, BIO_READ, sector + (xfer >> SECTOR_SHIFT) - 1, tail, SECTOR_SIZE)) < 0)
+        break;
+    }
+
+    size_t count = kio_nread_out(buf, xfer, skip, n, kio);
+    res = blkdev_xfer(bdev, BIO_WRITE, sector, buf, xfer);
+    // writes go straight to the device so drop any cached copy
+    blk_cache_invalidate(bdev, start, xfer);
+    if (res < 0)
+      break;
+    total += count;
+  }
+
+  kfree(buf);
+  if (total == 0 && res < 0)
+    return res;
+  return (ssize_t) total;
+}
+
+ssize_t blkdev_read(blkdev_t *bdev, uint64_t off, void *buf, size_t len) {
+  kio_t kio = kio_new_writable(buf, len);
+  if (bdev->cache != NULL)
+    return blk_cache_read(bdev, NULL, off, 0, &kio);
+  return blkdev_kio_read(bdev, off, 0, &kio);
+}
+
+ssize_t blkdev_write(blkdev_t *bdev, uint64_t off, const void *buf, size_t len) {
+  kio_t kio = kio_new_readable(buf, len);
+  return blkdev_kio_write(bdev, off, 0, &kio);
+}
+
+//
+// MARK: Device API
+//
+
+static ssize_t blkdev_d_read(device_t *dev, size_t off, size_t nmax, kio_t *kio) {
+  blkdev_t *bdev = dev->data;
+  return blk_cache_read(bdev, NULL, off, nmax, kio);
+}
+
+static ssize_t blkdev_d_write(device_t *dev, size_t off, size_t nmax, kio_t *kio) {
+  blkdev_t *bdev = dev->data;
+  return blkdev_kio_write(bdev, off, nmax, kio);
+}
+
+static struct device_ops blkdev_ops = {
+  .d_read = blkdev_d_read,
+  .d_write = blkdev_d_write,
+};
+
+//
+// MARK: Device File API
+//
+
+static ssize_t blkdev_f_read(file_t *file, kio_t *kio) {
+  f_lock_assert(file, LA_OWNED);
+  vnode_t *vn = file->data;
+  blkdev_t *bdev = vn->v_dev->data;
+
+  // reads go through the page cache using the readahead state of this file.
+  // the file lock is held so the state is not shared with concurrent readers.
+  ssize_t res = blk_cache_read(bdev, &file->ra, file->offset, 0, kio);
+  if (res > 0) {
+    file->offset += res;
+  }
+  return res;
+}
+
+static ssize_t blkdev_f_write(file_t *file, kio_t *kio) {
+  f_lock_assert(file, LA_OWNED);
+  vnode_t *vn = file->data;
+  blkdev_t *bdev = vn->v_dev->data;
+
+  ssize_t res = blkdev_kio_write(bdev, file->offset, 0, kio);
+  if (res > 0) {
+    file->offset += res;
+  }
+  return res;
+}
+
+static off_t blkdev_f_lseek(file_t *file, off_t offset, int whence) {
+  f_lock_assert(file, LA_OWNED);
+  vnode_t *vn = file->data;
+  blkdev_t *bdev = vn->v_dev->data;
+
+  off_t newoff;
+  switch (whence) {
+    case SEEK_SET:
+      newoff = offset;
+      break;
+    case SEEK_CUR:
+      newoff = file->offset + offset;
+      break;
+    case SEEK_END:
+      newoff = (off_t)(bdev->nr_sectors << SECTOR_SHIFT) + offset;
+      break;
+    default:
+      return -EINVAL;
+  }
+
+  if (newoff < 0) {
+    return -EINVAL;
+  }
+  file->offset = newoff;
+  return newoff;
+}
+
+static struct file_ops blkdev_file_ops = {
+  .f_open = dev_f_open,
+  .f_close = dev_f_close,
+  .f_read = blkdev_f_read,
+  .f_write = blkdev_f_write,
+  .f_lseek = blkdev_f_lseek,
+  .f_stat = dev_f_stat,
+  .f_ioctl = dev_f_ioctl,
+  .f_kqevent = dev_f_kqevent,
+  .f_cleanup = dev_f_cleanup,
+};
+
+int blkdev_register(blkdev_t *bdev, const char *dev_type) {
+  blk_cache_init(bdev);
+  device_t *dev = alloc_device(bdev, &blkdev_ops, &blkdev_file_ops);
+  int res;
+  if ((res = register_dev(dev_type, dev)) < 0) {
+    EPRINTF("failed to register {:str}: {:err}\n", &bdev->name, res);
+    free_device(dev);
+    blk_cache_destroy(bdev);
+    return res;
+  }
+
+  bdev->device = dev;
+  kprintf("blkdev: registered {:str} (%llu sectors, %u queues)\n",
+          &bdev->name, bdev->nr_sectors, bdev->nr_hw_queues);
+  return 0;
+}
@@ -48,6 +48,7 @@
 #define NUM_INTERRUPTS 256
 
 uint8_t cpu_bsp_id = 0;
+uint64_t cpu_tsc_khz = 0;
 uint32_t cpu_to_apic_id[MAX_CPUS];
 struct percpu *percpu_areas[MAX_CPUS];
 struct cpu_info cpu0_info;
@@ -215,6 +216,7 @@ void cpu_early_init() {
 
     uint64_t cpu_ticks_per_sec = cycles * (MS_PER_SEC / ms);
     uint64_t cpu_clock_khz = cpu_ticks_per_sec / 1000;
+    cpu_tsc_khz = cpu_clock_khz;
     kprintf("detected %ld.%03d MHz processor\n", cpu_clock_khz / 1000, cpu_clock_khz % 1000);
   }
 
@@ -4,6 +4,7 @@
 
 #include <kernel/debug/debug.h>
 #include <kernel/debug/dwarf.h>
+#include <kernel/debug/ksyms.h>
 #include <kernel/mm.h>
 
 #include <kernel/queue.h>
@@ -169,7 +170,8 @@ void debug_init() {
 
 const char *debug_function_name(uintptr_t addr) {
   if (!has_debug_info) {
-    return NULL;
+    // fall back to the builtin symbol table
+    return ksym_lookup(addr, NULL);
   }
 
   dwarf_function_t *func = locate_or_load_dwarf_function(addr);
@@ -213,7 +215,11 @@ int debug_unwind(uintptr_t rip, uintptr_t rbp) {
   uint64_t prev_rbp = 0;
   while (is_kernel_code_ptr((uintptr_t) frame->rip) && depth++ < MAX_DEPTH) {
     dwarf_function_t *func = locate_or_load_dwarf_function(rip);
-    if (func == NULL) {
+    const char *name;
+    size_t off;
+    if (func == NULL && (name = ksym_lookup(rip, &off)) != NULL) {
+      kprintf_raw("    %s+%#zx %018p\n", name, off, rip);
+    } else if (func == NULL) {
       kprintf_raw("    ?? %018p\n", rip);
     } else if (func->file == NULL) {
       kprintf_raw("    %s %018p\n", func->name, rip);
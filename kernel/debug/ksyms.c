@@ -0,0 +1,52 @@
+//
+// Created by Aaron Gill-Braun on 2026-10-18.
+//
+
+#include <kernel/debug/ksyms.h>
+
+// generated by scripts/gen_syms.py. these are weak so that the first link of
+// the kernel (which the table is generated from) succeeds without them.
+extern const uint32_t __ksym_count _weak;
+extern const struct ksym __ksym_table[] _weak;
+extern const char __ksym_names[] _weak;
+
+const char *ksym_lookup(uintptr_t addr, size_t *out_off) {
+  if (&__ksym_count == NULL || __ksym_count == 0) {
+    return NULL;
+  }
+
+  uintptr_t base = (uintptr_t) &__kernel_code_start;
+  if (addr < base || addr >= (uintptr_t) &__kernel_code_end) {
+    return NULL;
+  }
+
+  // find the last symbol at or below the address
+  uint32_t off = (uint32_t)(addr - base);
+  size_t lo = 0;
+  size_t hi = __ksym_count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (__ksym_table[mid].offset <= off) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  if (lo == 0) {
+    return NULL;
+  }
+
+  const struct ksym *sym = &__ksym_table[lo - 1];
+  if (out_off != NULL) {
+    *out_off = off - sym->offset;
+  }
+  return &__ksym_names[sym->name];
+}
+
+size_t ksym_count() {
+  if (&__ksym_count == NULL) {
+    return 0;
+  }
+  return __ksym_count;
+}
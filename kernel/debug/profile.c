@@ -0,0 +1,482 @@
+//
+// Created by Aaron Gill-Braun on 2026-10-18.
+//
+
+#include <kernel/debug/profile.h>
+#include <kernel/debug/ksyms.h>
+#include <kernel/debug/debug.h>
+#include <kernel/atomic.h>
+#include <kernel/irq.h>
+#include <kernel/mm.h>
+#include <kernel/params.h>
+#include <kernel/proc.h>
+#include <kernel/string.h>
+#include <kernel/hw/apic.h>
+#include <kernel/mm/pgtable.h>
+
+#include <kernel/panic.h>
+#include <kernel/printf.h>
+
+#include <fs/procfs/procfs.h>
+
+#include <sort.h>
+
+#define ASSERT(x) kassert(x)
+#define LOG_TAG profile
+#include <kernel/log.h>
+#define EPRINTF(fmt, ...) kprintf("profile: %s: " fmt, __func__, ##__VA_ARGS__)
+
+#define PROFILE_BUF_WORDS (PROFILE_BUF_SIZE / sizeof(uint64_t))
+
+// sample record header word
+#define SAMPLE_HDR(nkern, nuser) ((uint64_t)(nkern) | ((uint64_t)(nuser) << 8))
+#define SAMPLE_NKERN(hdr) ((uint32_t)((hdr) & 0xFF))
+#define SAMPLE_NUSER(hdr) ((uint32_t)(((hdr) >> 8) & 0xFF))
+
+/*
+ * A per-cpu sample buffer.
+ *
+ * Each sample is a header word followed by the kernel frames and then the user
+ * frames, both innermost first. The buffer is only written by the profiling
+ * interrupt on its own cpu, and head is published after the sample is written
+ * so readers can copy out [0, head) without any locking.
+ */
+struct profile_buf {
+  uint64_t *words;
+  volatile size_t head;           // words written
+  volatile uint64_t samples;      // samples recorded
+  volatile uint64_t dropped;      // samples lost because the buffer was full
+  uint32_t clear_generation;      // last clear applied to this buffer
+};
+
+static struct profile_buf profile_bufs[MAX_CPUS];
+static uint8_t profile_vector;
+static volatile uint32_t profile_hz;
+static volatile uint32_t profile_clear_generation;
+
+volatile uint32_t profile_generation;
+uint32_t profile_cpu_generation[MAX_CPUS];
+
+KERNEL_PARAM("profile", int, profile_hz_param, 0);
+
+static void profile_alloc_buf(uint32_t cpu) {
+  struct profile_buf *buf = &profile_bufs[cpu];
+  if (buf->words != NULL)
+    return;
+
+  uint64_t *words = vmalloc(PROFILE_BUF_SIZE, VM_RDWR);
+  if (words == NULL) {
+    EPRINTF("failed to allocate buffer for cpu %u\n", cpu);
+    return;
+  }
+
+  uint64_t *expected = NULL;
+  if (!__atomic_compare_exchange_n(&buf->words, &expected, words, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    vfree(words); // raced with another start
+  }
+}
+
+static inline bool kernel_frame_ok(thread_t *td, uintptr_t fp) {
+  // frames must be on the thread kernel stack or the cpu interrupt stack
+  uintptr_t irq_stack_top = curcpu_area->irq_stack_top;
+  if (!is_aligned(fp, sizeof(uint64_t)))
+    return false;
+  if (fp >= irq_stack_top - IRQ_STACK_SIZE && fp + sizeof(stackframe_t) <= irq_stack_top)
+    return true;
+  return td != NULL && fp >= td->kstack_base && fp + sizeof(stackframe_t) <= td->kstack_base + td->kstack_size;
+}
+
+static inline bool user_frame_ok(uintptr_t fp) {
+  if (fp == 0 || !is_aligned(fp, sizeof(uint64_t)) || fp + sizeof(stackframe_t) > USER_SPACE_END)
+    return false;
+  // the frame is read from interrupt context so it must already be mapped
+  return recursive_is_mapped(fp) && recursive_is_mapped(fp + sizeof(stackframe_t) - 1);
+}
+
+static size_t profile_walk_kernel(thread_t *td, uintptr_t rip, uintptr_t rbp, uintptr_t *pcs, size_t max) {
+  size_t n = 0;
+  pcs[n++] = rip;
+  while (n < max && kernel_frame_ok(td, rbp)) {
+    stackframe_t *frame = (void *) rbp;
+    if (!is_kernel_code_ptr(frame->rip))
+      break;
+    pcs[n++] = frame->rip;
+    if ((uintptr_t) frame->rbp <= rbp)
+      break; // callers are always higher on the stack
+    rbp = (uintptr_t) frame->rbp;
+  }
+  return n;
+}
+
+static size_t profile_walk_user(uintptr_t rip, uintptr_t rbp, uintptr_t *pcs, size_t max) {
+  size_t n = 0;
+  if (max == 0 || rip == 0 || rip >= USER_SPACE_END)
+    return 0;
+
+  pcs[n++] = rip;
+  while (n < max && user_frame_ok(rbp)) {
+    stackframe_t *frame = (void *) rbp;
+    if (frame->rip == 0 || frame->rip >= USER_SPACE_END)
+      break;
+    pcs[n++] = frame->rip;
+    if ((uintptr_t) frame->rbp <= rbp)
+      break;
+    rbp = (uintptr_t) frame->rbp;
+  }
+  return n;
+}
+
+static struct trapframe *profile_user_frame(thread_t *td, struct trapframe *frame) {
+  // the innermost trapframe with a user return address holds the user state
+  // of a thread that is in the kernel. frames of interrupts taken in the kernel
+  // are skipped.
+  if (td == NULL || TDF_IS_KTHREAD(td))
+    return NULL;
+
+  for (int i = 0; frame != NULL && i < 8; i++) {
+    if (!kernel_frame_ok(td, (uintptr_t) frame))
+      return NULL;
+    if (frame->rip != 0 && frame->rip < USER_SPACE_END)
+      return frame;
+    frame = frame->parent;
+  }
+  return NULL;
+}
+
+static void profile_irq_handler(struct trapframe *frame) {
+  uint32_t cpu = curcpu_id;
+  if (__expect_false(profile_cpu_generation[cpu] != profile_generation)) {
+    __profile_sync_cpu();
+    if (profile_hz == 0)
+      return;
+  }
+
+  struct profile_buf *buf = &profile_bufs[cpu];
+  if (buf->words == NULL)
+    return;
+
+  thread_t *td = curthread;
+  uintptr_t pcs[PROFILE_MAX_DEPTH];
+  size_t nkern = 0;
+  size_t nuser = 0;
+  struct trapframe *uframe;
+  if (frame->cs & 3) {
+    uframe = frame;
+  } else {
+    nkern = profile_walk_kernel(td, frame->rip, frame->rbp, pcs, PROFILE_MAX_DEPTH);
+    uframe = profile_user_frame(td, frame->parent);
+  }
+  if (uframe != NULL) {
+    nuser = profile_walk_user(uframe->rip, uframe->rbp, pcs + nkern, PROFILE_MAX_DEPTH - nkern);
+  }
+
+  size_t head = buf->head;
+  size_t n = 1 + nkern + nuser;
+  if (head + n > PROFILE_BUF_WORDS) {
+    buf->dropped++;
+    return;
+  }
+
+  buf->words[head] = SAMPLE_HDR(nkern, nuser);
+  memcpy(&buf->words[head + 1], pcs, (nkern + nuser) * sizeof(uintptr_t));
+  atomic_store_release(&buf->head, head + n);
+  buf->samples++;
+}
+
+//
+
+static void profile_static_init() {
+  int irq = irq_alloc_software_irqnum();
+  if (irq < 0) {
+    panic("profile: failed to allocate irq");
+  }
+  irq_register_handler(irq, profile_irq_handler, NULL);
+  irq_enable_interrupt(irq);
+  profile_vector = (uint8_t) irq_get_vector(irq);
+
+  if (profile_hz_param > 0) {
+    if (profile_start((uint32_t) profile_hz_param) < 0) {
+      kprintf("profile: invalid profile parameter %d\n", profile_hz_param);
+    }
+  }
+}
+STATIC_INIT(profile_static_init);
+
+static void profile_percpu_static_init() {
+  // cpus that come up after profiling was started allocate their own buffer
+  if (profile_hz != 0) {
+    profile_alloc_buf(curcpu_id);
+  }
+}
+PERCPU_STATIC_INIT(profile_percpu_static_init);
+
+//
+// MARK: Public API
+//
+
+void __profile_sync_cpu() {
+  uint32_t cpu = curcpu_id;
+  struct profile_buf *buf = &profile_bufs[cpu];
+
+  uint64_t flags;
+  temp_irq_save(flags);
+  uint32_t gen = atomic_load(&profile_generation);
+  profile_cpu_generation[cpu] = gen;
+
+  uint32_t clear_gen = atomic_load(&profile_clear_generation);
+  if (buf->clear_generation != clear_gen) {
+    buf->clear_generation = clear_gen;
+    buf->samples = 0;
+    buf->dropped = 0;
+    atomic_store_release(&buf->head, 0);
+  }
+
+  uint32_t hz = profile_hz;
+  if (hz == 0 || buf->words == NULL) {
+    apic_timer_stop();
+  } else {
+    apic_timer_start_periodic(profile_vector, hz);
+  }
+  temp_irq_restore(flags);
+}
+
+int profile_start(uint32_t hz) {
+  if (hz == 0 || hz > PROFILE_MAX_HZ)
+    return -EINVAL;
+
+  for (uint32_t cpu = 0; cpu < system_num_cpus; cpu++) {
+    profile_alloc_buf(cpu);
+  }
+  atomic_store(&profile_hz, hz);
+  atomic_fetch_add(&profile_generation, 1);
+
+  profile_sync_cpu();
+  return 0;
+}
+
+void profile_stop() {
+  atomic_store(&profile_hz, 0);
+  atomic_fetch_add(&profile_generation, 1);
+
+  profile_sync_cpu();
+}
+
+void profile_clear() {
+  atomic_fetch_add(&profile_clear_generation, 1);
+  atomic_fetch_add(&profile_generation, 1);
+
+  profile_sync_cpu();
+}
+
+//
+// MARK: procfs
+//
+
+struct profile_stack {
+  uint64_t count;                 // number of samples with this stack
+  uint32_t nkern;
+  uint32_t nuser;
+  uintptr_t *pcs;                 // kernel frames then user frames, innermost first
+};
+
+struct profile_snapshot {
+  uint64_t *words;                // copied sample records
+  size_t size;                    // allocation size of words
+  struct profile_stack *stacks;   // unique stacks
+  size_t count;
+};
+
+static int profile_stack_cmp(const void *a, const void *b) {
+  const struct profile_stack *sa = a;
+  const struct profile_stack *sb = b;
+  if (sa->nkern != sb->nkern)
+    return sa->nkern < sb->nkern ? -1 : 1;
+  if (sa->nuser != sb->nuser)
+    return sa->nuser < sb->nuser ? -1 : 1;
+  for (uint32_t i = 0; i < sa->nkern + sa->nuser; i++) {
+    if (sa->pcs[i] != sb->pcs[i])
+      return sa->pcs[i] < sb->pcs[i] ? -1 : 1;
+  }
+  return 0;
+}
+
+static struct profile_snapshot *profile_snapshot_take() {
+  struct profile_snapshot *snap = kmallocz(sizeof(struct profile_snapshot));
+  size_t heads[MAX_CPUS] = {0};
+  size_t total = 0;
+  for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+    struct profile_buf *buf = &profile_bufs[cpu];
+    if (buf->words != NULL) {
+      heads[cpu] = atomic_load(&buf->head);
+      total += heads[cpu];
+    }
+  }
+  if (total == 0)
+    return snap;
+
+  // copy out the buffers so sampling can continue while the profile is read
+  snap->size = page_align(total * sizeof(uint64_t));
+  snap->words = vmalloc(snap->size, VM_RDWR);
+  size_t n = 0;
+  for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+    if (heads[cpu] > 0) {
+      memcpy(&snap->words[n], profile_bufs[cpu].words, heads[cpu] * sizeof(uint64_t));
+      n += heads[cpu];
+    }
+  }
+
+  // a buffer may have been cleared while it was copied so records are checked
+  // against the copied length before they are used
+  size_t nsamples = 0;
+  for (size_t i = 0; i < n; nsamples++) {
+    uint64_t hdr = snap->words[i];
+    i += 1 + SAMPLE_NKERN(hdr) + SAMPLE_NUSER(hdr);
+  }
+
+  struct profile_stack *stacks = kmallocz(nsamples * sizeof(struct profile_stack));
+  size_t count = 0;
+  for (size_t i = 0; i < n;) {
+    uint64_t hdr = snap->words[i];
+    uint32_t nkern = SAMPLE_NKERN(hdr);
+    uint32_t nuser = SAMPLE_NUSER(hdr);
+    if (nkern + nuser > PROFILE_MAX_DEPTH || i + 1 + nkern + nuser > n)
+      break;
+
+    struct profile_stack *stack = &stacks[count++];
+    stack->count = 1;
+    stack->nkern = nkern;
+    stack->nuser = nuser;
+    stack->pcs = (uintptr_t *) &snap->words[i + 1];
+    for (uint32_t j = 0; j < nkern; j++) {
+      // samples in the same function are merged
+      size_t off;
+      if (ksym_lookup(stack->pcs[j], &off) != NULL)
+        stack->pcs[j] -= off;
+    }
+    i += 1 + nkern + nuser;
+  }
+
+  // sort and merge identical stacks
+  qsort(stacks, count, sizeof(struct profile_stack), profile_stack_cmp);
+  size_t unique = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (unique > 0 && profile_stack_cmp(&stacks[unique - 1], &stacks[i]) == 0) {
+      stacks[unique - 1].count++;
+    } else {
+      stacks[unique++] = stacks[i];
+    }
+  }
+
+  snap->stacks = stacks;
+  snap->count = unique;
+  return snap;
+}
+
+static void profile_snapshot_free(struct profile_snapshot *snap) {
+  if (snap->words != NULL)
+    vfree(snap->words);
+  kfree(snap->stacks);
+  kfree(snap);
+}
+
+static void *profile_seq_start(seqfile_t *sf, off_t *pos) {
+  struct profile_snapshot *snap = sf->private;
+  if (snap == NULL) {
+    snap = profile_snapshot_take();
+    sf->private = snap;
+  }
+
+  if ((size_t) *pos >= snap->count)
+    return NULL;
+  return &snap->stacks[*pos];
+}
+
+static void profile_seq_stop(seqfile_t *sf, void *v) {
+}
+
+static void *profile_seq_next(seqfile_t *sf, void *v, off_t *pos) {
+  struct profile_snapshot *snap = sf->private;
+  (*pos)++;
+  if ((size_t) *pos >= snap->count)
+    return NULL;
+  return &snap->stacks[*pos];
+}
+
+static int profile_seq_show(seqfile_t *sf, void *v) {
+  // folded stacks are written outermost frame first. user frames are
+  // left as addresses and kernel frames are resolved to function names.
+  struct profile_stack *stack = v;
+  const char *sep = "";
+  for (uint32_t i = stack->nuser; i > 0; i--) {
+    seq_printf(sf, "%suser`0x%lx", sep, stack->pcs[stack->nkern + i - 1]);
+    sep = ";";
+  }
+  for (uint32_t i = stack->nkern; i > 0; i--) {
+    uintptr_t pc = stack->pcs[i - 1];
+    const char *name = ksym_lookup(pc, NULL);
+    if (name != NULL) {
+      seq_printf(sf, "%skernel`%s", sep, name);
+    } else {
+      seq_printf(sf, "%skernel`0x%lx", sep, pc);
+    }
+    sep = ";";
+  }
+  return seq_printf(sf, " %lu\n", stack->count);
+}
+
+static ssize_t profile_seq_write(seqfile_t *sf, off_t off, kio_t *kio) {
+  // accepts a sampling rate in Hz to start profiling, "start" to start at the
+  // default rate, "stop" (or 0) to stop and "clear" to discard all samples.
+  char buf[32] = {0};
+  size_t len = kio_read_out(buf, min(kio_remaining(kio), sizeof(buf) - 1), 0, kio);
+  while (len > 0 && (buf[len - 1] == '\n' || buf[len - 1] == ' '))
+    buf[--len] = '\0';
+
+  int res = 0;
+  if (strcmp(buf, "start") == 0) {
+    res = profile_start(PROFILE_DEFAULT_HZ);
+  } else if (strcmp(buf, "stop") == 0 || strcmp(buf, "0") == 0) {
+    profile_stop();
+  } else if (strcmp(buf, "clear") == 0) {
+    profile_clear();
+  } else {
+    char *end;
+    long hz = strtol(buf, &end, 10);
+    if (end == buf || *end != '\0' || hz <= 0 || hz > PROFILE_MAX_HZ)
+      return -EINVAL;
+    res = profile_start((uint32_t) hz);
+  }
+
+  if (res < 0)
+    return res;
+  return (ssize_t) len;
+}
+
+static void profile_seq_cleanup(seqfile_t *sf) {
+  struct profile_snapshot *snap = sf->private;
+  if (snap != NULL) {
+    profile_snapshot_free(snap);
+    sf->private = NULL;
+  }
+}
+
+static struct seq_ops profile_seq_ops = {
+  .start = profile_seq_start,
+  .stop = profile_seq_stop,
+  .next = profile_seq_next,
+  .show = profile_seq_show,
+  .write = profile_seq_write,
+  .cleanup = profile_seq_cleanup,
+};
+PROCFS_REGISTER_SEQFILE(profile, "/profile", &profile_seq_ops, 0644);
+
+static int profile_stats_show(seqfile_t *sf, void *data) {
+  seq_printf(sf, "hz      %u\n", profile_hz);
+  seq_printf(sf, "symbols %zu\n", ksym_count());
+  for (uint32_t cpu = 0; cpu < system_num_cpus; cpu++) {
+    struct profile_buf *buf = &profile_bufs[cpu];
+    seq_printf(sf, "cpu%-4u samples %-10lu dropped %lu\n", cpu, buf->samples, buf->dropped);
+  }
+  return 0;
+}
+PROCFS_REGISTER_SIMPLE(profile_stats, "/profile_stats", profile_stats_show, NULL, 0444);
@@ -62,6 +62,7 @@ struct dev_type dev_types[] = {
   DECLARE_DEV_TYPE("input"   , 6, D_CHR),
   DECLARE_DEV_TYPE("pty"     , 7, D_CHR),
   DECLARE_DEV_TYPE("ctty"    , 8, D_CHR),
+  DECLARE_DEV_TYPE("vblk"    , 9, D_BLK),
 };
 #undef DECLARE_DEV_TYPE
 
@@ -22,22 +22,29 @@
 #define AUXV_COUNT 12
 #define AUX(type, val) ((Elf64_auxv_t) { .a_type = (type), .a_un.a_val = (val) })
 
-static int exec_map_file_full(int fd, void **file_base, size_t *file_size) {
+#define EXEC_HEADER_SIZE PAGE_SIZE
+
+// reads the start of the file which holds the headers. the rest of the file is
+// mapped by the loader and only read as it is faulted in.
+static int exec_read_header(int fd, void **header, size_t *header_len, size_t *file_size) {
   int res;
   struct stat stat;
   if ((res = fs_fstat(fd, &stat)) < 0) {
     return res;
   }
 
-  size_t size = page_align(stat.st_size);
-  void *addr = vm_mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
-  if (addr == MAP_FAILED) {
-    EPRINTF("failed to map file: {:err}\n", res);
-    return -ENOMEM;
+  void *buf = kmalloc(EXEC_HEADER_SIZE);
+  kio_t kio = kio_new_writable(buf, min((size_t) stat.st_size, EXEC_HEADER_SIZE));
+  ssize_t nread = fs_kpread(fd, &kio, 0);
+  if (nread < 0) {
+    EPRINTF("failed to read file header {:err}\n", nread);
+    kfree(buf);
+    return (int) nread;
   }
 
-  *file_base = addr;
-  *file_size = size;
+  *header = buf;
+  *header_len = (size_t) nread;
+  *file_size = (size_t) stat.st_size;
   return 0;
 }
 
@@ -110,9 +117,10 @@ int exec_load_image(enum exec_type type, uintptr_t base, cstr_t path, __out stru
     EPRINTF("failed to open file '{:cstr}' {:err}\n", &path, fd);
     return fd;
   }
-  void *file_base = NULL;
+  void *header = NULL;
+  size_t header_len = 0;
   size_t file_size = 0;
-  if ((res = exec_map_file_full(fd, &file_base, &file_size)) < 0) {
+  if ((res = exec_read_header(fd, &header, &header_len, &file_size)) < 0) {
     fs_close(fd);
     return res;
   }
@@ -121,13 +129,13 @@ int exec_load_image(enum exec_type type, uintptr_t base, cstr_t path, __out stru
   struct exec_image *image = kmallocz(sizeof(struct exec_image));
   image->type = type;
   image->path = str_from_cstr(path);
-  if (elf_is_valid_file(file_base, file_size)) {
-    if (elf_needs_base(file_base, file_size) && base == 0) {
+  if (elf_is_valid_file(header, header_len)) {
+    if (elf_needs_base(header, header_len) && base == 0) {
       // TODO: assign a base address automatically
       base = 0x2000000;
     }
-    res = elf_load_image(type, fd, file_base, file_size, base, image);
-  } else if (exec_is_interpreter_script(file_base, file_size)) {
+    res = elf_load_image(type, fd, header, header_len, file_size, base, image);
+  } else if (exec_is_interpreter_script(header, header_len)) {
     EPRINTF("interpreter script detected, not supported yet\n");
     res = -ENOEXEC; // TODO: handle interpreter scripts
   } else {
@@ -140,9 +148,7 @@ int exec_load_image(enum exec_type type, uintptr_t base, cstr_t path, __out stru
   else
     *imagep = image;
 
-  if (vmap_free((uintptr_t) file_base, file_size) < 0)
-    EPRINTF("failed to free file mapping\n");
-
+  kfree(header);
   fs_close(fd);
   return res;
 }
@@ -285,6 +285,27 @@ void apic_oneshot(uint64_t ms) {
   apic_write(APIC_INITIAL_COUNT, ms == 0 ? 0 : ms_to_count(ms));
 }
 
+void apic_timer_start_periodic(uint8_t vector, uint32_t hz) {
+  kassert(hz > 0);
+  apic_reg_div_config_t div = apic_reg_div_config(APIC_DIVIDE_1);
+  apic_write(APIC_DIVIDE_CONFIG, div.raw);
+
+  apic_reg_lvt_timer_t timer = apic_read_timer();
+  timer.timer_mode = APIC_PERIODIC;
+  timer.mask = APIC_UNMASK;
+  timer.vector = vector;
+  apic_write_timer(timer);
+
+  apic_write(APIC_INITIAL_COUNT, max(apic_clock / hz, 1));
+}
+
+void apic_timer_stop() {
+  apic_reg_lvt_timer_t timer = apic_read_timer();
+  timer.mask = APIC_MASK;
+  apic_write_timer(timer);
+  apic_write(APIC_INITIAL_COUNT, 0);
+}
+
 void apic_udelay(uint64_t us) {
   apic_reg_lvt_timer_t timer = apic_read_timer();
   timer.timer_mode = APIC_ONE_SHOT;
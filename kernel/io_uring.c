@@ -0,0 +1,924 @@
+//
+// Created by Aaron Gill-Braun on 2026-10-18.
+//
+
+#include <kernel/io_uring.h>
+#include <kernel/vfs/file.h>
+#include <kernel/vfs/vnode.h>
+#include <kernel/net/socket.h>
+#include <kernel/mm/file.h>
+#include <kernel/mm.h>
+#include <kernel/fs.h>
+#include <kernel/proc.h>
+#include <kernel/sched.h>
+#include <kernel/clock.h>
+#include <kernel/time.h>
+#include <kernel/panic.h>
+#include <kernel/printf.h>
+#include <kernel/string.h>
+
+#include <abi/fcntl.h>
+#include <abi/poll.h>
+
+#define ASSERT(x) kassert(x)
+#define LOG_TAG io_uring
+#include <kernel/log.h>
+
+#define EPRINTF(fmt, ...) kprintf("io_uring: %s: " fmt, __func__, ##__VA_ARGS__)
+
+#define IORING_MAX_THREADS (IORING_MAX_WORKERS + 1)
+#define IORING_MAX_IOVECS 1024
+
+#define SQ_THREAD_IDLE_MS 1000
+
+/*
+ * The shared ring header.
+ *
+ * The sq and cq indices live on separate cache lines since they are written
+ * from different sides. The cqe array follows the header and the sq index
+ * array follows the cqes, the sqes are in a separate region of the mapping.
+ */
+struct io_rings {
+  uint32_t sq_head;
+  uint32_t sq_tail;
+  uint32_t sq_ring_mask;
+  uint32_t sq_ring_entries;
+  uint32_t sq_flags;
+  uint32_t sq_dropped;
+  uint32_t cq_head _aligned(64);
+  uint32_t cq_tail;
+  uint32_t cq_ring_mask;
+  uint32_t cq_ring_entries;
+  uint32_t cq_overflow;
+  uint32_t cq_flags;
+  struct io_uring_cqe cqes[] _aligned(64);
+};
+
+typedef struct io_req {
+  uint8_t opcode;
+  uint8_t flags;                  // IOSQE_ flags
+  bool nowait;                    // file is O_NONBLOCK
+  enum ftype ftype;               // type of the target file
+  bool isreg;                     // target is a regular file
+  int fd;
+  uint64_t user_data;
+  uint64_t addr;
+  uint64_t off;
+  uint32_t len;
+  uint32_t op_flags;              // msg/poll/timeout flags
+  struct iovec *iov;              // copied iovecs (punted readv/writev)
+  uint64_t deadline;              // timeout deadline (ns)
+  uint64_t target;                // timeout completion count target
+  LIST_ENTRY(struct io_req) list;
+} io_req_t;
+
+typedef struct io_ring {
+  uint32_t flags;                 // IORING_SETUP_ flags
+  uint32_t sq_entries;
+  uint32_t cq_entries;
+  uint32_t sq_mask;
+  uint32_t cq_mask;
+
+  __ref vm_file_t *vm_file;       // backing pages of the rings and sqes
+  size_t rings_size;              // size of the ring region
+  size_t sqes_size;               // size of the sqe region
+  struct io_rings *rings;         // kernel mapping of the rings
+  uint32_t *sq_array;             // sq index array
+  struct io_uring_sqe *sqes;      // kernel mapping of the sqes
+
+  mtx_t submit_lock;              // serializes sq consumers
+  uint32_t sq_head;               // private sq head
+
+  mtx_t cq_lock;                  // protects the cq side
+  cond_t cq_cond;                 // signalled on completion
+  uint32_t cq_tail;               // private cq tail
+  uint64_t cq_posted;             // total completions posted
+  volatile uint32_t inflight;     // submitted requests not yet completed
+
+  mtx_t lock;                     // protects the fields below
+  cond_t work_cond;               // signalled when work is queued
+  cond_t sq_cond;                 // wakes the sq thread
+  LIST_HEAD(io_req_t) work;       // requests waiting for a worker
+  int nworkers;                   // number of workers
+  int idle_workers;               // workers waiting for work
+  thread_t *threads[IORING_MAX_THREADS]; // worker and sq threads
+  int nthreads;
+  uint32_t sq_thread_idle;        // sq thread idle time (ms)
+  bool stopping;                  // ring is being torn down
+
+  __ref proc_t *proc;             // owning process
+  _refcount;
+} io_ring_t;
+
+static int io_uring_f_open(file_t *file, int flags);
+static int io_uring_f_close(file_t *file);
+static void io_uring_f_cleanup(file_t *file);
+
+static struct file_ops io_uring_file_ops = {
+  .f_open = io_uring_f_open,
+  .f_close = io_uring_f_close,
+  .f_cleanup = io_uring_f_cleanup,
+};
+
+//
+// MARK: Ring allocation
+//
+
+static io_ring_t *io_ring_alloc(uint32_t sq_entries, uint32_t cq_entries, uint32_t flags) {
+  io_ring_t *ring = kmallocz(sizeof(io_ring_t));
+  if (ring == NULL)
+    return NULL;
+
+  ring->flags = flags;
+  ring->sq_entries = sq_entries;
+  ring->cq_entries = cq_entries;
+  ring->sq_mask = sq_entries - 1;
+  ring->cq_mask = cq_entries - 1;
+
+  size_t array_off = align(sizeof(struct io_rings) + cq_entries * sizeof(struct io_uring_cqe), 64);
+  ring->rings_size = page_align(array_off + sq_entries * sizeof(uint32_t));
+  ring->sqes_size = page_align(sq_entries * sizeof(struct io_uring_sqe));
+  size_t total = ring->rings_size + ring->sqes_size;
+
+  // the pages are shared between the kernel mapping and the process mappings
+  // through the page cache of the vm file
+  ring->vm_file = vm_file_alloc_anon(total, PAGE_SIZE);
+  uintptr_t base = vmap_file(vm_file_alloc_copy(ring->vm_file), 0, total, VM_RDWR, "io_uring");
+  if (base == 0) {
+    vm_file_free(&ring->vm_file);
+    kfree(ring);
+    return NULL;
+  }
+  // touch every page now so they are in the page cache before userspace maps them
+  memset((void *) base, 0, total);
+
+  ring->rings = (void *) base;
+  ring->sq_array = (void *) (base + array_off);
+  ring->sqes = (void *) (base + ring->rings_size);
+  ring->rings->sq_ring_mask = ring->sq_mask;
+  ring->rings->sq_ring_entries = sq_entries;
+  ring->rings->cq_ring_mask = ring->cq_mask;
+  ring->rings->cq_ring_entries = cq_entries;
+
+  mtx_init(&ring->submit_lock, 0, "io_uring_submit_lock");
+  mtx_init(&ring->cq_lock, 0, "io_uring_cq_lock");
+  cond_init(&ring->cq_cond, "io_uring_cq_cond");
+  mtx_init(&ring->lock, 0, "io_uring_lock");
+  cond_init(&ring->work_cond, "io_uring_work_cond");
+  cond_init(&ring->sq_cond, "io_uring_sq_cond");
+  LIST_INIT(&ring->work);
+  ring->proc = pr_getref(curproc);
+  initref(ring);
+  return ring;
+}
+
+static void io_ring_free(io_ring_t *ring) {
+  ASSERT(read_refcount(ring) == 0);
+  io_req_t *req;
+  while ((req = LIST_REMOVE_FIRST(&ring->work, list)) != NULL) {
+    kfree(req->iov);
+    kfree(req);
+  }
+
+  vmap_free((uintptr_t) ring->rings, ring->rings_size + ring->sqes_size);
+  vm_file_free(&ring->vm_file);
+  pr_putref(&ring->proc);
+
+  mtx_destroy(&ring->submit_lock);
+  mtx_destroy(&ring->cq_lock);
+  cond_destroy(&ring->cq_cond);
+  mtx_destroy(&ring->lock);
+  cond_destroy(&ring->work_cond);
+  cond_destroy(&ring->sq_cond);
+  kfree(ring);
+}
+
+static inline void io_ring_putref(io_ring_t **ringp) {
+  putref(ringp, io_ring_free);
+}
+
+static io_ring_t *io_ring_from_fd(int fd, fd_entry_t **fdep) {
+  fd_entry_t *fde = fs_proc_get_fdentry(curproc, fd);
+  if (fde == NULL)
+    return NULL;
+  if (!F_ISIOURING(fde->file)) {
+    fde_putref(&fde);
+    return NULL;
+  }
+  *fdep = fde;
+  return fde->file->data;
+}
+
+//
+// MARK: Completions
+//
+
+static void io_complete(io_ring_t *ring, uint64_t user_data, int32_t res) {
+  struct io_rings *rings = ring->rings;
+  mtx_lock(&ring->cq_lock);
+  uint32_t tail = ring->cq_tail;
+  if (tail - atomic_load(&rings->cq_head) >= ring->cq_entries) {
+    // submission is throttled so this only happens if userspace moved cq_head
+    rings->cq_overflow++;
+  } else {
+    struct io_uring_cqe *cqe = &rings->cqes[tail & ring->cq_mask];
+    cqe->user_data = user_data;
+    cqe->res = res;
+    cqe->flags = 0;
+    ring->cq_tail = tail + 1;
+    atomic_store_release(&rings->cq_tail, tail + 1);
+  }
+  ring->cq_posted++;
+  atomic_fetch_sub(&ring->inflight, 1);
+  if (ring->cq_cond.waiters > 0)
+    cond_broadcast(&ring->cq_cond);
+  mtx_unlock(&ring->cq_lock);
+}
+
+static inline uint32_t io_cq_ready(io_ring_t *ring) {
+  return ring->cq_tail - atomic_load(&ring->rings->cq_head);
+}
+
+//
+// MARK: Operations
+//
+
+static ssize_t io_rw_vec(io_req_t *req, struct iovec *iov, uint32_t iovcnt, bool nonblock) {
+  bool write = req->opcode == IORING_OP_WRITEV || req->opcode == IORING_OP_WRITE;
+  if (req->ftype == FT_SOCK) {
+    struct msghdr msg = {0};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = (int) iovcnt;
+    int flags = nonblock ? MSG_DONTWAIT : 0;
+    return write ? net_sendmsg(req->fd, &msg, flags) : net_recvmsg(req->fd, &msg, flags);
+  }
+
+  // only regular files and files opened with O_NONBLOCK are safe
+  // to access from the submitting context
+  if (nonblock && !req->isreg && !req->nowait)
+    return -EAGAIN;
+
+  kio_t kio = write ? kio_new_readablev(iov, iovcnt) : kio_new_writablev(iov, iovcnt);
+  if (req->off == (uint64_t) -1 || req->ftype != FT_VNODE) {
+    return write ? fs_kwrite(req->fd, &kio) : fs_kread(req->fd, &kio);
+  }
+  return write ? fs_kpwrite(req->fd, &kio, (off_t) req->off) : fs_kpread(req->fd, &kio, (off_t) req->off);
+}
+
+static ssize_t io_op_rw(io_req_t *req, bool nonblock) {
+  switch (req->opcode) {
+    case IORING_OP_READ:
+    case IORING_OP_WRITE: {
+      struct iovec iov = { .iov_base = (void *) req->addr, .iov_len = req->len };
+      return io_rw_vec(req, &iov, 1, nonblock);
+    }
+    case IORING_OP_READV:
+    case IORING_OP_WRITEV: {
+      struct iovec *iov = req->iov ? req->iov : (struct iovec *) req->addr;
+      return io_rw_vec(req, iov, req->len, nonblock);
+    }
+    default:
+      unreachable;
+  }
+}
+
+static int io_op_poll(io_req_t *req, bool nonblock) {
+  struct pollfd pfd = { .fd = req->fd, .events = (short) req->op_flags };
+  struct timespec zero = {0};
+  int res = fs_poll(&pfd, 1, nonblock ? &zero : NULL);
+  if (res < 0)
+    return res;
+  if (res == 0)
+    return -EAGAIN;
+  return pfd.revents;
+}
+
+static int io_op_timeout(io_ring_t *ring, io_req_t *req) {
+  // completes when `target` completions have been posted or the deadline passes
+  int res = 0;
+  mtx_lock(&ring->cq_lock);
+  while (req->target == 0 || ring->cq_posted < req->target) {
+    uint64_t now = clock_get_nanos();
+    if (now >= req->deadline) {
+      res = -ETIME;
+      break;
+    }
+    if (ring->stopping) {
+      res = -ECANCELED;
+      break;
+    }
+    struct timespec ts = timespec_from_nanos(req->deadline - now);
+    cond_wait_timeout(&ring->cq_cond, &ring->cq_lock, &ts);
+  }
+  mtx_unlock(&ring->cq_lock);
+  return res;
+}
+
+// issues a request. when nonblock is set the request must not sleep and
+// -EAGAIN is returned if it would have to.
+static int io_issue(io_ring_t *ring, io_req_t *req, bool nonblock) {
+  switch (req->opcode) {
+    case IORING_OP_NOP:
+      return 0;
+    case IORING_OP_READ:
+    case IORING_OP_WRITE:
+    case IORING_OP_READV:
+    case IORING_OP_WRITEV:
+      return (int) io_op_rw(req, nonblock);
+    case IORING_OP_RECV: {
+      int flags = (int) req->op_flags | (nonblock ? MSG_DONTWAIT : 0);
+      return (int) net_recvfrom(req->fd, (void *) req->addr, req->len, flags, NULL, NULL);
+    }
+    case IORING_OP_SEND: {
+      int flags = (int) req->op_flags | (nonblock ? MSG_DONTWAIT : 0);
+      return (int) net_sendto(req->fd, (void *) req->addr, req->len, flags, NULL, 0);
+    }
+    case IORING_OP_ACCEPT:
+      if (nonblock && !req->nowait)
+        return -EAGAIN;
+      return net_accept(req->fd, (struct sockaddr *) req->addr, (socklen_t *) req->off);
+    case IORING_OP_POLL_ADD:
+      return io_op_poll(req, nonblock);
+    case IORING_OP_TIMEOUT:
+      if (nonblock)
+        return -EAGAIN;
+      return io_op_timeout(ring, req);
+    default:
+      return -EINVAL;
+  }
+}
+
+static bool io_op_supported(uint8_t opcode) {
+  switch (opcode) {
+    case IORING_OP_NOP:
+    case IORING_OP_READV:
+    case IORING_OP_WRITEV:
+    case IORING_OP_POLL_ADD:
+    case IORING_OP_TIMEOUT:
+    case IORING_OP_ACCEPT:
+    case IORING_OP_READ:
+    case IORING_OP_WRITE:
+    case IORING_OP_SEND:
+    case IORING_OP_RECV:
+      return true;
+    default:
+      return false;
+  }
+}
+
+//
+// MARK: Worker threads
+//
+
+static noreturn void io_worker_main(io_ring_t *ring);
+
+static noreturn void io_thread_exit(io_ring_t *ring) {
+  io_ring_putref(&ring);
+
+  proc_t *proc = curproc;
+  pr_lock(proc);
+  thread_kill(curthread);
+  unreachable;
+}
+
+static int io_spawn_thread(io_ring_t *ring, uintptr_t entry, const char *name, int cpu) {
+  // the process lock and then ring->lock must be held. holding both keeps
+  // the thread from being added between the thread check in cleanup and
+  // the ring being marked as stopping.
+  ASSERT(ring->nthreads < IORING_MAX_THREADS);
+  if (ring->stopping)
+    return -EBADF;
+
+  thread_t *td = thread_alloc(TDF_KTHREAD, SIZE_16KB);
+  if (td == NULL)
+    return -ENOMEM;
+
+  thread_setup_entry(td, entry, 1, getref(ring));
+  thread_setup_name(td, cstr_make(name));
+  // signals sent to the process should never be routed to a ring thread
+  memset(&td->sigmask, 0xff, sizeof(td->sigmask));
+  if (cpu >= 0) {
+    cpuset_set(td->cpuset, cpu);
+    td->flags2 |= TDF2_AFFINITY;
+  }
+
+  ring->threads[ring->nthreads++] = td;
+  proc_add_thread(ring->proc, td);
+  return 0;
+}
+
+static void io_spawn_worker(io_ring_t *ring) {
+  proc_t *proc = ring->proc;
+  pr_lock(proc);
+  mtx_lock(&ring->lock);
+  if (ring->idle_workers == 0 && ring->nworkers < IORING_MAX_WORKERS && !LIST_EMPTY(&ring->work)) {
+    if (io_spawn_thread(ring, (uintptr_t) io_worker_main, "io_uring worker", -1) == 0)
+      ring->nworkers++;
+  }
+  mtx_unlock(&ring->lock);
+  pr_unlock(proc);
+}
+
+static noreturn void io_worker_main(io_ring_t *ring) {
+  mtx_lock(&ring->lock);
+  for (;;) {
+    while (LIST_EMPTY(&ring->work) && !ring->stopping) {
+      ring->idle_workers++;
+      cond_wait(&ring->work_cond, &ring->lock);
+      ring->idle_workers--;
+    }
+    if (ring->stopping)
+      break;
+
+    io_req_t *req = LIST_REMOVE_FIRST(&ring->work, list);
+    mtx_unlock(&ring->lock);
+
+    int res = io_issue(ring, req, /*nonblock=*/false);
+    io_complete(ring, req->user_data, res);
+    kfree(req->iov);
+    kfree(req);
+
+    mtx_lock(&ring->lock);
+  }
+  mtx_unlock(&ring->lock);
+  io_thread_exit(ring);
+}
+
+static int io_queue_work(io_ring_t *ring, io_req_t *req) {
+  io_req_t *work = kmalloc(sizeof(io_req_t));
+  if (work == NULL)
+    return -ENOMEM;
+
+  memcpy(work, req, sizeof(io_req_t));
+  LIST_ENTRY_INIT(&work->list);
+  if (req->opcode == IORING_OP_READV || req->opcode == IORING_OP_WRITEV) {
+    // the iovec array only has to stay valid until submission
+    size_t size = req->len * sizeof(struct iovec);
+    work->iov = kmalloc(size);
+    if (work->iov == NULL) {
+      kfree(work);
+      return -ENOMEM;
+    }
+    memcpy(work->iov, (void *) req->addr, size);
+  }
+
+  mtx_lock(&ring->lock);
+  LIST_ADD(&ring->work, work, list);
+  bool spawn = ring->idle_workers == 0 && ring->nworkers < IORING_MAX_WORKERS;
+  if (!spawn)
+    cond_signal(&ring->work_cond);
+  mtx_unlock(&ring->lock);
+
+  if (spawn)
+    io_spawn_worker(ring);
+  return 0;
+}
+
+//
+// MARK: Submission
+//
+
+static int io_prep(io_ring_t *ring, const struct io_uring_sqe *sqe, io_req_t *req) {
+  memset(req, 0, sizeof(io_req_t));
+  req->opcode = sqe->opcode;
+  req->flags = sqe->flags;
+  req->fd = sqe->fd;
+  req->user_data = sqe->user_data;
+  req->addr = sqe->addr;
+  req->off = sqe->off;
+  req->len = sqe->len;
+  req->op_flags = sqe->rw_flags;
+
+  if (!io_op_supported(req->opcode))
+    return -EINVAL;
+  if (req->flags & ~IOSQE_ASYNC)
+    return -EINVAL; // linked, drained and fixed-file requests are not supported
+
+  switch (req->opcode) {
+    case IORING_OP_NOP:
+      return 0;
+    case IORING_OP_READV:
+    case IORING_OP_WRITEV:
+      if (req->len == 0 || req->len > IORING_MAX_IOVECS)
+        return -EINVAL;
+      if (vm_validate_ptr(req->addr, /*write=*/false) < 0)
+        return -EFAULT;
+      break;
+    case IORING_OP_TIMEOUT: {
+      if (req->len != 1 || (req->op_flags & ~IORING_TIMEOUT_ABS))
+        return -EINVAL;
+      if (vm_validate_ptr(req->addr, /*write=*/false) < 0)
+        return -EFAULT;
+
+      struct timespec ts;
+      memcpy(&ts, (void *) req->addr, sizeof(ts));
+      uint64_t ns = timespec_to_nanos(&ts);
+      req->deadline = (req->op_flags & IORING_TIMEOUT_ABS) ? ns : clock_get_nanos() + ns;
+      if (req->off != 0) {
+        mtx_lock(&ring->cq_lock);
+        req->target = ring->cq_posted + req->off;
+        mtx_unlock(&ring->cq_lock);
+      }
+      return 0;
+    }
+    default:
+      break;
+  }
+
+  // everything else targets a file
+  fd_entry_t *fde = fs_proc_get_fdentry(curproc, req->fd);
+  if (fde == NULL)
+    return -EBADF;
+
+  file_t *file = fde->file;
+  req->ftype = file->type;
+  req->nowait = (file->flags & O_NONBLOCK) != 0;
+  req->isreg = F_ISVNODE(file) && V_ISREG((vnode_t *) file->data);
+  fde_putref(&fde);
+  return 0;
+}
+
+static void io_submit_one(io_ring_t *ring, const struct io_uring_sqe *sqe) {
+  io_req_t req;
+  int res;
+  if ((res = io_prep(ring, sqe, &req)) < 0)
+    goto complete;
+
+  if (!(req.flags & IOSQE_ASYNC)) {
+    res = io_issue(ring, &req, /*nonblock=*/true);
+    if (res != -EAGAIN || req.nowait)
+      goto complete;
+  }
+
+  // the request would block, hand it to a worker
+  if ((res = io_queue_work(ring, &req)) == 0)
+    return;
+
+LABEL(complete);
+  io_complete(ring, req.user_data, res);
+}
+
+// consumes up to `to_submit` entries from the sq ring. the caller must
+// hold ring->submit_lock.
+static int io_submit_sqes(io_ring_t *ring, uint32_t to_submit) {
+  struct io_rings *rings = ring->rings;
+  uint32_t head = ring->sq_head;
+  uint32_t tail = atomic_load(&rings->sq_tail);
+  uint32_t avail = min(tail - head, ring->sq_entries);
+  uint32_t count = min(to_submit, avail);
+
+  uint32_t start = head;
+  int submitted = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    // never have more requests outstanding than the cq can hold
+    uint32_t pending = atomic_load(&ring->inflight) + io_cq_ready(ring);
+    if (pending >= ring->cq_entries)
+      break;
+
+    uint32_t idx = atomic_load(&ring->sq_array[head & ring->sq_mask]);
+    head++;
+    if (idx >= ring->sq_entries) {
+      rings->sq_dropped++;
+      continue;
+    }
+
+    // copy the entry so userspace can reuse the slot once head moves
+    struct io_uring_sqe sqe;
+    memcpy(&sqe, &ring->sqes[idx], sizeof(sqe));
+    atomic_fetch_add(&ring->inflight, 1);
+    io_submit_one(ring, &sqe);
+    submitted++;
+  }
+
+  ring->sq_head = head;
+  atomic_store_release(&rings->sq_head, head);
+  if (count > 0 && head == start)
+    return -EBUSY; // completion queue is full
+  return submitted;
+}
+
+static inline uint32_t io_sq_pending(io_ring_t *ring) {
+  return atomic_load(&ring->rings->sq_tail) - ring->sq_head;
+}
+
+static noreturn void io_sq_thread_main(io_ring_t *ring) {
+  struct io_rings *rings = ring->rings;
+  uint64_t idle_ns = MS_TO_NS(ring->sq_thread_idle);
+  uint64_t last_work = clock_get_nanos();
+
+  mtx_lock(&ring->lock);
+  while (!ring->stopping) {
+    mtx_unlock(&ring->lock);
+    mtx_lock(&ring->submit_lock);
+    int res = io_submit_sqes(ring, UINT32_MAX);
+    mtx_unlock(&ring->submit_lock);
+
+    if (res > 0) {
+      last_work = clock_get_nanos();
+      mtx_lock(&ring->lock);
+      continue;
+    }
+
+    if (clock_get_nanos() - last_work < idle_ns) {
+      sched_again(SCHED_YIELDED);
+      mtx_lock(&ring->lock);
+      continue;
+    }
+
+    // idle for too long, go to sleep until io_uring_enter wakes us. the flag
+    // must be visible before the final check of the sq tail so a submission
+    // racing with it either gets seen here or sees the flag.
+    mtx_lock(&ring->lock);
+    atomic_fetch_or(&rings->sq_flags, IORING_SQ_NEED_WAKEUP);
+    atomic_thread_fence();
+    if (io_sq_pending(ring) == 0 && !ring->stopping) {
+      cond_wait(&ring->sq_cond, &ring->lock);
+    }
+    atomic_fetch_and(&rings->sq_flags, ~IORING_SQ_NEED_WAKEUP);
+    last_work = clock_get_nanos();
+  }
+  mtx_unlock(&ring->lock);
+  io_thread_exit(ring);
+}
+
+//
+// MARK: File operations
+//
+
+static int io_uring_f_open(file_t *file, int flags) {
+  ASSERT(F_ISIOURING(file));
+  return 0;
+}
+
+static int io_uring_f_close(file_t *file) {
+  ASSERT(F_ISIOURING(file));
+  return 0;
+}
+
+static void io_uring_f_cleanup(file_t *file) {
+  ASSERT(F_ISIOURING(file));
+  io_ring_t *ring = moveptr(file->data);
+  proc_t *proc = ring->proc;
+
+  // ring threads hold a reference which they drop on their way out. threads
+  // that were killed along with the process (exit or exec) never will, so
+  // drop their references here.
+  int dead = 0;
+  pr_lock(proc);
+  mtx_lock(&ring->lock);
+  ring->stopping = true;
+  for (int i = 0; i < ring->nthreads; i++) {
+    thread_t *thread = ring->threads[i];
+    if (LIST_FIND(td, &proc->threads, plist, td == thread) == NULL)
+      dead++;
+  }
+  cond_broadcast(&ring->work_cond);
+  cond_broadcast(&ring->sq_cond);
+  mtx_unlock(&ring->lock);
+  pr_unlock(proc);
+
+  mtx_lock(&ring->cq_lock);
+  cond_broadcast(&ring->cq_cond); // wake pending timeouts
+  mtx_unlock(&ring->cq_lock);
+
+  while (dead-- > 0) {
+    io_ring_t *ref = ring;
+    io_ring_putref(&ref);
+  }
+  io_ring_putref(&ring);
+}
+
+vm_file_t *io_uring_get_vmfile(file_t *file, size_t off, size_t len) {
+  ASSERT(F_ISIOURING(file));
+  io_ring_t *ring = file->data;
+
+  size_t base, size;
+  switch (off) {
+    case IORING_OFF_SQ_RING:
+    case IORING_OFF_CQ_RING:
+      // both rings are in the same region (IORING_FEAT_SINGLE_MMAP)
+      base = 0;
+      size = ring->rings_size;
+      break;
+    case IORING_OFF_SQES:
+      base = ring->rings_size;
+      size = ring->sqes_size;
+      break;
+    default:
+      return NULL;
+  }
+
+  if (len == 0 || len > size)
+    return NULL;
+
+  vm_file_t *vm_file = vm_file_alloc_copy(ring->vm_file);
+  vm_file->off = base;
+  vm_file->size = page_align(len);
+  return vm_file;
+}
+
+//
+// MARK: System calls
+//
+
+int io_uring_setup(uint32_t entries, struct io_uring_params *params) {
+  if (vm_validate_ptr((uintptr_t) params, /*write=*/true) < 0)
+    return -EFAULT;
+
+  struct io_uring_params p;
+  memcpy(&p, params, sizeof(p));
+  for (int i = 0; i < ARRAY_SIZE(p.resv); i++) {
+    if (p.resv[i] != 0)
+      return -EINVAL;
+  }
+
+  uint32_t supported = IORING_SETUP_SQPOLL | IORING_SETUP_SQ_AFF | IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+  if (p.flags & ~supported)
+    return -EINVAL;
+  if ((p.flags & IORING_SETUP_SQ_AFF) && (!(p.flags & IORING_SETUP_SQPOLL) || p.sq_thread_cpu >= system_num_cpus))
+    return -EINVAL;
+
+  if (entries == 0)
+    return -EINVAL;
+  if (entries > IORING_MAX_ENTRIES) {
+    if (!(p.flags & IORING_SETUP_CLAMP))
+      return -EINVAL;
+    entries = IORING_MAX_ENTRIES;
+  }
+
+  uint32_t sq_entries = is_pow2(entries) ? entries : next_pow2(entries);
+  uint32_t cq_entries = 2 * sq_entries;
+  if (p.flags & IORING_SETUP_CQSIZE) {
+    if (p.cq_entries == 0)
+      return -EINVAL;
+    if (p.cq_entries > IORING_MAX_CQ_ENTRIES) {
+      if (!(p.flags & IORING_SETUP_CLAMP))
+        return -EINVAL;
+      p.cq_entries = IORING_MAX_CQ_ENTRIES;
+    }
+    cq_entries = is_pow2(p.cq_entries) ? p.cq_entries : next_pow2(p.cq_entries);
+    if (cq_entries < sq_entries)
+      return -EINVAL;
+  }
+
+  proc_t *proc = curproc;
+  int fd = fs_proc_alloc_fd(proc);
+  if (fd < 0)
+    return -EMFILE;
+
+  io_ring_t *ring = io_ring_alloc(sq_entries, cq_entries, p.flags);
+  if (ring == NULL) {
+    fs_proc_free_fd(proc, fd);
+    return -ENOMEM;
+  }
+
+  file_t *file = f_alloc(FT_IOURING, O_RDWR, ring, &io_uring_file_ops);
+  if (file == NULL) {
+    io_ring_putref(&ring);
+    fs_proc_free_fd(proc, fd);
+    return -ENOMEM;
+  }
+
+  f_lock(file);
+  int res = f_open(file, O_RDWR);
+  f_unlock(file);
+  if (res < 0) {
+    f_putref(&file);
+    fs_proc_free_fd(proc, fd);
+    return res;
+  }
+
+  if (p.flags & IORING_SETUP_SQPOLL) {
+    ring->sq_thread_idle = p.sq_thread_idle ? p.sq_thread_idle : SQ_THREAD_IDLE_MS;
+    int cpu = (p.flags & IORING_SETUP_SQ_AFF) ? (int) p.sq_thread_cpu : -1;
+    pr_lock(proc);
+    mtx_lock(&ring->lock);
+    res = io_spawn_thread(ring, (uintptr_t) io_sq_thread_main, "io_uring sq", cpu);
+    mtx_unlock(&ring->lock);
+    pr_unlock(proc);
+    if (res < 0) {
+      f_putref(&file);
+      fs_proc_free_fd(proc, fd);
+      return res;
+    }
+  }
+
+  fd_entry_t *fde = fd_entry_alloc(fd, O_CLOEXEC, cstr_make("io_uring"), moveref(file));
+  if (fde == NULL) {
+    fs_proc_free_fd(proc, fd);
+    return -ENOMEM;
+  }
+  fs_proc_add_fdentry(proc, moveref(fde));
+
+  p.sq_entries = sq_entries;
+  p.cq_entries = cq_entries;
+  p.features = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_SUBMIT_STABLE | IORING_FEAT_RW_CUR_POS;
+
+  size_t array_off = (uintptr_t) ring->sq_array - (uintptr_t) ring->rings;
+  memset(&p.sq_off, 0, sizeof(p.sq_off));
+  p.sq_off.head = offsetof(struct io_rings, sq_head);
+  p.sq_off.tail = offsetof(struct io_rings, sq_tail);
+  p.sq_off.ring_mask = offsetof(struct io_rings, sq_ring_mask);
+  p.sq_off.ring_entries = offsetof(struct io_rings, sq_ring_entries);
+  p.sq_off.flags = offsetof(struct io_rings, sq_flags);
+  p.sq_off.dropped = offsetof(struct io_rings, sq_dropped);
+  p.sq_off.array = array_off;
+
+  memset(&p.cq_off, 0, sizeof(p.cq_off));
+  p.cq_off.head = offsetof(struct io_rings, cq_head);
+  p.cq_off.tail = offsetof(struct io_rings, cq_tail);
+  p.cq_off.ring_mask = offsetof(struct io_rings, cq_ring_mask);
+  p.cq_off.ring_entries = offsetof(struct io_rings, cq_ring_entries);
+  p.cq_off.overflow = offsetof(struct io_rings, cq_overflow);
+  p.cq_off.cqes = offsetof(struct io_rings, cqes);
+  p.cq_off.flags = offsetof(struct io_rings, cq_flags);
+
+  memcpy(params, &p, sizeof(p));
+  DPRINTF("setup: fd=%d sq_entries=%u cq_entries=%u flags=%#x\n", fd, sq_entries, cq_entries, p.flags);
+  return fd;
+}
+
+int io_uring_enter(int fd, uint32_t to_submit, uint32_t min_complete, uint32_t flags, const sigset_t *sig, size_t sigsz) {
+  if (flags & ~(IORING_ENTER_GETEVENTS | IORING_ENTER_SQ_WAKEUP | IORING_ENTER_SQ_WAIT))
+    return -EINVAL;
+
+  fd_entry_t *fde = NULL;
+  io_ring_t *ring = io_ring_from_fd(fd, &fde);
+  if (ring == NULL)
+    return -EBADF;
+
+  int res = 0;
+  if (ring->flags & IORING_SETUP_SQPOLL) {
+    // the sq thread does the submitting
+    if (flags & IORING_ENTER_SQ_WAKEUP) {
+      mtx_lock(&ring->lock);
+      cond_signal(&ring->sq_cond);
+      mtx_unlock(&ring->lock);
+    }
+    res = (int) to_submit;
+  } else if (to_submit > 0) {
+    mtx_lock(&ring->submit_lock);
+    res = io_submit_sqes(ring, to_submit);
+    mtx_unlock(&ring->submit_lock);
+    if (res < 0)
+      goto ret;
+  }
+
+  if (flags & IORING_ENTER_GETEVENTS) {
+    // the signal mask is not applied while waiting
+    min_complete = min(min_complete, ring->cq_entries);
+    mtx_lock(&ring->cq_lock);
+    while (io_cq_ready(ring) < min_complete) {
+      if (cond_wait_sig(&ring->cq_cond, &ring->cq_lock) < 0) {
+        if (res == 0)
+          res = -EINTR;
+        break;
+      }
+    }
+    mtx_unlock(&ring->cq_lock);
+  }
+
+LABEL(ret);
+  fde_putref(&fde);
+  return res;
+}
+
+int io_uring_register(int fd, uint32_t opcode, void *arg, uint32_t nr_args) {
+  fd_entry_t *fde = NULL;
+  io_ring_t *ring = io_ring_from_fd(fd, &fde);
+  if (ring == NULL)
+    return -EBADF;
+
+  int res;
+  switch (opcode) {
+    case IORING_REGISTER_PROBE: {
+      if (nr_args > 256)
+        goto_res(ret, -EINVAL);
+      size_t size = sizeof(struct io_uring_probe) + nr_args * sizeof(struct io_uring_probe_op);
+      if (vm_validate_ptr((uintptr_t) arg, /*write=*/true) < 0)
+        goto_res(ret, -EFAULT);
+
+      struct io_uring_probe *probe = arg;
+      memset(probe, 0, size);
+      probe->last_op = IORING_OP_LAST - 1;
+      probe->ops_len = (uint8_t) min(nr_args, IORING_OP_LAST);
+      for (int i = 0; i < probe->ops_len; i++) {
+        probe->ops[i].op = (uint8_t) i;
+        probe->ops[i].flags = io_op_supported(i) ? IO_URING_OP_SUPPORTED : 0;
+      }
+      res = 0;
+      break;
+    }
+    default:
+      res = -EINVAL;
+      break;
+  }
+
+LABEL(ret);
+  fde_putref(&fde);
+  return res;
+}
+
+SYSCALL_ALIAS(io_uring_setup, io_uring_setup);
+SYSCALL_ALIAS(io_uring_enter, io_uring_enter);
+SYSCALL_ALIAS(io_uring_register, io_uring_register);
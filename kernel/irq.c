@@ -5,6 +5,7 @@
 #include <kernel/irq.h>
 #include <kernel/proc.h>
 #include <kernel/mutex.h>
+#include <kernel/trace.h>
 #include <kernel/printf.h>
 #include <kernel/panic.h>
 #include <kernel/debug/debug.h>
@@ -194,7 +195,9 @@ _used void interrupt_handler(struct trapframe *frame) {
 
   struct irq_handler *handler = &handlers[frame->vector];
   frame->data = (uintptr_t) handler->data;
+  TRACE_EVENT(IRQ, TRACE_IRQ_ENTER, frame->vector, 0, 0, 0);
   handler->handler(frame);
+  TRACE_EVENT(IRQ, TRACE_IRQ_EXIT, frame->vector, 0, 0, 0);
   apic_send_eoi();
 }
 
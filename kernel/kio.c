@@ -86,6 +86,8 @@ size_t kio_nread_out(void *buf, size_t len, size_t off, size_t n, kio_t *kio) {
   if (to_copy == 0)
     return 0;
 
+  // to_copy only holds the last part of a copy spanning several iovecs
+  size_t start = kio_transfered(kio);
   if (kio->kind == KIO_BUF) {
     memcpy(buf + off, kio->buf.base + kio->buf.off, to_copy);
     kio->buf.off += to_copy;
@@ -119,7 +121,7 @@ size_t kio_nread_out(void *buf, size_t len, size_t off, size_t n, kio_t *kio) {
   } else {
     panic("invalid kio type");
   }
-  return to_copy;
+  return kio_transfered(kio) - start;
 }
 
 size_t kio_nwrite_in(kio_t *kio, const void *buf, size_t len, size_t off, size_t n) {
@@ -139,6 +141,8 @@ size_t kio_nwrite_in(kio_t *kio, const void *buf, size_t len, size_t off, size_t
   if (to_copy == 0)
     return 0;
 
+  // to_copy only holds the last part of a copy spanning several iovecs
+  size_t start = kio_transfered(kio);
   if (kio->kind == KIO_BUF) {
     memcpy(kio->buf.base + kio->buf.off, buf + off, to_copy);
     kio->buf.off += to_copy;
@@ -178,7 +182,7 @@ size_t kio_nwrite_in(kio_t *kio, const void *buf, size_t len, size_t off, size_t
   } else {
     panic("invalid kio type");
   }
-  return to_copy;
+  return kio_transfered(kio) - start;
 }
 
 size_t kio_fill(kio_t *kio, uint8_t byte, size_t len) {
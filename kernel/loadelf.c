@@ -72,17 +72,63 @@ bool elf_needs_base(void *file_base, size_t len) {
   return ehdr->e_type == ET_DYN && ehdr->e_entry != 0;
 }
 
-int elf_load_image(enum exec_type type, int fd, void *file_base, size_t len, uintptr_t base, __inout struct exec_image *image) {
+// returns a pointer to the file range [off, off+size). the range is read into a
+// new buffer which is returned in bufp if it is not within the header buffer.
+static void *elf_get_file_range(int fd, void *file_base, size_t len, size_t off, size_t size, void **bufp) {
+  if (off <= len && size <= len - off) {
+    return file_base + off;
+  }
+
+  void *buf = kmalloc(size);
+  kio_t kio = kio_new_writable(buf, size);
+  ssize_t res = fs_kpread(fd, &kio, (off_t) off);
+  if (res < 0 || (size_t) res != size) {
+    kfree(buf);
+    return NULL;
+  }
+
+  *bufp = buf;
+  return buf;
+}
+
+// fills in the last file page of a segment which also holds the start of the
+// bss. the page is private to the segment file and the part past the end of
+// the file data is zeroed.
+static int elf_load_bss_page(int fd, vm_file_t *file, size_t page_off, size_t file_end_off) {
+  size_t data_len = file_end_off & (PAGE_SIZE - 1);
+  void *buf = kmallocz(PAGE_SIZE);
+  kio_t kio = kio_new_writable(buf, data_len);
+  ssize_t res = fs_kpread(fd, &kio, (off_t) page_trunc(file_end_off));
+  if (res < 0 || (size_t) res != data_len) {
+    kfree(buf);
+    return res < 0 ? (int) res : -EIO;
+  }
+
+  page_t *page = alloc_pages(1);
+  if (page == NULL) {
+    kfree(buf);
+    return -ENOMEM;
+  }
+
+  kio = kio_new_readable(buf, PAGE_SIZE);
+  rw_unmapped_pages(page, 0, &kio);
+  kfree(buf);
+
+  vm_file_putpage(file, moveref(page), page_off, NULL);
+  return 0;
+}
+
+int elf_load_image(enum exec_type type, int fd, void *file_base, size_t len, size_t file_size, uintptr_t base, __inout struct exec_image *image) {
   Elf64_Ehdr *ehdr = file_base;
-  if (len < elf_get_image_filesz(ehdr)) {
+  if (len < sizeof(Elf64_Ehdr) || file_size < elf_get_image_filesz(ehdr)) {
     DPRINTF_FUNC("malformed elf file\n");
     return -EINVAL;
   }
   
   // bounds check program headers
-  if (ehdr->e_phoff > len || 
-      ehdr->e_phnum > (len - ehdr->e_phoff) / sizeof(Elf64_Phdr) ||
-      ehdr->e_phoff + (ehdr->e_phnum * sizeof(Elf64_Phdr)) > len) {
+  if (ehdr->e_phoff > file_size ||
+      ehdr->e_phnum > (file_size - ehdr->e_phoff) / sizeof(Elf64_Phdr) ||
+      ehdr->e_phoff + (ehdr->e_phnum * sizeof(Elf64_Phdr)) > file_size) {
     DPRINTF_FUNC("program headers extend beyond file bounds\n");
     return -EINVAL;
   } else if (ehdr->e_type == ET_DYN && base == 0) {
@@ -99,13 +145,20 @@ int elf_load_image(enum exec_type type, int fd, void *file_base, size_t len, uin
     return -ENOEXEC;
   }
 
+  // the program headers are almost always in the header buffer
+  void *phdr_buf = NULL;
+  Elf64_Phdr *phdr = elf_get_file_range(fd, file_base, len, ehdr->e_phoff, ehdr->e_phnum * sizeof(Elf64_Phdr), &phdr_buf);
+  if (phdr == NULL) {
+    DPRINTF_FUNC("failed to read program headers\n");
+    return -EIO;
+  }
+
   // iterate through the program headers
   int res;
   size_t loaded_size = 0;
   str_t interp = str_null;
   uint64_t min_vaddr = UINT64_MAX;
   LIST_HEAD(vm_desc_t) descs = {0};
-  Elf64_Phdr *phdr = offset_ptr(ehdr, ehdr->e_phoff);
   for (uint32_t i = 0; i < ehdr->e_phnum; i++) {
     switch (phdr[i].p_type) {
       case PT_LOAD:
@@ -113,16 +166,31 @@ int elf_load_image(enum exec_type type, int fd, void *file_base, size_t len, uin
       case PT_PHDR:
         image->phdr = base + phdr[i].p_vaddr;
         continue;
-      case PT_INTERP:
+      case PT_INTERP: {
         ASSERT(str_isnull(interp));
         // bounds check interpreter string
-        if (phdr[i].p_offset >= len || phdr[i].p_offset + phdr[i].p_filesz > len) {
+        if (phdr[i].p_offset >= file_size || phdr[i].p_filesz > file_size - phdr[i].p_offset ||
+            phdr[i].p_filesz == 0 || phdr[i].p_filesz > PATH_MAX) {
           DPRINTF_FUNC("interpreter string extends beyond file bounds\n");
           res = -EINVAL;
           goto ret;
         }
-        interp = str_from((const char *)(file_base + phdr[i].p_offset));
+
+        void *interp_buf = NULL;
+        const char *interp_str = elf_get_file_range(fd, file_base, len, phdr[i].p_offset, phdr[i].p_filesz, &interp_buf);
+        if (interp_str == NULL) {
+          DPRINTF_FUNC("failed to read interpreter string\n");
+          res = -EIO;
+          goto ret;
+        }
+
+        size_t interp_len = phdr[i].p_filesz;
+        if (interp_str[interp_len - 1] == '\0')
+          interp_len--;
+        interp = str_new(interp_str, interp_len);
+        kfree(interp_buf);
         continue;
+      }
       default:
         continue;
     }
@@ -130,9 +198,9 @@ int elf_load_image(enum exec_type type, int fd, void *file_base, size_t len, uin
       continue;
 
     // bounds check loadable segment
-    if (phdr[i].p_offset >= len || 
-        phdr[i].p_filesz > len - phdr[i].p_offset ||
-        phdr[i].p_offset + phdr[i].p_filesz > len) {
+    if (phdr[i].p_offset >= file_size ||
+        phdr[i].p_filesz > file_size - phdr[i].p_offset ||
+        phdr[i].p_filesz > phdr[i].p_memsz) {
       DPRINTF_FUNC("loadable segment extends beyond file bounds\n");
       res = -EINVAL;
       goto ret;
@@ -140,127 +208,63 @@ int elf_load_image(enum exec_type type, int fd, void *file_base, size_t len, uin
 
     uint64_t vaddr = page_trunc(phdr[i].p_vaddr);
     uint64_t end_vaddr = page_align(phdr[i].p_vaddr + phdr[i].p_memsz);
+    uint64_t file_end_vaddr = phdr[i].p_vaddr + phdr[i].p_filesz;
     uint64_t off = page_trunc(phdr[i].p_offset);
-    uint64_t end_off = page_align(phdr[i].p_offset + phdr[i].p_filesz);
-    size_t filesz = end_off - off;
+    size_t filesz = phdr[i].p_filesz > 0 ? page_align(file_end_vaddr) - vaddr : 0;
     size_t memsz = end_vaddr - vaddr;
     uint32_t flags = phdr[i].p_flags;
     min_vaddr = min(min_vaddr, vaddr);
 
+    // the file pages are mapped directly so the segment must have the same
+    // offset within a page in the file and in memory
+    if (phdr[i].p_vaddr - vaddr != phdr[i].p_offset - off) {
+      DPRINTF_FUNC("loadable segment is misaligned\n");
+      res = -EINVAL;
+      goto ret;
+    }
+
     uint32_t vm_flags = VM_READ | VM_USER | VM_PRIVATE | VM_FIXED;
     if (flags & PF_X)
       vm_flags |= VM_EXEC;
     if (flags & PF_W)
       vm_flags |= VM_WRITE;
 
-    if (phdr[i].p_filesz == phdr[i].p_memsz) {
-      // this is a data segment that is fully initialized
-      off_t cur_off = (off_t) off;
-      size_t rem_filesz = filesz;
-      page_t *data_pages = NULL;
-      while (rem_filesz > 0) {
-        page_t *page = fs_getpage_cow(fd, cur_off);
-        if (!page) {
-          pg_putref(&data_pages);
-          res = -EIO;
-          goto ret;
-        }
-
-        data_pages = raw_page_list_join(moveref(data_pages), moveref(page));
-        rem_filesz -= PAGE_SIZE;
-        cur_off += PAGE_SIZE;
+    if (filesz > 0) {
+      // the file backed pages are faulted in from the page cache as cow copies
+      // of the cached pages. they share the cached frames until written to, so
+      // text and rodata are still shared by every process running the binary,
+      // but a segment made writable later (e.g. by mprotect) can never write
+      // to the page cache.
+      vm_file_t *shared = fs_get_vmfile(fd, off, filesz, MAP_PRIVATE, PROT_READ);
+      if (shared == NULL) {
+        DPRINTF_FUNC("file cannot be mapped\n");
+        res = -ENOEXEC;
+        goto ret;
       }
-
-      vm_desc_t *seg_desc = vm_desc_alloc(VM_TYPE_PAGE, base + vaddr, memsz, vm_flags, "elf_seg", moveref(data_pages));
-      SLIST_ADD(&descs, seg_desc, next);
-      loaded_size += memsz;
-    } else if (phdr[i].p_filesz < phdr[i].p_memsz) {
-      // this is a data segment that contains the bss (uninitialized data) section
-      uint64_t file_end_vaddr = phdr[i].p_vaddr + phdr[i].p_filesz;
-
-      // if the last file mapped page contains part of the bss section,
-      // we need to replicate a "cow" and copy the file data into a new
-      // page which we will then zero out
-      bool last_page_has_bss = !is_aligned(file_end_vaddr, PAGE_SIZE);
-
-      off_t cur_off = (off_t) off;
-      size_t rem_filesz = filesz;
-      page_t *data_pages = NULL;
-      while (rem_filesz > 0) {
-        page_t *page = fs_getpage_cow(fd, cur_off);
-        if (!page) {
-          pg_putref(&data_pages);
-          res = -EIO;
+      vm_file_t *file = vm_file_alloc_cow(shared);
+      vm_file_free(&shared);
+
+      if (phdr[i].p_filesz < phdr[i].p_memsz && !is_aligned(file_end_vaddr, PAGE_SIZE)) {
+        // the last file page also holds the start of the bss
+        res = elf_load_bss_page(fd, file, filesz - PAGE_SIZE, phdr[i].p_offset + phdr[i].p_filesz);
+        if (res < 0) {
+          vm_file_free(&file);
           goto ret;
         }
-
-        if (last_page_has_bss && rem_filesz <= PAGE_SIZE) {
-          // allocate a new page
-          page_t *last_page = alloc_pages(1);
-          if (!last_page) {
-            pg_putref(&page);
-            pg_putref(&data_pages);
-            res = -ENOMEM;
-            goto ret;
-          }
-
-          // temporarily map the current page into the kernel
-          uintptr_t tmp_vaddr = vmap_pages(moveref(page), 0, PAGE_SIZE, VM_RDWR, "bss_page");
-          if (tmp_vaddr == 0) {
-            pg_putref(&data_pages);
-            pg_putref(&last_page);
-            res = -ENOMEM;
-            goto ret;
-          }
-
-          // copy the data from the mapped page to the new page
-          kio_t kio = kio_new_readable((void *)tmp_vaddr, PAGE_SIZE);
-          rw_unmapped_pages(last_page, 0, &kio);
-
-          // zero out the BSS portion within this page
-          size_t page_file_end = file_end_vaddr & (PAGE_SIZE - 1);
-          size_t page_bss_size = PAGE_SIZE - page_file_end;
-          fill_unmapped_pages(last_page, 0, page_file_end, page_bss_size);
-
-          // unmap the temporary page
-          vmap_free(tmp_vaddr, PAGE_SIZE);
-
-          page = moveref(last_page);
-        }
-
-        data_pages = raw_page_list_join(moveref(data_pages), moveref(page));
-        rem_filesz -= PAGE_SIZE;
-        cur_off += PAGE_SIZE;
-      }
-
-      if (memsz > filesz) {
-        // the unititialized memory spans more than just the pages from the file
-        // allocate extra pages needed to fill the bss section. but first calculate
-        // how much of that spills past the last file page to determine how many we
-        // need to allocate.
-        size_t bss_pages = SIZE_TO_PAGES(memsz) - SIZE_TO_PAGES(page_align(file_end_vaddr) - vaddr);
-        if (bss_pages > 0) {
-          page_t *extra_pages = alloc_pages(SIZE_TO_PAGES(memsz - filesz));
-          if (!extra_pages) {
-            pg_putref(&data_pages);
-            res = -ENOMEM;
-            goto ret;
-          }
-
-          // we need to zero out the extra pages
-          fill_unmapped_pages(extra_pages, 0, 0, PAGES_TO_SIZE(bss_pages));
-
-          data_pages = raw_page_list_join(moveref(data_pages), moveref(extra_pages));
-        }
       }
 
-      // create a descriptor for mapping the pages
-      vm_desc_t *seg_desc = vm_desc_alloc(VM_TYPE_PAGE, base + vaddr, memsz, vm_flags, "elf_seg", moveref(data_pages));
+      vm_desc_t *seg_desc = vm_desc_alloc(VM_TYPE_FILE, base + vaddr, filesz, vm_flags, "elf_seg", file);
       SLIST_ADD(&descs, seg_desc, next);
-      loaded_size += memsz;
-    } else {
-      unreachable;
     }
+
+    if (memsz > filesz) {
+      // the rest of the bss is backed by zeroed anonymous pages
+      size_t bss_size = memsz - filesz;
+      vm_file_t *bss_file = vm_file_alloc_anon_zero(bss_size, PAGE_SIZE);
+      vm_desc_t *bss_desc = vm_desc_alloc(VM_TYPE_FILE, base + vaddr + filesz, bss_size, vm_flags, "elf_bss", bss_file);
+      SLIST_ADD(&descs, bss_desc, next);
+    }
+    loaded_size += memsz;
   }
 
   image->base = base + min_vaddr;
@@ -282,5 +286,6 @@ int elf_load_image(enum exec_type type, int fd, void *file_base, size_t len, uin
 LABEL(ret);
   vm_desc_free_all(&LIST_FIRST(&descs));
   str_free(&interp);
+  kfree(phdr_buf);
   return res;
 }
@@ -5,6 +5,8 @@
 #include <kernel/mm/file.h>
 #include <kernel/mm/pmalloc.h>
 #include <kernel/mm/pgcache.h>
+#include <kernel/mm/pgtable.h>
+#include <kernel/mm/reclaim.h>
 #include <kernel/vfs/vnode.h>
 #include <kernel/panic.h>
 
@@ -16,6 +18,17 @@ static __ref page_t *anon_getpage_missing(vm_file_t *file, size_t off) {
   return page;
 }
 
+static __ref page_t *zero_getpage_missing(vm_file_t *file, size_t off) {
+  // pages are zeroed once when they enter the cache. zeroing them on fault
+  // would clear the contents of a page that a forked child maps for the first
+  // time.
+  page_t *page = alloc_pages_size(1, file->pg_size);
+  if (page != NULL) {
+    fill_unmapped_page(page, 0, 0, file->pg_size);
+  }
+  return page;
+}
+
 static __ref page_t *vnode_getpage_missing(vm_file_t *file, size_t off) {
   int res;
   page_t *page;
@@ -26,6 +39,31 @@ static __ref page_t *vnode_getpage_missing(vm_file_t *file, size_t off) {
   return page;
 }
 
+static __ref page_t *vnode_getpage_cow_missing(vm_file_t *file, size_t off) {
+  // the pages of a private file start out as cow copies of the shared vnode
+  // pages so that only the pages which are written to are copied
+  struct pgcache *pgcache = vn_get_pgcache(file->vnode);
+  mtx_lock(&pgcache->lock);
+  page_t *page = pgcache_lookup(pgcache, off);
+  if (page == NULL) {
+    page = vnode_getpage_missing(file, off);
+    if (page != NULL) {
+      pgcache_insert(pgcache, off, pg_getref(page), NULL);
+    }
+  } else {
+    atomic_fetch_or(&page->flags, PG_REFERENCED);
+  }
+  mtx_unlock(&pgcache->lock);
+  pgcache_free(&pgcache);
+  if (page == NULL) {
+    return NULL;
+  }
+
+  page_t *cow_page = alloc_cow_pages(page);
+  pg_putref(&page);
+  return cow_page;
+}
+
 //
 //
 
@@ -54,6 +92,18 @@ vm_file_t *vm_file_alloc_anon(size_t size, size_t pg_size) {
   return file;
 }
 
+vm_file_t *vm_file_alloc_anon_zero(size_t size, size_t pg_size) {
+  vm_file_t *file = vm_file_alloc_anon(size, pg_size);
+  file->missing_page = zero_getpage_missing;
+  return file;
+}
+
+vm_file_t *vm_file_alloc_shmem(size_t size) {
+  // shared memory objects are visible through read/write as well as through
+  // mappings so their pages must start out zeroed
+  return vm_file_alloc_anon_zero(size, PAGE_SIZE);
+}
+
 vm_file_t *vm_file_alloc_copy(vm_file_t *file) {
   vm_file_t *new_file = kmallocz(sizeof(vm_file_t));
   new_file->size = file->size;
@@ -66,6 +116,19 @@ vm_file_t *vm_file_alloc_copy(vm_file_t *file) {
   return new_file;
 }
 
+vm_file_t *vm_file_alloc_cow(vm_file_t *file) {
+  ASSERT(file->vnode != NULL);
+  vm_file_t *new_file = kmallocz(sizeof(vm_file_t));
+  new_file->size = file->size;
+  new_file->off = file->off;
+  new_file->pg_size = file->pg_size;
+
+  new_file->vnode = vn_getref(file->vnode);
+  new_file->pgcache = pgcache_alloc(file->pgcache->order, file->pg_size);
+  new_file->missing_page = vnode_getpage_cow_missing;
+  return new_file;
+}
+
 vm_file_t *vm_file_alloc_clone(vm_file_t *file) {
   vm_file_t *new_file = kmallocz(sizeof(vm_file_t));
   new_file->size = file->size;
@@ -93,12 +156,23 @@ __ref page_t *vm_file_getpage(vm_file_t *file, size_t off) {
   }
 
   off += file->off;
+  // the cache may be shared by several files (mappings of the same object)
+  // that fault on the same offset at once, only one of them may fill it
+  mtx_lock(&file->pgcache->lock);
   page_t *page = pgcache_lookup(file->pgcache, off);
   if (page == NULL) {
     page = file->missing_page(file, off);
     if (page != NULL) {
       pgcache_insert(file->pgcache, off, pg_getref(page), NULL);
     }
+  } else {
+    atomic_fetch_or(&page->flags, PG_REFERENCED);
+  }
+  mtx_unlock(&file->pgcache->lock);
+
+  if (file->vnode != NULL) {
+    // keep the vnode page cache ordered for reclaim
+    reclaim_track_vnode(file->vnode);
   }
   return moveref(page);
 }
@@ -116,7 +190,7 @@ int vm_file_putpage(vm_file_t *file, __ref page_t *page, size_t off, __move page
     return -1;
   }
 
-  pgcache_insert(file->pgcache, off, page, oldpage);
+  pgcache_insert(file->pgcache, file->off + off, page, oldpage);
   return 0;
 }
 
@@ -124,6 +198,30 @@ void vm_file_visit_pages(vm_file_t *file, size_t start_off, size_t end_off, pgca
   pgcache_visit_pages(file->pgcache, start_off, end_off, fn, data);
 }
 
+void vm_file_discard(vm_file_t *file, size_t off, size_t len) {
+  // drops the pages in [off, off+len) of an unshared anonymous file. the next
+  // access faults in a fresh zeroed page. files whose missing pages are not
+  // zeroed get a zeroed page in place of each dropped one, the freed frame
+  // could otherwise come back still holding its old contents.
+  ASSERT(is_aligned(off, file->pg_size) && is_aligned(len, file->pg_size));
+  if (file->vnode != NULL || read_refcount(file->pgcache) != 1) {
+    return;
+  }
+
+  size_t end = min(off + len, file->size);
+  for (; off < end; off += file->pg_size) {
+    page_t *page = NULL;
+    pgcache_remove(file->pgcache, file->off + off, &page);
+    if (page != NULL && file->missing_page != zero_getpage_missing) {
+      page_t *zero = zero_getpage_missing(file, file->off + off);
+      if (zero != NULL) {
+        pgcache_insert(file->pgcache, file->off + off, zero, NULL);
+      }
+    }
+    pg_putref(&page);
+  }
+}
+
 //
 
 void vm_file_resize(vm_file_t *file, size_t new_size) {
@@ -134,9 +232,16 @@ void vm_file_resize(vm_file_t *file, size_t new_size) {
 
     size_t old_order = pgcache_size_to_order(old_size, file->pg_size);
     size_t new_order = pgcache_size_to_order(new_size, file->pg_size);
-    if (new_order > old_order) {
+    if (new_order > old_order && new_order > file->pgcache->order) {
+      mtx_lock(&file->pgcache->lock);
       pgcache_resize(file->pgcache, new_order);
+      mtx_unlock(&file->pgcache->lock);
     }
+  } else if (new_size < file->size) {
+    // shrinking the file. pages of an anonymous file past the new end can never
+    // be reached again so they are dropped from the cache now.
+    vm_file_discard(file, new_size, file->size - new_size);
+    file->size = new_size;
   }
 }
 
@@ -25,6 +25,7 @@ struct pgcache_node {
 
 struct visit_stack_entry {
   struct pgcache_node *node;
+  size_t base;          // page index of the first slot
   int slot_index;
   uint16_t level;
 };
@@ -61,6 +62,7 @@ static void internal_visit_pages_iter(
 
   stack[top++] = (struct visit_stack_entry){
     .node = root,
+    .base = 0,
     .slot_index = 0,
     .level = level
   };
@@ -79,8 +81,10 @@ static void internal_visit_pages_iter(
     }
 
     current->slot_index++;
-    size_t slot_start = (i << (cache->bits_per_lvl * (cache->order - current->level)));
-    size_t slot_end = slot_start + (1ULL << (cache->bits_per_lvl * (cache->order - current->level)));
+    size_t span = 1ULL << (cache->bits_per_lvl * (cache->order - current->level));
+    size_t slot_index = current->base + i * span;
+    size_t slot_start = slot_index * cache->pg_size;
+    size_t slot_end = slot_start + span * cache->pg_size;
     if (slot_end <= start_off || slot_start >= end_off) {
       continue;
     }
@@ -89,6 +93,7 @@ static void internal_visit_pages_iter(
       if (current->level < cache->order) {
         stack[top++] = (struct visit_stack_entry){
           .node = (struct pgcache_node *) node->slots[i],
+          .base = slot_index,
           .slot_index = 0,
           .level = current->level + 1
         };
@@ -110,9 +115,11 @@ static struct pgcache_node *internal_lookup_leaf(struct pgcache *tree, size_t of
   size_t order = tree->order;
   size_t idx;
 
+  // the root is indexed by the most significant bits so that growing the tree
+  // only needs to push the old root down into slot 0 of a new one
   off >>= log2(pg_size); // shift out the page offset
   for (size_t i = 0; i < order; i++) {
-    idx = (off & ((1 << bits_per_lvl) - 1));
+    idx = ((off >> (bits_per_lvl * (order - i))) & ((1 << bits_per_lvl) - 1));
     kassert(idx < PGCACHE_FANOUT);
     struct pgcache_node *child = node->slots[idx];
     if (child == NULL) {
@@ -126,7 +133,6 @@ static struct pgcache_node *internal_lookup_leaf(struct pgcache *tree, size_t of
         LIST_ADD(&tree->leaf_nodes, child, leaf.list);
       }
     }
-    off >>= bits_per_lvl;
     node = child;
   }
 
@@ -158,6 +164,7 @@ __ref struct pgcache *pgcache_alloc(uint16_t order, uint32_t pg_size) {
   tree->pg_size = pg_size;
   tree->max_capacity = (1ULL << ((order + 1) * tree->bits_per_lvl)) * pg_size;
   tree->root = kmallocz(sizeof(struct pgcache_node));
+  mtx_init(&tree->lock, 0, "pgcache_lock");
   ref_init(&tree->refcount);
 
   if (order == 0) {
@@ -176,6 +183,7 @@ void pgcache_free(struct pgcache **cacheptr) {
   struct pgcache *cache = moveref(*cacheptr);
   if (cache && ref_put(&cache->refcount)) {
     internal_visit_pages_iter(cache, &cache->root, 0, cache->max_capacity, /*free=*/true, 0, (void *) pgcache_putpage_cb, NULL);
+    mtx_destroy(&cache->lock);
     kfree(cache);
   }
 }
@@ -308,6 +308,20 @@ void recursive_unmap_entry(uintptr_t vaddr, uint32_t vm_flags) {
   cpu_invlpg(pt);
 }
 
+bool recursive_is_mapped(uintptr_t vaddr) {
+  // walks the active tables without taking any locks so it is safe to use from
+  // interrupt context. the answer may be stale by the time it is used.
+  for (pg_level_t level = PG_LEVEL_PML4; level > PG_LEVEL_PT; level--) {
+    uint64_t entry = get_pgtable_address(vaddr, level)[index_for_pg_level(vaddr, level)];
+    if (!(entry & PE_PRESENT)) {
+      return false;
+    } else if (level != PG_LEVEL_PML4 && (entry & PE_SIZE)) {
+      return true; // large page
+    }
+  }
+  return (get_pgtable_address(vaddr, PG_LEVEL_PT)[PT_INDEX(vaddr)] & PE_PRESENT) != 0;
+}
+
 void recursive_update_entry_flags(uintptr_t vaddr, uint32_t vm_flags) {
   pg_level_t level = PG_LEVEL_PT;
   if (vm_flags & VM_HUGE_2MB) {
@@ -339,6 +353,92 @@ void recursive_update_entry(uintptr_t vaddr, uintptr_t frame, uint32_t vm_flags)
   cpu_invlpg(pt);
 }
 
+void recursive_move_entries(uintptr_t old_vaddr, uintptr_t new_vaddr, size_t size, uint32_t vm_flags, __move page_t **out_pages) {
+  pg_level_t level = vm_flags_to_level(vm_flags);
+  size_t pg_size = 1ULL << pg_level_to_shift(level);
+  page_t *first_table = NULL;
+  page_t *last_table = NULL;
+
+  size_t off = 0;
+  while (off < size) {
+    uintptr_t vaddr = old_vaddr + off;
+
+    // skip over the whole range covered by a missing intermediate table
+    pg_level_t l;
+    for (l = PG_LEVEL_PML4; l > level; l--) {
+      uint64_t *table = get_pgtable_address(vaddr, l);
+      if (!(table[index_for_pg_level(vaddr, l)] & PE_PRESENT)) {
+        break;
+      }
+    }
+    if (l > level) {
+      size_t span = 1ULL << pg_level_to_shift(l);
+      off = align(vaddr + 1, span) - old_vaddr;
+      continue;
+    }
+
+    int index = index_for_pg_level(vaddr, level);
+    uint64_t *pt = get_pgtable_address(vaddr, level);
+    uint64_t entry = pt[index];
+    if (entry & PE_PRESENT) {
+      pt[index] = 0;
+      barrier();
+      cpu_invlpg(vaddr);
+
+      // install the same entry at the new address. the original entry flags
+      // are kept so that cow pages stay write protected
+      page_t *table_pages = NULL;
+      uint64_t *new_pte = recursive_map_entry(new_vaddr + off, entry & PE_FRAME_MASK, vm_flags, &table_pages);
+      *new_pte = entry;
+      barrier();
+      cpu_invlpg(new_vaddr + off);
+
+      if (table_pages != NULL) {
+        if (first_table == NULL) {
+          first_table = table_pages;
+        } else {
+          last_table->next = table_pages;
+        }
+        last_table = SLIST_GET_LAST(table_pages, next);
+      }
+    }
+    off += pg_size;
+  }
+
+  if (out_pages != NULL) {
+    *out_pages = first_table;
+  }
+}
+
+void recursive_write_protect_range(uintptr_t vaddr, size_t size, uint32_t vm_flags) {
+  pg_level_t level = vm_flags_to_level(vm_flags);
+  size_t pg_size = 1ULL << pg_level_to_shift(level);
+  uintptr_t end = vaddr + size;
+
+  while (vaddr < end) {
+    // skip over the whole range covered by a missing intermediate table
+    pg_level_t l;
+    for (l = PG_LEVEL_PML4; l > level; l--) {
+      uint64_t *table = get_pgtable_address(vaddr, l);
+      if (!(table[index_for_pg_level(vaddr, l)] & PE_PRESENT)) {
+        break;
+      }
+    }
+    if (l > level) {
+      vaddr = align(vaddr + 1, 1ULL << pg_level_to_shift(l));
+      continue;
+    }
+
+    // clear the write bit of the remaining entries of this table in one pass
+    uint64_t *table = get_pgtable_address(vaddr, level);
+    for (int i = index_for_pg_level(vaddr, level); i < NUM_ENTRIES && vaddr < end; i++) {
+      table[i] &= ~PE_WRITE;
+      vaddr += pg_size;
+    }
+  }
+  barrier();
+}
+
 uint64_t recursive_duplicate_pgtable(
   const uint64_t *src_table,
   pg_level_t level,
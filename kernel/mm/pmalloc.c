@@ -5,6 +5,7 @@
 #include <kernel/mm/pmalloc.h>
 #include <kernel/mm/vmalloc.h>
 #include <kernel/mm/init.h>
+#include <kernel/mm/reclaim.h>
 
 #include <kernel/mutex.h>
 #include <kernel/string.h>
@@ -23,6 +24,15 @@ static size_t zone_page_count[MAX_ZONE_TYPE];
 static size_t reserved_pages = 128;
 static page_t *initrd_pages = NULL;
 
+// free memory across all allocators. when an allocation leaves less than the
+// low watermark free the reclaimer is woken to bring it back over the high one.
+static volatile size_t pmem_free;
+static size_t pmem_low_watermark;
+static size_t pmem_high_watermark;
+
+#define WATERMARK_MIN_PAGES 256
+#define WATERMARK_DIVISOR   64  // low watermark is 1/64 of memory
+
 static const size_t zone_limits[MAX_ZONE_TYPE] = {
   [ZONE_TYPE_LOW] = ZONE_LOW_MAX,
   [ZONE_TYPE_DMA] = ZONE_DMA_MAX,
@@ -314,6 +324,7 @@ frame_allocator_t *new_frame_allocator(uintptr_t base, size_t size, struct frame
     return NULL;
   }
 
+  atomic_fetch_add(&pmem_free, size);
   return fa;
 }
 
@@ -324,11 +335,12 @@ __move page_t *fa_alloc_pages(frame_allocator_t *fa, size_t count, size_t pg_siz
   }
 
   // alloc the backing frames
-  uintptr_t frame = fa->impl->fa_alloc(fa, count, pg_size);
-  if (frame == 0) {
+  intptr_t frame = fa->impl->fa_alloc(fa, count, pg_size);
+  if (frame <= 0) {
     return NULL;
   }
 
+  atomic_fetch_sub(&pmem_free, count * pg_size);
   ASSERT(is_aligned(frame, pg_size));
   return alloc_page_structs(fa, frame, count, pg_size);
 }
@@ -341,13 +353,18 @@ int fa_reserve_pages(frame_allocator_t *fa, uintptr_t frame, size_t count, size_
     return -1;
   }
 
-  return fa->impl->fa_reserve(fa, frame, count, pg_size);
+  int res = fa->impl->fa_reserve(fa, frame, count, pg_size);
+  if (res == 0) {
+    atomic_fetch_sub(&pmem_free, count * pg_size);
+  }
+  return res;
 }
 
 void fa_free_page(page_t *page) {
   if (page->flags & PG_OWNING) {
     frame_allocator_t *fa = page->fa;
     fa->impl->fa_free(fa, page->address, 1, pg_flags_to_size(page->flags));
+    atomic_fetch_add(&pmem_free, pg_flags_to_size(page->flags));
   } else if (page->flags & PG_COW) {
     // drop ref to the source page
     putref(&page->source, fa_free_page);
@@ -406,6 +423,13 @@ void init_mem_zones() {
     }
   }
 
+  size_t total_pages = 0;
+  for (size_t i = 0; i < MAX_ZONE_TYPE; i++) {
+    total_pages += zone_page_count[i];
+  }
+  pmem_low_watermark = PAGES_TO_SIZE(max(total_pages / WATERMARK_DIVISOR, WATERMARK_MIN_PAGES));
+  pmem_high_watermark = 2 * pmem_low_watermark;
+
   kprintf("memory zones:\n");
   for (size_t i = 0; i < MAX_ZONE_TYPE; i++) {
     uintptr_t zone_start = i == 0 ? 0 : zone_limits[i - 1];
@@ -433,6 +457,15 @@ void get_pmem_info(size_t *total_bytes, size_t *free_bytes) {
   if (free_bytes) *free_bytes = free;
 }
 
+size_t get_pmem_free() {
+  return atomic_load(&pmem_free);
+}
+
+void get_pmem_watermarks(size_t *low_bytes, size_t *high_bytes) {
+  if (low_bytes) *low_bytes = pmem_low_watermark;
+  if (high_bytes) *high_bytes = pmem_high_watermark;
+}
+
 int reserve_pages(enum pg_rsrv_kind kind, uintptr_t address, size_t count, size_t pagesize) {
   ASSERT(pagesize == PAGE_SIZE || pagesize == PAGE_SIZE_2MB || pagesize == PAGE_SIZE_1GB);
   ASSERT(is_aligned(address, pagesize));
@@ -512,6 +545,9 @@ __ref page_t *alloc_pages_size(size_t count, size_t pagesize) {
       zone_type = zone_alloc_order[zone_type];
   }
 
+  if (atomic_load(&pmem_free) < pmem_low_watermark) {
+    reclaim_wakeup();
+  }
   return pages;
 }
 
@@ -602,7 +602,8 @@ void *pool_alloc(pool_t *pool, size_t size) {
   }
 
   if (obj) {
-    memset(obj, 0, class->obj_size);
+    if (!(pool->flags & POOL_NOZERO))
+      memset(obj, 0, class->obj_size);
     if (!(pool->flags & POOL_NOSTATS))
       atomic_fetch_add(&pool->allocs, 1);
   }
@@ -733,10 +734,11 @@ void pool_print_debug_stats(pool_t *pool) {
   kprintf_raw("  total frees: %llu\n", pool->frees);
   kprintf_raw("  slabs created: %llu\n", pool->slab_creates);
   kprintf_raw("  slabs destroyed: %llu\n", pool->slab_destroys);
-  kprintf_raw("  flags: %s%s%s\n",
+  kprintf_raw("  flags: %s%s%s%s\n",
           (pool->flags & POOL_NOCACHE) ? "NOCACHE " : "",
           (pool->flags & POOL_NOSTATS) ? "NOSTATS " : "",
-          (pool->flags & POOL_LAZY) ? "LAZY" : "");
+          (pool->flags & POOL_LAZY) ? "LAZY " : "",
+          (pool->flags & POOL_NOZERO) ? "NOZERO" : "");
   kprintf_raw("  alignment: %zu\n", pool->alignment);
 
   for (uint32_t i = 0; i < pool->num_classes; i++) {
@@ -0,0 +1,270 @@
+//
+// Created by Aaron Gill-Braun on 2026-10-18.
+//
+
+#include <kernel/mm/reclaim.h>
+#include <kernel/mm/pmalloc.h>
+#include <kernel/mm/pgcache.h>
+#include <kernel/vfs/vnode.h>
+#include <kernel/proc.h>
+#include <kernel/mutex.h>
+#include <kernel/cond.h>
+#include <kernel/time.h>
+
+#include <kernel/panic.h>
+#include <kernel/printf.h>
+
+#include <fs/procfs/procfs.h>
+
+#define ASSERT(x) kassert(x)
+#define LOG_TAG reclaim
+#include <kernel/log.h>
+#define EPRINTF(fmt, ...) kprintf("reclaim: %s: " fmt, __func__, ##__VA_ARGS__)
+
+#define RECLAIM_BATCH       32    // max pages dropped from one cache per pass
+#define RECLAIM_INTERVAL_MS 1000  // watermark recheck interval when idle
+
+/*
+ * Page cache reclaim.
+ *
+ * Vnodes with a page cache are kept on an lru list ordered by the last time a
+ * page was faulted in through one of their mappings. When free memory drops
+ * below the low watermark the reclaim thread walks the list from the cold end
+ * and drops idle pages until free memory is back above the high watermark.
+ * Pages accessed since the last pass get a second chance.
+ *
+ * Page table entries do not hold page references, so a mapped page cannot be
+ * told apart from an idle one. Only caches that no vm_file is using (the vnode
+ * holds the only reference) are scanned and of those only pages referenced by
+ * the cache alone are dropped. Such pages are clean, the filesystem getpage
+ * can always produce them again.
+ *
+ * Pages of a filesystem that keeps file data in memory (ramfs pages are owned
+ * by the file memfile) always have a second reference. They are the only copy
+ * of the data and dropping them from the cache would free nothing, so a vnode
+ * whose cache holds nothing but such pages is taken off the lru until it is
+ * used again.
+ */
+
+static LIST_HEAD(struct vnode) vnode_lru;
+static size_t vnode_lru_count;
+static mtx_t vnode_lru_lock;
+
+static mtx_t reclaim_lock;
+static cond_t reclaim_cond;
+static volatile bool reclaim_pending;
+
+// stats
+static uint64_t reclaim_runs;
+static uint64_t reclaim_scanned;
+static uint64_t reclaim_freed;
+
+static void reclaim_static_init() {
+  mtx_init(&vnode_lru_lock, MTX_SPIN, "vnode_lru_lock");
+  mtx_init(&reclaim_lock, 0, "reclaim_lock");
+  cond_init(&reclaim_cond, "reclaim_cond");
+}
+STATIC_INIT(reclaim_static_init);
+
+static inline bool vnode_on_lru(vnode_t *vn) {
+  return vn->lru.prev != NULL || LIST_FIRST(&vnode_lru) == vn;
+}
+
+struct reclaim_scan {
+  size_t offs[RECLAIM_BATCH];
+  size_t count;
+  size_t max;
+  size_t visited;
+  size_t held;      // pages with a reference from outside the cache
+};
+
+static void reclaim_scan_cb(page_t **pageref, size_t off, void *data) {
+  struct reclaim_scan *scan = data;
+  page_t *page = *pageref;
+  scan->visited++;
+  if (scan->count >= scan->max) {
+    return;
+  }
+
+  // anything other than the cache holding a reference means the page is in use
+  if (ref_count(&page->refcount) > 1) {
+    scan->held++;
+    atomic_fetch_and(&page->flags, ~PG_REFERENCED);
+    return;
+  }
+  if (page->flags & (PG_BUSY | PG_REFERENCED)) {
+    atomic_fetch_and(&page->flags, ~PG_REFERENCED);
+    return;
+  }
+  scan->offs[scan->count++] = off;
+}
+
+// drops up to `max` idle pages from the vnode page cache. `empty` is set if the
+// cache has no pages left that could be dropped later.
+static size_t reclaim_vnode(vnode_t *vn, size_t max, bool *empty) {
+  *empty = false;
+  if (!vn_lock(vn)) {
+    *empty = true; // vnode is dead
+    return 0;
+  }
+
+  // holding the vnode lock keeps new mappings from taking a cache reference
+  // and serializes against lookups through vn_getpage.
+  size_t freed = 0;
+  struct pgcache *cache = vn->pgcache;
+  if (cache == NULL) {
+    *empty = true;
+  } else if (read_refcount(cache) == 1) {
+    struct reclaim_scan scan = {.count = 0, .max = min(max, RECLAIM_BATCH), .visited = 0, .held = 0};
+    pgcache_visit_pages(cache, 0, 0, reclaim_scan_cb, &scan);
+    for (size_t i = 0; i < scan.count; i++) {
+      pgcache_remove(cache, scan.offs[i], NULL);
+    }
+
+    freed = scan.count;
+    *empty = scan.visited == scan.count + scan.held;
+    atomic_fetch_add(&reclaim_scanned, scan.visited);
+  }
+
+  vn_unlock(vn);
+  return freed;
+}
+
+//
+// MARK: Reclaim API
+//
+
+void reclaim_track_vnode(vnode_t *vn) {
+  if (LIST_FIRST(&vnode_lru) == vn) {
+    return; // already the most recent, skip the lock
+  }
+
+  mtx_spin_lock(&vnode_lru_lock);
+  if (LIST_FIRST(&vnode_lru) != vn) {
+    if (vnode_on_lru(vn)) {
+      LIST_REMOVE(&vnode_lru, vn, lru);
+    } else {
+      vnode_lru_count++;
+    }
+    LIST_ADD_FRONT(&vnode_lru, vn, lru);
+  }
+  mtx_spin_unlock(&vnode_lru_lock);
+}
+
+void reclaim_untrack_vnode(vnode_t *vn) {
+  mtx_spin_lock(&vnode_lru_lock);
+  if (vnode_on_lru(vn)) {
+    LIST_REMOVE(&vnode_lru, vn, lru);
+    vnode_lru_count--;
+  }
+  mtx_spin_unlock(&vnode_lru_lock);
+}
+
+size_t reclaim_pages(size_t target) {
+  // walks the lru from the cold end, rotating each scanned vnode to the front
+  mtx_spin_lock(&vnode_lru_lock);
+  size_t passes = vnode_lru_count;
+  mtx_spin_unlock(&vnode_lru_lock);
+
+  size_t freed = 0;
+  while (freed < target && passes-- > 0) {
+    mtx_spin_lock(&vnode_lru_lock);
+    vnode_t *vn = LIST_LAST(&vnode_lru);
+    if (vn == NULL) {
+      mtx_spin_unlock(&vnode_lru_lock);
+      break;
+    }
+
+    // a vnode with no references left is being cleaned up
+    LIST_REMOVE(&vnode_lru, vn, lru);
+    bool alive = ref_tryget(&vn->refcount);
+    if (alive) {
+      LIST_ADD_FRONT(&vnode_lru, vn, lru);
+    } else {
+      vnode_lru_count--;
+    }
+    mtx_spin_unlock(&vnode_lru_lock);
+    if (!alive) {
+      continue;
+    }
+
+    bool empty;
+    freed += reclaim_vnode(vn, target - freed, &empty);
+    if (empty) {
+      // it is added back the next time one of its pages is faulted in
+      reclaim_untrack_vnode(vn);
+    }
+    vn_putref(&vn);
+  }
+
+  atomic_fetch_add(&reclaim_freed, freed);
+  return freed;
+}
+
+void reclaim_wakeup() {
+  // called from the page allocator when free memory crosses the low watermark
+  if (reclaim_pending) {
+    return;
+  }
+  reclaim_pending = true;
+  cond_signal(&reclaim_cond);
+}
+
+//
+// MARK: Reclaim thread
+//
+
+static int reclaim_main() {
+  // this runs in a dedicated kernel process
+  size_t low, high;
+  for (;;) {
+    mtx_lock(&reclaim_lock);
+    while (!reclaim_pending) {
+      struct timespec ts = timespec_from_nanos(MS_TO_NS(RECLAIM_INTERVAL_MS));
+      cond_wait_timeout(&reclaim_cond, &reclaim_lock, &ts);
+
+      // the wakeup is not synchronized with the lock so recheck periodically
+      get_pmem_watermarks(&low, &high);
+      if (get_pmem_free() < low) {
+        reclaim_pending = true;
+      }
+    }
+    mtx_unlock(&reclaim_lock);
+
+    reclaim_runs++;
+    get_pmem_watermarks(&low, &high);
+    size_t free;
+    while ((free = get_pmem_free()) < high) {
+      size_t freed = reclaim_pages(SIZE_TO_PAGES(high - free));
+      DPRINTF("reclaimed %zu pages [free=%zu, high=%zu]\n", freed, free, high);
+      if (freed == 0) {
+        break; // nothing left to drop
+      }
+    }
+    reclaim_pending = false;
+  }
+  return 0;
+}
+
+static void reclaim_init() {
+  __ref proc_t *reclaim_proc = proc_alloc_new(getref(curproc->creds));
+  proc_setup_add_thread(reclaim_proc, thread_alloc(TDF_KTHREAD, SIZE_16KB));
+  proc_setup_entry(reclaim_proc, (uintptr_t) reclaim_main, 0);
+  proc_setup_name(reclaim_proc, cstr_make("reclaim"));
+  proc_finish_setup_and_submit_all(moveref(reclaim_proc));
+}
+MODULE_INIT(reclaim_init);
+
+//
+// MARK: procfs
+//
+
+static int reclaim_stats_show(seqfile_t *sf, void *_) {
+  size_t low, high;
+  get_pmem_watermarks(&low, &high);
+  seq_printf(sf, "free=%zu  low=%zu  high=%zu  vnodes=%zu  runs=%llu  scanned=%llu  freed=%llu\n",
+    SIZE_TO_PAGES(get_pmem_free()), SIZE_TO_PAGES(low), SIZE_TO_PAGES(high), vnode_lru_count,
+    reclaim_runs, reclaim_scanned, reclaim_freed);
+  return 0;
+}
+PROCFS_REGISTER_SIMPLE(reclaim, "/reclaim", reclaim_stats_show, NULL, 0444);
@@ -17,6 +17,7 @@
 #include <kernel/proc.h>
 #include <kernel/panic.h>
 #include <kernel/string.h>
+#include <kernel/trace.h>
 #include <kernel/printf.h>
 
 #include <fs/procfs/procfs.h>
@@ -36,6 +37,9 @@
 
 #define do_align(x, al) ((al) > 0 ? (align(x, al)) : (x))
 
+#define VM_READAHEAD_PAGES 16 // pages read ahead of a fault in a VM_SEQ_READ mapping
+#define VM_FAULTAROUND_PAGES 16 // pages mapped around a non-present fault in a page mapping
+
 // these are the default hints for different combinations of vm flags
 // they are used as a starting point for the kernel when searching for
 // a free region
@@ -229,17 +233,15 @@ static page_list_t *page_type_fork_internal(vm_mapping_t *vm) {
   }
 
   // for private or writable mappings, we need to mark the pages as COW
-  // and then update the entries to be read-only
-  uint32_t cow_flags = vm->flags & ~VM_WRITE;
-  size_t stride = vm_flags_to_size(vm->flags);
-  size_t off = 0;
+  // and then update the entries to be read-only. the entries are protected
+  // in a single pass over the range and the tlb is flushed once the whole
+  // space has been forked.
   page_list_foreach(page, vm->vm_pages) {
     page->flags |= PG_COW;
-    if (vm->flags & VM_MAPPED) {
-      recursive_update_entry_flags(vm->address + off, cow_flags);
-    }
-    off += stride;
   };
+  if (vm->flags & VM_MAPPED) {
+    recursive_write_protect_range(vm->address, vm->size, vm->flags);
+  }
 
   return page_list_clone(vm->vm_pages);
 }
@@ -295,6 +297,40 @@ static void page_type_putpage_internal(vm_mapping_t *vm, __ref page_t *page, siz
   page_list_putpage(vm->vm_pages, index, moveref(page));
 }
 
+// zeroes the pages in [off, off+size). page mappings must stay fully backed so
+// the pages are cleared rather than released, and a copy-on-write page still
+// shared with another space is replaced with a new zeroed page.
+static int page_type_discard_internal(vm_mapping_t *vm, size_t size, size_t off) {
+  size_t stride = vm_flags_to_size(vm->flags);
+  if (stride != PAGE_SIZE) {
+    return -EINVAL;
+  }
+
+  for (size_t o = off; o < off + size; o += stride) {
+    page_t *page = page_type_getpage_internal(vm, o);
+    if (page->flags & PG_COW) {
+      page_t *newpage = alloc_pages_size(1, stride);
+      if (newpage == NULL) {
+        pg_putref(&page);
+        return -ENOMEM;
+      }
+
+      fill_unmapped_page(newpage, 0, 0, stride);
+      uintptr_t newpage_addr = newpage->address;
+      page_type_putpage_internal(vm, moveref(newpage), o);
+      if ((vm->flags & VM_MAPPED) && recursive_is_mapped(vm->address + o)) {
+        // an entry that was never faulted in (forked page tables are filled
+        // on demand) picks up the new page on its next fault
+        recursive_update_entry(vm->address + o, newpage_addr, vm->flags);
+      }
+    } else {
+      fill_unmapped_page(page, 0, 0, stride);
+    }
+    pg_putref(&page);
+  }
+  return 0;
+}
+
 static page_list_t *page_type_split_internal(vm_mapping_t *vm, size_t off) {
   ASSERT(off > 0);
   size_t index = off / vm_flags_to_size(vm->flags);
@@ -309,17 +345,13 @@ static void page_type_join_internal(vm_mapping_t *vm, page_list_t **otherlist) {
 
 struct file_cb_data {
   vm_mapping_t *vm;
-  size_t off;
   bool unmap;
 };
 
+// the visited offsets are cache offsets so they are relative to vm_file->off
 static void file_fork_cb(page_t **pageref, size_t off, void *data) {
   page_t *page = *pageref;
-  struct file_cb_data *cb = data;
-  vm_mapping_t *vm = cb->vm;
   page->flags |= PG_COW;
-  recursive_update_entry_flags(vm->address + cb->off, vm->flags & ~VM_WRITE);
-  cb->off += pg_flags_to_size(page->flags);
 }
 
 static void file_map_update_cb(page_t **pageref, size_t off, void *data) {
@@ -327,7 +359,7 @@ static void file_map_update_cb(page_t **pageref, size_t off, void *data) {
   struct file_cb_data *cb = data;
   vm_mapping_t *vm = cb->vm;
 
-  uintptr_t vaddr = vm->address + cb->off;
+  uintptr_t vaddr = vm->address + (off - vm->vm_file->off);
   if (cb->unmap) {
     recursive_unmap_entry(vaddr, vm->flags);
   } else {
@@ -343,8 +375,6 @@ static void file_map_update_cb(page_t **pageref, size_t off, void *data) {
       SLIST_ADD_SLIST(&vm->space->table_pages, table_pages, last_page, next);
     }
   }
-
-  cb->off += pg_flags_to_size(page->flags);
 }
 
 static vm_file_t *file_type_fork_internal(vm_mapping_t *vm) {
@@ -355,14 +385,17 @@ static vm_file_t *file_type_fork_internal(vm_mapping_t *vm) {
 
   // for private or writable mappings, we need to mark the pages as COW
   // and then update the entries to be read-only.
-  struct file_cb_data data = {vm, /*off=*/0, /*unmap=*/false};
-  vm_file_visit_pages(vm->vm_file, 0, vm->size, file_fork_cb, &data);
+  struct file_cb_data data = {vm, /*unmap=*/false};
+  vm_file_visit_pages(vm->vm_file, vm->vm_file->off, vm->vm_file->off + vm->size, file_fork_cb, &data);
+  if (vm->flags & VM_MAPPED) {
+    recursive_write_protect_range(vm->address, vm->size, vm->flags);
+  }
   return vm_file_alloc_clone(vm->vm_file);
 }
 
 static void file_type_map_internal(vm_mapping_t *vm, size_t size, size_t off) {
-  struct file_cb_data data = {vm, off, /*unmap=*/false};
-  vm_file_visit_pages(vm->vm_file, vm->vm_file->off + off, vm->vm_file->off + off + vm->size, file_map_update_cb, &data);
+  struct file_cb_data data = {vm, /*unmap=*/false};
+  vm_file_visit_pages(vm->vm_file, vm->vm_file->off + off, vm->vm_file->off + off + size, file_map_update_cb, &data);
 }
 
 static void file_type_unmap_internal(vm_mapping_t *vm, size_t size, size_t off) {
@@ -516,12 +549,16 @@ static void vm_free_internal(vm_mapping_t *vm, bool unmap) {
   }
 }
 
-static int vm_handle_non_present_fault(vm_mapping_t *vm, size_t off) {
-  if (vm->type != VM_TYPE_FILE) {
-    EPRINTF("vm_handle_non_present_fault: non-file vm type [vm={:str}, addr=%p, off=%zu]\n", &vm->name, vm->address, off);
-    return -1;
+static void vm_map_fault_entry(vm_mapping_t *vm, uintptr_t vaddr, uintptr_t paddr, uint32_t vm_flags) {
+  page_t *table_pages = NULL;
+  recursive_map_entry(vaddr, paddr, vm_flags, &table_pages);
+  if (table_pages != NULL) {
+    page_t *last_page = SLIST_GET_LAST(table_pages, next);
+    SLIST_ADD_SLIST(&vm->space->table_pages, table_pages, last_page, next);
   }
+}
 
+static int vm_handle_file_fault(vm_mapping_t *vm, size_t off) {
   page_t *page = file_type_getpage_internal(vm, off);
   if (page == NULL) {
     EPRINTF("failed to get non-present page in vm_file [vm={:str}, addr=%p, off=%zu]\n", &vm->name, vm->address, off);
@@ -529,30 +566,72 @@ static int vm_handle_non_present_fault(vm_mapping_t *vm, size_t off) {
   }
 
   // map the page into the address space
-  page_t *table_pages = NULL;
-  recursive_map_entry(vm->address+off, page->address, vm->flags, &table_pages);
-  if (table_pages != NULL) {
-    page_t *last_page = SLIST_GET_LAST(table_pages, next);
-    SLIST_ADD_SLIST(&vm->space->table_pages, table_pages, last_page, next);
+  uint32_t vm_flags = vm->flags;
+  if (page->flags & PG_COW) {
+    vm_flags &= ~VM_WRITE;
   }
-
-  if (vm->flags & VM_ZERO) {
-    size_t pg_size = pg_flags_to_size(page->flags);
-    if (vm->flags & VM_WRITE) {
-      memset((void *)(vm->address + off), 0, pg_size);
-    } else {
-      critical_enter();
-      cpu_disable_write_protection();
-      memset((void *)(vm->address + off), 0, pg_size);
-      cpu_enable_write_protection();
-      critical_exit();
+  vm_map_fault_entry(vm, vm->address+off, page->address, vm_flags);
+  pg_putref(&page);
+  if ((vm->flags & VM_SEQ_READ) && vm->vm_file->vnode != NULL) {
+    // read ahead of sequential access so the following faults hit the cache
+    size_t pg_size = vm_flags_to_size(vm->flags);
+    size_t end = min(off + (VM_READAHEAD_PAGES + 1) * pg_size, vm->size);
+    for (size_t ra_off = off + pg_size; ra_off < end; ra_off += pg_size) {
+      page_t *ra_page = vm_file_getpage(vm->vm_file, ra_off);
+      pg_putref(&ra_page);
     }
   }
+  return 0;
+}
 
-  pg_putref(&page);
+// page and phys mappings are always backed in full, so a non-present fault in
+// one is an address that has not been touched since the space was forked (the
+// user page tables are not copied on fork).
+static int vm_handle_page_fault(vm_mapping_t *vm, size_t off) {
+  // map the surrounding pages as well so that a forked process touching its
+  // memory does not take a fault for every page
+  size_t stride = vm_flags_to_size(vm->flags);
+  size_t window = VM_FAULTAROUND_PAGES * stride;
+  size_t start = align_down(off, window);
+  size_t end = min(start + window, vm->size);
+  for (size_t pg_off = start; pg_off < end; pg_off += stride) {
+    uintptr_t vaddr = vm->address + pg_off;
+    if (pg_off != off && recursive_is_mapped(vaddr)) {
+      continue;
+    }
+
+    page_t *page = page_type_getpage_internal(vm, pg_off);
+    if (page == NULL) {
+      EPRINTF("failed to get page in mapping [vm={:str}, addr=%p, off=%zu]\n", &vm->name, vm->address, pg_off);
+      return -1;
+    }
+
+    uint32_t vm_flags = vm->flags;
+    if (page->flags & PG_COW) {
+      vm_flags &= ~VM_WRITE;
+    }
+    vm_map_fault_entry(vm, vaddr, page->address, vm_flags);
+    pg_putref(&page);
+  }
   return 0;
 }
 
+static int vm_handle_non_present_fault(vm_mapping_t *vm, size_t off) {
+  off = align_down(off, vm_flags_to_size(vm->flags));
+  switch (vm->type) {
+    case VM_TYPE_PHYS:
+      vm_map_fault_entry(vm, vm->address+off, vm->vm_phys+off, vm->flags);
+      return 0;
+    case VM_TYPE_PAGE:
+      return vm_handle_page_fault(vm, off);
+    case VM_TYPE_FILE:
+      return vm_handle_file_fault(vm, off);
+    default:
+      EPRINTF("vm_handle_non_present_fault: invalid vm type [vm={:str}, addr=%p, off=%zu]\n", &vm->name, vm->address, off);
+      return -1;
+  }
+}
+
 static int vm_handle_cow_fault(vm_mapping_t *vm, size_t off) {
   __ref page_t *page;
   if (vm->type == VM_TYPE_PAGE) {
@@ -666,14 +745,14 @@ static bool resize_mapping_inplace(vm_mapping_t *vm, size_t new_size) {
   // we dont need to update the tree just the mapping size and address. for normal
   // mappings this means just updating vm->size + vm->vm_size, for stack mappings,
   // we need to bump vm->address up to account for the change.
-  off_t delta = diff(new_size, vm->size);
+  size_t delta = new_size > vm->size ? new_size - vm->size : vm->size - new_size;
   if (new_size < vm->size) {
     vm->size = new_size;
     vm->virt_size = max(vm->virt_size, new_size);
     if (vm->flags & VM_STACK)
       vm->address += delta;
     return true;
-  } else if (new_size > vm->size && new_size <= vm_empty_space(vm)) {
+  } else if (new_size > vm->size && delta <= vm_empty_space(vm)) {
     vm->size = new_size;
     vm->virt_size = max(vm->virt_size, new_size);
     if (vm->flags & VM_STACK)
@@ -682,32 +761,34 @@ static bool resize_mapping_inplace(vm_mapping_t *vm, size_t new_size) {
   }
 
   // for growing beyond the virtual space of the node we need to update the tree
-  // but first we need to make sure we dont overlap with the next node
+  // but first we need to make sure we dont overlap with the next node. only the
+  // part not already covered by the empty space needs to be claimed.
+  size_t grow = delta - vm_empty_space(vm);
   if (vm->flags & VM_STACK) {
     vm_mapping_t *prev = LIST_PREV(vm, vm_list);
 
     // |--prev--| empty space |---vm---|
-    size_t empty_space = vm->inode.start - prev->inode.end + vm_empty_space(vm);
-    if (empty_space < delta) {
+    uintptr_t limit = prev ? prev->inode.end : space->min_addr;
+    if (vm->inode.start - limit < grow) {
       return false;
     }
 
-    intvl_tree_v2_update(space->tree, &vm->inode, -delta, 0);
-    vm->address -= new_size - vm->size;
+    intvl_tree_v2_update(space->tree, &vm->inode, -(int64_t)grow, 0);
+    vm->address -= delta;
     vm->size = new_size;
-    vm->virt_size = max(vm->virt_size, new_size);
+    vm->virt_size += grow;
   } else {
     vm_mapping_t *next = LIST_NEXT(vm, vm_list);
 
     // |---vm---| empty space |--next--|
-    size_t empty_space = next->inode.start - vm->inode.end + vm_empty_space(vm);
-    if (empty_space < delta) {
+    uintptr_t limit = next ? next->inode.start : space->max_addr;
+    if (limit - vm->inode.end < grow) {
       return false;
     }
 
-    intvl_tree_v2_update(space->tree, &vm->inode, 0, delta);
+    intvl_tree_v2_update(space->tree, &vm->inode, 0, (int64_t)grow);
     vm->size = new_size;
-    vm->virt_size = max(vm->virt_size, new_size);
+    vm->virt_size += grow;
   }
 
   return true;
@@ -786,7 +867,11 @@ static vm_mapping_t *join_mappings(vm_mapping_t *vm_a, vm_mapping_t *vm_b) {
   return vm_a;
 }
 
-static bool move_mapping(vm_mapping_t *vm, size_t newsize) {
+// Moves the mapping to a new region of the address space large enough for
+// newsize, either a free region found near the current one or the free range
+// at fixed_addr if it is non-zero. The page table entries of the mapped part
+// are moved along with it so none of the data is copied.
+static bool move_mapping(vm_mapping_t *vm, size_t newsize, uintptr_t fixed_addr) {
   address_space_t *space = vm->space;
   space_lock_assert(space, MA_OWNED);
 
@@ -801,9 +886,26 @@ static bool move_mapping(vm_mapping_t *vm, size_t newsize) {
 
   // look for a new free region
   vm_mapping_t *closest = NULL;
-  uintptr_t virt_addr = get_free_region(space, base, virt_size, vm_flags_to_size(vm->flags), vm->flags, &closest);
-  if (virt_addr == 0) {
-    return false;
+  uintptr_t virt_addr;
+  if (fixed_addr != 0) {
+    if (!check_range_free(space, fixed_addr - off, virt_size, vm->flags, &closest)) {
+      return false;
+    }
+    virt_addr = fixed_addr - off;
+  } else {
+    virt_addr = get_free_region(space, base, virt_size, vm_flags_to_size(vm->flags), vm->flags, &closest);
+    if (virt_addr == 0 || virt_addr == UINT64_MAX) {
+      return false;
+    }
+  }
+
+  // the mapping before the new region becomes the list predecessor
+  vm_mapping_t *prev = closest;
+  if (prev != NULL && prev->address > virt_addr) {
+    prev = LIST_PREV(prev, vm_list);
+  }
+  if (prev == vm) {
+    prev = LIST_PREV(vm, vm_list);
   }
 
   // remove from the old node tree and insert the new one
@@ -814,19 +916,61 @@ static bool move_mapping(vm_mapping_t *vm, size_t newsize) {
 
   // switch place of the mapping in the space list
   LIST_REMOVE(&space->mappings, vm, vm_list);
-  if (closest->address > virt_addr) {
-    closest = LIST_PREV(closest, vm_list);
+  if (prev != NULL) {
+    LIST_INSERT(&space->mappings, vm, vm_list, prev);
+  } else {
+    LIST_ADD_FRONT(&space->mappings, vm, vm_list);
   }
-  // insert into the list
-  LIST_INSERT(&space->mappings, vm, vm_list, closest);
 
   // update the mapping
+  uintptr_t old_addr = vm->address;
+  size_t old_size = vm->size;
   vm->address = virt_addr + off;
   vm->size = newsize;
   vm->virt_size = virt_size;
+
+  if (vm->flags & VM_MAPPED) {
+    page_t *table_pages = NULL;
+    recursive_move_entries(old_addr, vm->address, min(old_size, newsize), vm->flags, &table_pages);
+    if (table_pages != NULL) {
+      page_t *last_page = SLIST_GET_LAST(table_pages, next);
+      SLIST_ADD_SLIST(&space->table_pages, table_pages, last_page, next);
+    }
+  }
   return true;
 }
 
+// Updates the underlying mapping after the size of vm has changed from old_size
+// to its current size. Entries past the new end are unmapped when shrinking and
+// the backing file is resized to match.
+static void vm_resize_internal(vm_mapping_t *vm, size_t old_size) {
+  space_lock_assert(vm->space, MA_OWNED);
+  size_t new_size = vm->size;
+  if (new_size < old_size) {
+    if (vm->type == VM_TYPE_PAGE) {
+      size_t pg_size = vm_flags_to_size(vm->flags);
+      if (vm->flags & VM_MAPPED) {
+        for (uintptr_t addr = vm->address + new_size; addr < vm->address + old_size; addr += pg_size) {
+          recursive_unmap_entry(addr, vm->flags);
+        }
+        cpu_flush_tlb();
+      }
+
+      page_list_t *tail = page_list_split(vm->vm_pages, new_size / pg_size);
+      page_list_free(&tail);
+    } else if (vm->type == VM_TYPE_FILE) {
+      if (vm->flags & VM_MAPPED) {
+        file_type_unmap_internal(vm, old_size - new_size, new_size);
+      }
+      file_type_resize_internal(vm, new_size);
+    }
+  } else if (new_size > old_size) {
+    // grow the underlying mapping (new pages are faulted in on demand)
+    ASSERT(vm->type == VM_TYPE_FILE);
+    file_type_resize_internal(vm, new_size);
+  }
+}
+
 static void free_mapping(vm_mapping_t **vmp, bool unmap) {
   vm_mapping_t *vm = *vmp;
   address_space_t *space = vm->space;
@@ -1126,7 +1270,7 @@ static int vmap_internal(
 
   if (vm->type == VM_TYPE_PAGE && vm->flags & VM_ZERO) {
     // zero the memory in the region if requested on a page mapping.
-    // for file mappings this is done on demand
+    // file mappings zero their pages as they are allocated
     vm->flags ^= VM_ZERO; // flag only applied on allocation
 
     if (vm->flags & VM_WRITE) {
@@ -1160,8 +1304,9 @@ static always_inline bool can_vm_handle_fault(vm_mapping_t *vm, uintptr_t fault_
   }
 
   if (!(error_code & CPU_PF_P)) {
-    // page not present; could be a lazily mapped page
-    if (vm->type != VM_TYPE_FILE) {
+    // page not present; could be a lazily mapped page or one that has not been
+    // touched since the space was forked
+    if (vm->type == VM_TYPE_RSVD) {
       return false;
     }
 
@@ -1186,6 +1331,7 @@ static always_inline bool can_vm_handle_fault(vm_mapping_t *vm, uintptr_t fault_
 _used void page_fault_handler(struct trapframe *frame) {
   uint32_t id = curcpu_id;
   uint64_t fault_addr = __read_cr2();
+  TRACE_EVENT(FAULT, TRACE_PAGE_FAULT, fault_addr, frame->error, frame->rip, 0);
   if (fault_addr == 0 || !curspace)
     goto exception;
 
@@ -1199,7 +1345,9 @@ _used void page_fault_handler(struct trapframe *frame) {
 
   size_t off = page_trunc(fault_addr - vm->address);
   if (!(frame->error & CPU_PF_P)) {
-    // DPRINTF("non-present page fault in vm_file [vm={:str},addr=%p]\n", &vm->name, fault_addr);
+    // DPRINTF("non-present page fault [vm={:str},addr=%p]\n", &vm->name, fault_addr);
+    // a write to a cow page is mapped read-only here and copied by the
+    // protection fault taken when the write is retried
     if (vm_handle_non_present_fault(vm, off) < 0)
       goto unhandled;
     space_unlock(space);
@@ -1366,7 +1514,8 @@ address_space_t *vm_new_space(uintptr_t min_addr, uintptr_t max_addr, uintptr_t
   return space;
 }
 
-// the caller must have target space locked
+// the caller must have target space locked. if fork_user is false the user
+// page tables are not copied and the new space maps its pages on first access.
 address_space_t *vm_fork_space(address_space_t *space, bool fork_user) {
   space_lock_assert(space, MA_OWNED);
   address_space_t *newspace = vm_new_space(space->min_addr, space->max_addr, 0);
@@ -1391,6 +1540,8 @@ address_space_t *vm_fork_space(address_space_t *space, bool fork_user) {
     }
     newspace->num_mappings++;
   }
+  // flush the entries write protected by the forked mappings
+  cpu_flush_tlb();
 
   // fork the page tables
   page_t *meta_pages = NULL;
@@ -1520,7 +1671,9 @@ uintptr_t vmap_file(vm_file_t *file, uintptr_t hint, size_t vm_size, uint32_t vm
 }
 
 uintptr_t vmap_anon(size_t vm_size, uintptr_t hint, size_t size, uint32_t vm_flags, const char *name) {
-  vm_file_t *file = vm_file_alloc_anon(size, vm_flags_to_size(vm_flags));
+  vm_file_t *file = vm_flags & VM_ZERO ?
+    vm_file_alloc_anon_zero(size, vm_flags_to_size(vm_flags)) :
+    vm_file_alloc_anon(size, vm_flags_to_size(vm_flags));
   int res;
   uintptr_t vaddr;
   if ((res = vmap_internal(curspace, VM_TYPE_FILE, hint, size, vm_size, vm_flags, name, file, &vaddr)) < 0) {
@@ -1554,6 +1707,10 @@ void *vm_mmap(uintptr_t addr, size_t len, int prot, int flags, int fd, off_t off
   }
 
   vm_file_t *vm_file = fs_get_vmfile(fd, off, len, flags, prot);
+  if (vm_file == NULL) {
+    DPRINTF("fd %d cannot be mapped\n", fd);
+    return MAP_FAILED;
+  }
   uintptr_t res = vmap_file(vm_file, addr, 0, vm_flags, "mmap file");
   if (res == 0) {
     DPRINTF("failed to map file\n");
@@ -1749,6 +1906,27 @@ LABEL(ret);
   return res;
 }
 
+// checks that vm can be resized from old_size to new_size by vmap_resize/vmap_move
+static int check_resizable(vm_mapping_t *vm, size_t old_size, size_t new_size) {
+  if (vm == NULL || vm->type == VM_TYPE_RSVD) {
+    return -ENOMEM;
+  }
+
+  if ((vm->type != VM_TYPE_PAGE && vm->type != VM_TYPE_FILE) || vm->size != old_size) {
+    return -EINVAL;
+  } else if (vm->flags & VM_LINKED || vm->flags & VM_SPLIT) {
+    EPRINTF("cannot resize part of a split mapping [name={:str}]\n", &vm->name);
+    return -EINVAL;
+  } else if (vm->flags & VM_STACK) {
+    EPRINTF("cannot resize stack mapping [name={:str}]\n", &vm->name);
+    return -EINVAL;
+  } else if (vm->type == VM_TYPE_PAGE && new_size > old_size) {
+    // page list mappings have nothing to grow into
+    return -EINVAL;
+  }
+  return 0;
+}
+
 int vmap_resize(uintptr_t vaddr, size_t old_size, size_t new_size, bool allow_move, uintptr_t *new_vaddr) {
   // The range [vaddr, vaddr+old_size) must represent exactly one mapping of type
   // VM_TYPE_PAGE or VM_TYPE_FILE with a mapping size of old_size. If new_size is
@@ -1757,7 +1935,8 @@ int vmap_resize(uintptr_t vaddr, size_t old_size, size_t new_size, bool allow_mo
   // mapping will be resized in-place if the mapping has non-mapped but claimed
   // vm space, or there is free space after the mapping. If allow_move is true,
   // the mapping will be moved to a new location if the above conditions are not
-  // met, and new_vaddr will be set to the new address.
+  // met, and new_vaddr will be set to the new address. Moving a mapping moves
+  // its page table entries, the mapped pages themselves are not copied.
   if (!is_valid_range(vaddr, old_size) || !is_aligned(old_size, PAGE_SIZE) || !is_aligned(new_size, PAGE_SIZE)) {
     return -EINVAL;
   }
@@ -1767,17 +1946,7 @@ int vmap_resize(uintptr_t vaddr, size_t old_size, size_t new_size, bool allow_mo
   space_lock(space);
 
   vm_mapping_t *vm = space_get_mapping(space, vaddr);
-  if (vm == NULL || vm->type == VM_TYPE_RSVD) {
-    res = -ENOMEM;
-    goto ret;
-  }
-
-  if ((vm->type != VM_TYPE_PAGE && vm->type != VM_TYPE_FILE) || vm->size != old_size) {
-    res = -EINVAL;
-    goto ret;
-  } else if (vm->flags & VM_LINKED || vm->flags & VM_SPLIT) {
-    EPRINTF("cannot resize part of a split mapping [name={:str}]\n", &vm->name);
-    res = -EINVAL;
+  if ((res = check_resizable(vm, old_size, new_size)) < 0) {
     goto ret;
   }
 
@@ -1787,37 +1956,205 @@ int vmap_resize(uintptr_t vaddr, size_t old_size, size_t new_size, bool allow_mo
   }
 
   // first try resizing the existing mapping in place
-  uintptr_t old_addr = vm->address;
   if (!resize_mapping_inplace(vm, new_size)) {
     // that didnt work but maybe we can try moving the mapping
-    if (!allow_move && move_mapping(vm, new_size)) {
+    if (!allow_move || !move_mapping(vm, new_size, 0)) {
       res = -ENOMEM;
       goto ret;
     }
   }
 
-  // finally call the appropriate resize function to update the underlying mappings
+  // finally update the underlying mappings
+  vm_resize_internal(vm, old_size);
+LABEL(ret);
+  if (res == 0 && new_vaddr)
+    *new_vaddr = vm->address;
+  space_unlock(space);
+  return res;
+}
+
+int vmap_move(uintptr_t vaddr, size_t old_size, size_t new_size, uintptr_t new_vaddr) {
+  // Moves the single mapping at [vaddr, vaddr+old_size) to new_vaddr and resizes
+  // it to new_size. Any existing mappings in the target range are unmapped first
+  // but the target range may not overlap the source mapping.
+  if (!is_valid_range(vaddr, old_size) || !is_valid_range(new_vaddr, new_size) ||
+      !is_aligned(old_size, PAGE_SIZE) || !is_aligned(new_size, PAGE_SIZE) || new_size == 0) {
+    return -EINVAL;
+  }
+
+  int res = 0;
+  address_space_t *space = select_space(curspace, vaddr);
+  if (space != select_space(curspace, new_vaddr)) {
+    return -EINVAL;
+  }
+  space_lock(space);
+
+  vm_mapping_t *vm = space_get_mapping(space, vaddr);
+  if ((res = check_resizable(vm, old_size, new_size)) < 0) {
+    goto ret;
+  }
+
+  interval_t target = intvl(new_vaddr, new_vaddr + new_size);
+  if (overlaps(vm_virt_interval(vm), target)) {
+    res = -EINVAL;
+    goto ret;
+  }
+
+  // clear out the target range
+  if ((res = vmap_unmap_range(space, new_vaddr, new_size)) < 0) {
+    goto ret;
+  }
+
   if (new_size < old_size) {
-    // unmap the excess mapping
-    size_t unmap_size = old_size - new_size;
-    size_t off = new_size;
-    if (vm->type == VM_TYPE_PAGE) {
-      page_type_unmap_internal(vm, unmap_size, off);
-    } else if (vm->type == VM_TYPE_FILE) {
-      struct file_cb_data data = {vm, off, /*unmap=*/false};
-      vm_file_visit_pages(vm->vm_file, off, off+unmap_size, file_map_update_cb, &data);
+    // shrink in place first so that only the remaining entries are moved
+    resize_mapping_inplace(vm, new_size);
+    vm_resize_internal(vm, old_size);
+    old_size = new_size;
+  }
+
+  if (!move_mapping(vm, new_size, new_vaddr)) {
+    res = -ENOMEM;
+    goto ret;
+  }
+  vm_resize_internal(vm, old_size);
+
+LABEL(ret);
+  space_unlock(space);
+  return res;
+}
+
+// applies the madvise advice to the part [off, off+len) of a single mapping
+static int vm_advise_internal(vm_mapping_t *vm, size_t off, size_t len, int advice) {
+  if (vm->type != VM_TYPE_FILE && vm->type != VM_TYPE_PAGE) {
+    return -EINVAL; // physical and reserved mappings have no pages to manage
+  }
+
+  vm_file_t *file = vm->type == VM_TYPE_FILE ? vm->vm_file : NULL;
+  switch (advice) {
+    case MADV_NORMAL:
+      vm->flags &= ~(VM_SEQ_READ | VM_RAND_READ);
+      break;
+    case MADV_RANDOM:
+      vm->flags = (vm->flags & ~VM_SEQ_READ) | VM_RAND_READ;
+      break;
+    case MADV_SEQUENTIAL:
+      vm->flags = (vm->flags & ~VM_RAND_READ) | VM_SEQ_READ;
+      break;
+    case MADV_WILLNEED:
+      // bring file pages into the page cache, anonymous memory has nowhere to
+      // be read in from and page mappings are always resident
+      if (file == NULL || file->vnode == NULL)
+        break;
+      for (size_t o = off; o < off + len; o += vm_flags_to_size(vm->flags)) {
+        page_t *page = vm_file_getpage(file, o);
+        pg_putref(&page);
+      }
+      break;
+    case MADV_DONTNEED:
+    case MADV_FREE:
+      if (vm->flags & VM_SHARED && (file == NULL || file->vnode == NULL)) {
+        // shared anonymous memory keeps its contents for the other mappings
+        // of it so there is nothing that can be dropped
+        break;
+      }
+      if (file == NULL) {
+        return page_type_discard_internal(vm, len, off);
+      }
+
+      if (file->vnode == NULL && read_refcount(file->pgcache) != 1) {
+        // a private mapping that was read-only when its space was forked still
+        // shares the page cache with the other space. it gets a cache of its
+        // own whose pages are copied on write before any are dropped.
+        struct pgcache *shared = file->pgcache;
+        file->pgcache = pgcache_clone(shared);
+        pgcache_free(&shared);
+        vm_file_visit_pages(file, file->off, file->off + vm->size, file_fork_cb, NULL);
+        if (vm->flags & VM_MAPPED) {
+          recursive_write_protect_range(vm->address, vm->size, vm->flags);
+          cpu_flush_tlb();
+        }
+      }
+
+      // file pages are faulted back in from the cache, private anonymous pages
+      // are released and come back zeroed
+      if (vm->flags & VM_MAPPED) {
+        file_type_unmap_internal(vm, len, off);
+      }
+      vm_file_discard(file, off, len);
+      break;
+    default:
+      return -EINVAL;
+  }
+  return 0;
+}
+
+int vmap_advise(uintptr_t vaddr, size_t len, int advice) {
+  // The range [vaddr, vaddr+len) may span multiple mappings. The access pattern
+  // advice applies to each whole mapping in the range. Unmapped parts of the
+  // range are skipped and reported with -ENOMEM once the rest is done.
+  if (!is_valid_range(vaddr, len) || !is_aligned(vaddr, PAGE_SIZE) || !is_aligned(len, PAGE_SIZE)) {
+    return -EINVAL;
+  }
+
+  int res = 0;
+  address_space_t *space = select_space(curspace, vaddr);
+  space_lock(space);
+
+  uintptr_t end = vaddr + len;
+  uintptr_t addr = vaddr;
+  vm_mapping_t *vm = space_get_mapping(space, vaddr);
+  if (vm == NULL) {
+    res = -ENOMEM;
+    goto ret;
+  }
+
+  while (vm != NULL && vm->address < end) {
+    interval_t i = intersection(vm_real_interval(vm), intvl(addr, end));
+    if (vm->type == VM_TYPE_RSVD || is_null_set(i)) {
+      vm = LIST_NEXT(vm, vm_list);
+      continue;
+    } else if (i.start > addr) {
+      res = -ENOMEM; // hole in the range
     }
-  } else if (new_size > old_size) {
-    // grow the underlying mapping
-    if (vm->type == VM_TYPE_PAGE) {
-      todo("handle page mapping resize\n");
-    } else if (vm->type == VM_TYPE_FILE) {
-      file_type_resize_internal(vm, new_size);
+
+    int r = vm_advise_internal(vm, i.start - vm->address, magnitude(i), advice);
+    if (r < 0) {
+      res = r;
+      goto ret;
     }
+
+    addr = i.end;
+    vm = LIST_NEXT(vm, vm_list);
+  }
+  if (addr < end) {
+    res = -ENOMEM;
   }
+
+LABEL(ret);
+  space_unlock(space);
+  return res;
+}
+
+int vmap_get_file(uintptr_t vaddr, __out struct pgcache **out_pgcache, __out size_t *out_size) {
+  // Looks up the file mapping which starts at vaddr and returns the page cache
+  // backing it along with the mapping size. The page cache pointer is only
+  // useful as an identity, no reference is taken.
+  if (!is_valid_pointer(vaddr) || !is_aligned(vaddr, PAGE_SIZE)) {
+    return -EINVAL;
+  }
+
+  int res = 0;
+  address_space_t *space = select_space(curspace, vaddr);
+  space_lock(space);
+  vm_mapping_t *vm = space_get_mapping(space, vaddr);
+  if (vm == NULL || vm->type != VM_TYPE_FILE || vm->address != vaddr) {
+    res = -EINVAL;
+    goto ret;
+  }
+
+  *out_pgcache = vm->vm_file->pgcache;
+  *out_size = vm->size;
 LABEL(ret);
-  if (res == 0 && new_vaddr)
-    *new_vaddr = vm->address;
   space_unlock(space);
   return res;
 }
@@ -1861,6 +2198,45 @@ LABEL(ret);
   return page;
 }
 
+__ref page_t *vm_getpage_writable(uintptr_t vaddr) {
+  if (vaddr >= USER_SPACE_END) {
+    return NULL;
+  }
+
+  address_space_t *space = curspace;
+  space_lock(space);
+
+  // only private anonymous pages can be written without a fault. this is
+  // page memory or an anonymous file with no other users (heap, brk and
+  // anonymous mmap). a copy-on-write page is still shared with another space
+  // and a vnode page needs the fault path to track the write.
+  page_t *page = NULL;
+  vm_mapping_t *vm = space_get_mapping(space, vaddr);
+  uint32_t want = VM_USER | VM_WRITE;
+  if (vm == NULL || (vm->flags & want) != want || vm_flags_to_size(vm->flags) != PAGE_SIZE) {
+    goto ret;
+  }
+
+  size_t off = page_trunc(vaddr - vm->address);
+  if (off >= vm->size) {
+    goto ret;
+  }
+
+  if (vm->type == VM_TYPE_PAGE) {
+    page = page_type_getpage_internal(vm, off);
+  } else if (vm->type == VM_TYPE_FILE && !(vm->flags & VM_SHARED) && vm->vm_file->vnode == NULL &&
+             read_refcount(vm->vm_file->pgcache) == 1) {
+    page = file_type_getpage_internal(vm, off);
+  }
+  if (page != NULL && (page->flags & PG_COW)) {
+    pg_putref(&page);
+  }
+
+LABEL(ret);
+  space_unlock(space);
+  return page;
+}
+
 int vm_validate_space_ptr(address_space_t *space, uintptr_t ptr, bool write) {
   if (ptr == 0 || !is_valid_pointer(ptr)) {
     return -EFAULT;
@@ -2048,7 +2424,9 @@ uintptr_t vmap_other_anon(address_space_t *uspace, size_t vm_size, uintptr_t vad
           vaddr, vm_size, size, vm_flags, name);
 
   int res;
-  vm_file_t *file = vm_file_alloc_anon(size, vm_flags_to_size(vm_flags));
+  vm_file_t *file = vm_flags & VM_ZERO ?
+    vm_file_alloc_anon_zero(size, vm_flags_to_size(vm_flags)) :
+    vm_file_alloc_anon(size, vm_flags_to_size(vm_flags));
   if ((res = vmap_internal(uspace, VM_TYPE_FILE, vaddr, size, vm_size, vm_flags, name, file, NULL)) < 0) {
     ALLOC_ERROR("vmap: failed to make anonymous mapping %s {:err}\n", name, res);
     vm_file_free(&file);
@@ -2507,6 +2885,15 @@ DEFINE_SYSCALL(mprotect, int, void *addr, size_t len, int prot) {
   return res;
 }
 
+DEFINE_SYSCALL(madvise, int, void *addr, size_t length, int advice) {
+  length = page_align(length);
+  DPRINTF("madvise: addr=%p, len=%zu, advice=%d\n", addr, length, advice);
+  if ((uintptr_t) addr + length > USER_SPACE_END) {
+    return -EINVAL;
+  }
+  return vmap_advise((uintptr_t) addr, length, advice);
+}
+
 DEFINE_SYSCALL(munmap, int, void *addr, size_t len) {
   len = page_align(len);
   DPRINTF("munmap: addr=%p, len=%zu\n", addr, len);
@@ -2514,8 +2901,41 @@ DEFINE_SYSCALL(munmap, int, void *addr, size_t len) {
 }
 
 DEFINE_SYSCALL(mremap, void *, void *old_address, size_t old_size, size_t new_size, int flags, void *new_address) {
-  DPRINTF("mremap: TODO implement me\n");
-  return (void *)(intptr_t)-ENOSYS;
+  DPRINTF("mremap: old_address=%p, old_size=%zu, new_size=%zu, flags=%#x, new_address=%p\n",
+          old_address, old_size, new_size, flags, new_address);
+  uintptr_t old_addr = (uintptr_t) old_address;
+  uintptr_t new_addr = (uintptr_t) new_address;
+  old_size = page_align(old_size);
+  new_size = page_align(new_size);
+
+  if (flags & ~(MREMAP_MAYMOVE | MREMAP_FIXED)) {
+    // MREMAP_DONTUNMAP is not supported
+    return (void *)(intptr_t)-EINVAL;
+  } else if ((flags & MREMAP_FIXED) && !(flags & MREMAP_MAYMOVE)) {
+    return (void *)(intptr_t)-EINVAL;
+  } else if (!is_aligned(old_addr, PAGE_SIZE) || old_size == 0 || new_size == 0) {
+    // old_size == 0 (duplicating a shared mapping) is not supported
+    return (void *)(intptr_t)-EINVAL;
+  } else if (old_addr + old_size > USER_SPACE_END) {
+    return (void *)(intptr_t)-EFAULT;
+  }
+
+  int res;
+  if (flags & MREMAP_FIXED) {
+    if (!is_aligned(new_addr, PAGE_SIZE) || new_addr + new_size > USER_SPACE_END) {
+      return (void *)(intptr_t)-EINVAL;
+    }
+    res = vmap_move(old_addr, old_size, new_size, new_addr);
+  } else {
+    // grows in place when there is room after the mapping, otherwise moves the
+    // page table entries to a new range if MREMAP_MAYMOVE was given
+    res = vmap_resize(old_addr, old_size, new_size, flags & MREMAP_MAYMOVE, &new_addr);
+  }
+
+  if (res < 0) {
+    return (void *)(intptr_t)res;
+  }
+  return (void *) new_addr;
 }
 
 //
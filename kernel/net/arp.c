@@ -15,18 +15,37 @@
 #include <kernel/proc.h>
 #include <kernel/chan.h>
 
+#include <fs/procfs/procfs.h>
+
 #define ASSERT(x) kassert(x)
 #define LOG_TAG arp
 #include <kernel/log.h>
 #define EPRINTF(fmt, ...) kprintf("arp: %s: " fmt, __func__, ##__VA_ARGS__)
 
 #define ARP_CACHE_MAX_ENTRIES 256
-
+#define ARP_HASH_BITS 6
+#define ARP_HASH_SIZE (1 << ARP_HASH_BITS)
+#define ARP_HASH(ip) ((uint32_t)((ip) * 0x9E3779B1u) >> (32 - ARP_HASH_BITS))
+
+/*
+ * The neighbour cache is a hash table of entries keyed by ip address.
+ *
+ * Entries move from INCOMPLETE to REACHABLE when a reply confirms the address.
+ * A REACHABLE entry becomes STALE once ARP_REACHABLE_TIMEOUT has passed since
+ * it was last confirmed. This is checked when the entry is used rather than
+ * with a timer so the transmit path never has to touch the alarm queue. Using
+ * a STALE entry moves it to PROBE, where packets keep using the cached address
+ * while the address is being revalidated. Timers are only armed for the retries
+ * of INCOMPLETE and PROBE entries.
+ *
+ * Packets sent to an INCOMPLETE entry are queued on it (up to ARP_MAX_PENDING
+ * with the oldest dropped first) and are sent once the address resolves.
+ */
 typedef struct arp_cache {
   size_t num_entries;
   size_t max_entries;
   mtx_t lock;
-  LIST_HEAD(struct arp_entry) entries;
+  LIST_HEAD(struct arp_entry) buckets[ARP_HASH_SIZE];
 } arp_cache_t;
 
 typedef struct arp_entry {
@@ -36,14 +55,16 @@ typedef struct arp_entry {
   netdev_t *dev;                // network device (ref)
   uint8_t state;                // entry state
   uint8_t retries;              // retry count
+  uint16_t num_pending;         // number of queued packets
 
-  id_t timer_id;                // expiry/retry timer id
+  id_t timer_id;                // retry timer id
+  uint64_t confirmed;           // last confirmation timestamp
   uint64_t last_used;           // last use timestamp
 
   // packets queued waiting for resolution
   LIST_HEAD(struct sk_buff) pending_queue;
 
-  LIST_ENTRY(struct arp_entry) link; // cache list
+  LIST_ENTRY(struct arp_entry) link; // hash bucket list
 } arp_entry_t;
 
 #define arp_putref(entry)  putref(entry, _arp_entry_free)
@@ -82,6 +103,14 @@ static int arp_softirq_handler() {
   return 0;
 }
 
+static void arp_free_skb_queue(struct sk_buff *skb) {
+  while (skb) {
+    struct sk_buff *next = LIST_NEXT(skb, list);
+    skb_free(&skb);
+    skb = next;
+  }
+}
+
 static void _arp_entry_free(__ref arp_entry_t *entry) {
   if (!entry) {
     return;
@@ -91,43 +120,157 @@ static void _arp_entry_free(__ref arp_entry_t *entry) {
   ASSERT(entry->timer_id == 0);
 
   // free queued packets
-  LIST_FOR_IN_SAFE(skb, &entry->pending_queue, list) {
-    LIST_REMOVE(&entry->pending_queue, skb, list);
-    skb_free(&skb);
-  }
-
+  arp_free_skb_queue(LIST_FIRST(&entry->pending_queue));
   netdev_putref(&entry->dev);
   kfree(entry);
 }
 
-static id_t arp_setup_cache_timeout_alarm(arp_entry_t *entry, int seconds) {
-  if (seconds == 0)
-    seconds = ARP_CACHE_TIMEOUT;
-
-  if (entry->timer_id > 0) {
-    // cancel existing timer
-    id_t old_timer_id = entry->timer_id;
-    entry->timer_id = 0;
-    struct callback cb;
-    if (alarm_unregister(old_timer_id, &cb) == 0) {
-      arp_entry_t *old_entry = (arp_entry_t *)cb.args[0];
-      arp_putref(&old_entry);
-    }
+static void arp_cancel_timer(arp_entry_t *entry) {
+  if (entry->timer_id == 0) {
+    return;
   }
 
+  // clearing the id makes an already fired callback be ignored
+  id_t old_timer_id = entry->timer_id;
+  entry->timer_id = 0;
+  struct callback cb;
+  if (alarm_unregister(old_timer_id, &cb) == 0) {
+    arp_entry_t *old_entry = (arp_entry_t *)cb.args[0];
+    arp_putref(&old_entry);
+  }
+}
+
+static void arp_setup_retry_alarm(arp_entry_t *entry, int seconds) {
+  arp_cancel_timer(entry);
+
   alarm_t *alarm = alarm_alloc_relative(SEC_TO_NS(seconds), alarm_cb(arp_entry_timeout_cb, getref(entry)));
   entry->timer_id = alarm->id;
   id_t id = alarm_register(alarm);
   ASSERT(id > 0);
-  return id;
+}
+
+static void arp_send_probe(netdev_t *dev, uint32_t ip_addr) {
+  struct in_ifaddr *ifa = LIST_FIRST(&dev->ip_addrs);
+  if (ifa) {
+    arp_send_request(dev, ifa->ifa_address, ip_addr);
+  }
+}
+
+// returns the state of an entry after applying any reachability timeout
+static inline uint8_t arp_entry_state(arp_entry_t *entry, uint64_t now) {
+  if (entry->state == ARP_STATE_REACHABLE &&
+      now - entry->confirmed > SEC_TO_NS(ARP_REACHABLE_TIMEOUT)) {
+    entry->state = ARP_STATE_STALE;
+  }
+  return entry->state;
+}
+
+static arp_entry_t *arp_cache_find_locked(uint32_t ip_addr) {
+  arp_entry_t *entry;
+  LIST_FOREACH(entry, &arp_cache.buckets[ARP_HASH(ip_addr)], link) {
+    if (entry->ip_addr == ip_addr) {
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+// removes an entry from the cache and drops the cache reference to it
+static void arp_cache_unlink_locked(arp_entry_t *entry) {
+  LIST_REMOVE(&arp_cache.buckets[ARP_HASH(entry->ip_addr)], entry, link);
+  arp_cache.num_entries--;
+  arp_cancel_timer(entry);
+  entry->state = ARP_STATE_FAILED;
+
+  arp_free_skb_queue(LIST_FIRST(&entry->pending_queue));
+  LIST_INIT(&entry->pending_queue);
+  entry->num_pending = 0;
+  arp_putref(&entry);
+}
+
+static void arp_cache_evict_locked() {
+  // evict the least recently used entry that is not being resolved. if every
+  // entry is being resolved the oldest of them is dropped along with its
+  // queued packets so that the cache stays bounded.
+  arp_entry_t *oldest = NULL;
+  arp_entry_t *oldest_incomplete = NULL;
+  for (int i = 0; i < ARP_HASH_SIZE; i++) {
+    arp_entry_t *entry;
+    LIST_FOREACH(entry, &arp_cache.buckets[i], link) {
+      if (entry->state == ARP_STATE_INCOMPLETE) {
+        if (!oldest_incomplete || entry->last_used < oldest_incomplete->last_used)
+          oldest_incomplete = entry;
+      } else if (!oldest || entry->last_used < oldest->last_used) {
+        oldest = entry;
+      }
+    }
+  }
+
+  if (!oldest) {
+    oldest = oldest_incomplete;
+  }
+  if (oldest) {
+    DPRINTF("evicting entry for IP {:ip}\n", oldest->ip_addr);
+    arp_cache_unlink_locked(oldest);
+  }
+}
+
+static arp_entry_t *arp_cache_create_locked(netdev_t *dev, uint32_t ip_addr, uint64_t now) {
+  if (arp_cache.num_entries >= arp_cache.max_entries) {
+    arp_cache_evict_locked();
+  }
+
+  arp_entry_t *entry = kmallocz(sizeof(arp_entry_t));
+  if (!entry) {
+    return NULL;
+  }
+
+  entry->ip_addr = ip_addr;
+  entry->dev = netdev_getref(dev);
+  entry->state = ARP_STATE_INCOMPLETE;
+  entry->last_used = now;
+  LIST_INIT(&entry->pending_queue);
+  initref(entry);
+
+  // the cache owns the initial reference
+  LIST_ADD(&arp_cache.buckets[ARP_HASH(ip_addr)], entry, link);
+  arp_cache.num_entries++;
+  return entry;
+}
+
+// confirms the address of an entry and returns the packets waiting on it
+static struct sk_buff *arp_entry_confirm_locked(arp_entry_t *entry, uint8_t *hw_addr, uint64_t now) {
+  eth_addr_copy(entry->hw_addr, hw_addr);
+  entry->state = ARP_STATE_REACHABLE;
+  entry->retries = 0;
+  entry->confirmed = now;
+  arp_cancel_timer(entry);
+
+  struct sk_buff *pending = LIST_FIRST(&entry->pending_queue);
+  LIST_INIT(&entry->pending_queue);
+  entry->num_pending = 0;
+  return pending;
+}
+
+static void arp_send_pending(netdev_t *dev, uint8_t *hw_addr, struct sk_buff *skb) {
+  while (skb) {
+    struct sk_buff *next = LIST_NEXT(skb, list);
+    if (eth_header(skb, dev, ETH_P_IP, hw_addr, NULL) < 0) {
+      EPRINTF("failed to add ethernet header to queued packet\n");
+      skb_free(&skb);
+    } else {
+      skb->dev = dev;
+      netdev_tx(dev, skb);
+    }
+    skb = next;
+  }
 }
 
 static void arp_entry_timeout(__ref arp_entry_t *entry, id_t fired_timer_id) {
   mtx_lock(&arp_cache.lock);
 
-  // check if this timer is still current (wasn't replaced)
+  // check if this timer is still current (wasn't replaced or cancelled)
   if (entry->timer_id != fired_timer_id) {
-    // timer was replaced while this callback was queued, ignore it
     DPRINTF("ignoring stale timer callback (fired=%u, current=%u) for IP {:ip}\n",
             fired_timer_id, entry->timer_id, entry->ip_addr);
     mtx_unlock(&arp_cache.lock);
@@ -135,228 +278,104 @@ static void arp_entry_timeout(__ref arp_entry_t *entry, id_t fired_timer_id) {
     return;
   }
 
-  if (entry->state == ARP_STATE_INCOMPLETE) {
+  entry->timer_id = 0;
+  bool send_probe = false;
+  if (entry->state == ARP_STATE_INCOMPLETE || entry->state == ARP_STATE_PROBE) {
     if (entry->retries < ARP_MAX_RETRIES) {
-      // retry ARP request
       entry->retries++;
       DPRINTF("retry %u for IP {:ip}\n", entry->retries, entry->ip_addr);
-
-      // send another request
-      struct in_ifaddr *ifa = LIST_FIRST(&entry->dev->ip_addrs);
-      if (ifa) {
-        arp_send_request(entry->dev, ifa->ifa_address, entry->ip_addr);
-      }
-
-      // reset timer for next retry (this updates timer_id)
-      arp_setup_cache_timeout_alarm(entry, ARP_RETRY_INTERVAL);
+      arp_setup_retry_alarm(entry, ARP_RETRY_INTERVAL);
+      send_probe = true;
     } else {
-      // failed to resolve
       DPRINTF("failed to resolve IP {:ip} after %u retries\n", entry->ip_addr, entry->retries);
-      entry->state = ARP_STATE_FAILED;
-
-      // drop all pending packets
-      LIST_FOR_IN_SAFE(skb, &entry->pending_queue, list) {
-        LIST_REMOVE(&entry->pending_queue, skb, list);
-        skb_free(&skb);
-      }
-
-      LIST_REMOVE(&arp_cache.entries, entry, link);
-      arp_cache.num_entries--;
-      entry->timer_id = 0;
+      arp_cache_unlink_locked(entry);
     }
-  } else if (entry->state == ARP_STATE_REACHABLE) {
-    // entry expired, mark as stale
-    entry->state = ARP_STATE_STALE;
-    DPRINTF("entry for IP {:ip} marked stale\n", entry->ip_addr);
-    entry->timer_id = 0;
   } else {
-    // STALE or FAILED entries should not have active timers
     EPRINTF("WARNING: timer fired for entry in state %u (should not happen!)\n", entry->state);
-    entry->timer_id = 0;
   }
 
   mtx_unlock(&arp_cache.lock);
+  if (send_probe) {
+    arp_send_probe(entry->dev, entry->ip_addr);
+  }
   arp_putref(&entry);
 }
 
+// updates the address of an entry, creating it if requested
+static __ref arp_entry_t *arp_cache_update_entry(netdev_t *dev, uint32_t ip_addr, uint8_t *hw_addr, bool create) {
+  uint64_t now = clock_get_nanos();
+  mtx_lock(&arp_cache.lock);
+  arp_entry_t *entry = arp_cache_find_locked(ip_addr);
+  if (!entry && create) {
+    entry = arp_cache_create_locked(dev, ip_addr, now);
+  }
+  if (!entry) {
+    mtx_unlock(&arp_cache.lock);
+    return NULL;
+  }
+
+  struct sk_buff *pending = NULL;
+  if (hw_addr && !eth_addr_is_zero(hw_addr)) {
+    pending = arp_entry_confirm_locked(entry, hw_addr, now);
+  } else if (entry->state == ARP_STATE_INCOMPLETE && entry->timer_id == 0) {
+    arp_setup_retry_alarm(entry, ARP_INCOMPLETE_TIMEOUT);
+  }
+  entry = getref(entry);
+  mtx_unlock(&arp_cache.lock);
+
+  if (pending) {
+    arp_send_pending(entry->dev, entry->hw_addr, pending);
+  }
+
+  DPRINTF("updated cache entry: IP {:ip} -> MAC {:mac} (state=%u)\n", ip_addr, entry->hw_addr, entry->state);
+  return entry;
+}
+
 //
 // MARK: ARP Cache
 //
 
 __ref arp_entry_t *arp_cache_lookup(uint32_t ip_addr) {
   mtx_lock(&arp_cache.lock);
-
-  arp_entry_t *entry;
-  LIST_FOREACH(entry, &arp_cache.entries, link) {
-    if (entry->ip_addr == ip_addr) {
-      entry->last_used = clock_get_nanos();
-
-      // refresh timer for reachable entries
-      if (entry->state == ARP_STATE_REACHABLE && entry->timer_id > 0) {
-        arp_setup_cache_timeout_alarm(entry, ARP_CACHE_TIMEOUT);
-      }
-
-      mtx_unlock(&arp_cache.lock);
-      return getref(entry);
-    }
+  arp_entry_t *entry = arp_cache_find_locked(ip_addr);
+  if (entry) {
+    entry->last_used = clock_get_nanos();
+    entry = getref(entry);
   }
-
   mtx_unlock(&arp_cache.lock);
-  return NULL;
+  return entry;
 }
 
 __ref arp_entry_t *arp_cache_add(netdev_t *dev, uint32_t ip_addr, uint8_t *hw_addr) {
   ASSERT(dev != NULL);
   // hw_addr can be NULL for incomplete entries
-
-  __ref arp_entry_t *entry = arp_cache_lookup(ip_addr);
-  DPRINTF("arp_cache_add: IP {:ip} hw_addr={:mac} entry=%p\n",
-          ip_addr, hw_addr ? hw_addr : (uint8_t[]){0,0,0,0,0,0}, entry);
-  if (entry) {
-    DPRINTF("  found existing entry: state=%u queue_empty=%d\n",
-            entry->state, LIST_EMPTY(&entry->pending_queue));
-    // update existing entry
-    if (hw_addr && !eth_addr_is_zero(hw_addr)) {
-      mtx_lock(&arp_cache.lock);
-      eth_addr_copy(entry->hw_addr, hw_addr);
-      entry->state = ARP_STATE_REACHABLE;
-      entry->retries = 0;
-
-      arp_setup_cache_timeout_alarm(entry, ARP_CACHE_TIMEOUT);
-      mtx_unlock(&arp_cache.lock);
-
-      // send queued packets
-      size_t queued_count = 0;
-      LIST_FOR_IN_SAFE(skb, &entry->pending_queue, list) {
-        LIST_REMOVE(&entry->pending_queue, skb, list);
-        queued_count++;
-
-        DPRINTF("sending queued packet %zu for IP {:ip}: skb=%p len=%zu\n",
-                queued_count, ip_addr, skb, skb->len);
-
-        // dump first 60 bytes of packet before adding ethernet header
-        {
-          uint8_t *bytes = skb->data;
-          size_t dump_len = skb->len < 60 ? skb->len : 60;
-          DPRINTF("  packet before eth header (%zu bytes): ", dump_len);
-          for (size_t i = 0; i < dump_len; i++) {
-            kprintf("%02x ", bytes[i]);
-            if ((i + 1) % 20 == 0) kprintf("\n    ");
-          }
-          kprintf("\n");
-        }
-
-        // add ethernet header
-        if (eth_header(skb, entry->dev, ETH_P_IP, hw_addr, NULL) < 0) {
-          EPRINTF("failed to add ethernet header to queued packet\n");
-          skb_free(&skb);
-          continue;
-        }
-
-        // dump packet after ethernet header is added
-        {
-          uint8_t *bytes = skb->data;
-          size_t dump_len = skb->len < 60 ? skb->len : 60;
-          DPRINTF("  final packet with eth header (%zu bytes total): ", skb->len);
-          for (size_t i = 0; i < dump_len; i++) {
-            kprintf("%02x ", bytes[i]);
-            if ((i + 1) % 20 == 0) kprintf("\n    ");
-          }
-          kprintf("\n");
-        }
-
-        // transmit packet
-        netdev_tx(entry->dev, skb);
-        DPRINTF("transmitted queued packet %zu\n", queued_count);
-      }
-      if (queued_count > 0) {
-        DPRINTF("sent %zu queued packets for IP {:ip}\n", queued_count, ip_addr);
-      }
-    }
-
-    return moveref(entry);
-  }
-
-  DPRINTF("  creating new entry (lookup returned NULL)\n");
-  mtx_lock(&arp_cache.lock);
-  if (arp_cache.num_entries >= ARP_CACHE_MAX_ENTRIES) {
-    // evict oldest entry
-    arp_entry_t *oldest = NULL;
-    uint64_t oldest_time = UINT64_MAX;
-
-    LIST_FOREACH(entry, &arp_cache.entries, link) {
-      if (entry->last_used < oldest_time && entry->state != ARP_STATE_INCOMPLETE) {
-        oldest = entry;
-        oldest_time = entry->last_used;
-      }
-    }
-
-    if (oldest) {
-      LIST_REMOVE(&arp_cache.entries, oldest, link);
-      arp_cache.num_entries--;
-      arp_putref(&oldest);
-    }
-  }
-
-  // create new entry
-  entry = kmallocz(sizeof(arp_entry_t));
-  ASSERT(entry != NULL);
-
-  entry->ip_addr = ip_addr;
-  entry->dev = netdev_getref(dev);
-  entry->last_used = clock_get_nanos();
-  initref(entry);
-
-  if (hw_addr && !eth_addr_is_zero(hw_addr)) {
-    eth_addr_copy(entry->hw_addr, hw_addr);
-    entry->state = ARP_STATE_REACHABLE;
-    arp_setup_cache_timeout_alarm(entry, ARP_CACHE_TIMEOUT);
-  } else {
-    entry->state = ARP_STATE_INCOMPLETE;
-    arp_setup_cache_timeout_alarm(entry, ARP_INCOMPLETE_TIMEOUT);
-  }
-
-  LIST_ADD(&arp_cache.entries, entry, link);
-  arp_cache.num_entries++;
-  mtx_unlock(&arp_cache.lock);
-
-  DPRINTF("added cache entry: IP {:ip} -> MAC {:mac} (state=%u)\n",
-          ip_addr, hw_addr ? hw_addr : entry->hw_addr, entry->state);
-
-  return getref(entry);
+  return arp_cache_update_entry(dev, ip_addr, hw_addr, true);
 }
 
 void arp_cache_update(uint32_t ip_addr, uint8_t *hw_addr) {
-  arp_entry_t *entry = arp_cache_add(NULL, ip_addr, hw_addr);
+  // only existing entries can be updated without a device
+  arp_entry_t *entry = arp_cache_update_entry(NULL, ip_addr, hw_addr, false);
   arp_putref(&entry);
 }
 
 void arp_cache_delete(uint32_t ip_addr) {
   mtx_lock(&arp_cache.lock);
-
-  LIST_FOR_IN_SAFE(entry, &arp_cache.entries, link) {
-    if (entry->ip_addr == ip_addr) {
-      LIST_REMOVE(&arp_cache.entries, entry, link);
-      arp_cache.num_entries--;
-      arp_putref(&entry);
-      break;
-    }
+  arp_entry_t *entry = arp_cache_find_locked(ip_addr);
+  if (entry) {
+    arp_cache_unlink_locked(entry);
   }
-
   mtx_unlock(&arp_cache.lock);
 }
 
 void arp_cache_flush(netdev_t *dev) {
   mtx_lock(&arp_cache.lock);
-
-  LIST_FOR_IN_SAFE(entry, &arp_cache.entries, link) {
-    if (!dev || entry->dev == dev) {
-      LIST_REMOVE(&arp_cache.entries, entry, link);
-      arp_cache.num_entries--;
-      arp_putref(&entry);
+  for (int i = 0; i < ARP_HASH_SIZE; i++) {
+    LIST_FOR_IN_SAFE(entry, &arp_cache.buckets[i], link) {
+      if (!dev || entry->dev == dev) {
+        arp_cache_unlink_locked(entry);
+      }
     }
   }
-
   mtx_unlock(&arp_cache.lock);
 }
 
@@ -435,94 +454,108 @@ int arp_send_gratuitous(netdev_t *dev, uint32_t ip_addr) {
 // MARK: ARP Resolution
 //
 
+static const uint8_t arp_loopback_addr[ETH_ALEN] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x01 };
+
+static inline bool arp_is_loopback(uint32_t ip_addr) {
+  return (ip_addr & 0xFF000000) == 0x7F000000;  // 127.x.x.x
+}
+
 int arp_lookup(netdev_t *dev, uint32_t ip_addr, uint8_t *hw_addr) {
   ASSERT(dev != NULL);
   ASSERT(hw_addr != NULL);
 
-  if ((ip_addr & 0xFF000000) == 0x7F000000) {  // 127.x.x.x
-    // loopback address
-    memset(hw_addr, 0, ETH_ALEN);
-    hw_addr[0] = 0x00;
-    hw_addr[1] = 0x00;
-    hw_addr[2] = 0x00;
-    hw_addr[3] = 0x00;
-    hw_addr[4] = 0x00;
-    hw_addr[5] = 0x01;
+  if (arp_is_loopback(ip_addr)) {
+    eth_addr_copy(hw_addr, arp_loopback_addr);
     return 0;
   }
 
-  // check cache
-  arp_entry_t *entry = arp_cache_lookup(ip_addr);
-  if (entry && entry->state == ARP_STATE_REACHABLE) {
+  int res = -EAGAIN;
+  uint64_t now = clock_get_nanos();
+  mtx_lock(&arp_cache.lock);
+  arp_entry_t *entry = arp_cache_find_locked(ip_addr);
+  if (entry && arp_entry_state(entry, now) != ARP_STATE_INCOMPLETE) {
     eth_addr_copy(hw_addr, entry->hw_addr);
-    return 0;
+    entry->last_used = now;
+    res = 0;
   }
-
-  return -EAGAIN;
+  mtx_unlock(&arp_cache.lock);
+  return res;
 }
 
 int arp_resolve(netdev_t *dev, uint32_t ip_addr, sk_buff_t *skb) {
   ASSERT(dev != NULL);
   ASSERT(skb != NULL);
-  int res = 0;
 
-  arp_entry_t *entry = arp_cache_lookup(ip_addr); __ref
+  uint8_t hw_addr[ETH_ALEN];
+  if (arp_is_loopback(ip_addr)) {
+    eth_addr_copy(hw_addr, arp_loopback_addr);
+    goto header;
+  }
+
+  uint64_t now = clock_get_nanos();
+  bool send_probe = false;
+  mtx_lock(&arp_cache.lock);
+  arp_entry_t *entry = arp_cache_find_locked(ip_addr);
   if (!entry) {
-    // create incomplete entry
-    entry = arp_cache_add(dev, ip_addr, NULL);
+    // create an incomplete entry and start resolving
+    entry = arp_cache_create_locked(dev, ip_addr, now);
     if (!entry) {
-      goto_res(done, -ENOMEM);
-    }
-
-    // send ARP request
-    struct in_ifaddr *ifa = LIST_FIRST(&dev->ip_addrs);
-    if (ifa) {
-      arp_send_request(dev, ifa->ifa_address, ip_addr);
+      mtx_unlock(&arp_cache.lock);
+      skb_free(&skb);
+      return -ENOMEM;
     }
+    arp_setup_retry_alarm(entry, ARP_INCOMPLETE_TIMEOUT);
+    send_probe = true;
   }
 
-  // handle stale entries - refresh them
-  if (entry->state == ARP_STATE_STALE) {
-    DPRINTF("refreshing stale entry for IP {:ip}\n", ip_addr);
-
-    mtx_lock(&arp_cache.lock);
-    entry->state = ARP_STATE_INCOMPLETE;
-    entry->retries = 0;
-    arp_setup_cache_timeout_alarm(entry, ARP_INCOMPLETE_TIMEOUT);
-    mtx_unlock(&arp_cache.lock);
-
-    // send ARP request
-    struct in_ifaddr *ifa = LIST_FIRST(&dev->ip_addrs);
-    if (ifa) {
-      arp_send_request(dev, ifa->ifa_address, ip_addr);
-    }
+  entry->last_used = now;
+  switch (arp_entry_state(entry, now)) {
+    case ARP_STATE_STALE:
+      // keep using the address while it is revalidated
+      DPRINTF("probing stale entry for IP {:ip}\n", ip_addr);
+      entry->state = ARP_STATE_PROBE;
+      entry->retries = 0;
+      arp_setup_retry_alarm(entry, ARP_RETRY_INTERVAL);
+      send_probe = true;
+      // fallthrough
+    case ARP_STATE_REACHABLE:
+    case ARP_STATE_PROBE:
+      eth_addr_copy(hw_addr, entry->hw_addr);
+      mtx_unlock(&arp_cache.lock);
+      if (send_probe) {
+        arp_send_probe(dev, ip_addr);
+      }
+      goto header;
+    case ARP_STATE_INCOMPLETE:
+      break;
+    default:
+      unreachable;
   }
 
-  // queue packet for later transmission
-  if (entry->state == ARP_STATE_INCOMPLETE) {
-    LIST_ADD(&entry->pending_queue, skb, list);
-    DPRINTF("queued packet for IP {:ip} (pending resolution)\n", ip_addr);
-    goto_res(done, 0); // packet queued successfully
+  // queue the packet until the address resolves
+  if (entry->num_pending >= ARP_MAX_PENDING) {
+    struct sk_buff *oldest = LIST_FIRST(&entry->pending_queue);
+    LIST_REMOVE(&entry->pending_queue, oldest, list);
+    entry->num_pending--;
+    skb_free(&oldest);
   }
+  LIST_ADD(&entry->pending_queue, skb, list);
+  entry->num_pending++;
+  mtx_unlock(&arp_cache.lock);
 
-  // entry became reachable between lookup and queue
-  // this can happen if ARP reply arrives very quickly
-  if (entry->state == ARP_STATE_REACHABLE) {
-    DPRINTF("ARP resolved while queuing for IP {:ip}, adding eth header\n", ip_addr);
-    int ret = eth_header(skb, dev, ETH_P_IP, entry->hw_addr, NULL);
-    if (ret < 0) {
-      skb_free(&skb);
-      goto_res(done, ret);
-    }
-    goto_res(done, 1); // signal caller to transmit immediately
+  DPRINTF("queued packet for IP {:ip} (pending resolution)\n", ip_addr);
+  if (send_probe) {
+    arp_send_probe(dev, ip_addr);
   }
+  return 0; // packet queued successfully
 
-  // entry is in unexpected state (e.g., FAILED)
-  DPRINTF("entry for IP {:ip} in unexpected state %u\n", ip_addr, entry->state);
-
-LABEL(done);
-  arp_putref(&entry);
-  return res;
+LABEL(header);
+  int ret = eth_header(skb, dev, ETH_P_IP, hw_addr, NULL);
+  if (ret < 0) {
+    skb_free(&skb);
+    return ret;
+  }
+  return 1; // signal caller to transmit immediately
 }
 
 //
@@ -565,20 +598,22 @@ int arp_rcv(struct sk_buff *skb) {
           op == ARPOP_REQUEST ? "request" : "reply",
           arp->eth_ipv4.ar_sha, sip, arp->eth_ipv4.ar_tha, tip);
 
-  // update cache with sender's information
+  struct in_ifaddr *ifa = LIST_FIRST(&dev->ip_addrs);
+  uint32_t our_ip = ifa ? ifa->ifa_address : 0;
+
+  // update the cache with the sender's information. new entries are only
+  // created when the packet is addressed to us (rfc 826).
   if (!eth_addr_is_zero(arp->eth_ipv4.ar_sha)) {
-    arp_entry_t *entry = arp_cache_add(dev, sip, arp->eth_ipv4.ar_sha);
+    arp_entry_t *entry = arp_cache_update_entry(dev, sip, arp->eth_ipv4.ar_sha, ifa && tip == our_ip);
     arp_putref(&entry);
   }
 
-  struct in_ifaddr *ifa = LIST_FIRST(&dev->ip_addrs);
   if (!ifa) {
     DPRINTF("device has no IP address\n");
     skb_free(&skb);
     return 0;
   }
 
-  uint32_t our_ip = ifa->ifa_address;
   if (tip == our_ip) {
     if (op == ARPOP_REQUEST) {
       arp_send_reply(dev, our_ip, sip, arp->eth_ipv4.ar_sha);
@@ -591,6 +626,31 @@ int arp_rcv(struct sk_buff *skb) {
   return 0;
 }
 
+static const char *arp_state_names[] = {
+  [ARP_STATE_INCOMPLETE] = "INCOMPLETE",
+  [ARP_STATE_REACHABLE] = "REACHABLE",
+  [ARP_STATE_STALE] = "STALE",
+  [ARP_STATE_FAILED] = "FAILED",
+  [ARP_STATE_PROBE] = "PROBE",
+};
+
+static int arp_cache_show(seqfile_t *sf, void *_) {
+  uint64_t now = clock_get_nanos();
+  seq_printf(sf, "address\thwaddr\tstate\tqueued\tdevice\n");
+  mtx_lock(&arp_cache.lock);
+  for (int i = 0; i < ARP_HASH_SIZE; i++) {
+    arp_entry_t *entry;
+    LIST_FOREACH(entry, &arp_cache.buckets[i], link) {
+      uint8_t state = arp_entry_state(entry, now);
+      seq_printf(sf, "{:ip}\t{:mac}\t%s\t%u\t{:str}\n", entry->ip_addr, entry->hw_addr,
+                 arp_state_names[state], entry->num_pending, &entry->dev->name);
+    }
+  }
+  mtx_unlock(&arp_cache.lock);
+  return 0;
+}
+PROCFS_REGISTER_SIMPLE(arp, "/net/arp", arp_cache_show, NULL, 0444);
+
 //
 // MARK: Initialization
 //
@@ -603,7 +663,9 @@ static packet_type_t arp_packet_type = {
 static void arp_init() {
   arp_cache.num_entries = 0;
   arp_cache.max_entries = ARP_CACHE_MAX_ENTRIES;
-  LIST_INIT(&arp_cache.entries);
+  for (int i = 0; i < ARP_HASH_SIZE; i++) {
+    LIST_INIT(&arp_cache.buckets[i]);
+  }
   mtx_init(&arp_cache.lock, 0, "arp_cache");
 
   arp_softirq_chan = chan_alloc(32, sizeof(arp_timer_event_t), 0, "arp_softirq");
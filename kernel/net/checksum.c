@@ -0,0 +1,242 @@
+//
+// Created by Aaron Gill-Braun on 2026-10-18.
+//
+
+#include <kernel/net/checksum.h>
+
+#include <kernel/clock.h>
+#include <kernel/mm.h>
+#include <kernel/panic.h>
+#include <kernel/printf.h>
+#include <kernel/string.h>
+
+#include <fs/procfs/procfs.h>
+
+#define ASSERT(x) kassert(x)
+#define LOG_TAG csum
+#include <kernel/log.h>
+#define EPRINTF(fmt, ...) kprintf("csum: %s: " fmt, __func__, ##__VA_ARGS__)
+
+static inline uint64_t load64(const void *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint64_t add64(uint64_t sum, uint64_t v) {
+  sum += v;
+  return sum + (sum < v);
+}
+
+static inline uint32_t fold64(uint64_t sum) {
+  sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+  sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+  return (uint32_t) sum;
+}
+
+// sums the last 0-7 bytes of a buffer
+static inline uint64_t csum_tail(const uint8_t *p, size_t len, uint64_t sum) {
+  if (len & 4) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    sum = add64(sum, v);
+    p += 4;
+  }
+  if (len & 2) {
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    sum = add64(sum, v);
+    p += 2;
+  }
+  if (len & 1) {
+    // the odd byte is the first byte of a zero padded word
+    sum = add64(sum, *p);
+  }
+  return sum;
+}
+
+uint32_t csum_partial(const void *buf, size_t len, uint32_t sum) {
+  const uint8_t *p = buf;
+  uint64_t sum64 = sum;
+
+  // 64 bytes per iteration with a single add/adc chain. unaligned loads are
+  // fine on x86 and cost little next to splitting the buffer.
+  while (len >= 64) {
+    __asm volatile(
+      "add %0, [%1]\n"
+      "adc %0, [%1 + 8]\n"
+      "adc %0, [%1 + 16]\n"
+      "adc %0, [%1 + 24]\n"
+      "adc %0, [%1 + 32]\n"
+      "adc %0, [%1 + 40]\n"
+      "adc %0, [%1 + 48]\n"
+      "adc %0, [%1 + 56]\n"
+      "adc %0, 0\n"
+      : "+r" (sum64)
+      : "r" (p)
+      : "cc", "memory"
+    );
+    p += 64;
+    len -= 64;
+  }
+
+  while (len >= 8) {
+    sum64 = add64(sum64, load64(p));
+    p += 8;
+    len -= 8;
+  }
+
+  sum64 = csum_tail(p, len, sum64);
+  return fold64(sum64);
+}
+
+uint32_t csum_partial_copy(void *dst, const void *src, size_t len, uint32_t sum) {
+  const uint8_t *s = src;
+  uint8_t *d = dst;
+  uint64_t sum64 = sum;
+
+  // sum the data while it is in registers instead of reading it twice
+  while (len >= 32) {
+    uint64_t v0 = load64(s);
+    uint64_t v1 = load64(s + 8);
+    uint64_t v2 = load64(s + 16);
+    uint64_t v3 = load64(s + 24);
+    memcpy(d, &v0, 8);
+    memcpy(d + 8, &v1, 8);
+    memcpy(d + 16, &v2, 8);
+    memcpy(d + 24, &v3, 8);
+    sum64 = add64(sum64, v0);
+    sum64 = add64(sum64, v1);
+    sum64 = add64(sum64, v2);
+    sum64 = add64(sum64, v3);
+    s += 32;
+    d += 32;
+    len -= 32;
+  }
+
+  while (len >= 8) {
+    uint64_t v = load64(s);
+    memcpy(d, &v, 8);
+    sum64 = add64(sum64, v);
+    s += 8;
+    d += 8;
+    len -= 8;
+  }
+
+  memcpy(d, s, len);
+  sum64 = csum_tail(s, len, sum64);
+  return fold64(sum64);
+}
+
+uint32_t csum_tcpudp_nofold(uint32_t saddr, uint32_t daddr, uint16_t len, uint8_t proto, uint32_t sum) {
+  // pseudo header: saddr, daddr, zero, protocol, length
+  uint64_t sum64 = sum;
+  sum64 += saddr;
+  sum64 += daddr;
+  sum64 += htons(len);
+  sum64 += (uint32_t) proto << 8;
+  return fold64(sum64);
+}
+
+//
+// MARK: Benchmark
+//
+
+#define BENCH_BUF_SIZE  (64 * SIZE_1KB)
+#define BENCH_BYTES     SIZE_16MB // bytes processed per measurement
+
+// simple word at a time reference used to check the results
+static uint16_t csum_reference(const uint8_t *p, size_t len) {
+  uint32_t sum = 0;
+  while (len > 1) {
+    sum += p[0] | (p[1] << 8);
+    p += 2;
+    len -= 2;
+  }
+  if (len > 0) {
+    sum += p[0];
+  }
+  while (sum >> 16) {
+    sum = (sum & 0xFFFF) + (sum >> 16);
+  }
+  return (uint16_t) ~sum;
+}
+
+// returns the rate in units of 10 MB/s (hundredths of a GB/s)
+static uint64_t bench_rate(size_t bytes, uint64_t ns) {
+  return ns ? (bytes * 100) / ns : 0;
+}
+
+// reading /proc/csum_bench measures csum_partial and csum_partial_copy over a
+// range of buffer sizes and alignments.
+static int csum_bench_show(seqfile_t *sf, void *_) {
+  static const size_t sizes[] = { 20, 64, 576, 1500, 4096, 65536 - 64 };
+  static const size_t aligns[] = { 0, 1, 2, 4 };
+
+  uint8_t *src = kmalloc(BENCH_BUF_SIZE);
+  uint8_t *dst = kmalloc(BENCH_BUF_SIZE);
+  if (src == NULL || dst == NULL) {
+    kfree(src);
+    kfree(dst);
+    return -ENOMEM;
+  }
+
+  uint32_t seed = 0x12345678;
+  for (size_t i = 0; i < BENCH_BUF_SIZE; i++) {
+    seed = seed * 1103515245 + 12345;
+    src[i] = (uint8_t)(seed >> 16);
+  }
+
+  seq_printf(sf, "%8s %6s %12s %12s %6s\n", "size", "align", "csum GB/s", "copy GB/s", "check");
+  for (size_t i = 0; i < ARRAY_SIZE(sizes); i++) {
+    for (size_t j = 0; j < ARRAY_SIZE(aligns); j++) {
+      size_t size = sizes[i];
+      const uint8_t *buf = src + aligns[j];
+      uint8_t *out = dst + aligns[j];
+      size_t iters = max(BENCH_BYTES / size, 1);
+
+      volatile uint32_t sink = 0;
+      uint64_t start = clock_get_nanos();
+      for (size_t k = 0; k < iters; k++) {
+        sink += csum_partial(buf, size, 0);
+      }
+      uint64_t csum_ns = clock_get_nanos() - start;
+
+      start = clock_get_nanos();
+      for (size_t k = 0; k < iters; k++) {
+        sink += csum_partial_copy(out, buf, size, 0);
+      }
+      uint64_t copy_ns = clock_get_nanos() - start;
+
+      uint16_t expected = csum_reference(buf, size);
+      bool ok = csum_fold(csum_partial(buf, size, 0)) == expected &&
+                csum_fold(csum_partial_copy(out, buf, size, 0)) == expected &&
+                memcmp(out, buf, size) == 0;
+
+      uint64_t csum_rate = bench_rate(size * iters, csum_ns);
+      uint64_t copy_rate = bench_rate(size * iters, copy_ns);
+      seq_printf(sf, "%8zu %6zu %9lu.%02lu %9lu.%02lu %6s\n", size, aligns[j],
+                 csum_rate / 100, csum_rate % 100, copy_rate / 100, copy_rate % 100,
+                 ok ? "ok" : "FAIL");
+      if (!ok) {
+        EPRINTF("mismatch for size %zu align %zu\n", size, aligns[j]);
+      }
+    }
+  }
+
+  // check the incremental updates against a full recompute
+  uint16_t check = ip_checksum(src, 64);
+  uint16_t old16 = *(uint16_t *)(src + 10);
+  uint32_t old32 = *(uint32_t *)(src + 20);
+  *(uint16_t *)(src + 10) = old16 ^ 0x5A5A;
+  *(uint32_t *)(src + 20) = old32 + 0x01020304;
+  csum_replace2(&check, old16, *(uint16_t *)(src + 10));
+  csum_replace4(&check, old32, *(uint32_t *)(src + 20));
+  bool ok = check == ip_checksum(src, 64);
+  seq_printf(sf, "incremental update: %s\n", ok ? "ok" : "FAIL");
+
+  kfree(src);
+  kfree(dst);
+  return 0;
+}
+PROCFS_REGISTER_SIMPLE(csum_bench, "/csum_bench", csum_bench_show, NULL, 0444);
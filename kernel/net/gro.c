@@ -0,0 +1,233 @@
+//
+// Created by Aaron Gill-Braun on 2026-10-18.
+//
+
+#include <kernel/net/gro.h>
+#include <kernel/net/checksum.h>
+#include <kernel/net/ip.h>
+#include <kernel/net/netdev.h>
+#include <kernel/net/skbuff.h>
+#include <kernel/net/tcp.h>
+
+#include <kernel/atomic.h>
+#include <kernel/panic.h>
+#include <kernel/printf.h>
+#include <kernel/string.h>
+
+#include <fs/procfs/procfs.h>
+
+#include <linux/in.h>
+
+#define ASSERT(x) kassert(x)
+#define LOG_TAG gro
+#include <kernel/log.h>
+#define EPRINTF(fmt, ...) kprintf("gro: %s: " fmt, __func__, ##__VA_ARGS__)
+
+#define GRO_HDR_LEN (sizeof(struct iphdr) + sizeof(struct tcphdr))
+
+static struct {
+  uint64_t held;      // packets held as the start of a flow
+  uint64_t merged;    // packets appended to a held packet
+  uint64_t flushed;   // held packets passed up
+} gro_stats;
+
+static inline struct iphdr *gro_iph(sk_buff_t *skb) {
+  return (struct iphdr *)skb->data;
+}
+
+static inline struct tcphdr *gro_tcph(sk_buff_t *skb) {
+  return (struct tcphdr *)(skb->data + sizeof(struct iphdr));
+}
+
+static inline size_t gro_tcp_hdrlen(struct tcphdr *tcph) {
+  return TCP_DOFF_GET(ntohs(tcph->flags)) * 4UL;
+}
+
+static inline size_t gro_payload_len(sk_buff_t *skb) {
+  return skb->len - sizeof(struct iphdr) - gro_tcp_hdrlen(gro_tcph(skb));
+}
+
+// returns true if the packet is an ipv4 tcp segment without ip options
+static bool gro_is_tcp(sk_buff_t *skb) {
+  if (skb->len < GRO_HDR_LEN) {
+    return false;
+  }
+
+  struct iphdr *iph = gro_iph(skb);
+  return iph->version_ihl == IPVERSION_IHL(IPVERSION, sizeof(struct iphdr)) &&
+         iph->protocol == IPPROTO_TCP &&
+         (ntohs(iph->frag_off) & (IP_MF | IP_OFFMASK)) == 0;
+}
+
+// returns true if a tcp segment can be merged with others
+static bool gro_can_merge(sk_buff_t *skb) {
+  struct iphdr *iph = gro_iph(skb);
+  size_t tot_len = ntohs(iph->tot_len);
+  if (tot_len < GRO_HDR_LEN || tot_len > skb->len || ip_checksum(iph, sizeof(struct iphdr)) != 0) {
+    return false;
+  }
+  skb_trim(skb, tot_len); // drop any link-layer padding
+
+  // only plain data segments are merged
+  struct tcphdr *tcph = gro_tcph(skb);
+  size_t tcp_hdrlen = gro_tcp_hdrlen(tcph);
+  uint16_t flags = TCP_FLAGS_GET(ntohs(tcph->flags));
+  if (tcp_hdrlen < sizeof(struct tcphdr) || sizeof(struct iphdr) + tcp_hdrlen >= tot_len ||
+      !(flags & TCP_FLAG_ACK) || (flags & ~(TCP_FLAG_ACK | TCP_FLAG_PSH))) {
+    return false;
+  }
+
+  // the checksum of a merged packet is not valid so verify it now
+  if (skb->ip_summed != CHECKSUM_UNNECESSARY) {
+    size_t len = tot_len - sizeof(struct iphdr);
+    uint32_t sum = csum_partial(tcph, len, 0);
+    if (csum_tcpudp_magic(iph->saddr, iph->daddr, len, IPPROTO_TCP, sum) != 0) {
+      return false;
+    }
+    skb->ip_summed = CHECKSUM_UNNECESSARY;
+  }
+  return true;
+}
+
+static sk_buff_t *gro_find_flow(netdev_t *dev, sk_buff_t *skb) {
+  struct iphdr *iph = gro_iph(skb);
+  struct tcphdr *tcph = gro_tcph(skb);
+  return LIST_FIND(p, &dev->gro_list, list,
+                   gro_iph(p)->saddr == iph->saddr && gro_iph(p)->daddr == iph->daddr &&
+                   gro_tcph(p)->source == tcph->source && gro_tcph(p)->dest == tcph->dest);
+}
+
+static void gro_flush_one(netdev_t *dev, sk_buff_t *p) {
+  LIST_REMOVE(&dev->gro_list, p, list);
+  dev->gro_count--;
+  atomic_fetch_add(&gro_stats.flushed, 1);
+  ip_rcv(p);
+}
+
+static void gro_hold(netdev_t *dev, sk_buff_t *skb) {
+  if (dev->gro_count >= GRO_MAX_HELD) {
+    gro_flush_one(dev, LIST_FIRST(&dev->gro_list));
+  }
+
+  LIST_ADD(&dev->gro_list, skb, list);
+  dev->gro_count++;
+  atomic_fetch_add(&gro_stats.held, 1);
+}
+
+// returns true if the segment continues the held packet of its flow
+static bool gro_segment_follows(sk_buff_t *p, sk_buff_t *skb) {
+  struct iphdr *piph = gro_iph(p);
+  struct iphdr *iph = gro_iph(skb);
+  struct tcphdr *ptcph = gro_tcph(p);
+  struct tcphdr *tcph = gro_tcph(skb);
+  size_t tcp_hdrlen = gro_tcp_hdrlen(tcph);
+
+  return piph->tos == iph->tos && piph->ttl == iph->ttl &&
+         ntohl(tcph->seq) == ntohl(ptcph->seq) + gro_payload_len(p) &&
+         ptcph->ack_seq == tcph->ack_seq &&
+         !(TCP_FLAGS_GET(ntohs(ptcph->flags)) & TCP_FLAG_PSH) &&
+         gro_tcp_hdrlen(ptcph) == tcp_hdrlen &&
+         memcmp(ptcph + 1, tcph + 1, tcp_hdrlen - sizeof(struct tcphdr)) == 0 &&
+         p->len + gro_payload_len(skb) <= GRO_MAX_SIZE;
+}
+
+// appends the payload of skb to the held packet and returns the held packet
+static sk_buff_t *gro_merge(netdev_t *dev, sk_buff_t *p, sk_buff_t *skb) {
+  size_t len = gro_payload_len(skb);
+  if (skb_tailroom(p) < len) {
+    // move the held packet into a buffer that fits a full merged packet
+    sk_buff_t *np = skb_alloc(GRO_MAX_SIZE);
+    if (!np) {
+      return NULL;
+    }
+
+    memcpy(skb_put_data(np, p->len), p->data, p->len);
+    np->dev = p->dev;
+    np->protocol = p->protocol;
+    np->pkt_type = p->pkt_type;
+    np->ip_summed = p->ip_summed;
+    np->timestamp = p->timestamp;
+
+    LIST_INSERT(&dev->gro_list, np, list, p);
+    LIST_REMOVE(&dev->gro_list, p, list);
+    skb_free(&p);
+    p = np;
+  }
+
+  memcpy(skb_put_data(p, len), skb->data + skb->len - len, len);
+
+  // the ip header describes the merged packet and tcp takes the most recent
+  // window and push flag
+  struct iphdr *iph = gro_iph(p);
+  iph->tot_len = htons(p->len);
+  iph->check = 0;
+  iph->check = ip_checksum(iph, sizeof(struct iphdr));
+
+  struct tcphdr *ptcph = gro_tcph(p);
+  struct tcphdr *tcph = gro_tcph(skb);
+  ptcph->window = tcph->window;
+  ptcph->flags |= tcph->flags & htons(TCP_FLAG_PSH);
+
+  atomic_fetch_add(&gro_stats.merged, 1);
+  skb_free(&skb);
+  return p;
+}
+
+bool gro_receive(netdev_t *dev, sk_buff_t *skb) {
+  if (!gro_is_tcp(skb)) {
+    return false;
+  }
+
+  // packets of a held flow that cannot be merged are passed up after it to
+  // keep the flow in order
+  sk_buff_t *p = gro_find_flow(dev, skb);
+  if (!gro_can_merge(skb)) {
+    if (p) {
+      gro_flush_one(dev, p);
+    }
+    return false;
+  }
+
+  if (p && gro_segment_follows(p, skb)) {
+    p = gro_merge(dev, p, skb);
+    if (p) {
+      // pass the packet up once it is pushed or cannot take another segment
+      if ((ntohs(gro_tcph(p)->flags) & TCP_FLAG_PSH) || p->len + dev->mtu > GRO_MAX_SIZE) {
+        gro_flush_one(dev, p);
+      }
+      return true;
+    }
+    p = gro_find_flow(dev, skb);
+  }
+
+  if (p) {
+    gro_flush_one(dev, p);
+  }
+  if (TCP_FLAGS_GET(ntohs(gro_tcph(skb)->flags)) & TCP_FLAG_PSH) {
+    return false; // nothing can follow a pushed segment
+  }
+
+  gro_hold(dev, skb);
+  return true;
+}
+
+void gro_flush(netdev_t *dev) {
+  sk_buff_t *p;
+  while ((p = LIST_FIRST(&dev->gro_list)) != NULL) {
+    gro_flush_one(dev, p);
+  }
+}
+
+static int gro_stats_show(seqfile_t *sf, void *_) {
+  uint64_t held = atomic_load(&gro_stats.held);
+  uint64_t merged = atomic_load(&gro_stats.merged);
+  seq_printf(sf, "held:     %llu\n", held);
+  seq_printf(sf, "merged:   %llu\n", merged);
+  seq_printf(sf, "flushed:  %llu\n", atomic_load(&gro_stats.flushed));
+  if (held > 0) {
+    uint64_t ratio = ((held + merged) * 100) / held;
+    seq_printf(sf, "segments per packet: %llu.%02llu\n", ratio / 100, ratio % 100);
+  }
+  return 0;
+}
+PROCFS_REGISTER_SIMPLE(gro_stats, "/net/gro", gro_stats_show, NULL, 0444);
@@ -57,13 +57,14 @@ int icmp_send_echo_reply(sk_buff_t *skb) {
 
   skb_set_transport_header(reply_skb, 0);
 
-  // modify the icmp header to be an echo reply
+  // modify the icmp header to be an echo reply. the request checksum was
+  // verified so it can be updated for the changed type and code instead of
+  // summing the whole message again
   struct icmphdr *reply_icmph = skb_transport_header(reply_skb);
+  uint16_t old_word = *(uint16_t *)reply_icmph;
   reply_icmph->type = ICMP_ECHOREPLY;
   reply_icmph->code = 0;
-  reply_icmph->checksum = 0;
-
-  reply_icmph->checksum = ip_checksum(reply_icmph, icmp_len);
+  csum_replace2(&reply_icmph->checksum, old_word, *(uint16_t *)reply_icmph);
 
   DPRINTF("sending echo reply: src={:ip} dst={:ip} via {:str}\n", ifa->ifa_address, ntohl(iph->saddr), &dev->name);
   reply_skb->dev = dev;
@@ -9,7 +9,10 @@
 #include <kernel/net/skbuff.h>
 #include <kernel/net/netdev.h>
 
+#include <kernel/atomic.h>
 #include <kernel/bits.h>
+#include <kernel/clock.h>
+#include <kernel/cpu/cpu.h>
 #include <kernel/mm.h>
 #include <kernel/panic.h>
 #include <kernel/printf.h>
@@ -19,7 +22,36 @@
 #include <kernel/log.h>
 #define EPRINTF(fmt, ...) kprintf("ip: %s: " fmt, __func__, ##__VA_ARGS__)
 
-static LIST_HEAD(route_t) routing_table;
+/**
+ * A node in the routing trie.
+ *
+ * The trie is a path compressed binary trie keyed on the destination prefix.
+ * Each node covers a prefix and has a child for each value of the bit that
+ * follows it. Chains of single child nodes are collapsed so the depth is
+ * bounded by the number of distinct prefix lengths. Nodes without routes
+ * are only kept where two subtrees branch.
+ */
+struct route_node {
+  uint32_t key;                     // prefix (host byte order, masked)
+  uint8_t plen;                     // prefix length
+  route_t *best;                    // lowest metric route for the prefix
+  LIST_HEAD(route_t) routes;        // routes for this prefix (by metric)
+  struct route_node *child[2];      // subtrees by the bit after the prefix
+};
+
+/*
+ * Lookups do not take the routing lock. A lookup runs with interrupts
+ * disabled and marks the cpu as reading by making its counter odd. Writers
+ * update the trie under the routing lock, publishing new nodes only once they
+ * are initialized, and before freeing an unlinked node or dropping the table
+ * reference to a route they wait for any lookup in progress to finish.
+ */
+struct route_reader {
+  volatile uint32_t seq;
+} __attribute__((aligned(64)));
+
+static struct route_node *routing_trie;
+static struct route_reader route_readers[MAX_CPUS];
 static mtx_t routing_lock;
 
 static int (*protocol_handlers[256])(sk_buff_t *skb) = { NULL };
@@ -27,9 +59,47 @@ static mtx_t proto_handlers_lock;
 
 static uint16_t ip_id_counter = 1;
 
+#define IPQ_HASH_SIZE     64
+#define IPQ_HASH(saddr, daddr, id, proto) \
+  ((((saddr) ^ (daddr) ^ ((uint32_t)(id) << 16) ^ (proto)) * 0x9E3779B1u) >> 26)
+#define IPQ_TIMEOUT       SEC_TO_NS(30)    // time to wait for all fragments
+#define IPQ_MAX_MEM       (256 * SIZE_1KB) // max fragment payload held overall
+
+#define IPQ_FIRST_IN      0x1 // fragment at offset 0 received
+#define IPQ_LAST_IN       0x2 // fragment without IP_MF received
+
+/**
+ * A fragment reassembly queue.
+ *
+ * Holds the fragments of a datagram identified by the source, destination,
+ * id and protocol (rfc 791) sorted by offset. Fragments keep their ip header
+ * in the buffer and skb->network_header points to it.
+ */
+struct ipq {
+  uint32_t saddr;                   // source address (network byte order)
+  uint32_t daddr;                   // destination address (network byte order)
+  uint16_t id;                      // datagram id
+  uint8_t protocol;                 // ip protocol
+  uint8_t flags;                    // IPQ_* flags
+  size_t len;                       // datagram payload length (once last is in)
+  size_t meat;                      // payload bytes received
+  uint64_t expires;                 // time after which the queue is dropped
+  LIST_HEAD(struct sk_buff) frags;  // fragments sorted by offset
+  LIST_ENTRY(struct ipq) link;      // hash bucket list
+};
+
+static LIST_HEAD(struct ipq) ipq_table[IPQ_HASH_SIZE];
+static size_t ipq_mem;
+static uint64_t ipq_next_expire;
+static mtx_t ipq_lock;
+
 void ip_static_init() {
   mtx_init(&routing_lock, 0, "ip_routing");
   mtx_init(&proto_handlers_lock, 0, "ip_protocols");
+  mtx_init(&ipq_lock, 0, "ip_frag");
+  for (int i = 0; i < IPQ_HASH_SIZE; i++) {
+    LIST_INIT(&ipq_table[i]);
+  }
 }
 STATIC_INIT(ip_static_init);
 
@@ -48,14 +118,154 @@ void _route_free(route_t **routep) {
   kfree(route);
 }
 
+static inline uint32_t prefix_mask(uint8_t plen) {
+  return plen == 0 ? 0 : UINT32_MAX << (32 - plen);
+}
+
+static inline int prefix_bit(uint32_t key, uint8_t pos) {
+  return (key >> (31 - pos)) & 1;
+}
+
+// returns the prefix length of a contiguous mask or -1
+static int mask_to_plen(uint32_t mask) {
+  int plen = bit_popcnt32(mask);
+  return prefix_mask(plen) == mask ? plen : -1;
+}
+
+static inline uint64_t route_read_begin() {
+  uint64_t flags;
+  temp_irq_save(flags);
+  atomic_fetch_add(&route_readers[curcpu_id].seq, 1);
+  return flags;
+}
+
+static inline void route_read_end(uint64_t flags) {
+  atomic_fetch_add(&route_readers[curcpu_id].seq, 1);
+  temp_irq_restore(flags);
+}
+
+// waits until no cpu is in a lookup that started before the call
+static void route_synchronize() {
+  atomic_thread_fence();
+  for (int cpu = 0; cpu < system_num_cpus; cpu++) {
+    uint32_t seq = atomic_load(&route_readers[cpu].seq);
+    if (seq & 1) {
+      while (atomic_load(&route_readers[cpu].seq) == seq) {
+        cpu_pause();
+      }
+    }
+  }
+}
+
+static struct route_node *route_node_alloc(uint32_t key, uint8_t plen) {
+  struct route_node *node = kmallocz(sizeof(struct route_node));
+  if (node) {
+    node->key = key & prefix_mask(plen);
+    node->plen = plen;
+    LIST_INIT(&node->routes);
+  }
+  return node;
+}
+
+// recomputes the best route of a node after its route list changed
+static void route_node_update_best(struct route_node *node) {
+  atomic_store_release(&node->best, LIST_FIRST(&node->routes));
+}
+
+// returns the node for the exact prefix creating it if needed
+static struct route_node *route_trie_insert(uint32_t key, uint8_t plen) {
+  struct route_node **link = &routing_trie;
+  struct route_node *node;
+  while ((node = *link) != NULL) {
+    uint32_t diff = (key ^ node->key) & prefix_mask(min(plen, node->plen));
+    if (diff != 0 || plen < node->plen) {
+      break; // the prefix diverges from or is above this node
+    }
+    if (plen == node->plen) {
+      return node;
+    }
+    link = &node->child[prefix_bit(key, node->plen)];
+  }
+
+  struct route_node *leaf = route_node_alloc(key, plen);
+  if (!leaf) {
+    return NULL;
+  }
+
+  if (node == NULL) {
+    atomic_store_release(link, leaf);
+    return leaf;
+  }
+
+  // length of the prefix shared with the existing node
+  uint32_t diff = (key ^ node->key) & prefix_mask(min(plen, node->plen));
+  uint8_t cplen = diff ? (uint8_t) __builtin_clz(diff) : min(plen, node->plen);
+  if (cplen == plen) {
+    // the new prefix is a parent of the existing node
+    leaf->child[prefix_bit(node->key, plen)] = node;
+    atomic_store_release(link, leaf);
+    return leaf;
+  }
+
+  // branch where the prefixes diverge
+  struct route_node *glue = route_node_alloc(key, cplen);
+  if (!glue) {
+    kfree(leaf);
+    return NULL;
+  }
+  glue->child[prefix_bit(key, cplen)] = leaf;
+  glue->child[prefix_bit(node->key, cplen)] = node;
+  atomic_store_release(link, glue);
+  return leaf;
+}
+
+// returns the link to the node for the exact prefix and the link to its parent
+static struct route_node **route_trie_find(uint32_t key, uint8_t plen, struct route_node ***parentp) {
+  struct route_node **parent = NULL;
+  struct route_node **link = &routing_trie;
+  struct route_node *node;
+  while ((node = *link) != NULL && node->plen <= plen) {
+    if (((key ^ node->key) & prefix_mask(node->plen)) != 0) {
+      break;
+    }
+    if (node->plen == plen) {
+      *parentp = parent;
+      return link;
+    }
+    parent = link;
+    link = &node->child[prefix_bit(key, node->plen)];
+  }
+  return NULL;
+}
+
+// unlinks the node at link if it no longer needs to be in the trie and
+// returns it so that it can be freed after a grace period
+static struct route_node *route_trie_prune(struct route_node **link) {
+  struct route_node *node = *link;
+  if (!LIST_EMPTY(&node->routes) || (node->child[0] && node->child[1])) {
+    return NULL;
+  }
+
+  // replace the node with its only child (if any). lookups that already
+  // reached the node still see its children until it is freed.
+  atomic_store_release(link, node->child[0] ? node->child[0] : node->child[1]);
+  return node;
+}
+
 int ip_route_add(uint32_t dest, uint32_t mask, uint32_t gateway, netdev_t *dev, int metric) {
   ASSERT(dev != NULL);
+  int plen = mask_to_plen(mask);
+  if (plen < 0) {
+    EPRINTF("non-contiguous netmask {:ip}\n", mask);
+    return -EINVAL;
+  }
+
   route_t *route = kmallocz(sizeof(route_t));
   if (!route) {
     return -ENOMEM;
   }
 
-  route->dest = dest;
+  route->dest = dest & mask;
   route->mask = mask;
   route->gateway = gateway;
   route->dev = netdev_getref(dev);
@@ -63,7 +273,22 @@ int ip_route_add(uint32_t dest, uint32_t mask, uint32_t gateway, netdev_t *dev,
   initref(route);
 
   mtx_lock(&routing_lock);
-  LIST_ADD(&routing_table, route, list);
+  struct route_node *node = route_trie_insert(dest, plen);
+  if (!node) {
+    mtx_unlock(&routing_lock);
+    route_putref(&route);
+    return -ENOMEM;
+  }
+
+  // keep the routes for a prefix sorted by metric
+  route_t *prev = LIST_FIND(_route, &node->routes, list,
+                            LIST_NEXT(_route, list) == NULL || LIST_NEXT(_route, list)->metric > metric);
+  if (prev == NULL || prev->metric > metric) {
+    LIST_ADD_FRONT(&node->routes, route, list);
+  } else {
+    LIST_INSERT(&node->routes, route, list, prev);
+  }
+  route_node_update_best(node);
   mtx_unlock(&routing_lock);
 
   DPRINTF("added route: {:ip}/{:ip} via {:ip} dev {:str} metric %d\n", dest, mask, gateway, &dev->name, metric);
@@ -71,66 +296,103 @@ int ip_route_add(uint32_t dest, uint32_t mask, uint32_t gateway, netdev_t *dev,
 }
 
 int ip_route_del(uint32_t dest, uint32_t mask) {
+  int plen = mask_to_plen(mask);
+  if (plen < 0) {
+    return -ENOENT;
+  }
+
   mtx_lock(&routing_lock);
-  route_t *route = LIST_FIND(_route, &routing_table, list, _route->dest == dest && _route->mask == mask);
+  struct route_node **parent;
+  struct route_node **link = route_trie_find(dest, plen, &parent);
+  if (!link) {
+    mtx_unlock(&routing_lock);
+    return -ENOENT;
+  }
+
+  struct route_node *node = *link;
+  route_t *route = LIST_FIRST(&node->routes);
+  ASSERT(route != NULL || (node->child[0] && node->child[1]));
   if (!route) {
     mtx_unlock(&routing_lock);
     return -ENOENT;
   }
 
-  LIST_REMOVE(&routing_table, route, list);
+  LIST_REMOVE(&node->routes, route, list);
+  route_node_update_best(node);
+  // removing a node can leave its parent as a branch with a single child
+  struct route_node *unlinked = route_trie_prune(link);
+  struct route_node *unlinked_parent = NULL;
+  if (unlinked && parent) {
+    unlinked_parent = route_trie_prune(parent);
+  }
+  route_synchronize();
   mtx_unlock(&routing_lock);
 
+  kfree(unlinked);
+  kfree(unlinked_parent);
   route_putref(&route);
   return 0;
 }
 
 __ref route_t *ip_route_lookup(uint32_t dest) {
   route_t *best_route = NULL;
-  int best_metric = INT_MAX;
-  int best_prefix_len = -1;
+  uint64_t flags = route_read_begin();
 
-  mtx_lock(&routing_lock);
+  // walk down the trie remembering the route of the longest matching prefix
+  struct route_node *node = atomic_load_relaxed(&routing_trie);
+  while (node != NULL) {
+    if (((dest ^ node->key) & prefix_mask(node->plen)) != 0) {
+      break;
+    }
 
-  route_t *route;
-  LIST_FOREACH(route, &routing_table, list) {
-    if ((dest & route->mask) == (route->dest & route->mask)) {
-      int prefix_len = bit_popcnt32(route->mask);
-
-      // prefer routes with lower metric, but if metrics are equal, prefer longer prefix lengths
-      if (route->metric < best_metric ||
-          (route->metric == best_metric && prefix_len > best_prefix_len)) {
-        best_route = route;
-        best_metric = route->metric;
-        best_prefix_len = prefix_len;
-      }
+    route_t *route = atomic_load_relaxed(&node->best);
+    if (route != NULL) {
+      best_route = route;
+    }
+    if (node->plen == 32) {
+      break;
     }
+    node = atomic_load_relaxed(&node->child[prefix_bit(dest, node->plen)]);
   }
 
   best_route = route_getref(best_route);
-  mtx_unlock(&routing_lock);
+  route_read_end(flags);
   return best_route;
 }
 
-int ip_route_iterate(int (*callback)(route_t *route, void *data), void *data) {
-  if (!callback) {
-    return -EINVAL;
+static int route_trie_iterate(struct route_node *node, int (*callback)(route_t *route, void *data), void *data) {
+  if (node == NULL) {
+    return 0;
   }
 
   int count = 0;
-  // TODO: dont hold lock during callbacks
-  mtx_lock(&routing_lock);
-
   route_t *route;
-  LIST_FOREACH(route, &routing_table, list) {
+  LIST_FOREACH(route, &node->routes, list) {
     int ret = callback(route, data);
     if (ret < 0) {
-      mtx_unlock(&routing_lock);
       return ret;
     }
     count++;
   }
 
+  for (int i = 0; i < 2; i++) {
+    int ret = route_trie_iterate(node->child[i], callback, data);
+    if (ret < 0) {
+      return ret;
+    }
+    count += ret;
+  }
+  return count;
+}
+
+int ip_route_iterate(int (*callback)(route_t *route, void *data), void *data) {
+  if (!callback) {
+    return -EINVAL;
+  }
+
+  // TODO: dont hold lock during callbacks
+  mtx_lock(&routing_lock);
+  int count = route_trie_iterate(routing_trie, callback, data);
   mtx_unlock(&routing_lock);
   return count;
 }
@@ -167,28 +429,277 @@ void ip_unregister_protocol(uint8_t protocol) {
 }
 
 //
-// MARK: IP Packet Processing
+// MARK: Fragmentation
 //
 
-uint16_t ip_checksum(const void *data, size_t len) {
-  const uint16_t *ptr = (const uint16_t *)data;
-  uint32_t sum = 0;
-  while (len > 1) {
-    sum += *ptr++;
-    len -= 2;
+static inline size_t ip_frag_offset(sk_buff_t *skb) {
+  struct iphdr *iph = skb_network_header(skb);
+  return (ntohs(iph->frag_off) & IP_OFFMASK) * 8;
+}
+
+static void ipq_free_locked(struct ipq *q) {
+  LIST_REMOVE(&ipq_table[IPQ_HASH(q->saddr, q->daddr, q->id, q->protocol)], q, link);
+  ipq_mem -= q->meat;
+  LIST_FOR_IN_SAFE(skb, &q->frags, list) {
+    LIST_REMOVE(&q->frags, skb, list);
+    skb_free(&skb);
+  }
+  kfree(q);
+}
+
+// drops queues that timed out or, when over the memory limit, the oldest ones
+static void ipq_evict_locked(uint64_t now, bool force) {
+  if (!force && now < ipq_next_expire) {
+    return;
+  }
+
+  ipq_next_expire = UINT64_MAX;
+  struct ipq *oldest = NULL;
+  for (int i = 0; i < IPQ_HASH_SIZE; i++) {
+    LIST_FOR_IN_SAFE(q, &ipq_table[i], link) {
+      if (q->expires <= now) {
+        DPRINTF("fragment reassembly timed out (id %u)\n", ntohs(q->id));
+        ipq_free_locked(q);
+        continue;
+      }
+      ipq_next_expire = min(ipq_next_expire, q->expires);
+      if (!oldest || q->expires < oldest->expires) {
+        oldest = q;
+      }
+    }
+  }
+
+  if (force && oldest && ipq_mem > IPQ_MAX_MEM) {
+    EPRINTF("fragment memory limit reached, dropping datagram (id %u)\n", ntohs(oldest->id));
+    ipq_free_locked(oldest);
+    ipq_evict_locked(now, true);
+  }
+}
+
+static struct ipq *ipq_find_locked(struct iphdr *iph, uint64_t now) {
+  uint32_t hash = IPQ_HASH(iph->saddr, iph->daddr, iph->id, iph->protocol);
+  struct ipq *q = LIST_FIND(_q, &ipq_table[hash], link,
+                            _q->saddr == iph->saddr && _q->daddr == iph->daddr &&
+                            _q->id == iph->id && _q->protocol == iph->protocol);
+  if (q) {
+    return q;
+  }
+
+  q = kmallocz(sizeof(struct ipq));
+  if (!q) {
+    return NULL;
+  }
+
+  q->saddr = iph->saddr;
+  q->daddr = iph->daddr;
+  q->id = iph->id;
+  q->protocol = iph->protocol;
+  q->expires = now + IPQ_TIMEOUT;
+  LIST_INIT(&q->frags);
+  LIST_ADD(&ipq_table[hash], q, link);
+  ipq_next_expire = min(ipq_next_expire, q->expires);
+  return q;
+}
+
+// builds the datagram from a complete queue
+static sk_buff_t *ipq_reassemble(struct ipq *q) {
+  sk_buff_t *first = LIST_FIRST(&q->frags);
+  struct iphdr *first_iph = skb_network_header(first);
+  size_t hdrlen = IPHDR_LEN_GET(first_iph->version_ihl);
+
+  sk_buff_t *skb = skb_alloc(hdrlen + q->len);
+  if (!skb) {
+    return NULL;
+  }
+
+  struct iphdr *iph = skb_put_data(skb, hdrlen);
+  memcpy(iph, first_iph, hdrlen);
+  uint8_t *payload = skb_put_data(skb, q->len);
+  LIST_FOR_IN(frag, &q->frags, list) {
+    memcpy(payload + ip_frag_offset(frag), frag->data, frag->len);
+  }
+
+  iph->tot_len = htons(hdrlen + q->len);
+  iph->frag_off = 0;
+  iph->check = 0;
+  iph->check = ip_checksum(iph, hdrlen);
+
+  skb->dev = first->dev;
+  skb->protocol = first->protocol;
+  skb->pkt_type = first->pkt_type;
+  return skb;
+}
+
+/**
+ * Adds a fragment to its reassembly queue.
+ *
+ * The skb data starts at the ip header which has been validated. Returns the
+ * reassembled datagram (starting at its ip header) once all fragments are in,
+ * otherwise NULL. The fragment is consumed in either case.
+ */
+static sk_buff_t *ip_defrag(sk_buff_t *skb) {
+  struct iphdr *iph = (struct iphdr *)skb->data;
+  size_t hdrlen = IPHDR_LEN_GET(iph->version_ihl);
+  uint16_t frag_off = ntohs(iph->frag_off);
+  size_t offset = (frag_off & IP_OFFMASK) * 8;
+
+  skb_set_network_header(skb, 0);
+  skb_pull(skb, hdrlen);
+  size_t end = offset + skb->len;
+  if (end + hdrlen > IP_MAXPACKET || ((frag_off & IP_MF) && (skb->len == 0 || (skb->len & 7)))) {
+    EPRINTF("invalid fragment (offset %zu, len %zu)\n", offset, skb->len);
+    skb_free(&skb);
+    return NULL;
   }
 
-  if (len == 1) {
-    sum += *(const uint8_t *)ptr << 8;
+  sk_buff_t *result = NULL;
+  uint64_t now = clock_get_nanos();
+  mtx_lock(&ipq_lock);
+  ipq_evict_locked(now, false);
+
+  struct ipq *q = ipq_find_locked(iph, now);
+  if (!q) {
+    goto drop;
   }
 
-  while (sum >> 16) {
-    sum = (sum & 0xFFFF) + (sum >> 16);
+  if (!(frag_off & IP_MF)) {
+    // the last fragment sets the datagram length
+    if ((q->flags & IPQ_LAST_IN) ? end != q->len : end < q->len) {
+      goto drop_queue;
+    }
+    q->flags |= IPQ_LAST_IN;
+    q->len = end;
+  } else if ((q->flags & IPQ_LAST_IN) && end > q->len) {
+    goto drop_queue;
+  } else if (!(q->flags & IPQ_LAST_IN)) {
+    q->len = max(q->len, end);
   }
 
-  return ~sum;
+  // find the fragment to insert after. overlapping fragments are not merged
+  // (they are a known evasion technique) and make the whole datagram invalid,
+  // but exact duplicates are simply dropped.
+  sk_buff_t *prev = NULL;
+  LIST_FOR_IN(frag, &q->frags, list) {
+    size_t frag_start = ip_frag_offset(frag);
+    size_t frag_end = frag_start + frag->len;
+    if (frag_start == offset && frag_end == end) {
+      goto drop;
+    }
+    if (frag_start >= end) {
+      break;
+    }
+    if (frag_end > offset) {
+      EPRINTF("overlapping fragments (id %u)\n", ntohs(iph->id));
+      goto drop_queue;
+    }
+    prev = frag;
+  }
+
+  if (prev) {
+    LIST_INSERT(&q->frags, skb, list, prev);
+  } else {
+    LIST_ADD_FRONT(&q->frags, skb, list);
+  }
+  if (offset == 0) {
+    q->flags |= IPQ_FIRST_IN;
+  }
+  q->meat += skb->len;
+  ipq_mem += skb->len;
+  skb = NULL;
+
+  if (q->flags == (IPQ_FIRST_IN | IPQ_LAST_IN) && q->meat == q->len) {
+    result = ipq_reassemble(q);
+    if (!result) {
+      EPRINTF("failed to allocate reassembled datagram\n");
+    }
+    ipq_free_locked(q);
+  } else if (ipq_mem > IPQ_MAX_MEM) {
+    ipq_evict_locked(now, true);
+  }
+  mtx_unlock(&ipq_lock);
+  return result;
+
+LABEL(drop_queue);
+  ipq_free_locked(q);
+LABEL(drop);
+  mtx_unlock(&ipq_lock);
+  skb_free(&skb);
+  return result;
 }
 
+// sends a packet that starts at its ip header to the next hop
+static int ip_finish_output(sk_buff_t *skb, uint32_t daddr, netdev_t *dev) {
+  // for ethernet devices, add ethernet header with ARP resolution
+  if (dev->type == ARPHRD_ETHER) {
+    // lookup route to determine next hop
+    uint32_t resolve_ip = daddr;
+    route_t *route = ip_route_lookup(daddr);
+    if (route && route->gateway != 0) {
+      resolve_ip = route->gateway;
+    }
+    route_putref(&route);
+
+    // add the ethernet header or queue the packet until the address resolves
+    int ret = arp_resolve(dev, resolve_ip, skb);
+    if (ret <= 0) {
+      return ret; // packet queued or dropped
+    }
+  }
+
+  // transmit packet
+  skb->dev = dev;
+  return netdev_tx(dev, skb);
+}
+
+/**
+ * Splits a packet that does not fit in the device mtu into fragments and
+ * sends them. The packet starts at its ip header and is consumed.
+ */
+static int ip_fragment(sk_buff_t *skb, uint32_t daddr, netdev_t *dev) {
+  struct iphdr *iph = (struct iphdr *)skb->data;
+  size_t hdrlen = IPHDR_LEN_GET(iph->version_ihl);
+  size_t payload_len = skb->len - hdrlen;
+  size_t max_len = (dev->mtu - hdrlen) & ~7UL;
+  if (dev->mtu <= hdrlen + 8) {
+    skb_free(&skb);
+    return -EMSGSIZE;
+  }
+
+  int res = 0;
+  for (size_t off = 0; off < payload_len; off += max_len) {
+    size_t len = min(max_len, payload_len - off);
+    sk_buff_t *frag = skb_alloc(hdrlen + len);
+    if (!frag) {
+      res = -ENOMEM;
+      break;
+    }
+
+    struct iphdr *fiph = skb_put_data(frag, hdrlen);
+    memcpy(fiph, iph, hdrlen);
+    memcpy(skb_put_data(frag, len), skb->data + hdrlen + off, len);
+
+    fiph->tot_len = htons(hdrlen + len);
+    fiph->frag_off = htons((off / 8) | (off + len < payload_len ? IP_MF : 0));
+    fiph->check = 0;
+    fiph->check = ip_checksum(fiph, hdrlen);
+
+    skb_set_network_header(frag, 0);
+    frag->protocol = ETH_P_IP;
+    res = ip_finish_output(frag, daddr, dev);
+    if (res < 0) {
+      break;
+    }
+  }
+
+  DPRINTF("sent %zu byte datagram in fragments of %zu\n", payload_len, max_len);
+  skb_free(&skb);
+  return res < 0 ? res : 0;
+}
+
+//
+// MARK: IP Packet Processing
+//
+
 int ip_rcv(sk_buff_t *skb) {
   int res;
   if (!skb || skb->len < sizeof(struct iphdr)) {
@@ -249,9 +760,13 @@ int ip_rcv(sk_buff_t *skb) {
   DPRINTF("received IP packet: {:ip} -> {:ip}, proto %d, len %u\n", ntohl(iph->saddr), daddr, iph->protocol, tot_len);
 
   if (ntohs(iph->frag_off) & (IP_MF | IP_OFFMASK)) {
-    // TODO: support fragmented packets
-    EPRINTF("fragmented packets not supported\n");
-    goto_res(error, -ENOTSUP);
+    skb = ip_defrag(skb);
+    if (!skb) {
+      return 0; // fragment queued or dropped
+    }
+    iph = (struct iphdr *)skb->data;
+    hdrlen = IPHDR_LEN_GET(iph->version_ihl);
+    skb_set_network_header(skb, 0);
   }
 
   // pull ip header and pass to protocol handler
@@ -287,6 +802,11 @@ int ip_output(sk_buff_t *skb, uint32_t saddr, uint32_t daddr, uint8_t protocol,
     return -ENOBUFS;
   }
 
+  if (skb->len + sizeof(struct iphdr) > IP_MAXPACKET) {
+    skb_free(&skb);
+    return -EMSGSIZE;
+  }
+
   // add ip header
   struct iphdr *iph = skb_push(skb, sizeof(struct iphdr));
   memset(iph, 0, sizeof(struct iphdr));
@@ -294,8 +814,8 @@ int ip_output(sk_buff_t *skb, uint32_t saddr, uint32_t daddr, uint8_t protocol,
   iph->version_ihl = IPVERSION_IHL(IPVERSION, sizeof(struct iphdr));
   iph->tos = 0;
   iph->tot_len = htons(skb->len);
-  iph->id = htons(ip_id_counter++);
-  iph->frag_off = htons(IP_DF);  // don't fragment
+  iph->id = htons(atomic_fetch_add(&ip_id_counter, 1));
+  iph->frag_off = skb->len <= dev->mtu ? htons(IP_DF) : 0;
   iph->ttl = 64;  // default TTL
   iph->protocol = protocol;
   iph->saddr = htonl(saddr);
@@ -309,42 +829,10 @@ int ip_output(sk_buff_t *skb, uint32_t saddr, uint32_t daddr, uint8_t protocol,
 
   DPRINTF("sending IP packet: {:ip} -> {:ip}, proto %d, len %u\n", saddr, daddr, protocol, ntohs(iph->tot_len));
 
-  // for ethernet devices, add ethernet header with ARP resolution
-  if (dev->type == ARPHRD_ETHER) {
-    // lookup route to determine next hop
-    uint32_t resolve_ip = daddr;
-    route_t *route = ip_route_lookup(daddr);
-    if (route && route->gateway != 0) {
-      resolve_ip = route->gateway;
-    }
-
-    // try to resolve MAC address via ARP
-    uint8_t dst_mac[ETH_ALEN];
-    int ret = arp_lookup(dev, resolve_ip, dst_mac);
-    if (ret < 0) {
-      // arp resolution needed - queue packet or add header if resolved immediately
-      DPRINTF("ARP resolution needed for {:ip}\n", resolve_ip);
-      ret = arp_resolve(dev, resolve_ip, skb);
-      if (ret < 0) {
-        return ret;  // error
-      } else if (ret == 0) {
-        return 0;  // packet queued successfully
-      }
-      // ret == 1: ethernet header already added, continue to transmit
-    } else {
-      // add ethernet header with resolved MAC address
-      ret = eth_header(skb, dev, ETH_P_IP, dst_mac, NULL);
-      if (ret < 0) {
-        EPRINTF("failed to add ethernet header: {:err}\n", ret);
-        skb_free(&skb);
-        return ret;
-      }
-    }
+  if (skb->len > dev->mtu) {
+    return ip_fragment(skb, daddr, dev);
   }
-
-  // transmit packet
-  skb->dev = dev;
-  return netdev_tx(dev, skb);
+  return ip_finish_output(skb, daddr, dev);
 }
 
 //
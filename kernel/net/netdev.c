@@ -4,6 +4,7 @@
 
 #include <kernel/net/netdev.h>
 #include <kernel/net/in_dev.h>
+#include <kernel/net/gro.h>
 
 #include <kernel/mm.h>
 #include <kernel/panic.h>
@@ -275,6 +276,8 @@ int netdev_tx(netdev_t *dev, sk_buff_t *skb) {
 
   skb->dev = dev;
 
+  // the skb belongs to the driver once it is called
+  size_t len = skb->len;
   int ret = 0;
   if (dev->netdev_ops->net_start_tx) {
     ret = dev->netdev_ops->net_start_tx(dev, skb);
@@ -285,7 +288,7 @@ int netdev_tx(netdev_t *dev, sk_buff_t *skb) {
   mtx_lock(&dev->lock);
   if (ret == 0) {
     dev->stats.tx_packets++;
-    dev->stats.tx_bytes += skb->len;
+    dev->stats.tx_bytes += len;
   } else {
     dev->stats.tx_errors++;
     dev->stats.tx_dropped++;
@@ -298,6 +301,12 @@ int netdev_tx(netdev_t *dev, sk_buff_t *skb) {
 int netdev_receive_skb(sk_buff_t *skb) {
   ASSERT(skb != NULL);
 
+  if (skb->protocol == ETH_P_IP && skb->dev && (skb->dev->features & NETDEV_F_GRO)) {
+    if (gro_receive(skb->dev, skb)) {
+      return 0; // held until the end of the receive batch
+    }
+  }
+
   mtx_lock(&ptype_list_lock);
   packet_type_t *pt = LIST_FIND(_pt, &ptype_list, list, _pt->type == skb->protocol);
   mtx_unlock(&ptype_list_lock);
@@ -331,11 +340,13 @@ int netdev_rx(netdev_t *dev, sk_buff_t *skb) {
   mtx_unlock(&ltype_list_lock);
 
   if (lt) {
+    // the skb belongs to the handler once it is called
+    size_t len = skb->len;
     int ret = lt->func(skb);
     if (ret == 0) {
       mtx_lock(&dev->lock);
       dev->stats.rx_packets++;
-      dev->stats.rx_bytes += skb->len;
+      dev->stats.rx_bytes += len;
       mtx_unlock(&dev->lock);
     }
     return ret;
@@ -349,6 +360,13 @@ int netdev_rx(netdev_t *dev, sk_buff_t *skb) {
   return netdev_receive_skb(skb);
 }
 
+void netdev_rx_flush(netdev_t *dev) {
+  ASSERT(dev != NULL);
+  if (dev->features & NETDEV_F_GRO) {
+    gro_flush(dev);
+  }
+}
+
 int netdev_ioctl(unsigned long request, uintptr_t argp) {
   switch (request) {
     case SIOCSIFFLAGS: {
@@ -450,6 +450,7 @@ static int rtnetlink_fill_ifinfo(struct sk_buff *skb, struct netdev *dev,
   mtx_lock(&dev->lock);
 
   ifm = skb_put_data(skb, sizeof(struct ifinfomsg));
+  memset(ifm, 0, sizeof(struct ifinfomsg));
   ifm->ifi_family = AF_UNSPEC;
   ifm->ifi_type = dev->type;
   ifm->ifi_index = dev->ifindex;
@@ -3,118 +3,281 @@
 //
 
 #include <kernel/net/skbuff.h>
+#include <kernel/net/checksum.h>
 
 #include <kernel/mm.h>
 #include <kernel/mm/pool.h>
+#include <kernel/cpu/cpu.h>
 #include <kernel/clock.h>
 #include <kernel/panic.h>
+#include <kernel/percpu.h>
+#include <kernel/printf.h>
+#include <kernel/string.h>
+
+#include <fs/procfs/procfs.h>
 
 #define ASSERT(x) kassert(x)
 #define LOG_TAG skbuff
 #include <kernel/log.h>
 
-// default buffer sizes
-#define SKB_DEFAULT_HEADROOM 64
-#define SKB_DEFAULT_SIZE     1536  // ethernet MTU + headers
+#define SKB_DATA_CLASSES 5
+#define SKB_CACHE_SKBS   64   // sk_buff structures cached per cpu
+#define SKB_CACHE_BUFS   64   // max buffers cached per cpu and size class
 
 struct skb_data {
   _refcount;
+  uint32_t class;       // size class index
   size_t size;          // total buffer size
   uint8_t buffer[];     // buffer data
 };
 
+// buffer sizes of the skb_data size classes: default (ethernet mtu + headroom),
+// 2048, 4096, 9000 (jumbo frames) and a full 64k datagram for reassembled
+// fragments and merged receives
+static const size_t skb_data_sizes[SKB_DATA_CLASSES] = {
+  SKB_DEFAULT_SIZE + SKB_DEFAULT_HEADROOM,
+  2048,
+  4096,
+  9000,
+  SKB_MAX_ALLOC + SKB_DEFAULT_HEADROOM,
+};
+
+// number of buffers of each size class kept in a cpu cache
+static const uint32_t skb_cache_depth[SKB_DATA_CLASSES] = { 64, 32, 16, 8, 2 };
+
+/*
+ * Per-cpu recycling caches.
+ *
+ * Freed sk_buffs and data buffers are kept on a small per-cpu stack and handed
+ * out again by the next allocation on that cpu, so the common send/receive
+ * path never touches the pool size class locks. The caches are only accessed
+ * with interrupts disabled on the owning cpu. Misses fall back to the pools
+ * and frees that find the cache full return the object to its pool.
+ */
+struct skb_cache {
+  uint32_t nskbs;
+  uint32_t nbufs[SKB_DATA_CLASSES];
+  sk_buff_t *skbs[SKB_CACHE_SKBS];
+  skb_data_t *bufs[SKB_DATA_CLASSES][SKB_CACHE_BUFS];
+
+  // statistics
+  uint64_t skb_hits;
+  uint64_t skb_misses;
+  uint64_t skb_spills;  // frees returned to the pool
+  uint64_t buf_hits[SKB_DATA_CLASSES];
+  uint64_t buf_misses[SKB_DATA_CLASSES];
+  uint64_t buf_spills[SKB_DATA_CLASSES];
+} __attribute__((aligned(64)));
+
+static struct skb_cache skb_caches[MAX_CPUS];
+
 // memory pools
 static pool_t *skb_pool;       // pool for sk_buff structures
 static pool_t *skb_data_pool;  // pool for skb_data buffers
 
 static void skb_init_pools() {
-  skb_pool = pool_create("skb", pool_sizes(sizeof(sk_buff_t)), 0);
+  // objects are initialized here so the pools do not need to zero them
+  skb_pool = pool_create("skb", pool_sizes(sizeof(sk_buff_t)), POOL_NOZERO);
   if (!skb_pool) {
     panic("skb_init_pools: failed to create skb pool");
   }
 
-  // common skb_data sizes: header + 1500, 2048, 4096, 9000 (jumbo frames)
-  size_t default_size = sizeof(skb_data_t) + SKB_DEFAULT_SIZE + SKB_DEFAULT_HEADROOM;
   skb_data_pool = pool_create("skb_data", pool_sizes(
-    default_size,
-    sizeof(skb_data_t) + 2048,
-    sizeof(skb_data_t) + 4096,
-    sizeof(skb_data_t) + 9000
-  ), 0);
+    sizeof(skb_data_t) + skb_data_sizes[0],
+    sizeof(skb_data_t) + skb_data_sizes[1],
+    sizeof(skb_data_t) + skb_data_sizes[2],
+    sizeof(skb_data_t) + skb_data_sizes[3],
+    sizeof(skb_data_t) + skb_data_sizes[4]
+  ), POOL_NOZERO);
   if (!skb_data_pool) {
     panic("skb_init_pools: failed to create skb_data pool");
   }
-
-  // preload some buffers for the default size
-  pool_preload_cache(skb_pool, sizeof(sk_buff_t), 256);
-  pool_preload_cache(skb_data_pool, default_size, 256);
 }
 STATIC_INIT(skb_init_pools);
 
+static inline int skb_data_class(size_t size) {
+  for (int i = 0; i < SKB_DATA_CLASSES; i++) {
+    if (skb_data_sizes[i] >= size) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// the cache functions must be called with interrupts disabled
+
+static inline sk_buff_t *skb_cache_get_skb(struct skb_cache *cache) {
+  if (cache->nskbs == 0) {
+    cache->skb_misses++;
+    return NULL;
+  }
+  cache->skb_hits++;
+  return cache->skbs[--cache->nskbs];
+}
+
+static inline bool skb_cache_put_skb(struct skb_cache *cache, sk_buff_t *skb) {
+  if (cache->nskbs == SKB_CACHE_SKBS) {
+    cache->skb_spills++;
+    return false;
+  }
+  cache->skbs[cache->nskbs++] = skb;
+  return true;
+}
+
+static inline skb_data_t *skb_cache_get_buf(struct skb_cache *cache, int class) {
+  if (cache->nbufs[class] == 0) {
+    cache->buf_misses[class]++;
+    return NULL;
+  }
+  cache->buf_hits[class]++;
+  return cache->bufs[class][--cache->nbufs[class]];
+}
+
+static inline bool skb_cache_put_buf(struct skb_cache *cache, skb_data_t *buf) {
+  uint32_t class = buf->class;
+  if (cache->nbufs[class] == skb_cache_depth[class]) {
+    cache->buf_spills[class]++;
+    return false;
+  }
+  cache->bufs[class][cache->nbufs[class]++] = buf;
+  return true;
+}
+
 //
 // MARK: Socket Buffer API
 //
 
-static __ref skb_data_t *skb_data_alloc(size_t size) {
-  size_t total_size = sizeof(skb_data_t) + size;
-  skb_data_t *buf = pool_alloc(skb_data_pool, total_size);
+static sk_buff_t *skb_struct_alloc() {
+  uint64_t flags;
+  temp_irq_save(flags);
+  sk_buff_t *skb = skb_cache_get_skb(&skb_caches[curcpu_id]);
+  temp_irq_restore(flags);
+  if (!skb) {
+    skb = pool_alloc(skb_pool, sizeof(sk_buff_t));
+  }
+  return skb;
+}
+
+static void skb_struct_free(sk_buff_t *skb) {
+  uint64_t flags;
+  temp_irq_save(flags);
+  bool cached = skb_cache_put_skb(&skb_caches[curcpu_id], skb);
+  temp_irq_restore(flags);
+  if (!cached) {
+    pool_free(skb_pool, skb);
+  }
+}
+
+static __ref skb_data_t *skb_data_alloc(int class) {
+  uint64_t flags;
+  temp_irq_save(flags);
+  skb_data_t *buf = skb_cache_get_buf(&skb_caches[curcpu_id], class);
+  temp_irq_restore(flags);
   if (!buf) {
-    return NULL;
+    buf = pool_alloc(skb_data_pool, sizeof(skb_data_t) + skb_data_sizes[class]);
+    if (!buf) {
+      return NULL;
+    }
+    buf->class = class;
+    buf->size = skb_data_sizes[class];
   }
 
-  memset(buf, 0, total_size);
   initref(buf);
-  buf->size = size;
   return buf;
 }
 
+static void skb_data_free(skb_data_t *buf) {
+  uint64_t flags;
+  temp_irq_save(flags);
+  bool cached = skb_cache_put_buf(&skb_caches[curcpu_id], buf);
+  temp_irq_restore(flags);
+  if (!cached) {
+    pool_free(skb_data_pool, buf);
+  }
+}
+
+// initializes a new skb that owns buf
+static void skb_init(sk_buff_t *skb, __move skb_data_t *buf) {
+  memset(skb, 0, sizeof(sk_buff_t));
+
+  // the packet data is not cleared but the headroom is, so headers pushed in
+  // front of the data start out zeroed
+  memset(buf->buffer, 0, SKB_DEFAULT_HEADROOM);
+
+  // set up pointers into the buffer
+  skb->head = buf->buffer;
+  skb->data = buf->buffer + SKB_DEFAULT_HEADROOM;
+  skb->tail = skb->data;
+  skb->end = buf->buffer + buf->size;
+
+  skb->buf = buf;
+  skb->pkt_type = PACKET_HOST;
+  skb->ip_summed = CHECKSUM_NONE;
+  skb->timestamp = clock_get_nanos();
+}
+
 sk_buff_t *skb_alloc(size_t size) {
   if (size == 0) {
     size = SKB_DEFAULT_SIZE;
   }
 
-  sk_buff_t *skb = pool_alloc(skb_pool, sizeof(sk_buff_t));
-  if (!skb) {
+  int class = skb_data_class(size + SKB_DEFAULT_HEADROOM);
+  if (class < 0) {
     return NULL;
   }
 
-  memset(skb, 0, sizeof(sk_buff_t));
+  sk_buff_t *skb = skb_struct_alloc();
+  if (!skb) {
+    return NULL;
+  }
 
   // allocate the skb_data buffer
-  size_t total_size = size + SKB_DEFAULT_HEADROOM;
-  skb_data_t *buf = skb_data_alloc(total_size);
+  skb_data_t *buf = skb_data_alloc(class);
   if (!buf) {
-    pool_free(skb_pool, skb);
+    skb_struct_free(skb);
     return NULL;
   }
 
-  // set up pointers into the buffer
-  skb->head = buf->buffer;
-  skb->data = buf->buffer + SKB_DEFAULT_HEADROOM;
-  skb->tail = skb->data;
-  skb->end = buf->buffer + total_size;
-
-  skb->len = 0;
-  skb->data_len = 0;
-
-  skb->buf = moveref(buf);
-  skb->dev = NULL;
+  skb_init(skb, moveref(buf));
+  return skb;
+}
 
-  skb->protocol = 0;
-  skb->pkt_type = PACKET_HOST;
+size_t skb_alloc_bulk(size_t size, sk_buff_t **skbs, size_t count) {
+  if (size == 0) {
+    size = SKB_DEFAULT_SIZE;
+  }
 
-  skb->network_header = NULL;
-  skb->transport_header = NULL;
+  int class = skb_data_class(size + SKB_DEFAULT_HEADROOM);
+  if (class < 0) {
+    return 0;
+  }
 
-  skb->csum = 0;
-  skb->ip_summed = CHECKSUM_NONE;
+  // take as many as possible from the cache at once
+  size_t n = 0;
+  uint64_t flags;
+  temp_irq_save(flags);
+  struct skb_cache *cache = &skb_caches[curcpu_id];
+  while (n < count && cache->nskbs > 0 && cache->nbufs[class] > 0) {
+    sk_buff_t *skb = skb_cache_get_skb(cache);
+    skb->buf = skb_cache_get_buf(cache, class);
+    skbs[n++] = skb;
+  }
+  temp_irq_restore(flags);
 
-  skb->timestamp = clock_get_nanos();
-  return skb;
-}
+  for (size_t i = 0; i < n; i++) {
+    skb_data_t *buf = skbs[i]->buf;
+    initref(buf);
+    skb_init(skbs[i], moveref(buf));
+  }
 
-static void skb_data_free(skb_data_t *buf) {
-  pool_free(skb_data_pool, buf);
+  // and allocate the rest one at a time
+  for (; n < count; n++) {
+    skbs[n] = skb_alloc(size);
+    if (!skbs[n]) {
+      break;
+    }
+  }
+  return n;
 }
 
 void skb_free(sk_buff_t **skbp) {
@@ -124,18 +287,53 @@ void skb_free(sk_buff_t **skbp) {
   }
 
   putref(&skb->buf, skb_data_free);
-  pool_free(skb_pool, skb);
+  skb_struct_free(skb);
+}
+
+void skb_free_bulk(sk_buff_t **skbs, size_t count) {
+  size_t i = 0;
+  while (i < count) {
+    sk_buff_t *spill_skb = NULL;
+    skb_data_t *spill_buf = NULL;
+
+    // return everything to the cache until an object does not fit
+    uint64_t flags;
+    temp_irq_save(flags);
+    struct skb_cache *cache = &skb_caches[curcpu_id];
+    for (; i < count && !spill_skb && !spill_buf; i++) {
+      sk_buff_t *skb = moveptr(skbs[i]);
+      if (!skb) {
+        continue;
+      }
+
+      skb_data_t *buf = moveref(skb->buf);
+      if (buf && ref_put(&buf->_refname) && !skb_cache_put_buf(cache, buf)) {
+        spill_buf = buf;
+      }
+      if (!skb_cache_put_skb(cache, skb)) {
+        spill_skb = skb;
+      }
+    }
+    temp_irq_restore(flags);
+
+    if (spill_buf) {
+      pool_free(skb_data_pool, spill_buf);
+    }
+    if (spill_skb) {
+      pool_free(skb_pool, spill_skb);
+    }
+  }
 }
 
 sk_buff_t *skb_clone(sk_buff_t *skb) {
   ASSERT(skb != NULL);
 
   // grab reference to underlying buffer
-  getref(skb->buf);
+  skb_data_t *buf = getref(skb->buf);
 
-  sk_buff_t *clone = pool_alloc(skb_pool, sizeof(sk_buff_t));
+  sk_buff_t *clone = skb_struct_alloc();
   if (!clone) {
-    putref(&skb->buf, skb_data_free);
+    putref(&buf, skb_data_free);
     return NULL;
   }
 
@@ -162,7 +360,7 @@ sk_buff_t *skb_copy(sk_buff_t *skb) {
   size_t orig_data_len = skb->data_len;
   uint16_t orig_protocol = skb->protocol;
   uint16_t orig_pkt_type = skb->pkt_type;
-  uint16_t orig_csum = skb->csum;
+  uint32_t orig_csum = skb->csum;
   uint8_t orig_ip_summed = skb->ip_summed;
 
   size_t buffer_size = orig_end - orig_head;
@@ -282,6 +480,34 @@ size_t skb_copy_from_iovec(sk_buff_t *skb, const struct iovec *iov, size_t offse
   return to_copy;
 }
 
+// like skb_copy_from_iovec but the data is summed while it is copied. the sum
+// is kept in skb->csum with ip_summed set to CHECKSUM_COMPLETE, as long as
+// all of the skb data was added this way.
+size_t skb_copy_from_iovec_csum(sk_buff_t *skb, const struct iovec *iov, size_t offset, size_t len) {
+  ASSERT(skb != NULL);
+  ASSERT(iov != NULL);
+
+  if (offset >= iov->iov_len) {
+    return 0;
+  }
+
+  size_t to_copy = min(len, iov->iov_len - offset);
+  to_copy = min(to_copy, skb_tailroom(skb));
+  if (to_copy == 0) {
+    return 0;
+  }
+
+  bool summed = skb->len == 0 || skb->ip_summed == CHECKSUM_COMPLETE;
+  size_t data_off = skb->len;
+  uint8_t *dst = skb_put_data(skb, to_copy);
+  uint32_t sum = csum_partial_copy(dst, (uint8_t *)iov->iov_base + offset, to_copy, 0);
+  if (summed) {
+    skb->csum = csum_block_add(data_off ? skb->csum : 0, sum, data_off);
+    skb->ip_summed = CHECKSUM_COMPLETE;
+  }
+  return to_copy;
+}
+
 size_t skb_copy_to_iovec(sk_buff_t *skb, struct iovec *iov, size_t offset, size_t len, bool consume) {
   ASSERT(skb != NULL);
   ASSERT(iov != NULL);
@@ -314,3 +540,39 @@ size_t skb_copy_to_iovec(sk_buff_t *skb, struct iovec *iov, size_t offset, size_
 
   return to_copy;
 }
+
+//
+// MARK: Statistics
+//
+
+static int skb_cache_show(seqfile_t *sf, void *_) {
+  uint64_t skb_hits = 0, skb_misses = 0, skb_spills = 0, skb_cached = 0;
+  uint64_t buf_hits[SKB_DATA_CLASSES] = {0};
+  uint64_t buf_misses[SKB_DATA_CLASSES] = {0};
+  uint64_t buf_spills[SKB_DATA_CLASSES] = {0};
+  uint64_t buf_cached[SKB_DATA_CLASSES] = {0};
+
+  // the counters are read without synchronization and may be slightly off
+  for (int cpu = 0; cpu < MAX_CPUS; cpu++) {
+    struct skb_cache *cache = &skb_caches[cpu];
+    skb_hits += cache->skb_hits;
+    skb_misses += cache->skb_misses;
+    skb_spills += cache->skb_spills;
+    skb_cached += cache->nskbs;
+    for (int i = 0; i < SKB_DATA_CLASSES; i++) {
+      buf_hits[i] += cache->buf_hits[i];
+      buf_misses[i] += cache->buf_misses[i];
+      buf_spills[i] += cache->buf_spills[i];
+      buf_cached[i] += cache->nbufs[i];
+    }
+  }
+
+  seq_printf(sf, "%-10s %12s %12s %12s %8s\n", "cache", "hits", "misses", "spills", "cached");
+  seq_printf(sf, "%-10s %12llu %12llu %12llu %8llu\n", "skb", skb_hits, skb_misses, skb_spills, skb_cached);
+  for (int i = 0; i < SKB_DATA_CLASSES; i++) {
+    seq_printf(sf, "data-%-5zu %12llu %12llu %12llu %8llu\n", skb_data_sizes[i],
+               buf_hits[i], buf_misses[i], buf_spills[i], buf_cached[i]);
+  }
+  return 0;
+}
+PROCFS_REGISTER_SIMPLE(skb_cache, "/net/skb_cache", skb_cache_show, NULL, 0444);
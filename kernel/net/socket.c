@@ -7,12 +7,14 @@
 #include <kernel/net/udp.h>
 #include <kernel/vfs/file.h>
 
+#include <kernel/clock.h>
 #include <kernel/mm.h>
 #include <kernel/proc.h>
 #include <kernel/fs.h>
 #include <kernel/kevent.h>
 #include <kernel/panic.h>
 #include <kernel/printf.h>
+#include <kernel/time.h>
 
 #define ASSERT(x) kassert(x)
 #define LOG_TAG socket
@@ -744,6 +746,122 @@ ssize_t net_recvmsg(int sockfd, struct msghdr *msg, int flags) {
   return ret;
 }
 
+static size_t msg_iov_len(struct msghdr *msg) {
+  size_t len = 0;
+  for (int i = 0; i < msg->msg_iovlen; i++) {
+    len += msg->msg_iov[i].iov_len;
+  }
+  return len;
+}
+
+int net_sendmmsg(int sockfd, struct mmsghdr *vec, unsigned int vlen, unsigned int flags) {
+  proc_t *proc = curproc;
+  fd_entry_t *fde = fs_proc_get_fdentry(proc, sockfd);
+  if (!fde) {
+    return -EBADF;
+  }
+
+  file_t *file = fde->file;
+  if (!F_ISSOCK(file)) {
+    fde_putref(&fde);
+    return -ENOTSOCK;
+  }
+
+  sock_t *sock = file->data;
+  if (!sock->ops->sendmsg) {
+    fde_putref(&fde);
+    return -EOPNOTSUPP;
+  }
+
+  if (file->flags & O_NONBLOCK)
+    flags |= MSG_DONTWAIT;
+  vlen = min(vlen, SOCK_MMSG_MAX);
+
+  int ret;
+  if (sock->ops->sendmmsg) {
+    // the protocol can send the whole batch in one pass
+    ret = sock->ops->sendmmsg(sock, vec, vlen, (int)flags);
+  } else {
+    unsigned int count;
+    for (count = 0; count < vlen; count++) {
+      struct msghdr *msg = &vec[count].msg_hdr;
+      ret = sock->ops->sendmsg(sock, msg, msg_iov_len(msg), (int)flags);
+      if (ret < 0) {
+        break;
+      }
+      vec[count].msg_len = (unsigned int)ret;
+    }
+    if (count > 0) {
+      ret = (int)count;
+    }
+  }
+
+  fde_putref(&fde);
+  return ret;
+}
+
+int net_recvmmsg(int sockfd, struct mmsghdr *vec, unsigned int vlen, unsigned int flags, struct timespec *timeout) {
+  proc_t *proc = curproc;
+  fd_entry_t *fde = fs_proc_get_fdentry(proc, sockfd);
+  if (!fde) {
+    return -EBADF;
+  }
+
+  file_t *file = fde->file;
+  if (!F_ISSOCK(file)) {
+    fde_putref(&fde);
+    return -ENOTSOCK;
+  }
+
+  sock_t *sock = file->data;
+  if (!sock->ops->recvmsg) {
+    fde_putref(&fde);
+    return -EOPNOTSUPP;
+  }
+
+  if (file->flags & O_NONBLOCK)
+    flags |= MSG_DONTWAIT;
+  vlen = min(vlen, SOCK_MMSG_MAX);
+
+  int ret;
+  if (sock->ops->recvmmsg) {
+    // the protocol can dequeue the whole batch in one pass
+    ret = sock->ops->recvmmsg(sock, vec, vlen, (int)flags, timeout);
+  } else {
+    // like linux the timeout is only checked between messages
+    uint64_t deadline = timeout ? clock_get_nanos() + timespec_to_nanos(timeout) : 0;
+    unsigned int count;
+    for (count = 0; count < vlen; count++) {
+      struct msghdr *msg = &vec[count].msg_hdr;
+      msg->msg_flags = 0;
+      ret = sock->ops->recvmsg(sock, msg, msg_iov_len(msg), (int)flags);
+      if (ret < 0) {
+        break;
+      }
+      vec[count].msg_len = (unsigned int)ret;
+
+      if (flags & MSG_WAITFORONE) {
+        flags |= MSG_DONTWAIT;
+      }
+      if (timeout && clock_get_nanos() >= deadline) {
+        count++;
+        break;
+      }
+    }
+    if (count > 0) {
+      ret = (int)count;
+    }
+
+    if (timeout) {
+      uint64_t now = clock_get_nanos();
+      *timeout = timespec_from_nanos(now < deadline ? deadline - now : 0);
+    }
+  }
+
+  fde_putref(&fde);
+  return ret;
+}
+
 int net_shutdown(int sockfd, int how) {
   proc_t *proc = curproc;
   fd_entry_t *fde = fs_proc_get_fdentry(proc, sockfd);
@@ -769,7 +887,27 @@ int net_shutdown(int sockfd, int how) {
 }
 
 int net_setsockopt(int sockfd, int level, int optname, const void *optval, socklen_t optlen) {
-  return -EOPNOTSUPP;  // not implemented for initial version
+  proc_t *proc = curproc;
+  fd_entry_t *fde = fs_proc_get_fdentry(proc, sockfd);
+  if (!fde) {
+    return -EBADF;
+  }
+
+  file_t *file = fde->file;
+  if (!F_ISSOCK(file)) {
+    fde_putref(&fde);
+    return -ENOTSOCK;
+  }
+
+  // delegate to protocol-specific setsockopt if available
+  sock_t *sock = file->data;
+  int ret = -ENOPROTOOPT;
+  if (sock->ops->setsockopt) {
+    ret = sock->ops->setsockopt(sock, level, optname, optval, optlen);
+  }
+
+  fde_putref(&fde);
+  return ret;
 }
 
 int net_getsockopt(int sockfd, int level, int optname, void *optval, socklen_t *optlen) {
@@ -904,6 +1042,8 @@ SYSCALL_ALIAS(sendto, net_sendto);
 SYSCALL_ALIAS(recvfrom, net_recvfrom);
 SYSCALL_ALIAS(sendmsg, net_sendmsg);
 SYSCALL_ALIAS(recvmsg, net_recvmsg);
+SYSCALL_ALIAS(sendmmsg, net_sendmmsg);
+SYSCALL_ALIAS(recvmmsg, net_recvmmsg);
 SYSCALL_ALIAS(shutdown, net_shutdown);
 SYSCALL_ALIAS(setsockopt, net_setsockopt);
 SYSCALL_ALIAS(getsockopt, net_getsockopt);
@@ -3,6 +3,7 @@
 //
 
 #include <kernel/net/tcp.h>
+#include <kernel/net/checksum.h>
 #include <kernel/net/inet.h>
 #include <kernel/net/in_dev.h>
 #include <kernel/net/netdev.h>
@@ -41,7 +42,7 @@ static void tcp_stop_retrans_timer(tcp_sock_t *tcp_sk);
 static uint16_t tcp_get_port();
 static int tcp_check_port(uint16_t port);
 static tcp_sock_t *tcp_lookup_sock(uint32_t saddr, uint16_t sport, uint32_t daddr, uint16_t dport);
-static uint16_t tcp_checksum(uint32_t saddr, uint32_t daddr, struct tcphdr *tcph, size_t len);
+static uint16_t tcp_segment_checksum(uint32_t saddr, uint32_t daddr, sk_buff_t *skb);
 
 static void tcp_static_init() {
   port_bitmap = create_bitmap(65536);
@@ -165,40 +166,18 @@ static void tcp_stop_rtt_measurement(tcp_sock_t *tcp_sk, uint32_t ack) {
 
 // MARK: Checksum Calculation
 
-static uint16_t tcp_checksum(uint32_t saddr, uint32_t daddr, struct tcphdr *tcph, size_t len) {
-  uint32_t sum = 0;
-
-  // pseudo-header: add all values as they appear in network byte order
-  sum += (saddr >> 16) & 0xFFFF;
-  sum += saddr & 0xFFFF;
-  sum += (daddr >> 16) & 0xFFFF;
-  sum += daddr & 0xFFFF;
-  sum += IPPROTO_TCP;  // protocol is single byte, pad with zero: 0x0006
-  sum += len;           // length in host byte order equals network byte order for this value
-
-  // packet data: read bytes in network byte order (same as UDP)
-  uint8_t *ptr = (uint8_t *)tcph;
-  size_t count = len;
-
-  while (count > 1) {
-    sum += (ptr[0] << 8) | ptr[1];
-    ptr += 2;
-    count -= 2;
-  }
-
-  if (count > 0) {
-    sum += ptr[0] << 8;
-  }
-
-  while (sum >> 16) {
-    sum = (sum & 0xFFFF) + (sum >> 16);
+// returns the checksum of an outgoing segment with the tcp header at skb->data.
+// the addresses are in network byte order. if the payload was summed when it was
+// copied in (CHECKSUM_COMPLETE) only the header is summed here.
+static uint16_t tcp_segment_checksum(uint32_t saddr, uint32_t daddr, sk_buff_t *skb) {
+  struct tcphdr *tcph = (struct tcphdr *)skb->data;
+  uint32_t sum;
+  if (skb->ip_summed == CHECKSUM_COMPLETE) {
+    sum = csum_partial(tcph, sizeof(struct tcphdr), skb->csum);
+  } else {
+    sum = csum_partial(tcph, skb->len, 0);
   }
-
-  uint16_t result = ~sum;
-
-  kprintf("TCP_CSUM: addrs=%08x->%08x len=%zu cksum=%04x\n", saddr, daddr, len, result);
-
-  return result;
+  return csum_tcpudp_magic(saddr, daddr, skb->len, IPPROTO_TCP, sum);
 }
 
 //
@@ -301,17 +280,18 @@ static void tcp_retransmit_timeout(alarm_t *alarm, __ref tcp_sock_t *tcp_sk) {
       uint32_t seq = ntohl(tcph->seq);
       DPRINTF("retransmitting segment (seq=%u)\n", seq);
 
-      tcph->check = 0;
-      size_t tcp_len = retrans_skb->len;
-      // tcp_checksum expects addresses in HOST byte order (like UDP)
-      tcph->check = htons(tcp_checksum(ntohl(tcp_sk->saddr), ntohl(tcp_sk->daddr), tcph, tcp_len));
-
       // ip_output expects host byte order
       uint32_t saddr = ntohl(tcp_sk->saddr);
       uint32_t daddr = ntohl(tcp_sk->daddr);
       route_t *route = ip_route_lookup(daddr);
       if (route) {
+        tcph->check = 0;
+        if (!(route->dev->features & NETDEV_F_NO_CSUM)) {
+          tcph->check = tcp_segment_checksum(tcp_sk->saddr, tcp_sk->daddr, retrans_skb);
+        }
+        retrans_skb->ip_summed = CHECKSUM_NONE;
         ip_output(retrans_skb, saddr, daddr, IPPROTO_TCP, route->dev);
+        route_putref(&route);
       } else {
         skb_free(&retrans_skb);
       }
@@ -434,9 +414,6 @@ static int tcp_transmit_skb(tcp_sock_t *tcp_sk, sk_buff_t *skb, uint32_t seq, ui
   tcph->check = 0;
   tcph->urg_ptr = 0;
 
-  // tcp_checksum expects addresses in HOST byte order (like UDP)
-  tcph->check = htons(tcp_checksum(ntohl(tcp_sk->saddr), ntohl(tcp_sk->daddr), tcph, tx_skb->len));
-
   uint32_t daddr = ntohl(tcp_sk->daddr);
   uint32_t saddr = ntohl(tcp_sk->saddr);
   route_t *route = ip_route_lookup(daddr);
@@ -445,7 +422,15 @@ static int tcp_transmit_skb(tcp_sock_t *tcp_sk, sk_buff_t *skb, uint32_t seq, ui
     return -EHOSTUNREACH;
   }
 
-  return ip_output(tx_skb, saddr, daddr, IPPROTO_TCP, route->dev);
+  // segments to a device that cannot corrupt them are sent without a checksum
+  if (!(route->dev->features & NETDEV_F_NO_CSUM)) {
+    tcph->check = tcp_segment_checksum(tcp_sk->saddr, tcp_sk->daddr, tx_skb);
+  }
+  tx_skb->ip_summed = CHECKSUM_NONE;
+
+  int res = ip_output(tx_skb, saddr, daddr, IPPROTO_TCP, route->dev);
+  route_putref(&route);
+  return res;
 }
 
 static int tcp_send_syn(tcp_sock_t *tcp_sk) {
@@ -558,6 +543,20 @@ static tcp_sock_t *tcp_lookup_sock(uint32_t saddr, uint16_t sport, uint32_t dadd
 // MARK: TCP Socket Management
 //
 
+// returns the segment size for a destination. it follows the mtu of the route
+// device so that loopback connections send few large segments.
+static uint16_t tcp_route_mss(uint32_t daddr) {
+  uint16_t mss = TCP_MSS;
+  route_t *route = ip_route_lookup(ntohl(daddr));
+  if (route && route->dev) {
+    size_t mtu = min(route->dev->mtu, IP_MAXPACKET);
+    size_t hdrlen = sizeof(struct iphdr) + sizeof(struct tcphdr);
+    mss = (uint16_t) max(mtu > hdrlen ? mtu - hdrlen : 0, TCP_MIN_MSS);
+  }
+  route_putref(&route);
+  return mss;
+}
+
 __ref tcp_sock_t *tcp_sock_alloc() {
   tcp_sock_t *tcp_sk = pool_alloc(tcp_pool, sizeof(tcp_sock_t));
   if (!tcp_sk) {
@@ -663,7 +662,7 @@ static int tcp_queue_sendmsg(tcp_sock_t *tcp_sk, struct msghdr *msg, size_t len)
         return total_queued > 0 ? (int)total_queued : -ENOMEM;
       }
 
-      size_t copied = skb_copy_from_iovec(skb, iov, iov_offset, chunk_size);
+      size_t copied = skb_copy_from_iovec_csum(skb, iov, iov_offset, chunk_size);
       if (copied != chunk_size) {
         skb_free(&skb);
         return total_queued > 0 ? (int)total_queued : -EFAULT;
@@ -986,6 +985,7 @@ static int inet_stream_connect(sock_t *sock, struct sockaddr *addr, int addrlen,
   // set destination
   tcp_sk->daddr = sin->sin_addr.s_addr;
   tcp_sk->dport = sin->sin_port;
+  tcp_sk->mss = tcp_route_mss(tcp_sk->daddr);
 
   // initialize sequence numbers
   tcp_sk->iss = tcp_new_isn();
@@ -1381,6 +1381,7 @@ static int tcp_rcv_listen(tcp_sock_t *tcp_sk, sk_buff_t *skb, struct tcphdr *tcp
   new_sk->sport = tcp_sk->sport;
   new_sk->daddr = iph->saddr;
   new_sk->dport = tcph->source;
+  new_sk->mss = tcp_route_mss(new_sk->daddr);
   new_sk->bound = 1;
   new_sk->connected = 1;
 
@@ -1535,8 +1536,12 @@ int tcp_rcv(sk_buff_t *skb) {
   struct tcphdr *tcph = (struct tcphdr *)skb->data;
   struct iphdr *iph = (struct iphdr *)skb_network_header(skb);
 
-  // tcp_checksum expects addresses in HOST byte order (like UDP)
-  uint16_t expected_csum = tcp_checksum(ntohl(iph->saddr), ntohl(iph->daddr), tcph, skb->len);
+  // segments merged by gro were verified before they were merged
+  uint16_t expected_csum = 0;
+  if (skb->ip_summed != CHECKSUM_UNNECESSARY) {
+    uint32_t sum = csum_partial(tcph, skb->len, 0);
+    expected_csum = csum_tcpudp_magic(iph->saddr, iph->daddr, skb->len, IPPROTO_TCP, sum);
+  }
   if (expected_csum != 0) {
     DPRINTF("BAD CHECKSUM: expected=0 got=0x%04x len=%zu stored_csum=0x%04x\n",
             expected_csum, skb->len, ntohs(tcph->check));
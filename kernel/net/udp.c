@@ -3,17 +3,20 @@
 //
 
 #include <kernel/net/udp.h>
+#include <kernel/net/checksum.h>
 #include <kernel/net/inet.h>
 #include <kernel/net/ip.h>
 #include <kernel/net/socket.h>
 #include <kernel/net/netdev.h>
 #include <kernel/net/in_dev.h>
 
+#include <kernel/clock.h>
 #include <kernel/mm.h>
 #include <kernel/mm/pool.h>
 #include <kernel/mutex.h>
 #include <kernel/panic.h>
 #include <kernel/printf.h>
+#include <kernel/time.h>
 #include <linux/in.h>
 
 #include <bitmap.h>
@@ -81,6 +84,7 @@ __ref udp_sock_t *udp_sock_alloc() {
 
   udp_sk->saddr = INADDR_ANY;
   udp_sk->daddr = INADDR_ANY;
+  udp_sk->gso_size = 0;
 
   initref(udp_sk);
   mtx_init(&udp_sk->lock, 0, "udp_lock");
@@ -169,35 +173,6 @@ int udp_connect(udp_sock_t *udp_sk, uint32_t addr, uint16_t port) {
 // MARK: UDP Protocol Processing
 //
 
-static uint16_t udp_checksum(uint32_t saddr, uint32_t daddr, struct udphdr *udph, size_t len) {
-  uint32_t sum = 0;
-  sum += (saddr >> 16) & 0xFFFF;
-  sum += saddr & 0xFFFF;
-  sum += (daddr >> 16) & 0xFFFF;
-  sum += daddr & 0xFFFF;
-  sum += IPPROTO_UDP;  // protocol is single byte, pad with zero
-  sum += len;           // length in host byte order
-
-  uint8_t *ptr = (uint8_t *)udph;
-  size_t count = len;
-
-  while (count > 1) {
-    sum += (ptr[0] << 8) | ptr[1];
-    ptr += 2;
-    count -= 2;
-  }
-
-  if (count > 0) {
-    sum += ptr[0] << 8;
-  }
-
-  while (sum >> 16) {
-    sum = (sum & 0xFFFF) + (sum >> 16);
-  }
-
-  return ~sum;
-}
-
 int udp_rcv(sk_buff_t *skb) {
   ASSERT(skb != NULL);
   if (skb->len < sizeof(struct udphdr)) {
@@ -216,15 +191,13 @@ int udp_rcv(sk_buff_t *skb) {
     return -EINVAL;
   }
 
-  // TODO: Fix UDP checksum verification
   // verify UDP checksum if present (optional for IPv4)
-  if (0 && udph->check != 0) {
-    uint32_t saddr_host = ntohl(iph->saddr);
-    uint32_t daddr_host = ntohl(iph->daddr);
-    uint16_t expected_csum = udp_checksum(saddr_host, daddr_host, udph, len);
+  if (udph->check != 0 && skb->ip_summed != CHECKSUM_UNNECESSARY) {
+    uint32_t sum = csum_partial(udph, len, 0);
+    uint16_t expected_csum = csum_tcpudp_magic(iph->saddr, iph->daddr, len, IPPROTO_UDP, sum);
     if (expected_csum != 0) {
       EPRINTF("bad checksum: saddr={:ip} daddr={:ip} len=%u stored=0x%04x computed=0x%04x\n",
-              saddr_host, daddr_host, len, ntohs(udph->check), expected_csum);
+              ntohl(iph->saddr), ntohl(iph->daddr), len, ntohs(udph->check), expected_csum);
       skb_free(&skb);
       return -EINVAL;
     }
@@ -263,16 +236,125 @@ int udp_rcv(sk_buff_t *skb) {
   return 0;
 }
 
-int udp_sendmsg(sock_t *sock, struct msghdr *msg, size_t len, int flags) {
-  ASSERT(sock != NULL);
-  ASSERT(msg != NULL);
+// copies len bytes starting at offset off of the message payload into dst
+// copies len bytes starting at off in the message iovec to dst and returns
+// the partial checksum of the copied data
+static uint32_t udp_copy_from_iov(uint8_t *dst, struct msghdr *msg, size_t off, size_t len) {
+  uint32_t sum = 0;
+  size_t pos = 0;
+  for (size_t i = 0; i < msg->msg_iovlen && len > 0; i++) {
+    size_t iov_len = msg->msg_iov[i].iov_len;
+    if (off >= iov_len) {
+      off -= iov_len;
+      continue;
+    }
 
-  udp_sock_t *udp_sk = sock->sk;
+    size_t to_copy = min(iov_len - off, len);
+    uint32_t part = csum_partial_copy(dst + pos, (uint8_t *)msg->msg_iov[i].iov_base + off, to_copy, 0);
+    sum = csum_block_add(sum, part, pos);
+    pos += to_copy;
+    len -= to_copy;
+    off = 0;
+  }
+  return sum;
+}
+
+// returns the UDP_SEGMENT size given in the message control data (if any)
+static int udp_cmsg_gso_size(struct msghdr *msg, uint16_t *gso_size) {
+  if (!msg->msg_control || msg->msg_controllen < sizeof(struct cmsghdr)) {
+    return 0;
+  }
+
+  for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+    if (cmsg->cmsg_level != SOL_UDP || cmsg->cmsg_type != UDP_SEGMENT) {
+      continue;
+    }
+    if (cmsg->cmsg_len != CMSG_LEN(sizeof(uint16_t))) {
+      return -EINVAL;
+    }
+    *gso_size = *(uint16_t *)CMSG_DATA(cmsg);
+  }
+  return 0;
+}
+
+/*
+ * Transmit state shared by all datagrams sent in one call. The socket lock
+ * is taken once to snapshot the addresses and the route is only looked up
+ * again when the destination changes, so a sendmmsg batch or a segmented
+ * send pays for them once instead of per datagram.
+ */
+struct udp_tx {
+  uint32_t saddr;     // bound source address
+  uint16_t sport;     // bound source port
+  uint32_t daddr;     // connected destination address
+  uint16_t dport;     // connected destination port
+  bool connected;
+  uint16_t gso_size;  // socket UDP_SEGMENT size
+
+  route_t *route;     // cached route (ref)
+  uint32_t route_daddr;
+  uint32_t route_saddr;
+};
+
+static int udp_tx_begin(udp_sock_t *udp_sk, struct udp_tx *tx) {
+  memset(tx, 0, sizeof(struct udp_tx));
+
+  mtx_lock(&udp_sk->lock);
+  if (!udp_sk->bound) {
+    mtx_unlock(&udp_sk->lock);
+    int ret = udp_bind(udp_sk, INADDR_ANY, 0);
+    if (ret < 0 && ret != -EINVAL) {
+      // -EINVAL means another thread bound the socket first
+      return ret;
+    }
+    mtx_lock(&udp_sk->lock);
+  }
+
+  tx->saddr = ntohl(udp_sk->saddr);
+  tx->sport = ntohs(udp_sk->sport);
+  tx->daddr = ntohl(udp_sk->daddr);
+  tx->dport = ntohs(udp_sk->dport);
+  tx->connected = udp_sk->connected;
+  tx->gso_size = udp_sk->gso_size;
+  mtx_unlock(&udp_sk->lock);
+  return 0;
+}
+
+static void udp_tx_end(struct udp_tx *tx) {
+  route_putref(&tx->route);
+}
+
+static route_t *udp_tx_route(struct udp_tx *tx, uint32_t daddr) {
+  if (tx->route && tx->route_daddr == daddr) {
+    return tx->route;
+  }
+
+  route_putref(&tx->route);
+  route_t *route = ip_route_lookup(daddr);
+  if (!route) {
+    return NULL;
+  }
+
+  uint32_t src_addr = tx->saddr;
+  if (src_addr == INADDR_ANY) {
+    // use the IP address of the output device
+    in_ifaddr_t *ifa = LIST_FIRST(&route->dev->ip_addrs);
+    if (ifa && ifa->ifa_address != INADDR_ANY) {
+      src_addr = ifa->ifa_address;
+    } else {
+      src_addr = INADDR_LOOPBACK;  // fallback for loopback
+    }
+  }
+
+  tx->route = route;
+  tx->route_daddr = daddr;
+  tx->route_saddr = src_addr;
+  return route;
+}
+
+static int udp_tx_msg(struct udp_tx *tx, struct msghdr *msg, size_t len) {
   uint32_t daddr;
   uint16_t dport;
-  uint32_t saddr;
-  uint16_t sport;
-  bool bound;
 
   // determine destination
   if (msg->msg_name && msg->msg_namelen >= sizeof(struct sockaddr_in)) {
@@ -283,33 +365,17 @@ int udp_sendmsg(sock_t *sock, struct msghdr *msg, size_t len, int flags) {
     daddr = ntohl(sin->sin_addr.s_addr);
     dport = ntohs(sin->sin_port);
   } else {
-    mtx_lock(&udp_sk->lock);
-    if (!udp_sk->connected) {
-      mtx_unlock(&udp_sk->lock);
+    if (!tx->connected) {
       return -EDESTADDRREQ;
     }
-    daddr = ntohl(udp_sk->daddr);
-    dport = ntohs(udp_sk->dport);
-    mtx_unlock(&udp_sk->lock);
+    daddr = tx->daddr;
+    dport = tx->dport;
   }
 
-  mtx_lock(&udp_sk->lock);
-  bound = udp_sk->bound;
-  if (bound) {
-    sport = ntohs(udp_sk->sport);
-    saddr = ntohl(udp_sk->saddr);
-  }
-  mtx_unlock(&udp_sk->lock);
-
-  if (!bound) {
-    int ret = udp_bind(udp_sk, INADDR_ANY, 0);
-    if (ret < 0) {
-      return ret;
-    }
-    mtx_lock(&udp_sk->lock);
-    sport = ntohs(udp_sk->sport);
-    saddr = ntohl(udp_sk->saddr);
-    mtx_unlock(&udp_sk->lock);
+  uint16_t gso_size = tx->gso_size;
+  int ret = udp_cmsg_gso_size(msg, &gso_size);
+  if (ret < 0) {
+    return ret;
   }
 
   size_t total_len = 0;
@@ -317,81 +383,111 @@ int udp_sendmsg(sock_t *sock, struct msghdr *msg, size_t len, int flags) {
     total_len += msg->msg_iov[i].iov_len;
   }
   total_len = min(len, total_len);
-
-  sk_buff_t *skb = skb_alloc(total_len + sizeof(struct udphdr));
-  if (!skb) {
-    return -ENOMEM;
+  if (gso_size == 0 && total_len > IP_MAXPACKET - sizeof(struct iphdr) - sizeof(struct udphdr)) {
+    return -EMSGSIZE; // datagrams up to this size are fragmented by ip_output
   }
 
-  // copy data from iovec
-  uint8_t *data = skb_put_data(skb, total_len);
-  size_t copied = 0;
-  for (size_t i = 0; i < msg->msg_iovlen && copied < total_len; i++) {
-    size_t to_copy = min(msg->msg_iov[i].iov_len, total_len - copied);
-    memcpy(data + copied, msg->msg_iov[i].iov_base, to_copy);
-    copied += to_copy;
-  }
-
-  // add UDP header
-  struct udphdr *udph = skb_push(skb, sizeof(struct udphdr));
-  udph->source = htons(sport);
-  udph->dest = htons(dport);
-  udph->len = htons(skb->len);
-  udph->check = 0;
-
-  route_t *route = ip_route_lookup(daddr);
+  route_t *route = udp_tx_route(tx, daddr);
   if (!route) {
     EPRINTF("no route to destination {:ip}\n", daddr);
-    skb_free(&skb);
     return -EHOSTUNREACH;
   }
 
-  uint32_t src_addr = saddr;
-  if (src_addr == INADDR_ANY) {
-    // use the IP address of the output device
-    in_ifaddr_t *ifa = LIST_FIRST(&route->dev->ip_addrs);
-    if (ifa && ifa->ifa_address != INADDR_ANY) {
-      src_addr = ifa->ifa_address;
-    } else {
-      src_addr = INADDR_LOOPBACK;  // fallback for loopback
+  // with UDP_SEGMENT the payload is split into gso_size datagrams (the last
+  // one may be shorter) which all go out with a single route and copy pass
+  size_t seg_size = total_len;
+  if (gso_size > 0 && total_len > gso_size) {
+    size_t max_seg = route->dev->mtu - sizeof(struct iphdr) - sizeof(struct udphdr);
+    if (gso_size > max_seg || (total_len + gso_size - 1) / gso_size > UDP_MAX_SEGMENTS) {
+      return -EINVAL;
     }
+    seg_size = gso_size;
   }
 
-  udph->check = 0;
+  size_t off = 0;
+  do {
+    size_t seg_len = min(seg_size, total_len - off);
+    sk_buff_t *skb = skb_alloc(seg_len + sizeof(struct udphdr));
+    if (!skb) {
+      return off > 0 ? (int)off : -ENOMEM;
+    }
+
+    // copy data from iovec
+    uint8_t *data = skb_put_data(skb, seg_len);
+    uint32_t sum = udp_copy_from_iov(data, msg, off, seg_len);
+
+    // add UDP header
+    struct udphdr *udph = skb_push(skb, sizeof(struct udphdr));
+    udph->source = htons(tx->sport);
+    udph->dest = htons(dport);
+    udph->len = htons(skb->len);
+    udph->check = 0;
+
+    // the payload was summed while it was copied so only the header is left.
+    // datagrams to a device that cannot corrupt them go without a checksum.
+    if (!(route->dev->features & NETDEV_F_NO_CSUM)) {
+      sum = csum_partial(udph, sizeof(struct udphdr), sum);
+      udph->check = csum_tcpudp_magic(htonl(tx->route_saddr), htonl(daddr), skb->len, IPPROTO_UDP, sum);
+      if (udph->check == 0) {
+        udph->check = 0xFFFF; // zero means no checksum
+      }
+    }
+
+    DPRINTF("sending UDP: {:ip}:%u -> {:ip}:%u, len=%u\n",
+            tx->route_saddr, tx->sport, daddr, dport, ntohs(udph->len));
+
+    ret = ip_output(skb, tx->route_saddr, daddr, IPPROTO_UDP, route->dev);
+    if (ret < 0) {
+      return off > 0 ? (int)off : ret;
+    }
+    off += seg_len;
+  } while (off < total_len);
+
+  return (int)total_len;
+}
 
-  DPRINTF("sending UDP: {:ip}:%u -> {:ip}:%u, len=%u\n",
-          src_addr, sport, daddr, dport, ntohs(udph->len));
+int udp_sendmsg(sock_t *sock, struct msghdr *msg, size_t len, int flags) {
+  ASSERT(sock != NULL);
+  ASSERT(msg != NULL);
 
-  int ret = ip_output(skb, src_addr, daddr, IPPROTO_UDP, route->dev);
+  struct udp_tx tx;
+  int ret = udp_tx_begin(sock->sk, &tx);
   if (ret < 0) {
     return ret;
   }
 
-  return (int)total_len;
+  ret = udp_tx_msg(&tx, msg, len);
+  udp_tx_end(&tx);
+  return ret;
 }
 
-int udp_recvmsg(sock_t *sock, struct msghdr *msg, size_t len, int flags) {
+int udp_sendmmsg(sock_t *sock, struct mmsghdr *vec, unsigned int vlen, int flags) {
   ASSERT(sock != NULL);
-  ASSERT(msg != NULL);
+  ASSERT(vec != NULL);
 
-  udp_sock_t *udp_sk = sock->sk;
-  int is_nonblock = (sock->flags & SOCK_NONBLOCK) || (flags & MSG_DONTWAIT);
+  struct udp_tx tx;
+  int ret = udp_tx_begin(sock->sk, &tx);
+  if (ret < 0) {
+    return ret;
+  }
 
-  mtx_lock(&udp_sk->rx_lock);
-  while (udp_sk->rx_queue_len == 0) {
-    if (is_nonblock) {
-      mtx_unlock(&udp_sk->rx_lock);
-      return -EAGAIN;
+  unsigned int count;
+  for (count = 0; count < vlen; count++) {
+    struct msghdr *msg = &vec[count].msg_hdr;
+    ret = udp_tx_msg(&tx, msg, SIZE_MAX);
+    if (ret < 0) {
+      break;
     }
-
-    cond_wait(&udp_sk->rx_cond, &udp_sk->rx_lock);
+    vec[count].msg_len = (unsigned int)ret;
   }
 
-  sk_buff_t *skb = LIST_FIRST(&udp_sk->rx_queue);
-  LIST_REMOVE(&udp_sk->rx_queue, skb, list);
-  udp_sk->rx_queue_len--;
-  mtx_unlock(&udp_sk->rx_lock);
+  udp_tx_end(&tx);
+  // an error is only reported if no datagrams were sent
+  return count > 0 ? (int)count : ret;
+}
 
+// copies a received datagram into the message and returns the result for it
+static int udp_copy_to_msg(sk_buff_t *skb, struct msghdr *msg, size_t len, int flags) {
   // Skip UDP header - payload starts after it
   uint8_t *payload = skb->data + sizeof(struct udphdr);
   size_t payload_len = skb->len - sizeof(struct udphdr);
@@ -422,8 +518,6 @@ int udp_recvmsg(sock_t *sock, struct msghdr *msg, size_t len, int flags) {
     msg->msg_namelen = sizeof(struct sockaddr_in);
   }
 
-  skb_free(&skb);
-
   // If MSG_TRUNC was in flags, return actual message size; otherwise return copied
   if (flags & MSG_TRUNC) {
     return (int)payload_len;
@@ -431,6 +525,104 @@ int udp_recvmsg(sock_t *sock, struct msghdr *msg, size_t len, int flags) {
   return (int)copied;
 }
 
+int udp_recvmsg(sock_t *sock, struct msghdr *msg, size_t len, int flags) {
+  ASSERT(sock != NULL);
+  ASSERT(msg != NULL);
+
+  udp_sock_t *udp_sk = sock->sk;
+  int is_nonblock = (sock->flags & SOCK_NONBLOCK) || (flags & MSG_DONTWAIT);
+
+  mtx_lock(&udp_sk->rx_lock);
+  while (udp_sk->rx_queue_len == 0) {
+    if (is_nonblock) {
+      mtx_unlock(&udp_sk->rx_lock);
+      return -EAGAIN;
+    }
+
+    cond_wait(&udp_sk->rx_cond, &udp_sk->rx_lock);
+  }
+
+  sk_buff_t *skb = LIST_FIRST(&udp_sk->rx_queue);
+  LIST_REMOVE(&udp_sk->rx_queue, skb, list);
+  udp_sk->rx_queue_len--;
+  mtx_unlock(&udp_sk->rx_lock);
+
+  int ret = udp_copy_to_msg(skb, msg, len, flags);
+  skb_free(&skb);
+  return ret;
+}
+
+int udp_recvmmsg(sock_t *sock, struct mmsghdr *vec, unsigned int vlen, int flags, struct timespec *timeout) {
+  ASSERT(sock != NULL);
+  ASSERT(vec != NULL);
+
+  udp_sock_t *udp_sk = sock->sk;
+  bool nonblock = (sock->flags & SOCK_NONBLOCK) || (flags & MSG_DONTWAIT);
+  uint64_t deadline = timeout ? clock_get_nanos() + timespec_to_nanos(timeout) : 0;
+  unsigned int count = 0;
+  int ret = 0;
+
+  while (count < vlen) {
+    // take every queued datagram that fits with one acquisition of the
+    // receive lock, then copy them out with the lock dropped
+    LIST_HEAD(sk_buff_t) batch = LIST_HEAD_INITR;
+    unsigned int nbatch = 0;
+
+    mtx_lock(&udp_sk->rx_lock);
+    while (udp_sk->rx_queue_len == 0) {
+      uint64_t now = timeout ? clock_get_nanos() : 0;
+      if (nonblock || (timeout && now >= deadline)) {
+        break;
+      }
+
+      if (timeout) {
+        struct timespec ts = timespec_from_nanos(deadline - now);
+        cond_wait_timeout(&udp_sk->rx_cond, &udp_sk->rx_lock, &ts);
+      } else {
+        cond_wait(&udp_sk->rx_cond, &udp_sk->rx_lock);
+      }
+    }
+
+    while (udp_sk->rx_queue_len > 0 && count + nbatch < vlen) {
+      sk_buff_t *skb = LIST_FIRST(&udp_sk->rx_queue);
+      LIST_REMOVE(&udp_sk->rx_queue, skb, list);
+      udp_sk->rx_queue_len--;
+      LIST_ADD(&batch, skb, list);
+      nbatch++;
+    }
+    mtx_unlock(&udp_sk->rx_lock);
+
+    if (nbatch == 0) {
+      ret = -EAGAIN;
+      break;
+    }
+
+    LIST_FOR_IN_SAFE(skb, &batch, list) {
+      struct msghdr *msg = &vec[count].msg_hdr;
+      size_t len = 0;
+      for (size_t i = 0; i < msg->msg_iovlen; i++) {
+        len += msg->msg_iov[i].iov_len;
+      }
+
+      msg->msg_flags = 0;
+      vec[count].msg_len = (unsigned int)udp_copy_to_msg(skb, msg, len, flags);
+      count++;
+      skb_free(&skb);
+    }
+
+    // after the first datagram only wait for more if asked to fill the vector
+    if (flags & MSG_WAITFORONE) {
+      nonblock = true;
+    }
+  }
+
+  if (timeout) {
+    uint64_t now = clock_get_nanos();
+    *timeout = timespec_from_nanos(now < deadline ? deadline - now : 0);
+  }
+  return count > 0 ? (int)count : ret;
+}
+
 //
 // MARK: UDP Socket Operations
 //
@@ -510,6 +702,52 @@ static int udp_shutdown(sock_t *sock, int how) {
   return -EOPNOTSUPP;
 }
 
+static int udp_setsockopt(sock_t *sock, int level, int optname, const void *optval, socklen_t optlen) {
+  udp_sock_t *udp_sk = sock->sk;
+  if (level != SOL_UDP) {
+    return -ENOPROTOOPT;
+  }
+
+  switch (optname) {
+    case UDP_SEGMENT: {
+      if (optlen < sizeof(int)) {
+        return -EINVAL;
+      }
+      int val = *(const int *)optval;
+      if (val < 0 || val > UINT16_MAX) {
+        return -EINVAL;
+      }
+
+      mtx_lock(&udp_sk->lock);
+      udp_sk->gso_size = (uint16_t)val;
+      mtx_unlock(&udp_sk->lock);
+      return 0;
+    }
+    default:
+      return -ENOPROTOOPT;
+  }
+}
+
+static int udp_getsockopt(sock_t *sock, int level, int optname, void *optval, socklen_t *optlen) {
+  udp_sock_t *udp_sk = sock->sk;
+  if (level != SOL_UDP) {
+    return -ENOPROTOOPT;
+  }
+
+  switch (optname) {
+    case UDP_SEGMENT: {
+      if (*optlen < sizeof(int)) {
+        return -EINVAL;
+      }
+      *(int *)optval = udp_sk->gso_size;
+      *optlen = sizeof(int);
+      return 0;
+    }
+    default:
+      return -ENOPROTOOPT;
+  }
+}
+
 const struct proto_ops udp_dgram_ops = {
   .family = AF_INET,
   .create = udp_create,
@@ -520,7 +758,11 @@ const struct proto_ops udp_dgram_ops = {
   .accept = udp_accept,
   .sendmsg = udp_sendmsg,
   .recvmsg = udp_recvmsg,
+  .sendmmsg = udp_sendmmsg,
+  .recvmmsg = udp_recvmmsg,
   .shutdown = udp_shutdown,
+  .setsockopt = udp_setsockopt,
+  .getsockopt = udp_getsockopt,
 };
 
 //
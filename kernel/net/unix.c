@@ -3,9 +3,14 @@
 //
 
 #include <kernel/net/socket.h>
+#include <kernel/vfs/file.h>
+#include <kernel/fs.h>
+#include <kernel/proc.h>
 
 #include <kernel/mm.h>
 #include <kernel/mm/pool.h>
+#include <kernel/mm/pgtable.h>
+#include <kernel/kio.h>
 #include <kernel/mutex.h>
 #include <kernel/cond.h>
 #include <kernel/queue.h>
@@ -24,11 +29,46 @@
 #define UNIX_BUFFER_SIZE (64 * 1024UL)  // 64KB for stream sockets
 #define UNIX_MAX_DGRAM_SIZE (16 * 1024UL)  // 16KB max datagram size
 #define UNIX_BACKLOG_MAX 128
+#define UNIX_SCM_MAX_FDS 253  // max files passed in one message (SCM_MAX_FD)
+#define UNIX_HANDOFF_PAGES 16 // max pages of a reader buffer pinned for a direct copy
+
+#ifndef SCM_CREDENTIALS
+#define SCM_CREDENTIALS 0x02
+#endif
+
+// same layout as struct ucred (which libc only exposes with _GNU_SOURCE)
+typedef struct unix_cred {
+  pid_t pid;
+  uid_t uid;
+  gid_t gid;
+} unix_cred_t;
+
+/*
+ * Files and credentials in flight (SCM_RIGHTS, SCM_CREDENTIALS).
+ *
+ * The sender's file references are held until the message is received and
+ * the files are installed in the receiving process. On a stream socket the
+ * files are attached to the first byte of the data they were sent with, and
+ * an entry without files marks the point where the sender credentials of the
+ * data change.
+ */
+typedef struct unix_scm {
+  size_t pos;                     // stream position of the attached data
+  unix_cred_t cred;               // credentials of the sender
+  int nfiles;
+  LIST_ENTRY(struct unix_scm) link;
+  struct {
+    __ref file_t *file;
+    str_t name;                   // name of the sender's fd entry
+  } files[];
+} unix_scm_t;
 
 typedef struct unix_dgram_msg {
   struct sockaddr_un addr;
   socklen_t addrlen;
   size_t len;
+  unix_cred_t cred;               // credentials of the sender
+  unix_scm_t *scm;                // passed files (or NULL)
   LIST_ENTRY(struct unix_dgram_msg) link;
   uint8_t data[];
 } unix_dgram_msg_t;
@@ -39,6 +79,23 @@ typedef struct unix_dgram {
   size_t rx_queue_bytes;
 } unix_dgram_t;
 
+/*
+ * Direct handoff.
+ *
+ * A reader that blocks on an empty stream pins the pages of its buffer and
+ * publishes them on the socket. The next writer copies its data straight into
+ * them instead of into the ring, so the data is copied once rather than into
+ * the ring and back out. Only anonymous pages that are not copy-on-write are
+ * pinned (see vm_getpage_writable), other buffers always go through the ring.
+ */
+typedef struct unix_handoff {
+  uintptr_t base;                 // start of the reader buffer
+  size_t len;                     // bytes covered by the pinned pages
+  size_t copied;                  // bytes copied in by the writer
+  int npages;
+  __ref page_t *pages[UNIX_HANDOFF_PAGES];
+} unix_handoff_t;
+
 // stream buffer structure
 typedef struct unix_stream {
   void *buffer;
@@ -46,6 +103,12 @@ typedef struct unix_stream {
   size_t read_pos;
   size_t write_pos;
   size_t count;
+  size_t in_bytes;   // total bytes written into the buffer
+  size_t out_bytes;  // total bytes read from the buffer
+  LIST_HEAD(unix_scm_t) scm_queue; // passed files in stream order
+  unix_cred_t in_cred;   // credentials of the last data written
+  unix_cred_t out_cred;  // credentials of the data at the read position
+  unix_handoff_t *handoff; // blocked reader taking a direct copy (or NULL)
 
   struct unix_socket *peer;
   int shutdown_flags;  // SHUT_RD, SHUT_WR
@@ -67,9 +130,12 @@ typedef struct unix_socket {
     unix_stream_t stream;
   };
 
+  unix_cred_t cred;  // credentials of the creator (SO_PEERCRED)
+
   // socket options
   int rcvbuf;
   int sndbuf;
+  bool passcred;     // SO_PASSCRED
 
   mtx_t lock;
   cond_t rx_cond;
@@ -133,76 +199,271 @@ static size_t copy_to_iovec(const struct iovec *iov, size_t iovcnt, const void *
   return offset;
 }
 
-static size_t stream_buffer_write(unix_stream_t *stream, const void *data, size_t len) {
+static size_t stream_buffer_write(unix_stream_t *stream, kio_t *kio, size_t len) {
   size_t write_pos = stream->write_pos;
   size_t buffer_size = stream->buffer_size;
-  const uint8_t *src = (const uint8_t *)data;
 
-  if (write_pos + len > buffer_size) {
-    size_t first_part = buffer_size - write_pos;
-    size_t second_part = len - first_part;
+  size_t first_part = min(len, buffer_size - write_pos);
+  size_t n = kio_nread_out(stream->buffer, write_pos + first_part, write_pos, 0, kio);
+  if (n == first_part && len > first_part) {
+    n += kio_nread_out(stream->buffer, len - first_part, 0, 0, kio);
+  }
 
-    memcpy((uint8_t *)stream->buffer + write_pos, src, first_part);
-    memcpy(stream->buffer, src + first_part, second_part);
+  stream->write_pos = (write_pos + n) % buffer_size;
+  stream->count += n;
+  stream->in_bytes += n;
+  return n;
+}
 
-    stream->write_pos = second_part;
-  } else {
-    memcpy((uint8_t *)stream->buffer + write_pos, src, len);
-    stream->write_pos = write_pos + len;
+static size_t stream_buffer_read(unix_stream_t *stream, kio_t *kio, size_t len) {
+  size_t read_pos = stream->read_pos;
+  size_t buffer_size = stream->buffer_size;
+
+  size_t first_part = min(len, buffer_size - read_pos);
+  size_t n = kio_nwrite_in(kio, stream->buffer, read_pos + first_part, read_pos, 0);
+  if (n == first_part && len > first_part) {
+    n += kio_nwrite_in(kio, stream->buffer, len - first_part, 0, 0);
+  }
+
+  stream->read_pos = (read_pos + n) % buffer_size;
+  stream->count -= n;
+  stream->out_bytes += n;
+  return n;
+}
+
+//
+// MARK: Direct Handoff
+//
 
-    if (stream->write_pos == buffer_size) {
-      stream->write_pos = 0;
+static void unix_handoff_prepare(unix_handoff_t *h, struct msghdr *msg, size_t len) {
+  // pins the pages under the first buffer of the reader. this runs in the
+  // reader's context so its address space is the current one.
+  const struct iovec *iov = NULL;
+  for (size_t i = 0; i < msg->msg_iovlen; i++) {
+    if (msg->msg_iov[i].iov_len > 0) {
+      iov = &msg->msg_iov[i];
+      break;
     }
   }
+  if (iov == NULL)
+    return;
 
-  stream->count += len;
-  return len;
+  uintptr_t base = (uintptr_t) iov->iov_base;
+  uintptr_t end = base + min(iov->iov_len, len);
+  uintptr_t va = page_trunc(base);
+  while (va < end && h->npages < UNIX_HANDOFF_PAGES) {
+    page_t *page = vm_getpage_writable(va);
+    if (page == NULL)
+      break;
+    h->pages[h->npages++] = page;
+    va += PAGE_SIZE;
+  }
+
+  h->base = base;
+  h->len = h->npages > 0 ? min(end, va) - base : 0;
+  h->copied = 0;
 }
 
-static size_t stream_buffer_read(unix_stream_t *stream, void *data, size_t len) {
-  size_t read_pos = stream->read_pos;
-  size_t buffer_size = stream->buffer_size;
-  uint8_t *dst = (uint8_t *)data;
+static void unix_handoff_release(unix_handoff_t *h) {
+  for (int i = 0; i < h->npages; i++) {
+    pg_putref(&h->pages[i]);
+  }
+  h->npages = 0;
+}
 
-  if (read_pos + len > buffer_size) {
-    size_t first_part = buffer_size - read_pos;
-    size_t second_part = len - first_part;
+static size_t unix_handoff_fill(unix_handoff_t *h, kio_t *kio, size_t len) {
+  // copies from the writer's buffer into the pinned reader pages
+  len = min(len, h->len - h->copied);
+  size_t size = kio->size;
+  size_t n = 0;
+  while (n < len) {
+    size_t off = (h->base + h->copied) - page_trunc(h->base);
+    page_t *page = h->pages[off / PAGE_SIZE];
+    if (page->flags & PG_COW) {
+      // the reader forked since the page was pinned and the page is shared
+      break;
+    }
 
-    memcpy(dst, (uint8_t *)stream->buffer + read_pos, first_part);
-    memcpy(dst + first_part, stream->buffer, second_part);
+    // rw_unmapped_page copies as much as the kio has left so limit it
+    size_t chunk = min(PAGE_SIZE - (off % PAGE_SIZE), len - n);
+    kio->size = kio_transfered(kio) + chunk;
+    size_t copied = rw_unmapped_page(page, off % PAGE_SIZE, kio);
+    kio->size = size;
 
-    stream->read_pos = second_part;
-  } else {
-    memcpy(dst, (uint8_t *)stream->buffer + read_pos, len);
-    stream->read_pos = read_pos + len;
+    h->copied += copied;
+    n += copied;
+    if (copied < chunk)
+      break;
+  }
+  return n;
+}
+
+//
+// MARK: Passing Files
+//
+
+static inline unix_cred_t unix_cred_current() {
+  proc_t *proc = curproc;
+  return (unix_cred_t){ .pid = proc->pid, .uid = proc->creds->euid, .gid = proc->creds->egid };
+}
+
+static inline bool unix_cred_equal(const unix_cred_t *a, const unix_cred_t *b) {
+  return a->pid == b->pid && a->uid == b->uid && a->gid == b->gid;
+}
+
+static int unix_cred_check(const unix_cred_t *cred) {
+  // a process may only claim its own pid and one of its own ids unless it is
+  // privileged
+  proc_t *proc = curproc;
+  struct pcreds *creds = proc->creds;
+  if (creds->euid == 0)
+    return 0;
+  if (cred->pid != proc->pid)
+    return -EPERM;
+  if (cred->uid != creds->uid && cred->uid != creds->euid)
+    return -EPERM;
+  if (cred->gid != creds->gid && cred->gid != creds->egid)
+    return -EPERM;
+  return 0;
+}
+
+static unix_scm_t *unix_scm_alloc(int nfiles, const unix_cred_t *cred) {
+  unix_scm_t *scm = kmallocz(sizeof(unix_scm_t) + nfiles * sizeof(scm->files[0]));
+  if (scm == NULL)
+    return NULL;
+  scm->cred = *cred;
+  return scm;
+}
 
-    if (stream->read_pos == buffer_size) {
-      stream->read_pos = 0;
+static void unix_scm_free(unix_scm_t **scmp) {
+  unix_scm_t *scm = moveptr(*scmp);
+  if (scm == NULL)
+    return;
+
+  for (int i = 0; i < scm->nfiles; i++) {
+    f_putref(&scm->files[i].file);
+    str_free(&scm->files[i].name);
+  }
+  kfree(scm);
+}
+
+static int unix_scm_from_msg(struct msghdr *msg, __out unix_scm_t **out_scm) {
+  // takes references to the files named in a SCM_RIGHTS control message and
+  // checks the credentials given in a SCM_CREDENTIALS message. the returned
+  // scm is NULL if neither was sent.
+  unix_scm_t *scm = NULL;
+  *out_scm = NULL;
+  if (msg->msg_control == NULL || msg->msg_controllen == 0)
+    return 0;
+
+  struct cmsghdr *rights = NULL;
+  struct cmsghdr *creds = NULL;
+  for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+    if (cmsg->cmsg_len < CMSG_LEN(0) || cmsg->cmsg_level != SOL_SOCKET)
+      return -EINVAL;
+
+    if (cmsg->cmsg_type == SCM_RIGHTS && rights == NULL) {
+      rights = cmsg;
+    } else if (cmsg->cmsg_type == SCM_CREDENTIALS && creds == NULL) {
+      if (cmsg->cmsg_len != CMSG_LEN(sizeof(unix_cred_t)))
+        return -EINVAL;
+      creds = cmsg;
+    } else {
+      return -EINVAL;
     }
   }
 
-  stream->count -= len;
-  return len;
+  unix_cred_t cred = unix_cred_current();
+  if (creds != NULL) {
+    memcpy(&cred, CMSG_DATA(creds), sizeof(unix_cred_t));
+    int res = unix_cred_check(&cred);
+    if (res < 0)
+      return res;
+  }
+
+  int nfds = 0;
+  if (rights != NULL) {
+    nfds = (int)((rights->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+    if (nfds <= 0 || nfds > UNIX_SCM_MAX_FDS)
+      return -EINVAL;
+  }
+
+  scm = unix_scm_alloc(nfds, &cred);
+  if (scm == NULL)
+    return -ENOMEM;
+
+  int res = 0;
+  proc_t *proc = curproc;
+  int *fds = nfds > 0 ? (int *) CMSG_DATA(rights) : NULL;
+  for (int i = 0; i < nfds; i++) {
+    fd_entry_t *fde = fs_proc_get_fdentry(proc, fds[i]);
+    if (fde == NULL)
+      goto_res(fail, -EBADF);
+
+    scm->files[i].file = f_getref(fde->file);
+    scm->files[i].name = str_dup(fde->real_path);
+    scm->nfiles++;
+    fde_putref(&fde);
+  }
+
+  *out_scm = scm;
+  return 0;
+LABEL(fail);
+  unix_scm_free(&scm);
+  return res;
 }
 
-static size_t stream_buffer_write_iovec(unix_stream_t *stream, const struct iovec *iov, size_t iovcnt, size_t total_len) {
-  size_t written = 0;
-  for (size_t i = 0; i < iovcnt && written < total_len; i++) {
-    size_t to_write = min(iov[i].iov_len, total_len - written);
-    stream_buffer_write(stream, iov[i].iov_base, to_write);
-    written += to_write;
+static size_t unix_cred_deliver(struct msghdr *msg, const unix_cred_t *cred, size_t off) {
+  // reports the sender credentials in a SCM_CREDENTIALS control message
+  size_t space = msg->msg_control && msg->msg_controllen > off ? msg->msg_controllen - off : 0;
+  if (space < CMSG_LEN(sizeof(unix_cred_t))) {
+    msg->msg_flags |= MSG_CTRUNC;
+    return 0;
   }
-  return written;
+
+  struct cmsghdr *cmsg = offset_ptr(msg->msg_control, off);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_CREDENTIALS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(unix_cred_t));
+  memcpy(CMSG_DATA(cmsg), cred, sizeof(unix_cred_t));
+  return min(CMSG_SPACE(sizeof(unix_cred_t)), space);
 }
 
-static size_t stream_buffer_read_iovec(unix_stream_t *stream, const struct iovec *iov, size_t iovcnt, size_t total_len) {
-  size_t read = 0;
-  for (size_t i = 0; i < iovcnt && read < total_len; i++) {
-    size_t to_read = min(iov[i].iov_len, total_len - read);
-    stream_buffer_read(stream, iov[i].iov_base, to_read);
-    read += to_read;
+static size_t unix_scm_deliver(struct msghdr *msg, __move unix_scm_t **scmp, size_t off, int flags) {
+  // installs the passed files in the current process and reports the new fds
+  // in a SCM_RIGHTS control message. files that do not fit are closed.
+  unix_scm_t *scm = moveptr(*scmp);
+  size_t space = msg->msg_control && msg->msg_controllen > off ? msg->msg_controllen - off : 0;
+  int max_fds = space >= CMSG_LEN(0) ? (int)((space - CMSG_LEN(0)) / sizeof(int)) : 0;
+  int fdeflags = (flags & MSG_CMSG_CLOEXEC) ? O_CLOEXEC : 0;
+
+  proc_t *proc = curproc;
+  struct cmsghdr *cmsg = offset_ptr(msg->msg_control, off);
+  int installed = 0;
+  for (int i = 0; i < scm->nfiles && installed < max_fds; i++) {
+    int fd = fs_proc_alloc_fd(proc);
+    if (fd < 0)
+      break;
+
+    fd_entry_t *fde = fd_entry_alloc(fd, fdeflags, cstr_from_str(scm->files[i].name), moveref(scm->files[i].file));
+    if (fde == NULL) {
+      fs_proc_free_fd(proc, fd);
+      break;
+    }
+    fs_proc_add_fdentry(proc, moveref(fde));
+    ((int *) CMSG_DATA(cmsg))[installed++] = fd;
   }
-  return read;
+
+  if (installed < scm->nfiles)
+    msg->msg_flags |= MSG_CTRUNC;
+  unix_scm_free(&scm);
+  if (installed == 0)
+    return 0;
+
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(installed * sizeof(int));
+  return min(CMSG_SPACE(installed * sizeof(int)), space);
 }
 
 //
@@ -221,6 +482,7 @@ static void _unix_sock_cleanup(unix_socket_t **usockp) {
     // free all pending datagrams
     LIST_FOR_IN_SAFE(msg, &usock->dgram.rx_queue, link) {
       LIST_REMOVE(&usock->dgram.rx_queue, msg, link);
+      unix_scm_free(&msg->scm);
       kfree(msg);
     }
   } else if (usock->type == SOCK_STREAM) {
@@ -232,6 +494,12 @@ static void _unix_sock_cleanup(unix_socket_t **usockp) {
       unix_sock_putref(&usock->stream.peer);
     }
 
+    // drop files that were never received
+    LIST_FOR_IN_SAFE(scm, &usock->stream.scm_queue, link) {
+      LIST_REMOVE(&usock->stream.scm_queue, scm, link);
+      unix_scm_free(&scm);
+    }
+
     // free pending accept queue
     LIST_FOR_IN_SAFE(pending, &usock->stream.accept_queue, aq_link) {
       LIST_REMOVE(&usock->stream.accept_queue, pending, aq_link);
@@ -297,6 +565,7 @@ static int unix_create(sock_t *sock, int protocol) {
   }
 
   usock->type = sock->type;
+  usock->cred = unix_cred_current();
   usock->rcvbuf = 64 * 1024;
   usock->sndbuf = 64 * 1024;
 
@@ -512,6 +781,7 @@ static int unix_accept(sock_t *sock, sock_t *newsock, int flags) {
   }
 
   accepted->type = SOCK_STREAM;
+  accepted->cred = usock->cred;
   accepted->rcvbuf = UNIX_BUFFER_SIZE;
   accepted->sndbuf = UNIX_BUFFER_SIZE;
 
@@ -551,84 +821,85 @@ static int unix_accept(sock_t *sock, sock_t *newsock, int flags) {
   return 0;
 }
 
-static int unix_sendmsg(sock_t *sock, struct msghdr *msg, size_t len, int flags) {
-  unix_socket_t *usock = sock->sk;
-  ASSERT(usock != NULL);
-
-  if (usock->type == SOCK_DGRAM) {
-    if (len > UNIX_MAX_DGRAM_SIZE) {
-      return -EMSGSIZE;
-    }
+static int unix_dgram_sendmsg(unix_socket_t *usock, struct msghdr *msg, size_t len, int flags, unix_scm_t **scmp) {
+  if (len > UNIX_MAX_DGRAM_SIZE) {
+    return -EMSGSIZE;
+  }
 
-    // determine destination
-    struct sockaddr_un *dest = NULL;
-    socklen_t destlen = 0;
+  // determine destination
+  struct sockaddr_un *dest = NULL;
+  socklen_t destlen = 0;
 
-    if (msg->msg_name) {
-      dest = (struct sockaddr_un *)msg->msg_name;
-      destlen = msg->msg_namelen;
+  if (msg->msg_name) {
+    dest = (struct sockaddr_un *)msg->msg_name;
+    destlen = msg->msg_namelen;
 
-      if (destlen < sizeof(sa_family_t) || dest->sun_family != AF_UNIX) {
-        return -EINVAL;
-      }
-    } else if (usock->addrlen > 0) {
-      dest = &usock->addr;
-      destlen = usock->addrlen;
-    } else {
-      return -EDESTADDRREQ;
+    if (destlen < sizeof(sa_family_t) || dest->sun_family != AF_UNIX) {
+      return -EINVAL;
     }
+  } else if (usock->addrlen > 0) {
+    dest = &usock->addr;
+    destlen = usock->addrlen;
+  } else {
+    return -EDESTADDRREQ;
+  }
 
-    unix_socket_t *peer = unix_find_bound_socket(dest, destlen);
-    if (!peer) {
-      return -ECONNREFUSED;
-    }
+  unix_socket_t *peer = unix_find_bound_socket(dest, destlen);
+  if (!peer) {
+    return -ECONNREFUSED;
+  }
 
-    if (peer->type != SOCK_DGRAM) {
-      unix_sock_putref(&peer);
-      return -EPROTOTYPE;
-    }
+  if (peer->type != SOCK_DGRAM) {
+    unix_sock_putref(&peer);
+    return -EPROTOTYPE;
+  }
 
-    // allocate message
-    unix_dgram_msg_t *dgram = kmallocz(sizeof(unix_dgram_msg_t) + len);
-    if (!dgram) {
-      unix_sock_putref(&peer);
-      return -ENOMEM;
-    }
+  // allocate message
+  unix_dgram_msg_t *dgram = kmallocz(sizeof(unix_dgram_msg_t) + len);
+  if (!dgram) {
+    unix_sock_putref(&peer);
+    return -ENOMEM;
+  }
 
-    if (usock->bound) {
-      memcpy(&dgram->addr, &usock->addr, usock->addrlen);
-      dgram->addrlen = usock->addrlen;
-    } else {
-      dgram->addr.sun_family = AF_UNIX;
-      dgram->addrlen = sizeof(sa_family_t);
-    }
+  if (usock->bound) {
+    memcpy(&dgram->addr, &usock->addr, usock->addrlen);
+    dgram->addrlen = usock->addrlen;
+  } else {
+    dgram->addr.sun_family = AF_UNIX;
+    dgram->addrlen = sizeof(sa_family_t);
+  }
 
-    dgram->len = len;
-    copy_from_iovec(msg->msg_iov, msg->msg_iovlen, dgram->data, len);
+  dgram->len = len;
+  copy_from_iovec(msg->msg_iov, msg->msg_iovlen, dgram->data, len);
+  dgram->cred = *scmp ? (*scmp)->cred : unix_cred_current();
+  if (*scmp && (*scmp)->nfiles > 0) {
+    dgram->scm = moveptr(*scmp);
+  }
 
-    // queue message
-    mtx_lock(&peer->lock);
-    if (peer->dgram.rx_queue_bytes + len > (size_t)peer->rcvbuf) {
-      mtx_unlock(&peer->lock);
-      unix_sock_putref(&peer);
-      kfree(dgram);
-      return -ENOBUFS;
-    }
+  // queue message
+  mtx_lock(&peer->lock);
+  if (peer->dgram.rx_queue_bytes + len > (size_t)peer->rcvbuf) {
+    mtx_unlock(&peer->lock);
+    unix_sock_putref(&peer);
+    *scmp = moveptr(dgram->scm);
+    kfree(dgram);
+    return -ENOBUFS;
+  }
 
-    LIST_ADD(&peer->dgram.rx_queue, dgram, link);
-    peer->dgram.rx_queue_len++;
-    peer->dgram.rx_queue_bytes += len;
+  LIST_ADD(&peer->dgram.rx_queue, dgram, link);
+  peer->dgram.rx_queue_len++;
+  peer->dgram.rx_queue_bytes += len;
 
-    cond_broadcast(&peer->rx_cond);
-    knlist_activate_notes(&peer->knlist, 0);
+  cond_broadcast(&peer->rx_cond);
+  knlist_activate_notes(&peer->knlist, 0);
 
-    mtx_unlock(&peer->lock);
-    unix_sock_putref(&peer);
+  mtx_unlock(&peer->lock);
+  unix_sock_putref(&peer);
 
-    return (int)len;
-  }
+  return (int)len;
+}
 
-  // SOCK_STREAM
+static int unix_stream_sendmsg(unix_socket_t *usock, struct msghdr *msg, size_t len, int flags, unix_scm_t **scmp) {
   if (!usock->stream.peer) {
     return -ENOTCONN;
   }
@@ -643,6 +914,7 @@ static int unix_sendmsg(sock_t *sock, struct msghdr *msg, size_t len, int flags)
   }
   mtx_unlock(&usock->lock);
 
+  kio_t kio = kio_new_readablev(msg->msg_iov, msg->msg_iovlen);
   size_t total_written = 0;
   size_t to_write = len;
 
@@ -654,8 +926,39 @@ static int unix_sendmsg(sock_t *sock, struct msghdr *msg, size_t len, int flags)
     return -EPIPE;
   }
 
+  // data is only tagged when the sender credentials change so that reads
+  // stop at the boundary
+  unix_cred_t cred = *scmp ? (*scmp)->cred : unix_cred_current();
+  if (!unix_cred_equal(&cred, &peer->stream.in_cred)) {
+    if (*scmp == NULL && len > 0) {
+      *scmp = unix_scm_alloc(0, &cred);
+      if (*scmp == NULL) {
+        mtx_unlock(&peer->lock);
+        return -ENOMEM;
+      }
+    }
+  } else if (*scmp != NULL && (*scmp)->nfiles == 0) {
+    unix_scm_free(scmp);
+  }
+
   // write data to peer's buffer
   while (to_write > 0) {
+    unix_handoff_t *h = peer->stream.handoff;
+    if (h != NULL && *scmp == NULL && peer->stream.count == 0) {
+      // the reader is blocked on an empty buffer, copy straight to it
+      peer->stream.handoff = NULL;
+      size_t copied = unix_handoff_fill(h, &kio, to_write);
+      if (copied > 0) {
+        peer->stream.in_bytes += copied;
+        peer->stream.out_bytes += copied;
+        total_written += copied;
+        to_write = len - total_written;
+        DPRINTF("sendmsg: handed off %zu to peer=%p\n", copied, peer);
+        cond_broadcast(&peer->rx_cond);
+        continue;
+      }
+    }
+
     size_t available = peer->stream.buffer_size - peer->stream.count;
 
     while (available == 0) {
@@ -680,7 +983,14 @@ static int unix_sendmsg(sock_t *sock, struct msghdr *msg, size_t len, int flags)
     }
 
     size_t chunk = min(to_write, available);
-    size_t written = stream_buffer_write_iovec(&peer->stream, msg->msg_iov, msg->msg_iovlen, chunk);
+    if (*scmp != NULL) {
+      // the files and credentials go with the first byte of this message
+      unix_scm_t *scm = moveptr(*scmp);
+      scm->pos = peer->stream.in_bytes;
+      peer->stream.in_cred = scm->cred;
+      LIST_ADD(&peer->stream.scm_queue, scm, link);
+    }
+    size_t written = stream_buffer_write(&peer->stream, &kio, chunk);
     total_written += written;
     to_write = len - total_written;
 
@@ -690,73 +1000,95 @@ static int unix_sendmsg(sock_t *sock, struct msghdr *msg, size_t len, int flags)
     // wake up reader
     cond_broadcast(&peer->rx_cond);
     knlist_activate_notes(&peer->knlist, 0);
+    if (written < chunk) {
+      // ran out of source data
+      break;
+    }
   }
 
   mtx_unlock(&peer->lock);
   return (int)total_written;
 }
 
-static int unix_recvmsg(sock_t *sock, struct msghdr *msg, size_t len, int flags) {
+static int unix_sendmsg(sock_t *sock, struct msghdr *msg, size_t len, int flags) {
   unix_socket_t *usock = sock->sk;
-  if (!usock) {
-    return -EINVAL;
+  ASSERT(usock != NULL);
+
+  unix_scm_t *scm = NULL;
+  int res = unix_scm_from_msg(msg, &scm);
+  if (res < 0) {
+    return res;
   }
 
   if (usock->type == SOCK_DGRAM) {
-    // datagram socket
-    mtx_lock(&usock->lock);
+    res = unix_dgram_sendmsg(usock, msg, len, flags, &scm);
+  } else {
+    res = unix_stream_sendmsg(usock, msg, len, flags, &scm);
+  }
 
-    while (usock->dgram.rx_queue_len == 0) {
-      if (flags & MSG_DONTWAIT) {
-        mtx_unlock(&usock->lock);
-        return -EAGAIN;
-      }
+  // the files were not sent
+  unix_scm_free(&scm);
+  return res;
+}
 
-      cond_wait(&usock->rx_cond, &usock->lock);
+static int unix_dgram_recvmsg(unix_socket_t *usock, struct msghdr *msg, size_t len, int flags, __out unix_scm_t **scmp, __out unix_cred_t *credp) {
+  mtx_lock(&usock->lock);
+
+  while (usock->dgram.rx_queue_len == 0) {
+    if (flags & MSG_DONTWAIT) {
+      mtx_unlock(&usock->lock);
+      return -EAGAIN;
     }
 
-    unix_dgram_msg_t *dgram = LIST_REMOVE_FIRST(&usock->dgram.rx_queue, link);
-    usock->dgram.rx_queue_len--;
-    usock->dgram.rx_queue_bytes -= dgram->len;
+    cond_wait(&usock->rx_cond, &usock->lock);
+  }
 
-    mtx_unlock(&usock->lock);
+  unix_dgram_msg_t *dgram = LIST_REMOVE_FIRST(&usock->dgram.rx_queue, link);
+  usock->dgram.rx_queue_len--;
+  usock->dgram.rx_queue_bytes -= dgram->len;
 
-    // copy source address
-    if (msg->msg_name && msg->msg_namelen > 0) {
-      socklen_t to_copy = min(msg->msg_namelen, dgram->addrlen);
-      memcpy(msg->msg_name, &dgram->addr, to_copy);
-      msg->msg_namelen = to_copy;
-    }
+  mtx_unlock(&usock->lock);
 
-    // copy data to iovec
-    size_t to_copy = min(len, dgram->len);
-    copy_to_iovec(msg->msg_iov, msg->msg_iovlen, dgram->data, to_copy);
+  // copy source address
+  if (msg->msg_name && msg->msg_namelen > 0) {
+    socklen_t to_copy = min(msg->msg_namelen, dgram->addrlen);
+    memcpy(msg->msg_name, &dgram->addr, to_copy);
+    msg->msg_namelen = to_copy;
+  }
 
-    int result = (int)to_copy;
-    if (to_copy < dgram->len) {
-      msg->msg_flags |= MSG_TRUNC;
-    }
+  // copy data to iovec
+  size_t to_copy = min(len, dgram->len);
+  copy_to_iovec(msg->msg_iov, msg->msg_iovlen, dgram->data, to_copy);
 
-    kfree(dgram);
-    return result;
+  int result = (int)to_copy;
+  if (to_copy < dgram->len) {
+    msg->msg_flags |= MSG_TRUNC;
   }
 
-  // SOCK_STREAM
+  *scmp = moveptr(dgram->scm);
+  *credp = dgram->cred;
+  kfree(dgram);
+  return result;
+}
+
+static int unix_stream_recvmsg(unix_socket_t *usock, struct msghdr *msg, size_t len, int flags, __out unix_scm_t **scmp, __out unix_cred_t *credp) {
   if (!usock->stream.peer) {
     return -ENOTCONN;
   }
 
+  kio_t kio = kio_new_writablev(msg->msg_iov, msg->msg_iovlen);
+  unix_handoff_t handoff = {0};
+  size_t total_read = 0;
+  size_t to_read = len;
+  int res = 0;
+
   mtx_lock(&usock->lock);
 
   // check if shut down for reading
   if (usock->stream.shutdown_flags & SHUT_RD) {
-    mtx_unlock(&usock->lock);
-    return 0;
+    goto out;
   }
 
-  size_t total_read = 0;
-  size_t to_read = len;
-
   while (to_read > 0) {
     while (usock->stream.count == 0) {
       if (total_read > 0) {
@@ -766,22 +1098,54 @@ static int unix_recvmsg(sock_t *sock, struct msghdr *msg, size_t len, int flags)
 
       // check if peer closed
       if (usock->stream.shutdown_flags & SHUT_WR) {
-        mtx_unlock(&usock->lock);
-        return (int)total_read;
+        goto out;
       }
 
       if (flags & MSG_DONTWAIT) {
-        mtx_unlock(&usock->lock);
-        return -EAGAIN;
+        res = -EAGAIN;
+        goto out;
+      }
+
+      // let the next writer copy directly into our buffer
+      if (handoff.npages == 0) {
+        unix_handoff_prepare(&handoff, msg, to_read);
+      }
+      if (handoff.npages > 0) {
+        usock->stream.handoff = &handoff;
       }
 
       cond_wait(&usock->rx_cond, &usock->lock);
+
+      if (usock->stream.handoff == &handoff) {
+        usock->stream.handoff = NULL;
+      }
+      if (handoff.copied > 0) {
+        // the handed off data comes before anything written to the buffer
+        total_read = handoff.copied;
+        goto out;
+      }
+    }
+
+    // passed files are received with the first byte they were sent with and
+    // a single read never runs into data that carries another set of files
+    // or other credentials
+    unix_scm_t *next = LIST_FIRST(&usock->stream.scm_queue);
+    if (next != NULL && next->pos == usock->stream.out_bytes) {
+      if (total_read > 0) {
+        goto out;
+      }
+      *scmp = LIST_REMOVE_FIRST(&usock->stream.scm_queue, link);
+      usock->stream.out_cred = (*scmp)->cred;
+      next = LIST_FIRST(&usock->stream.scm_queue);
     }
 
     size_t available = usock->stream.count;
+    if (next != NULL) {
+      available = min(available, next->pos - usock->stream.out_bytes);
+    }
     size_t chunk = min(to_read, available);
 
-    size_t read = stream_buffer_read_iovec(&usock->stream, msg->msg_iov, msg->msg_iovlen, chunk);
+    size_t read = stream_buffer_read(&usock->stream, &kio, chunk);
     total_read += read;
     to_read = len - total_read;
 
@@ -791,12 +1155,48 @@ static int unix_recvmsg(sock_t *sock, struct msghdr *msg, size_t len, int flags)
       cond_broadcast(&peer->tx_cond);
       knlist_activate_notes(&peer->knlist, 0);
     }
-  }
 
-out:
+    if (read < chunk || (next != NULL && next->pos == usock->stream.out_bytes)) {
+      break;
+    }
+  }
 
+LABEL(out);
+  *credp = usock->stream.out_cred;
   mtx_unlock(&usock->lock);
-  return (int)total_read;
+  unix_handoff_release(&handoff);
+  return res < 0 ? res : (int)total_read;
+}
+
+static int unix_recvmsg(sock_t *sock, struct msghdr *msg, size_t len, int flags) {
+  unix_socket_t *usock = sock->sk;
+  if (!usock) {
+    return -EINVAL;
+  }
+
+  int res;
+  unix_scm_t *scm = NULL;
+  unix_cred_t cred = {0};
+  if (usock->type == SOCK_DGRAM) {
+    res = unix_dgram_recvmsg(usock, msg, len, flags, &scm, &cred);
+  } else {
+    res = unix_stream_recvmsg(usock, msg, len, flags, &scm, &cred);
+  }
+
+  if (res >= 0) {
+    // install any passed files now that the socket lock is dropped. the
+    // credentials come first like on linux.
+    size_t controllen = 0;
+    if (usock->passcred) {
+      controllen += unix_cred_deliver(msg, &cred, controllen);
+    }
+    if (scm != NULL && scm->nfiles > 0) {
+      controllen += unix_scm_deliver(msg, &scm, controllen, flags);
+    }
+    msg->msg_controllen = controllen;
+  }
+  unix_scm_free(&scm);
+  return res;
 }
 
 static int unix_shutdown(sock_t *sock, int how) {
@@ -865,6 +1265,9 @@ static int unix_setsockopt(sock_t *sock, int level, int optname, const void *opt
     case SO_SNDBUF:
       usock->sndbuf = value;
       break;
+    case SO_PASSCRED:
+      usock->passcred = value != 0;
+      break;
     default:
       mtx_unlock(&usock->lock);
       return -ENOPROTOOPT;
@@ -884,6 +1287,23 @@ static int unix_getsockopt(sock_t *sock, int level, int optname, void *optval, s
     return -ENOPROTOOPT;
   }
 
+  if (optname == SO_PEERCRED) {
+    if (*optlen < sizeof(unix_cred_t)) {
+      return -EINVAL;
+    }
+
+    mtx_lock(&usock->lock);
+    if (usock->type != SOCK_STREAM || !usock->stream.peer) {
+      mtx_unlock(&usock->lock);
+      return -ENOTCONN;
+    }
+    memcpy(optval, &usock->stream.peer->cred, sizeof(unix_cred_t));
+    mtx_unlock(&usock->lock);
+
+    *optlen = sizeof(unix_cred_t);
+    return 0;
+  }
+
   if (*optlen < sizeof(int)) {
     return -EINVAL;
   }
@@ -902,6 +1322,9 @@ static int unix_getsockopt(sock_t *sock, int level, int optname, void *optval, s
     case SO_TYPE:
       value = usock->type;
       break;
+    case SO_PASSCRED:
+      value = usock->passcred;
+      break;
     default:
       mtx_unlock(&usock->lock);
       return -ENOPROTOOPT;
@@ -53,6 +53,7 @@ noreturn void panic(const char *fmt, ...) {
     goto hang;
   }
   panic_flags[id] = true;
+  kprintf_sync();
 
   if (system_num_cpus > 1) {
     ipi_deliver_mode(IPI_PANIC, IPI_ALL_EXCL, (uintptr_t) panic_other_cpus, /*wait_ack=*/false);
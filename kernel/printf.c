@@ -48,10 +48,7 @@ static int early_kprintf_puts(void *arg, const char *s) {
     unlock = true;
   }
 
-  while (*s) {
-    uart_hw_busy_write_ch(p->port, *s);
-    s++;
-  }
+  uart_hw_write(p->port, s, strlen(s));
 
   if (unlock)
     mtx_spin_unlock(&p->lock);
@@ -75,6 +72,19 @@ static void kprintf_static_init() {
 }
 STATIC_INIT(kprintf_static_init);
 
+static void kprintf_module_init() {
+  // from here on output is queued and sent from the uart transmit interrupt
+  // instead of having the caller wait on the port
+  if (uart_hw_start_tx_ring(early_kprintf.port) < 0) {
+    kprintf("kprintf: failed to start uart tx ring\n");
+  }
+}
+MODULE_INIT(kprintf_module_init);
+
+void kprintf_sync() {
+  uart_hw_stop_tx_ring(early_kprintf.port);
+}
+
 void kprintf_kputs(const char *str) {
   kprintf_puts_impl(impl_arg, str);
 }
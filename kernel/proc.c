@@ -26,6 +26,7 @@
 #include <fs/procfs/procfs.h>
 
 #include <linux/sched.h>
+#include <abi/sched.h>
 
 #include <bitmap.h>
 
@@ -676,8 +677,10 @@ __ref proc_t *proc_fork() {
   pr_lock(proc);
   address_space_t *space = proc->space;
 
+  // the user page tables are filled in by faults in the child instead of being
+  // copied so that the cost of fork does not depend on the size of the process
   mtx_lock(&space->lock);
-  address_space_t *new_space = vm_fork_space(space, /*fork_user=*/true);
+  address_space_t *new_space = vm_fork_space(space, /*fork_user=*/false);
   mtx_unlock(&space->lock);
 
   proc_t *new_proc = proc_alloc_internal(
@@ -815,7 +818,8 @@ int proc_setup_exec(proc_t *proc, cstr_t path) {
 
   // create a mapping for the process `brk` segment that reserves the virtual space
   // but initially has no size. the segment will be expanded as needed by the process
-  if (vmap_other_anon(proc->space, PROC_BRK_MAX, last_segment_end, 0, VM_RDWR|VM_FIXED, "brk") == 0) {
+  // and like other anonymous memory its pages start out zeroed
+  if (vmap_other_anon(proc->space, PROC_BRK_MAX, last_segment_end, 0, VM_RDWR|VM_FIXED|VM_ZERO, "brk") == 0) {
     EPRINTF("failed to map brk segment\n");
     goto_res(ret, -ENOMEM);
   }
@@ -1417,7 +1421,7 @@ int proc_syscall_execve(cstr_t path, char *const argv[], char *const envp[]) {
   // create the `brk` segment after the last data segment
   vm_desc_t *last_segment = SLIST_GET_LAST(image->descs, next);
   uintptr_t last_segment_end = last_segment->address + last_segment->size;
-  if (vmap_anon(PROC_BRK_MAX, last_segment_end, 0, VM_USER|VM_RDWR|VM_FIXED, "brk") == 0) {
+  if (vmap_anon(PROC_BRK_MAX, last_segment_end, 0, VM_USER|VM_RDWR|VM_FIXED|VM_ZERO, "brk") == 0) {
     EPRINTF("failed to map brk segment\n");
     goto_res(crash, -ENOMEM);
   }
@@ -1939,6 +1943,69 @@ static inline uint8_t td_flags_to_base_priority(uint32_t td_flags) {
   }
 }
 
+// kernel stack cache
+//
+// default sized kernel stacks are recycled through a small per-cpu cache so that
+// thread creation and cleanup do not have to allocate pages and set up a new
+// mapping each time. the cached stacks stay mapped as VM_STACK mappings so each
+// one keeps its unmapped guard page below the stack base.
+
+#define KSTACK_CACHE_SIZE     8
+#define KSTACK_CACHE_PREFILL  2
+
+struct kstack_cache {
+  size_t count;
+  uintptr_t stacks[KSTACK_CACHE_SIZE];
+};
+
+static struct kstack_cache kstack_caches[MAX_CPUS];
+
+static uintptr_t kstack_map_new(size_t kstack_size) {
+  return vmap_pages(alloc_pages(SIZE_TO_PAGES(kstack_size)), 0, kstack_size, VM_RDWR|VM_STACK, "kstack");
+}
+
+static uintptr_t kstack_alloc(size_t kstack_size) {
+  if (kstack_size == KERNEL_STACK_SIZE) {
+    uintptr_t kstack_base = 0;
+    critical_enter();
+    struct kstack_cache *cache = &kstack_caches[curcpu_id];
+    if (cache->count > 0) {
+      kstack_base = cache->stacks[--cache->count];
+    }
+    critical_exit();
+
+    if (kstack_base != 0) {
+      return kstack_base;
+    }
+  }
+  return kstack_map_new(kstack_size);
+}
+
+static void kstack_free(uintptr_t kstack_base, size_t kstack_size) {
+  if (kstack_size == KERNEL_STACK_SIZE) {
+    bool cached = false;
+    critical_enter();
+    struct kstack_cache *cache = &kstack_caches[curcpu_id];
+    if (cache->count < KSTACK_CACHE_SIZE) {
+      cache->stacks[cache->count++] = kstack_base;
+      cached = true;
+    }
+    critical_exit();
+
+    if (cached) {
+      return;
+    }
+  }
+  vmap_free(kstack_base, kstack_size);
+}
+
+static void kstack_cache_percpu_static_init() {
+  for (int i = 0; i < KSTACK_CACHE_PREFILL; i++) {
+    kstack_free(kstack_map_new(KERNEL_STACK_SIZE), KERNEL_STACK_SIZE);
+  }
+}
+PERCPU_STATIC_INIT(kstack_cache_percpu_static_init);
+
 // thread api
 
 static thread_t *thread_alloc_internal(uint32_t flags, uintptr_t kstack_base, size_t kstack_size) {
@@ -1989,7 +2056,7 @@ static thread_t *thread_alloc_internal(uint32_t flags, uintptr_t kstack_base, si
 
 thread_t *thread_alloc(uint32_t flags, size_t kstack_size) {
   ASSERT(kstack_size > 0 && is_aligned(kstack_size, PAGE_SIZE));
-  uintptr_t kstack_base = vmap_pages(alloc_pages(SIZE_TO_PAGES(kstack_size)), 0, kstack_size, VM_RDWR|VM_STACK, "kstack");
+  uintptr_t kstack_base = kstack_alloc(kstack_size);
   return thread_alloc_internal(flags, kstack_base, kstack_size);
 }
 
@@ -2017,8 +2084,12 @@ thread_t *thread_syscall_fork() {
   td_lock(td);
   thread_t *copy = thread_alloc(td->flags, td->kstack_size);
 
-  // copy the kernel stack
-  memcpy((void *)copy->kstack_base, (void *)td->kstack_base, td->kstack_size);
+  // copy the live part of the kernel stack. this is everything from the syscall
+  // trapframe up to the top of the stack (tcb included), anything below it belongs
+  // to the current syscall and is never used by the child.
+  ASSERT(td->kstack_ptr >= td->kstack_base && td->kstack_ptr < td->kstack_base + td->kstack_size);
+  size_t live_off = td->kstack_ptr - td->kstack_base;
+  memcpy((void *)(copy->kstack_base + live_off), (void *)td->kstack_ptr, td->kstack_size - live_off);
   // copy the syscall trapframe into the thread
   memcpy((void *)copy->frame, (void *)td->frame, sizeof(struct trapframe));
   // in the current thread frame->parent points to original on-stack trapframe
@@ -2032,6 +2103,12 @@ thread_t *thread_syscall_fork() {
   // we want this thread to be restored from the trapframe
   copy->flags2 |= TDF2_TRAPFRAME;
   copy->name = str_dup(td->name);
+  if (TDF2_HAS_AFFINITY(td)) {
+    // the cpu affinity is inherited by the new thread
+    cpuset_free(&copy->cpuset);
+    copy->cpuset = cpuset_alloc(td->cpuset);
+    copy->flags2 |= TDF2_AFFINITY;
+  }
 
   DPRINTF("fork: thread->frame = {:p}, thread->tcb = {:p}\n", copy->frame, copy->tcb);
 
@@ -2057,7 +2134,7 @@ void thread_free_exited(thread_t **tdp) {
   str_free(&td->name);
 
   // free the kernel stack
-  vmap_free(td->kstack_base, td->kstack_size);
+  kstack_free(td->kstack_base, td->kstack_size);
 
   mtx_destroy(&td->lock);
   kfree(td);
@@ -2323,13 +2400,13 @@ int thread_signal(thread_t *td, siginfo_t *info) {
 ///////////////////
 // MARK: cpuset
 
-#define CPUSET_MAX_INDEX (MAX_CPUS / 64)
+#define CPUSET_MAX_INDEX ((MAX_CPUS + 63) / 64)
 #define cpuset_index(cpu) ((cpu) / 64)
 #define cpuset_offset(cpu) ((cpu) % 64)
 #define cpuset_cpu(index, offset) (((index) * 64) + (offset))
 
 struct cpuset {
-  uint64_t bits[MAX_CPUS / 64];
+  uint64_t bits[CPUSET_MAX_INDEX];
   size_t ncpus;
 };
 
@@ -2350,45 +2427,127 @@ void cpuset_free(struct cpuset **set) {
 }
 
 void cpuset_set(struct cpuset *set, int cpu) {
-  ASSERT(cpu < MAX_CPUS);
-  set->bits[cpuset_index(cpu)] |= (1ULL << cpuset_offset(cpu));
-  set->ncpus++;
+  ASSERT(cpu >= 0 && cpu < MAX_CPUS);
+  uint64_t bit = 1ULL << cpuset_offset(cpu);
+  if (!(set->bits[cpuset_index(cpu)] & bit)) {
+    set->bits[cpuset_index(cpu)] |= bit;
+    set->ncpus++;
+  }
 }
 
 void cpuset_reset(struct cpuset *set, int cpu) {
-  ASSERT(cpu < MAX_CPUS);
-  set->bits[cpuset_index(cpu)] &= ~(1ULL << cpuset_offset(cpu));
-  set->ncpus--;
+  ASSERT(cpu >= 0 && cpu < MAX_CPUS);
+  uint64_t bit = 1ULL << cpuset_offset(cpu);
+  if (set->bits[cpuset_index(cpu)] & bit) {
+    set->bits[cpuset_index(cpu)] &= ~bit;
+    set->ncpus--;
+  }
 }
 
 bool cpuset_test(struct cpuset *set, int cpu) {
-  ASSERT(cpu < MAX_CPUS);
+  ASSERT(cpu >= 0 && cpu < MAX_CPUS);
   return set->bits[cpuset_index(cpu)] & (1ULL << cpuset_offset(cpu));
 }
 
+// returns the first cpu in the set after `cpu`, or -1 if there are none.
+// passing -1 returns the first cpu in the set.
 int cpuset_next_set(struct cpuset *set, int cpu) {
   if (set->ncpus == 0) {
     return -1;
   }
 
-  uint64_t mask;
-  if (cpu >= 0) {
-    mask = UINT64_MAX << cpuset_offset(cpu);
-  } else {
-    mask = UINT64_MAX;
+  cpu++;
+  if (cpu >= MAX_CPUS) {
+    return -1;
   }
 
+  uint64_t mask = UINT64_MAX << cpuset_offset(cpu);
   for (int i = cpuset_index(cpu); i < CPUSET_MAX_INDEX; i++) {
-    uint64_t bits = set->bits[i];
+    uint64_t bits = set->bits[i] & mask;
+    mask = UINT64_MAX;
     if (bits == 0) {
       continue;
     }
-    int index = bit_ffs64(bits & mask);
-    return cpuset_cpu(i, index);
+    return cpuset_cpu(i, bit_ffs64(bits));
   }
   return -1;
 }
 
+size_t cpuset_count(struct cpuset *set) {
+  return set->ncpus;
+}
+
+// loads the set from a user cpu mask of the given size in bytes. bits for
+// cpus above MAX_CPUS are ignored.
+static void cpuset_load_mask(struct cpuset *set, const uint8_t *mask, size_t size) {
+  memset(set->bits, 0, sizeof(set->bits));
+  set->ncpus = 0;
+  size = min(size, sizeof(set->bits));
+  for (size_t i = 0; i < size * 8 && i < MAX_CPUS; i++) {
+    if (mask[i / 8] & (1 << (i % 8))) {
+      cpuset_set(set, (int) i);
+    }
+  }
+}
+
+// stores the set into a user cpu mask of the given size in bytes and returns
+// the number of bytes written.
+static size_t cpuset_store_mask(struct cpuset *set, uint8_t *mask, size_t size) {
+  size = min(size, sizeof(set->bits));
+  memset(mask, 0, size);
+  for (int cpu = cpuset_next_set(set, -1); cpu >= 0; cpu = cpuset_next_set(set, cpu)) {
+    if ((size_t) cpu / 8 >= size)
+      break;
+    mask[cpu / 8] |= (1 << (cpu % 8));
+  }
+  return size;
+}
+
+// fills the set with all online cpus
+static void cpuset_fill_online(struct cpuset *set) {
+  memset(set->bits, 0, sizeof(set->bits));
+  set->ncpus = 0;
+  for (int cpu = 0; cpu < system_num_cpus; cpu++) {
+    cpuset_set(set, cpu);
+  }
+}
+
+// changes the cpu affinity of a thread and moves it off of its current cpu
+// if that cpu is no longer allowed. an empty mask or one that includes every
+// online cpu clears the thread affinity.
+static int thread_set_affinity(thread_t *td, struct cpuset *set) {
+  td_lock(td);
+  if (TDS_IS_EXITED(td)) {
+    td_unlock(td);
+    return -ESRCH;
+  }
+
+  memcpy(td->cpuset->bits, set->bits, sizeof(set->bits));
+  td->cpuset->ncpus = set->ncpus;
+  if (set->ncpus == 0 || set->ncpus >= (size_t) system_num_cpus) {
+    atomic_fetch_and(&td->flags2, ~TDF2_AFFINITY);
+  } else {
+    atomic_fetch_or(&td->flags2, TDF2_AFFINITY);
+  }
+
+  if (td->cpu_id < 0 || !TDF2_HAS_AFFINITY(td) || cpuset_test(td->cpuset, td->cpu_id)) {
+    // thread is allowed to stay where it is
+    td_unlock(td);
+    return 0;
+  }
+
+  if (td == curthread) {
+    // move off the current cpu. the thread is resubmitted to an allowed cpu
+    // by the scheduler and we return once it runs there.
+    sched_again(SCHED_YIELDED);
+    return 0;
+  }
+
+  sched_migrate_thread(td);
+  td_unlock(td);
+  return 0;
+}
+
 //
 //
 
@@ -2486,6 +2645,33 @@ struct seq_ops vmspace_seq_ops = {
 };
 
 // /pid/N/status
+static void proc_status_show_cpus(seqfile_t *sf, thread_t *td) {
+  if (!TDF2_HAS_AFFINITY(td)) {
+    seq_printf(sf, "0-%d\n", system_num_cpus - 1);
+    return;
+  }
+
+  // print the allowed cpus as a list of ranges (e.g. 0-2,5)
+  bool first = true;
+  int cpu = cpuset_next_set(td->cpuset, -1);
+  while (cpu >= 0) {
+    int last = cpu;
+    int next;
+    while ((next = cpuset_next_set(td->cpuset, last)) == last + 1) {
+      last = next;
+    }
+
+    if (last == cpu) {
+      seq_printf(sf, "%s%d", first ? "" : ",", cpu);
+    } else {
+      seq_printf(sf, "%s%d-%d", first ? "" : ",", cpu, last);
+    }
+    first = false;
+    cpu = next;
+  }
+  seq_printf(sf, "\n");
+}
+
 static int proc_status_show(seqfile_t *sf, void *data) {
   proc_t *proc = data;
   pr_lock(proc);
@@ -2520,6 +2706,8 @@ static int proc_status_show(seqfile_t *sf, void *data) {
       case TDS_EXITED: seq_printf(sf, "X (exited)\n"); break;
       default: seq_printf(sf, "? (unknown)\n"); break;
     }
+    seq_printf(sf, "    Cpu: %d Cpus_allowed: ", td->cpu_id);
+    proc_status_show_cpus(sf, td);
   }
 
   pr_unlock(proc);
@@ -2715,6 +2903,114 @@ DEFINE_SYSCALL(gettid, pid_t) {
   return curthread->tid;
 }
 
+// resolves the target thread of the sched_*affinity syscalls. pid 0 is the
+// calling thread, a tid of the calling process selects that thread and any
+// other pid selects the main thread of that process. threads are not
+// refcounted so unless the target is the calling thread, the owning process
+// is returned referenced and locked (as in tkill) to keep the thread from
+// exiting until affinity_release_thread is called.
+static thread_t *affinity_lookup_thread(pid_t pid, __out proc_t **out_proc) {
+  proc_t *proc = curproc;
+  *out_proc = NULL;
+  if (pid == 0 || pid == curthread->tid) {
+    return curthread;
+  } else if (pid < 0) {
+    return NULL;
+  }
+
+  pr_lock(proc);
+  thread_t *td = LIST_FIND(_td, &proc->threads, plist, _td->tid == pid);
+  if (td != NULL) {
+    *out_proc = pr_getref(proc);
+    return td;
+  }
+  pr_unlock(proc);
+
+  proc = proc_lookup(pid);
+  if (proc == NULL) {
+    return NULL;
+  }
+
+  pr_lock(proc);
+  td = pr_main_thread(proc);
+  if (td == NULL || td == curthread) {
+    // the calling thread does not need to be held and must not yield with
+    // the process locked
+    pr_unlock(proc);
+    pr_putref(&proc);
+    return td;
+  }
+  *out_proc = proc;
+  return td;
+}
+
+static void affinity_release_thread(proc_t **procref) {
+  if (*procref != NULL) {
+    pr_unlock(*procref);
+    pr_putref(procref);
+  }
+}
+
+DEFINE_SYSCALL(sched_setaffinity, int, pid_t pid, size_t cpusetsize, const cpu_set_t *mask) {
+  DPRINTF("syscall: sched_setaffinity pid=%d cpusetsize=%zu mask=%p\n", pid, cpusetsize, mask);
+  if (vm_validate_ptr((uintptr_t) mask, /*write=*/false) < 0) {
+    return -EFAULT;
+  }
+
+  struct cpuset set;
+  cpuset_load_mask(&set, (const uint8_t *) mask, cpusetsize);
+  for (int cpu = system_num_cpus; cpu < MAX_CPUS; cpu++) {
+    cpuset_reset(&set, cpu); // ignore cpus that are not online
+  }
+  if (set.ncpus == 0) {
+    return -EINVAL;
+  }
+
+  proc_t *proc;
+  thread_t *td = affinity_lookup_thread(pid, &proc);
+  if (td == NULL) {
+    return -ESRCH;
+  }
+
+  int res;
+  if (proc != NULL && proc != curproc && curproc->creds->euid != 0 && curproc->creds->euid != proc->creds->uid) {
+    res = -EPERM;
+  } else {
+    res = thread_set_affinity(td, &set);
+  }
+
+  affinity_release_thread(&proc);
+  return res;
+}
+
+DEFINE_SYSCALL(sched_getaffinity, int, pid_t pid, size_t cpusetsize, cpu_set_t *mask) {
+  DPRINTF("syscall: sched_getaffinity pid=%d cpusetsize=%zu mask=%p\n", pid, cpusetsize, mask);
+  if (cpusetsize * 8 < (size_t) system_num_cpus) {
+    return -EINVAL;
+  }
+  if (vm_validate_ptr((uintptr_t) mask, /*write=*/true) < 0) {
+    return -EFAULT;
+  }
+
+  proc_t *proc;
+  thread_t *td = affinity_lookup_thread(pid, &proc);
+  if (td == NULL) {
+    return -ESRCH;
+  }
+
+  struct cpuset set;
+  td_lock(td);
+  if (TDF2_HAS_AFFINITY(td)) {
+    memcpy(&set, td->cpuset, sizeof(set));
+  } else {
+    cpuset_fill_online(&set);
+  }
+  td_unlock(td);
+
+  affinity_release_thread(&proc);
+  return (int) cpuset_store_mask(&set, (uint8_t *) mask, cpusetsize);
+}
+
 DEFINE_SYSCALL(getuid, uid_t) {
   return curproc->creds->uid;
 }
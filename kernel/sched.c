@@ -7,6 +7,8 @@
 #include <kernel/clock.h>
 #include <kernel/ipi.h>
 #include <kernel/futex.h>
+#include <kernel/trace.h>
+#include <kernel/debug/profile.h>
 
 #include <kernel/panic.h>
 #include <kernel/printf.h>
@@ -67,14 +69,17 @@ static int select_cpu_by_lowest_rough_est_ready(int *out_est) {
 
 // this function selects the cpu with the lowest thread count compared by summing
 // the counts of each runqueue. this is a more accurate heuristic for sched load
-// but it also requires more memory accesses.
-static int select_cpu_by_lowest_readycnt(size_t *out_count) {
+// but it also requires more memory accesses. if allowed is non-null only cpus
+// in the set are considered.
+static int select_cpu_by_lowest_readycnt(struct cpuset *allowed, size_t *out_count) {
   int cpu = -1;
   size_t min = INT_MAX;
   for (int i = 0; i < system_num_cpus; i++) {
     sched_t *sched = cpu_scheds[i];
     if (sched == NULL)
       continue;
+    if (allowed != NULL && !cpuset_test(allowed, i))
+      continue;
 
     size_t tdcount = 0;
     for (int j = 0; j < NRUNQS; j++) {
@@ -84,6 +89,8 @@ static int select_cpu_by_lowest_readycnt(size_t *out_count) {
     if (tdcount < min) {
       min = tdcount;
       cpu = i;
+      if (tdcount == 0)
+        break;
     }
   }
 
@@ -92,14 +99,24 @@ static int select_cpu_by_lowest_readycnt(size_t *out_count) {
   return cpu;
 }
 
+static inline bool sched_cpu_allowed(thread_t *td, int cpu) {
+  return !TDF2_HAS_AFFINITY(td) || cpuset_test(td->cpuset, cpu);
+}
+
 // this function selects a cpu for a thread based on the thread's affinity,
 // existing threads from the same process, and the current load on each cpu.
 int select_cpu_for_thread(thread_t *td) {
   proc_t *proc = td->proc;
   int cpu = -1;
   if (TDF2_HAS_AFFINITY(td)) {
-    // TODO: select the most optimal cpu allowed by the mask
-    if ((cpu = cpuset_next_set(td->cpuset, -1)) >= 0) {
+    // stay on the last cpu if it is allowed and has nothing else to run,
+    // otherwise pick the least loaded cpu allowed by the mask
+    cpu = td->cpu_id;
+    if (cpu >= 0 && cpuset_test(td->cpuset, cpu) && cpu_scheds[cpu] != NULL &&
+        atomic_load_relaxed(&cpu_scheds[cpu]->readymask) == 0) {
+      return cpu;
+    }
+    if ((cpu = select_cpu_by_lowest_readycnt(td->cpuset, NULL)) >= 0) {
       return cpu;
     }
   }
@@ -123,7 +140,7 @@ int select_cpu_for_thread(thread_t *td) {
     return cpu;
 
   // select cpu with lowest thread count
-  return select_cpu_by_lowest_readycnt(NULL);
+  return select_cpu_by_lowest_readycnt(NULL, NULL);
 }
 
 static inline thread_t *sched_runq_get_next_thread(sched_t *sched, int i) {
@@ -287,8 +304,8 @@ void sched_submit_ready_thread(thread_t *td) {
   ASSERT(TDS_IS_READY(td));
 
   int cpu = td->cpu_id;
-  if (cpu < 0) {
-    // thread cpu was cleared, reselect a cpu
+  if (cpu < 0 || !sched_cpu_allowed(td, cpu)) {
+    // thread cpu was cleared or is no longer allowed, reselect a cpu
     cpu = select_cpu_for_thread(td);
     td->cpu_id = cpu;
   }
@@ -317,6 +334,24 @@ void sched_remove_ready_thread(thread_t *td) {
   }
 }
 
+// moves a thread that is not currently running to a cpu allowed by its
+// affinity mask. running threads on other cpus are moved the next time
+// they are preempted or yield.
+void sched_migrate_thread(thread_t *td) {
+  td_lock_assert(td, MA_OWNED);
+  if (td->cpu_id < 0 || sched_cpu_allowed(td, td->cpu_id))
+    return;
+
+  if (TDS_IS_READY(td) && td->runq != NULL) {
+    sched_remove_ready_thread(td);
+    td->cpu_id = -1;
+    sched_submit_ready_thread(td);
+  } else if (!TDS_IS_RUNNING(td)) {
+    // blocked and waiting threads are placed when they are next submitted
+    td->cpu_id = -1;
+  }
+}
+
 //
 
 void sched_again(sched_reason_t reason) {
@@ -326,6 +361,8 @@ void sched_again(sched_reason_t reason) {
     return;
   }
 
+  profile_sync_cpu();
+
   thread_t *oldtd = curthread;
   if (td_lock_owner(oldtd) != curthread) {
     // lock the thread if it hasnt been already
@@ -346,14 +383,16 @@ void sched_again(sched_reason_t reason) {
     }
 
     // dont rereschedule to idle thread if oldtd is just yielding or being preempted
-    // because we have nothing better to do anyways
-    if (reason == SCHED_PREEMPTED || reason == SCHED_YIELDED) {
+    // because we have nothing better to do anyways (unless it is being moved off
+    // this cpu)
+    if ((reason == SCHED_PREEMPTED || reason == SCHED_YIELDED) && sched_cpu_allowed(oldtd, curcpu_id)) {
       td_unlock(oldtd);
       td_unlock(newtd);
       return; // return to oldtd
     }
   }
 
+  TRACE_EVENT(SCHED, TRACE_SCHED_SWITCH, oldtd->tid, newtd->tid, reason, 0);
   switch (reason) {
     case SCHED_PREEMPTED:
       ASSERT(!curcpu_is_interrupt);
@@ -0,0 +1,737 @@
+//
+// Created by Aaron Gill-Braun on 2026-10-18.
+//
+
+#include <kernel/shm.h>
+#include <kernel/vfs/file.h>
+#include <kernel/mm/file.h>
+#include <kernel/mm/pgcache.h>
+#include <kernel/mm/pgtable.h>
+#include <kernel/mm.h>
+#include <kernel/fs.h>
+#include <kernel/proc.h>
+#include <kernel/clock.h>
+#include <kernel/mutex.h>
+#include <kernel/queue.h>
+#include <kernel/panic.h>
+#include <kernel/printf.h>
+#include <kernel/string.h>
+
+#include <abi/fcntl.h>
+#include <abi/mman.h>
+#include <abi/stat.h>
+
+#define ASSERT(x) kassert(x)
+#define LOG_TAG shm
+#include <kernel/log.h>
+
+#define EPRINTF(fmt, ...) kprintf("shm: %s: " fmt, __func__, ##__VA_ARGS__)
+
+#define MEMFD_SEALS (F_SEAL_SEAL | F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_FUTURE_WRITE)
+
+/*
+ * A shared memory object.
+ *
+ * The vm_file may be larger than the object when a mapping extends past the
+ * end of it, its page cache must be able to hold every mapped page.
+ */
+typedef struct shm_object {
+  str_t name;                     // object name
+  __ref vm_file_t *vm_file;       // backing file (cache shared with all mappings)
+  size_t size;                    // size of the object in bytes
+  int seals;                      // F_SEAL_ seals (memfd only)
+  mtx_t lock;                     // protects the object
+  _refcount;
+} shm_object_t;
+
+/*
+ * A sysv shared memory segment.
+ *
+ * A segment stays on the list after IPC_RMID until its last attachment is gone.
+ * The number of attachments is not tracked separately, every mapping of the
+ * segment holds a reference to the page cache of the object.
+ */
+typedef struct shm_segment {
+  int id;                         // segment id
+  bool removed;                   // IPC_RMID has been requested
+  __ref shm_object_t *obj;        // backing object
+  struct shmid_ds ds;             // segment info
+  LIST_ENTRY(struct shm_segment) link;
+} shm_segment_t;
+
+static LIST_HEAD(shm_segment_t) shm_segments;
+static size_t shm_nsegs;
+static int shm_next_id;
+static mtx_t shm_lock;
+
+static void shm_static_init() {
+  mtx_init(&shm_lock, 0, "shm_lock");
+}
+STATIC_INIT(shm_static_init);
+
+static int memfd_f_open(file_t *file, int flags);
+static int memfd_f_close(file_t *file);
+static int memfd_f_allocate(file_t *file, off_t len);
+static int memfd_f_getpage(file_t *file, off_t off, __move page_t **page);
+static ssize_t memfd_f_read(file_t *file, kio_t *kio);
+static ssize_t memfd_f_write(file_t *file, kio_t *kio);
+static off_t memfd_f_lseek(file_t *file, off_t offset, int whence);
+static int memfd_f_stat(file_t *file, struct stat *statbuf);
+static void memfd_f_cleanup(file_t *file);
+
+static struct file_ops memfd_file_ops = {
+  .f_open = memfd_f_open,
+  .f_close = memfd_f_close,
+  .f_allocate = memfd_f_allocate,
+  .f_getpage = memfd_f_getpage,
+  .f_read = memfd_f_read,
+  .f_write = memfd_f_write,
+  .f_lseek = memfd_f_lseek,
+  .f_stat = memfd_f_stat,
+  .f_cleanup = memfd_f_cleanup,
+};
+
+static inline time_t shm_now() {
+  return clock_micro_time().tv_sec;
+}
+
+//
+// MARK: Shared memory objects
+//
+
+static shm_object_t *shm_object_alloc(cstr_t name, size_t size) {
+  shm_object_t *obj = kmallocz(sizeof(shm_object_t));
+  if (obj == NULL)
+    return NULL;
+
+  obj->name = str_from_cstr(name);
+  obj->vm_file = vm_file_alloc_shmem(max(page_align(size), PAGE_SIZE));
+  obj->size = size;
+  mtx_init(&obj->lock, 0, "shm_object_lock");
+  initref(obj);
+  return obj;
+}
+
+static void shm_object_free(shm_object_t *obj) {
+  ASSERT(read_refcount(obj) == 0);
+  vm_file_free(&obj->vm_file);
+  str_free(&obj->name);
+  mtx_destroy(&obj->lock);
+  kfree(obj);
+}
+
+static inline void shm_object_putref(shm_object_t **objp) {
+  putref(objp, shm_object_free);
+}
+
+static void shm_zero_page_cb(page_t **pageref, size_t off, void *data) {
+  fill_unmapped_page(*pageref, 0, 0, PAGE_SIZE);
+}
+
+static void shm_object_resize(shm_object_t *obj, size_t size) {
+  mtx_assert(&obj->lock, MA_OWNED);
+  vm_file_t *file = obj->vm_file;
+  if (size > obj->size) {
+    if (page_align(size) > file->size) {
+      vm_file_resize(file, page_align(size));
+    }
+  } else if (size < obj->size) {
+    // the truncated range must read back as zeros if the object grows again
+    struct pgcache *cache = file->pgcache;
+    mtx_lock(&cache->lock);
+    if (!is_aligned(size, PAGE_SIZE)) {
+      page_t *page = pgcache_lookup(cache, page_trunc(size));
+      if (page != NULL) {
+        size_t pgoff = size % PAGE_SIZE;
+        fill_unmapped_page(page, 0, pgoff, PAGE_SIZE - pgoff);
+        pg_putref(&page);
+      }
+    }
+
+    size_t start = page_align(size);
+    size_t end = page_align(obj->size);
+    if (read_refcount(cache) == 1) {
+      // not mapped anywhere so the pages can be released
+      for (size_t off = start; off < end; off += PAGE_SIZE) {
+        pgcache_remove(cache, off, NULL);
+      }
+    } else {
+      // the pages are still mapped and cannot be pulled out from under the
+      // mappings, clear them instead
+      pgcache_visit_pages(cache, start, end, shm_zero_page_cb, NULL);
+    }
+    mtx_unlock(&cache->lock);
+  }
+  obj->size = size;
+}
+
+static size_t shm_rw_page(page_t *page, size_t pgoff, size_t len, kio_t *kio) {
+  // bound the transfer to len bytes
+  size_t size = kio->size;
+  kio->size = min(size, kio_transfered(kio) + len);
+  size_t n = rw_unmapped_page(page, pgoff, kio);
+  kio->size = size;
+  return n;
+}
+
+static ssize_t shm_object_read(shm_object_t *obj, size_t off, kio_t *kio) {
+  ssize_t res = 0;
+  size_t total = 0;
+  mtx_lock(&obj->lock);
+  while (off < obj->size && kio_remaining(kio) > 0) {
+    size_t pgoff = off % PAGE_SIZE;
+    size_t len = min(PAGE_SIZE - pgoff, obj->size - off);
+    page_t *page = vm_file_getpage(obj->vm_file, page_trunc(off));
+    if (page == NULL) {
+      res = -ENOMEM;
+      break;
+    }
+
+    size_t n = shm_rw_page(page, pgoff, len, kio);
+    pg_putref(&page);
+    total += n;
+    off += n;
+    if (n < len)
+      break;
+  }
+  mtx_unlock(&obj->lock);
+  return total > 0 ? (ssize_t) total : res;
+}
+
+static ssize_t shm_object_write(shm_object_t *obj, size_t off, kio_t *kio) {
+  ssize_t res = 0;
+  size_t total = 0;
+  mtx_lock(&obj->lock);
+  if (obj->seals & (F_SEAL_WRITE | F_SEAL_FUTURE_WRITE))
+    goto_res(ret, -EPERM);
+
+  size_t end = off + kio_remaining(kio);
+  if (end > obj->size) {
+    if (obj->seals & F_SEAL_GROW)
+      goto_res(ret, -EPERM);
+    if (end > SHM_MAX_SIZE)
+      goto_res(ret, -EFBIG);
+    shm_object_resize(obj, end);
+  }
+
+  while (off < end) {
+    size_t pgoff = off % PAGE_SIZE;
+    size_t len = min(PAGE_SIZE - pgoff, end - off);
+    page_t *page = vm_file_getpage(obj->vm_file, page_trunc(off));
+    if (page == NULL) {
+      res = -ENOMEM;
+      break;
+    }
+
+    size_t n = shm_rw_page(page, pgoff, len, kio);
+    pg_putref(&page);
+    total += n;
+    off += n;
+    if (n < len)
+      break;
+  }
+
+LABEL(ret);
+  mtx_unlock(&obj->lock);
+  return total > 0 ? (ssize_t) total : res;
+}
+
+//
+// MARK: memfd
+//
+
+static int memfd_f_open(file_t *file, int flags) {
+  ASSERT(F_ISMEMFD(file));
+  return 0;
+}
+
+static int memfd_f_close(file_t *file) {
+  ASSERT(F_ISMEMFD(file));
+  return 0;
+}
+
+static int memfd_f_allocate(file_t *file, off_t len) {
+  ASSERT(F_ISMEMFD(file));
+  shm_object_t *obj = file->data;
+  if (len < 0 || (size_t) len > SHM_MAX_SIZE)
+    return -EINVAL;
+
+  int res = 0;
+  mtx_lock(&obj->lock);
+  if ((size_t) len < obj->size && (obj->seals & F_SEAL_SHRINK)) {
+    res = -EPERM;
+  } else if ((size_t) len > obj->size && (obj->seals & F_SEAL_GROW)) {
+    res = -EPERM;
+  } else {
+    shm_object_resize(obj, (size_t) len);
+  }
+  mtx_unlock(&obj->lock);
+  return res;
+}
+
+static int memfd_f_getpage(file_t *file, off_t off, __move page_t **page) {
+  ASSERT(F_ISMEMFD(file));
+  shm_object_t *obj = file->data;
+  if (off < 0)
+    return -EINVAL;
+
+  int res = 0;
+  mtx_lock(&obj->lock);
+  if ((size_t) off >= obj->size) {
+    res = -EINVAL;
+  } else if ((*page = vm_file_getpage(obj->vm_file, page_trunc((size_t) off))) == NULL) {
+    res = -ENOMEM;
+  }
+  mtx_unlock(&obj->lock);
+  return res;
+}
+
+static ssize_t memfd_f_read(file_t *file, kio_t *kio) {
+  ASSERT(F_ISMEMFD(file));
+  ssize_t res = shm_object_read(file->data, (size_t) file->offset, kio);
+  if (res > 0)
+    file->offset += res;
+  return res;
+}
+
+static ssize_t memfd_f_write(file_t *file, kio_t *kio) {
+  ASSERT(F_ISMEMFD(file));
+  shm_object_t *obj = file->data;
+  if (file->flags & O_APPEND)
+    file->offset = (off_t) obj->size;
+
+  ssize_t res = shm_object_write(obj, (size_t) file->offset, kio);
+  if (res > 0)
+    file->offset += res;
+  return res;
+}
+
+static off_t memfd_f_lseek(file_t *file, off_t offset, int whence) {
+  ASSERT(F_ISMEMFD(file));
+  shm_object_t *obj = file->data;
+  off_t newoff;
+  switch (whence) {
+    case SEEK_SET:
+      newoff = offset;
+      break;
+    case SEEK_CUR:
+      newoff = file->offset + offset;
+      break;
+    case SEEK_END:
+      newoff = (off_t) obj->size + offset;
+      break;
+    default:
+      return -EINVAL;
+  }
+
+  if (newoff < 0)
+    return -EINVAL;
+  file->offset = newoff;
+  return newoff;
+}
+
+static int memfd_f_stat(file_t *file, struct stat *statbuf) {
+  ASSERT(F_ISMEMFD(file));
+  shm_object_t *obj = file->data;
+  memset(statbuf, 0, sizeof(struct stat));
+  statbuf->st_ino = (ino_t)(uintptr_t) obj; // use object address as inode
+  statbuf->st_mode = S_IFREG | 0777;
+  statbuf->st_nlink = 1;
+  statbuf->st_size = (off_t) obj->size;
+  statbuf->st_blksize = PAGE_SIZE;
+  statbuf->st_blocks = (blkcnt_t)(page_align(obj->size) / 512);
+  return 0;
+}
+
+static void memfd_f_cleanup(file_t *file) {
+  ASSERT(F_ISMEMFD(file));
+  shm_object_t *obj = moveptr(file->data);
+  shm_object_putref(&obj);
+}
+
+vm_file_t *memfd_get_vmfile(file_t *file, size_t off, size_t len, int mmap_flags, int prot) {
+  ASSERT(F_ISMEMFD(file));
+  shm_object_t *obj = file->data;
+  if (len == 0 || !is_aligned(off, PAGE_SIZE) || off + len > SHM_MAX_SIZE)
+    return NULL;
+
+  bool private = (mmap_flags & MAP_TYPE) == MAP_PRIVATE;
+  mtx_lock(&obj->lock);
+  if (!private && (prot & PROT_WRITE) && (obj->seals & (F_SEAL_WRITE | F_SEAL_FUTURE_WRITE))) {
+    mtx_unlock(&obj->lock);
+    return NULL;
+  }
+
+  size_t end = off + page_align(len);
+  if (end > obj->vm_file->size) {
+    vm_file_resize(obj->vm_file, end);
+  }
+  vm_file_t *vm_file = vm_file_alloc_copy(obj->vm_file);
+  mtx_unlock(&obj->lock);
+
+  vm_file->off = off;
+  vm_file->size = page_align(len);
+  if (private && (prot & PROT_WRITE)) {
+    // private writable mappings get their own copy of the cache
+    vm_file_t *shared = vm_file;
+    vm_file = vm_file_alloc_clone(shared);
+    vm_file_free(&shared);
+  }
+  return vm_file;
+}
+
+int memfd_add_seals(file_t *file, int seals) {
+  if (!F_ISMEMFD(file))
+    return -EINVAL;
+  if (seals & ~MEMFD_SEALS)
+    return -EINVAL;
+  if ((file->flags & O_ACCMODE) == O_RDONLY)
+    return -EPERM;
+
+  int res = 0;
+  shm_object_t *obj = file->data;
+  mtx_lock(&obj->lock);
+  if (obj->seals & F_SEAL_SEAL) {
+    res = -EPERM;
+  } else if ((seals & F_SEAL_WRITE) && !(obj->seals & F_SEAL_WRITE) && read_refcount(obj->vm_file->pgcache) > 1) {
+    // existing shared mappings could still write to the object. mappings are
+    // not told apart by protection so any mapping blocks the seal.
+    res = -EBUSY;
+  } else {
+    obj->seals |= seals;
+  }
+  mtx_unlock(&obj->lock);
+  return res;
+}
+
+int memfd_get_seals(file_t *file) {
+  if (!F_ISMEMFD(file))
+    return -EINVAL;
+
+  shm_object_t *obj = file->data;
+  mtx_lock(&obj->lock);
+  int seals = obj->seals;
+  mtx_unlock(&obj->lock);
+  return seals;
+}
+
+ssize_t memfd_kpread(file_t *file, kio_t *kio, off_t off) {
+  ASSERT(F_ISMEMFD(file));
+  return shm_object_read(file->data, (size_t) off, kio);
+}
+
+ssize_t memfd_kpwrite(file_t *file, kio_t *kio, off_t off) {
+  ASSERT(F_ISMEMFD(file));
+  return shm_object_write(file->data, (size_t) off, kio);
+}
+
+int memfd_create(const char *uname, unsigned int flags) {
+  if (flags & ~(MFD_CLOEXEC | MFD_ALLOW_SEALING))
+    return -EINVAL; // MFD_HUGETLB is not supported
+  if (vm_validate_ptr((uintptr_t) uname, /*write=*/false) < 0)
+    return -EFAULT;
+
+  size_t len = 0;
+  while (len <= MEMFD_NAME_MAX && uname[len] != '\0')
+    len++;
+  if (len > MEMFD_NAME_MAX)
+    return -EINVAL;
+
+  char name[MEMFD_NAME_MAX + 8];
+  ksnprintf(name, sizeof(name), "memfd:%s", uname);
+
+  proc_t *proc = curproc;
+  int fd = fs_proc_alloc_fd(proc);
+  if (fd < 0)
+    return -EMFILE;
+
+  shm_object_t *obj = shm_object_alloc(cstr_make(name), 0);
+  if (obj == NULL) {
+    fs_proc_free_fd(proc, fd);
+    return -ENOMEM;
+  }
+  // objects that were not created sealable can never be sealed
+  obj->seals = (flags & MFD_ALLOW_SEALING) ? 0 : F_SEAL_SEAL;
+
+  file_t *file = f_alloc(FT_MEMFD, O_RDWR, obj, &memfd_file_ops);
+  if (file == NULL) {
+    shm_object_putref(&obj);
+    fs_proc_free_fd(proc, fd);
+    return -ENOMEM;
+  }
+
+  f_lock(file);
+  int res = f_open(file, O_RDWR);
+  f_unlock(file);
+  if (res < 0) {
+    f_putref(&file);
+    fs_proc_free_fd(proc, fd);
+    return res;
+  }
+
+  int fdeflags = (flags & MFD_CLOEXEC) ? O_CLOEXEC : 0;
+  fd_entry_t *fde = fd_entry_alloc(fd, fdeflags, cstr_make(name), moveref(file));
+  if (fde == NULL) {
+    fs_proc_free_fd(proc, fd);
+    return -ENOMEM;
+  }
+  fs_proc_add_fdentry(proc, moveref(fde));
+
+  DPRINTF("memfd_create: fd=%d name=%s flags=%#x\n", fd, name, flags);
+  return fd;
+}
+
+//
+// MARK: System V shared memory
+//
+
+static inline size_t shm_seg_nattch(shm_segment_t *seg) {
+  // each attachment holds a copy of the object file
+  return read_refcount(seg->obj->vm_file->pgcache) - 1;
+}
+
+static shm_segment_t *shm_lookup_id(int id) {
+  mtx_assert(&shm_lock, MA_OWNED);
+  LIST_FOR_IN(seg, &shm_segments, link) {
+    if (seg->id == id && !seg->removed)
+      return seg;
+  }
+  return NULL;
+}
+
+static shm_segment_t *shm_lookup_key(key_t key) {
+  mtx_assert(&shm_lock, MA_OWNED);
+  LIST_FOR_IN(seg, &shm_segments, link) {
+    if (seg->ds.shm_perm.__ipc_perm_key == key && !seg->removed)
+      return seg;
+  }
+  return NULL;
+}
+
+// checks the mode bits of a segment against the caller. want holds the
+// permission bits to check in the low three bits (4 read, 2 write).
+static int shm_check_access(shm_segment_t *seg, int want) {
+  struct pcreds *creds = curproc->creds;
+  struct ipc_perm *perm = &seg->ds.shm_perm;
+  if (creds->euid == 0)
+    return 0;
+
+  int mode = perm->mode;
+  if (creds->euid == perm->uid || creds->euid == perm->cuid)
+    mode >>= 6;
+  else if (creds->egid == perm->gid || creds->egid == perm->cgid)
+    mode >>= 3;
+  return (mode & want) == want ? 0 : -EACCES;
+}
+
+// the owner or creator of a segment (or root) may change or remove it
+static inline bool shm_is_owner(shm_segment_t *seg) {
+  struct pcreds *creds = curproc->creds;
+  return creds->euid == 0 || creds->euid == seg->ds.shm_perm.uid || creds->euid == seg->ds.shm_perm.cuid;
+}
+
+static void shm_reap_segments() {
+  // free removed segments that are no longer attached anywhere
+  mtx_assert(&shm_lock, MA_OWNED);
+  LIST_FOR_IN_SAFE(seg, &shm_segments, link) {
+    if (!seg->removed || shm_seg_nattch(seg) > 0)
+      continue;
+
+    DPRINTF("freeing segment %d\n", seg->id);
+    LIST_REMOVE(&shm_segments, seg, link);
+    shm_nsegs--;
+    shm_object_putref(&seg->obj);
+    kfree(seg);
+  }
+}
+
+int shm_get(key_t key, size_t size, int shmflg) {
+  int res;
+  mtx_lock(&shm_lock);
+  shm_reap_segments();
+
+  shm_segment_t *seg = NULL;
+  if (key != IPC_PRIVATE && (seg = shm_lookup_key(key)) != NULL) {
+    if ((shmflg & IPC_CREAT) && (shmflg & IPC_EXCL))
+      goto_res(ret, -EEXIST);
+    // the requested mode bits of any class are checked against the caller
+    int want = ((shmflg >> 6) | (shmflg >> 3) | shmflg) & 06;
+    if ((res = shm_check_access(seg, want)) < 0)
+      goto ret;
+    if (size > seg->ds.shm_segsz)
+      goto_res(ret, -EINVAL);
+    goto_res(ret, seg->id);
+  }
+
+  if (key != IPC_PRIVATE && !(shmflg & IPC_CREAT))
+    goto_res(ret, -ENOENT);
+  if (size == 0 || size > SHM_MAX_SIZE)
+    goto_res(ret, -EINVAL);
+  if (shm_nsegs >= SHM_MAX_SEGS)
+    goto_res(ret, -ENOSPC);
+
+  char name[16];
+  ksnprintf(name, sizeof(name), "SYSV%08x", (unsigned) key);
+  shm_object_t *obj = shm_object_alloc(cstr_make(name), size);
+  seg = kmallocz(sizeof(shm_segment_t));
+  if (obj == NULL || seg == NULL) {
+    shm_object_putref(&obj);
+    kfree(seg);
+    goto_res(ret, -ENOMEM);
+  }
+
+  // ids are never reused while a segment is live
+  do {
+    shm_next_id = (shm_next_id + 1) & INT32_MAX;
+  } while (shm_lookup_id(shm_next_id) != NULL);
+
+  proc_t *proc = curproc;
+  seg->id = shm_next_id;
+  seg->obj = moveref(obj);
+  seg->ds.shm_perm.__ipc_perm_key = key;
+  seg->ds.shm_perm.uid = seg->ds.shm_perm.cuid = proc->creds->euid;
+  seg->ds.shm_perm.gid = seg->ds.shm_perm.cgid = proc->creds->egid;
+  seg->ds.shm_perm.mode = shmflg & 0777;
+  seg->ds.shm_segsz = size;
+  seg->ds.shm_ctime = shm_now();
+  seg->ds.shm_cpid = proc->pid;
+  LIST_ADD(&shm_segments, seg, link);
+  shm_nsegs++;
+
+  DPRINTF("shmget: created segment %d key=%#x size=%zu\n", seg->id, key, size);
+  res = seg->id;
+LABEL(ret);
+  mtx_unlock(&shm_lock);
+  return res;
+}
+
+void *shm_at(int shmid, const void *shmaddr, int shmflg) {
+  uintptr_t addr = (uintptr_t) shmaddr;
+  if (addr != 0 && !is_aligned(addr, SHMLBA)) {
+    if (!(shmflg & SHM_RND))
+      return (void *)(intptr_t) -EINVAL;
+    addr = align_down(addr, SHMLBA);
+  }
+
+  mtx_lock(&shm_lock);
+  shm_segment_t *seg = shm_lookup_id(shmid);
+  if (seg == NULL) {
+    mtx_unlock(&shm_lock);
+    return (void *)(intptr_t) -EINVAL;
+  }
+  int access = shm_check_access(seg, (shmflg & SHM_RDONLY) ? 04 : 06);
+  if (access < 0) {
+    mtx_unlock(&shm_lock);
+    return (void *)(intptr_t) access;
+  }
+
+  // the mapping gets its own file sharing the page cache of the segment
+  vm_file_t *vm_file = vm_file_alloc_copy(seg->obj->vm_file);
+  vm_file->size = page_align(seg->ds.shm_segsz);
+  seg->ds.shm_atime = shm_now();
+  seg->ds.shm_lpid = curproc->pid;
+  mtx_unlock(&shm_lock);
+
+  uint32_t vm_flags = VM_USER | VM_SHARED | VM_READ;
+  vm_flags |= (shmflg & SHM_RDONLY) ? 0 : VM_WRITE;
+  vm_flags |= (shmflg & SHM_EXEC) ? VM_EXEC : 0;
+  vm_flags |= addr != 0 ? VM_FIXED : 0;
+  uintptr_t res = vmap_file(vm_file, addr, 0, vm_flags, "shm");
+  if (res == 0) {
+    vm_file_free(&vm_file);
+    return (void *)(intptr_t) -ENOMEM;
+  }
+
+  DPRINTF("shmat: attached segment %d at %p\n", shmid, res);
+  return (void *) res;
+}
+
+int shm_dt(const void *shmaddr) {
+  struct pgcache *cache;
+  size_t size;
+  if (vmap_get_file((uintptr_t) shmaddr, &cache, &size) < 0)
+    return -EINVAL;
+
+  mtx_lock(&shm_lock);
+  shm_segment_t *seg = NULL;
+  LIST_FOR_IN(s, &shm_segments, link) {
+    if (s->obj->vm_file->pgcache == cache) {
+      seg = s;
+      break;
+    }
+  }
+  if (seg == NULL) {
+    mtx_unlock(&shm_lock);
+    return -EINVAL; // not an attached segment
+  }
+  seg->ds.shm_dtime = shm_now();
+  seg->ds.shm_lpid = curproc->pid;
+  mtx_unlock(&shm_lock);
+
+  int res = vmap_free((uintptr_t) shmaddr, size);
+
+  mtx_lock(&shm_lock);
+  shm_reap_segments();
+  mtx_unlock(&shm_lock);
+  return res;
+}
+
+int shm_ctl(int shmid, int cmd, struct shmid_ds *buf) {
+  int res = 0;
+  cmd &= ~IPC_64;
+  if ((cmd == IPC_STAT || cmd == SHM_STAT) && vm_validate_ptr((uintptr_t) buf, /*write=*/true) < 0)
+    return -EFAULT;
+  if (cmd == IPC_SET && vm_validate_ptr((uintptr_t) buf, /*write=*/false) < 0)
+    return -EFAULT;
+
+  mtx_lock(&shm_lock);
+  shm_segment_t *seg = shm_lookup_id(shmid);
+  if (seg == NULL)
+    goto_res(ret, -EINVAL);
+
+  switch (cmd) {
+    case IPC_STAT:
+    case SHM_STAT:
+      if ((res = shm_check_access(seg, 04)) < 0)
+        break;
+      seg->ds.shm_nattch = shm_seg_nattch(seg);
+      memcpy(buf, &seg->ds, sizeof(struct shmid_ds));
+      res = cmd == SHM_STAT ? seg->id : 0;
+      break;
+    case IPC_SET:
+      if (!shm_is_owner(seg))
+        goto_res(ret, -EPERM);
+      seg->ds.shm_perm.uid = buf->shm_perm.uid;
+      seg->ds.shm_perm.gid = buf->shm_perm.gid;
+      seg->ds.shm_perm.mode = (seg->ds.shm_perm.mode & ~0777) | (buf->shm_perm.mode & 0777);
+      seg->ds.shm_ctime = shm_now();
+      break;
+    case IPC_RMID:
+      if (!shm_is_owner(seg))
+        goto_res(ret, -EPERM);
+      // the segment can no longer be found by id or key, it is freed once
+      // the last attachment goes away
+      seg->removed = true;
+      seg->ds.shm_perm.mode |= SHM_DEST;
+      seg->ds.shm_ctime = shm_now();
+      shm_reap_segments();
+      break;
+    case SHM_LOCK:
+    case SHM_UNLOCK:
+      break; // shared memory is never paged out
+    default:
+      EPRINTF("unsupported command %d\n", cmd);
+      res = -EINVAL;
+      break;
+  }
+
+LABEL(ret);
+  mtx_unlock(&shm_lock);
+  return res;
+}
+
+SYSCALL_ALIAS(memfd_create, memfd_create);
+SYSCALL_ALIAS(shmget, shm_get);
+SYSCALL_ALIAS(shmat, shm_at);
+SYSCALL_ALIAS(shmdt, shm_dt);
+SYSCALL_ALIAS(shmctl, shm_ctl);
@@ -4,18 +4,21 @@
 
 #include <kernel/syscall.h>
 #include <kernel/cpu/trapframe.h>
+#include <kernel/trace.h>
 
 #include <kernel/panic.h>
 #include <kernel/printf.h>
 
 #include <abi/dirent.h>
 #include <abi/fcntl.h>
+#include <abi/io_uring.h>
 #include <abi/poll.h>
 #include <abi/resource.h>
 #include <abi/sched.h>
 #include <abi/stat.h>
 #include <abi/statfs.h>
 #include <abi/select.h>
+#include <abi/shm.h>
 #include <abi/signal.h>
 #include <abi/sysinfo.h>
 #include <abi/time.h>
@@ -78,5 +81,14 @@ _used uint64_t handle_syscall(uint64_t syscall, struct trapframe *frame) {
   // r10   arg4
   // r8    arg5
   // r9    arg6
-  return fn(frame->rdi, frame->rsi, frame->rdx, frame->r10, frame->r8, frame->r9);
+  TRACE_EVENT(SYSCALL, TRACE_SYSCALL_ENTER, syscall, frame->rdi, frame->rsi, frame->rdx);
+  uint64_t res = fn(frame->rdi, frame->rsi, frame->rdx, frame->r10, frame->r8, frame->r9);
+  TRACE_EVENT(SYSCALL, TRACE_SYSCALL_EXIT, syscall, res, 0, 0);
+  return res;
+}
+
+const char *syscall_name(uint64_t syscall) {
+  if (syscall >= ARRAY_SIZE(syscall_names) || syscall_names[syscall] == NULL)
+    return "unknown";
+  return syscall_names[syscall];
 }
@@ -0,0 +1,558 @@
+//
+// Created by Aaron Gill-Braun on 2026-10-18.
+//
+
+#include <kernel/trace.h>
+#include <kernel/atomic.h>
+#include <kernel/clock.h>
+#include <kernel/mm.h>
+#include <kernel/params.h>
+#include <kernel/proc.h>
+#include <kernel/string.h>
+#include <kernel/syscall.h>
+#include <kernel/cpu/cpu.h>
+
+#include <kernel/panic.h>
+#include <kernel/printf.h>
+
+#include <fs/procfs/procfs.h>
+
+#define ASSERT(x) kassert(x)
+#define LOG_TAG trace
+#include <kernel/log.h>
+#define EPRINTF(fmt, ...) kprintf("trace: %s: " fmt, __func__, ##__VA_ARGS__)
+
+#define TRACE_RING_SIZE 4096 // records per cpu (256KB)
+#define TRACE_RING_MASK (TRACE_RING_SIZE - 1)
+#define TRACE_TEXT_MAX  256  // longest formatted message
+#define TRACE_TEXT_LEN  sizeof(((struct trace_record *)0)->args) // text bytes per record
+
+/*
+ * A per-cpu trace ring.
+ *
+ * Writers reserve a position with an atomic add, so a record interrupted by
+ * another tracepoint on the same cpu (or written after the thread migrated)
+ * never shares a slot. The record's seq is cleared while it is written and
+ * set to position+1 last, which lets readers detect torn or overwritten
+ * records without taking any locks.
+ */
+struct trace_ring {
+  volatile uint64_t head;         // next position to write
+  volatile uint64_t tail;         // first position visible to readers
+  struct trace_record *records;
+};
+
+static struct trace_ring trace_rings[MAX_CPUS];
+volatile uint64_t trace_enabled_tags = 0;
+
+// timestamp reference for converting tsc values to uptime
+static uint64_t trace_base_tsc;
+static uint64_t trace_base_ns;
+
+KERNEL_PARAM("trace", str_t, trace_tags_param, str_null);
+LOAD_SECTION(__trace_log_tags_section, ".trace_log_tags");
+
+static const char *trace_tag_names[TRACE_TAG_MAX] = {
+  [TRACE_TAG_SCHED] = "sched",
+  [TRACE_TAG_FAULT] = "fault",
+  [TRACE_TAG_SYSCALL] = "syscall",
+  [TRACE_TAG_IRQ] = "irq",
+  [TRACE_TAG_ALARM] = "alarm",
+};
+
+static inline size_t trace_log_tag_count() {
+  return __trace_log_tags_section.size / sizeof(void *);
+}
+
+static inline struct trace_log_tag *trace_log_tag_at(size_t i) {
+  return ((struct trace_log_tag **) __trace_log_tags_section.virt_addr)[i];
+}
+
+// sets the switch of every file with the given log tag. returns false if
+// there is no such tag.
+static bool trace_log_tag_set(const char *name, size_t n, bool apply, bool enabled) {
+  bool found = false;
+  for (size_t i = 0; i < trace_log_tag_count(); i++) {
+    struct trace_log_tag *tag = trace_log_tag_at(i);
+    if (strlen(tag->name) == n && strncmp(tag->name, name, n) == 0) {
+      found = true;
+      if (apply)
+        tag->enabled = enabled;
+    }
+  }
+  return found;
+}
+
+static void trace_log_tag_set_all(bool enabled) {
+  for (size_t i = 0; i < trace_log_tag_count(); i++) {
+    trace_log_tag_at(i)->enabled = enabled;
+  }
+}
+
+static void trace_alloc_ring(uint32_t cpu) {
+  struct trace_ring *ring = &trace_rings[cpu];
+  if (atomic_load(&ring->records) != NULL)
+    return;
+
+  struct trace_record *records = vmalloc(TRACE_RING_SIZE * sizeof(struct trace_record), VM_RDWR);
+  if (records == NULL) {
+    EPRINTF("failed to allocate ring for cpu %u\n", cpu);
+    return;
+  }
+  memset(records, 0, TRACE_RING_SIZE * sizeof(struct trace_record));
+
+  struct trace_record *expected = NULL;
+  if (!__atomic_compare_exchange_n(&ring->records, &expected, records, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    vfree(records); // another cpu got here first
+  }
+}
+
+static void trace_alloc_rings() {
+  for (uint32_t cpu = 0; cpu < system_num_cpus; cpu++) {
+    trace_alloc_ring(cpu);
+  }
+}
+
+static int trace_parse_tags(const char *s, size_t len, uint64_t *mask, bool apply) {
+  // parses a list of tag names separated by spaces or commas. a name enables
+  // the tag, a '-' prefix disables it and 'all' or 'none' set every tag. the
+  // event tags are returned in mask and log tags are only set if apply is
+  // true, so the list can be checked before anything is changed.
+  uint64_t new_mask = *mask;
+  size_t i = 0;
+  while (i < len) {
+    while (i < len && (s[i] == ' ' || s[i] == ',' || s[i] == '\n' || s[i] == '\t'))
+      i++;
+    if (i == len)
+      break;
+
+    bool disable = false;
+    if (s[i] == '-' || s[i] == '+') {
+      disable = s[i] == '-';
+      i++;
+    }
+
+    size_t start = i;
+    while (i < len && s[i] != ' ' && s[i] != ',' && s[i] != '\n' && s[i] != '\t')
+      i++;
+    size_t n = i - start;
+    const char *name = s + start;
+
+    uint64_t bits;
+    if (n == 3 && strncmp(name, "all", 3) == 0) {
+      bits = (1ULL << TRACE_TAG_MAX) - 1;
+      if (apply)
+        trace_log_tag_set_all(!disable);
+    } else if (n == 4 && strncmp(name, "none", 4) == 0) {
+      new_mask = 0;
+      if (apply)
+        trace_log_tag_set_all(false);
+      continue;
+    } else {
+      int tag;
+      for (tag = 0; tag < TRACE_TAG_MAX; tag++) {
+        if (strlen(trace_tag_names[tag]) == n && strncmp(name, trace_tag_names[tag], n) == 0)
+          break;
+      }
+      if (tag == TRACE_TAG_MAX) {
+        // not an event tag so it must be a log tag
+        if (!trace_log_tag_set(name, n, apply, !disable))
+          return -EINVAL;
+        if (apply && !disable)
+          trace_alloc_rings();
+        continue;
+      }
+      bits = 1ULL << tag;
+    }
+
+    if (disable) {
+      new_mask &= ~bits;
+    } else {
+      new_mask |= bits;
+    }
+  }
+
+  *mask = new_mask;
+  return 0;
+}
+
+static inline uint64_t trace_tsc_to_ns(uint64_t tsc) {
+  if (cpu_tsc_khz == 0 || tsc < trace_base_tsc)
+    return trace_base_ns;
+  __uint128_t delta = (__uint128_t)(tsc - trace_base_tsc) * 1000000;
+  return trace_base_ns + (uint64_t)(delta / cpu_tsc_khz);
+}
+
+//
+
+static void trace_static_init() {
+  trace_base_tsc = __builtin_ia32_rdtsc();
+  trace_base_ns = clock_get_nanos();
+
+  if (!str_isnull(trace_tags_param)) {
+    const char *tags = str_cptr(trace_tags_param);
+    size_t len = str_len(trace_tags_param);
+    uint64_t mask = 0;
+    if (trace_parse_tags(tags, len, &mask, false) < 0) {
+      kprintf("trace: invalid trace parameter '{:str}'\n", &trace_tags_param);
+      return;
+    }
+    trace_parse_tags(tags, len, &mask, true);
+    trace_set_tags(mask);
+  }
+}
+STATIC_INIT(trace_static_init);
+
+static void trace_percpu_static_init() {
+  // cpus that come up after tracing was enabled allocate their own ring. the
+  // boot cpu ring is allocated up front if any tag was enabled.
+  if (trace_rings[0].records != NULL) {
+    trace_alloc_ring(curcpu_id);
+  }
+}
+PERCPU_STATIC_INIT(trace_percpu_static_init);
+
+//
+// MARK: Public API
+//
+
+static inline void trace_fill(struct trace_record *rec, uint64_t pos, uint64_t tsc, uint16_t event, uint32_t cpu,
+                              int32_t tid, const uint64_t args[5]) {
+  rec->seq = 0;
+  barrier();
+
+  rec->tsc = tsc;
+  rec->event = event;
+  rec->cpu = (uint16_t) cpu;
+  rec->tid = tid;
+  memcpy(rec->args, args, sizeof(rec->args));
+
+  barrier();
+  rec->seq = pos + 1;
+}
+
+void __trace_record(uint16_t event, uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4) {
+  uint32_t cpu = curcpu_id;
+  struct trace_ring *ring = &trace_rings[cpu];
+  struct trace_record *records = ring->records;
+  if (__expect_false(records == NULL))
+    return;
+
+  uint64_t pos = atomic_fetch_add(&ring->head, 1);
+  thread_t *td = curthread;
+  uint64_t args[5] = { a0, a1, a2, a3, a4 };
+  trace_fill(&records[pos & TRACE_RING_MASK], pos, __builtin_ia32_rdtsc(), event, cpu, td ? td->tid : 0, args);
+}
+
+void __trace_text(const char *fmt, ...) {
+  uint32_t cpu = curcpu_id;
+  struct trace_ring *ring = &trace_rings[cpu];
+  struct trace_record *records = ring->records;
+  if (__expect_false(records == NULL))
+    return;
+
+  char buf[TRACE_TEXT_MAX];
+  va_list valist;
+  va_start(valist, fmt);
+  size_t len = min(kvsnprintf(buf, sizeof(buf), fmt, valist), sizeof(buf) - 1);
+  va_end(valist);
+
+  // the message takes consecutive positions so it is read back in one piece
+  size_t count = max((len + TRACE_TEXT_LEN - 1) / TRACE_TEXT_LEN, 1);
+  uint64_t pos = atomic_fetch_add(&ring->head, count);
+  uint64_t tsc = __builtin_ia32_rdtsc();
+  thread_t *td = curthread;
+  for (size_t i = 0; i < count; i++) {
+    uint64_t args[5] = {0};
+    size_t off = i * TRACE_TEXT_LEN;
+    memcpy(args, buf + off, min(len - off, TRACE_TEXT_LEN));
+    trace_fill(&records[(pos + i) & TRACE_RING_MASK], pos + i, tsc, i == 0 ? TRACE_TEXT : TRACE_TEXT_CONT,
+               cpu, td ? td->tid : 0, args);
+  }
+}
+
+static inline bool trace_fmt_isalpha(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+// returns true if a format type takes a plain integer argument
+static bool trace_fmt_type_is_scalar(const char *type, size_t n) {
+  if (n == 3 && strncmp(type, "err", 3) == 0)
+    return true;
+  while (n > 1 && (*type == 'l' || *type == 'h' || *type == 'z')) {
+    type++;
+    n--;
+  }
+  return n == 1 && strchr("diubBoxXcpM", *type) != NULL;
+}
+
+bool trace_fmt_is_deferrable(const char *fmt) {
+  // a message can be formatted when the trace is read if every argument is
+  // an integer. strings and other pointed to data may be gone by then, and
+  // specifiers without a type are not known to be either.
+  for (const char *p = fmt; *p; p++) {
+    if (*p == '{') {
+      if (p[1] == '{') {
+        p++;
+        continue;
+      }
+      const char *end = strchr(p, '}');
+      if (end == NULL)
+        return false;
+      const char *type = end;
+      while (type > p && trace_fmt_isalpha(type[-1]))
+        type--;
+      if (!trace_fmt_type_is_scalar(type, end - type))
+        return false;
+      p = end;
+    } else if (*p == '%') {
+      if (p[1] == '%') {
+        p++;
+        continue;
+      }
+      p++;
+      while (*p && strchr("-+ #0123456789.*lhzjt", *p) != NULL)
+        p++;
+      if (*p == '\0' || strchr("diuxXobcp", *p) == NULL)
+        return false;
+    }
+  }
+  return true;
+}
+
+int trace_set_tags(uint64_t mask) {
+  if (mask & ~((1ULL << TRACE_TAG_MAX) - 1))
+    return -EINVAL;
+
+  if (mask != 0) {
+    trace_alloc_rings();
+  }
+  atomic_store(&trace_enabled_tags, mask);
+  return 0;
+}
+
+void trace_clear() {
+  for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+    struct trace_ring *ring = &trace_rings[cpu];
+    atomic_store(&ring->tail, atomic_load(&ring->head));
+  }
+}
+
+//
+// MARK: procfs
+//
+
+struct trace_snapshot {
+  struct trace_record *records;   // records from all cpus ordered by time
+  size_t count;
+  size_t size;                    // allocation size
+  uint64_t lost;                  // records overwritten before they were read
+};
+
+static struct trace_snapshot *trace_snapshot_take() {
+  size_t counts[MAX_CPUS] = {0};
+  size_t total = 0;
+  for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+    struct trace_ring *ring = &trace_rings[cpu];
+    if (ring->records != NULL) {
+      counts[cpu] = min(atomic_load(&ring->head) - atomic_load(&ring->tail), TRACE_RING_SIZE);
+      total += counts[cpu];
+    }
+  }
+
+  struct trace_snapshot *snap = kmallocz(sizeof(struct trace_snapshot));
+  if (total == 0)
+    return snap;
+
+  // copy out each ring, more records may be written in the meantime so
+  // only positions that are still intact are kept
+  size_t size = page_align(total * sizeof(struct trace_record));
+  struct trace_record *copy = vmalloc(size, VM_RDWR);
+  size_t starts[MAX_CPUS + 1] = {0};
+  size_t n = 0;
+  for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+    struct trace_ring *ring = &trace_rings[cpu];
+    starts[cpu] = n;
+    if (counts[cpu] == 0)
+      continue;
+
+    uint64_t head = atomic_load(&ring->head);
+    uint64_t start = max(head - min(head, TRACE_RING_SIZE), atomic_load(&ring->tail));
+    for (uint64_t pos = start; pos < head && n - starts[cpu] < counts[cpu]; pos++) {
+      struct trace_record *rec = &ring->records[pos & TRACE_RING_MASK];
+      uint64_t seq = atomic_load(&rec->seq);
+      barrier();
+      copy[n] = *rec;
+      barrier();
+      if (seq != pos + 1 || atomic_load(&rec->seq) != seq) {
+        snap->lost++;
+        continue;
+      }
+      n++;
+    }
+  }
+  starts[MAX_CPUS] = n;
+
+  // merge the per-cpu runs by timestamp
+  snap->size = size;
+  snap->records = vmalloc(size, VM_RDWR);
+  size_t cursor[MAX_CPUS];
+  memcpy(cursor, starts, sizeof(cursor));
+  for (size_t i = 0; i < n; i++) {
+    int best = -1;
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+      if (cursor[cpu] < starts[cpu + 1] && (best < 0 || copy[cursor[cpu]].tsc < copy[cursor[best]].tsc))
+        best = (int) cpu;
+    }
+    snap->records[i] = copy[cursor[best]++];
+  }
+  snap->count = n;
+  vfree(copy);
+  return snap;
+}
+
+static void trace_snapshot_free(struct trace_snapshot *snap) {
+  if (snap->records != NULL)
+    vfree(snap->records);
+  kfree(snap);
+}
+
+static void *trace_seq_start(seqfile_t *sf, off_t *pos) {
+  struct trace_snapshot *snap = sf->private;
+  if (snap == NULL) {
+    snap = trace_snapshot_take();
+    sf->private = snap;
+  }
+
+  if ((size_t) *pos >= snap->count)
+    return NULL;
+  return &snap->records[*pos];
+}
+
+static void trace_seq_stop(seqfile_t *sf, void *v) {
+}
+
+static void *trace_seq_next(seqfile_t *sf, void *v, off_t *pos) {
+  struct trace_snapshot *snap = sf->private;
+  (*pos)++;
+  if ((size_t) *pos >= snap->count)
+    return NULL;
+  return &snap->records[*pos];
+}
+
+static int trace_seq_show(seqfile_t *sf, void *v) {
+  struct trace_snapshot *snap = sf->private;
+  struct trace_record *rec = v;
+  if (rec == &snap->records[0] && snap->lost > 0) {
+    seq_printf(sf, "# %llu records lost\n", snap->lost);
+  }
+
+  if (rec->event == TRACE_TEXT_CONT)
+    return 0; // shown with the record it continues
+
+  uint64_t ns = trace_tsc_to_ns(rec->tsc);
+  uint64_t *a = rec->args;
+  seq_printf(sf, "[%5llu.%06llu] cpu%u tid %-4d ", ns / NS_PER_SEC, (ns % NS_PER_SEC) / 1000, rec->cpu, rec->tid);
+
+  switch (rec->event) {
+    case TRACE_SCHED_SWITCH:
+      return seq_printf(sf, "sched_switch: prev=%d next=%d reason=%llu\n", (int) a[0], (int) a[1], a[2]);
+    case TRACE_PAGE_FAULT:
+      return seq_printf(sf, "page_fault: addr=%#llx error=%#llx rip=%#llx\n", a[0], a[1], a[2]);
+    case TRACE_SYSCALL_ENTER:
+      return seq_printf(sf, "syscall_enter: %s(%#llx, %#llx, %#llx)\n", syscall_name(a[0]), a[1], a[2], a[3]);
+    case TRACE_SYSCALL_EXIT:
+      return seq_printf(sf, "syscall_exit: %s = %lld\n", syscall_name(a[0]), (int64_t) a[1]);
+    case TRACE_IRQ_ENTER:
+      return seq_printf(sf, "irq_enter: vector=%llu\n", a[0]);
+    case TRACE_IRQ_EXIT:
+      return seq_printf(sf, "irq_exit: vector=%llu\n", a[0]);
+    case TRACE_ALARM_EXPIRE:
+      return seq_printf(sf, "alarm_expire: id=%llu expires=%llu late=%lluns\n", a[0], a[1], a[2]);
+    case TRACE_PRINTF: {
+      char buf[TRACE_TEXT_MAX];
+      ksnprintf(buf, sizeof(buf), (const char *) a[0], a[1], a[2], a[3], a[4]);
+      size_t len = strlen(buf);
+      return seq_printf(sf, "%s%s", buf, (len > 0 && buf[len - 1] == '\n') ? "" : "\n");
+    }
+    case TRACE_TEXT: {
+      // join the text of the records that follow it. a part that was lost
+      // ends the message early.
+      char buf[TRACE_TEXT_MAX + TRACE_TEXT_LEN + 1];
+      size_t len = 0;
+      memcpy(buf, a, TRACE_TEXT_LEN);
+      len += TRACE_TEXT_LEN;
+      for (size_t i = (rec - snap->records) + 1; i < snap->count && len <= TRACE_TEXT_MAX; i++) {
+        struct trace_record *next = &snap->records[i];
+        if (next->event != TRACE_TEXT_CONT || next->cpu != rec->cpu || next->seq != rec->seq + (len / TRACE_TEXT_LEN))
+          break;
+        memcpy(buf + len, next->args, TRACE_TEXT_LEN);
+        len += TRACE_TEXT_LEN;
+      }
+      buf[len] = '\0';
+      len = strlen(buf);
+      return seq_printf(sf, "%s%s", buf, (len > 0 && buf[len - 1] == '\n') ? "" : "\n");
+    }
+    default:
+      return seq_printf(sf, "event %u: %#llx %#llx %#llx %#llx\n", rec->event, a[0], a[1], a[2], a[3]);
+  }
+}
+
+static ssize_t trace_seq_write(seqfile_t *sf, off_t off, kio_t *kio) {
+  // any write clears the trace
+  trace_clear();
+  return (ssize_t) kio_remaining(kio);
+}
+
+static void trace_seq_cleanup(seqfile_t *sf) {
+  struct trace_snapshot *snap = sf->private;
+  if (snap != NULL) {
+    trace_snapshot_free(snap);
+    sf->private = NULL;
+  }
+}
+
+static struct seq_ops trace_seq_ops = {
+  .start = trace_seq_start,
+  .stop = trace_seq_stop,
+  .next = trace_seq_next,
+  .show = trace_seq_show,
+  .write = trace_seq_write,
+  .cleanup = trace_seq_cleanup,
+};
+PROCFS_REGISTER_SEQFILE(trace, "/trace", &trace_seq_ops, 0644);
+
+static int trace_tags_show(seqfile_t *sf, void *data) {
+  uint64_t mask = trace_enabled_tags;
+  for (int tag = 0; tag < TRACE_TAG_MAX; tag++) {
+    seq_printf(sf, "%-8s %s\n", trace_tag_names[tag], (mask & (1ULL << tag)) ? "on" : "off");
+  }
+
+  // log tags of the files built with DPRINTF enabled, each listed once
+  size_t count = trace_log_tag_count();
+  for (size_t i = 0; i < count; i++) {
+    struct trace_log_tag *tag = trace_log_tag_at(i);
+    size_t j;
+    for (j = 0; j < i && strcmp(trace_log_tag_at(j)->name, tag->name) != 0; j++);
+    if (j == i) {
+      seq_printf(sf, "%-8s %s (log)\n", tag->name, tag->enabled ? "on" : "off");
+    }
+  }
+  return 0;
+}
+
+static ssize_t trace_tags_write(seqfile_t *sf, off_t off, kio_t *kio) {
+  char buf[128];
+  size_t len = kio_read_out(buf, min(kio_remaining(kio), sizeof(buf)), 0, kio);
+
+  uint64_t mask = trace_enabled_tags;
+  int res;
+  if ((res = trace_parse_tags(buf, len, &mask, false)) < 0)
+    return res;
+  mask = trace_enabled_tags;
+  trace_parse_tags(buf, len, &mask, true);
+  if ((res = trace_set_tags(mask)) < 0)
+    return res;
+  return (ssize_t) len;
+}
+PROCFS_REGISTER_SIMPLE(trace_tags, "/trace_tags", trace_tags_show, trace_tags_write, 0644);
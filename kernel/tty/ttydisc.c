@@ -16,6 +16,8 @@
 #define EPRINTF(fmt, ...) kprintf("tty_disc: %s: " fmt, __func__, ##__VA_ARGS__)
 
 #define TAB_WIDTH 8
+#define WRITE_CHUNK 512             // bytes taken from a writer at a time
+#define OPROC_MAX_EXPAND TAB_WIDTH  // most bytes written for one processed char
 
 // control characters that should be echoed
 #define CTL_ECHO(c, q)	(!(q) && ((c) == '\t' || (c) == '\n' || (c) == '\r' || (c) == 0x8))
@@ -54,22 +56,21 @@ static int ttydisc_write_oproc(tty_t *tty, char ch) {
   switch (ch) {
     case '\t': {
       // expand tab to spaces
-      for (size_t i = 0; i < TAB_WIDTH; i++) {
-        res = ttyoutq_write_ch(tty->outq, ' ');
-        if (res < 0) {
-          return res;
-        }
+      static const char spaces[TAB_WIDTH] = "        ";
+      if (ttyoutq_write_buf(tty->outq, spaces, TAB_WIDTH) < TAB_WIDTH) {
+        return -1;
       }
       tty->column += TAB_WIDTH;
+      res = 0;
       break;
     }
     case '\n': {
       // newline conversion
       if (t->c_oflag & ONLCR) {
         // convert NL to CRLF
-        res = ttyoutq_write_ch(tty->outq, '\r');
+        res = ttyoutq_space(tty->outq) >= 2 ? 0 : -1;
         if (res == 0)
-          res = ttyoutq_write_ch(tty->outq, '\n');
+          ttyoutq_write_buf(tty->outq, "\r\n", 2);
       } else {
         res = ttyoutq_write_ch(tty->outq, '\n');
       }
@@ -117,6 +118,80 @@ static int ttydisc_write_oproc(tty_t *tty, char ch) {
   return res;
 }
 
+// characters which are changed by output processing
+static inline bool ttydisc_oproc_special(char ch) {
+  return ch == '\t' || ch == '\n' || ch == '\r';
+}
+
+// updates the column after a run of characters written without processing
+static void ttydisc_update_column(tty_t *tty, const char *buf, size_t len) {
+  size_t i = len;
+  while (i > 0 && buf[i - 1] != '\n' && buf[i - 1] != '\r') {
+    i--;
+  }
+  if (i > 0) {
+    tty->column = 0;
+  }
+
+  for (; i < len; i++) {
+    if (buf[i] == '\t') {
+      tty->column += TAB_WIDTH;
+    } else if (buf[i] >= 0x20 && buf[i] < 0x7f) {
+      tty->column++;
+    }
+  }
+}
+
+// writes a buffer with output processing. runs of characters that need no
+// processing are copied as a block. the queue must have room for the buffer
+// after processing.
+static int ttydisc_write_oproc_buf(tty_t *tty, const char *buf, size_t len) {
+  size_t start = 0;
+  uint32_t printable = 0;
+  for (size_t i = 0; i < len; i++) {
+    char ch = buf[i];
+    if (!ttydisc_oproc_special(ch)) {
+      if (ch >= 0x20 && ch < 0x7f)
+        printable++;
+      continue;
+    }
+
+    ttyoutq_write_buf(tty->outq, buf + start, i - start);
+    tty->column += printable;
+    printable = 0;
+    start = i + 1;
+
+    int res = ttydisc_write_oproc(tty, ch);
+    if (res < 0) {
+      return res;
+    }
+  }
+
+  ttyoutq_write_buf(tty->outq, buf + start, len - start);
+  tty->column += printable;
+  return 0;
+}
+
+// waits until the output queue has room for at least `space` bytes
+static int ttydisc_wait_outq(tty_t *tty, size_t space) {
+  while (ttyoutq_space(tty->outq) < space) {
+    if (tty->flags & TTYF_NONBLOCK) {
+      return -EAGAIN; // non-blocking mode, return immediately
+    }
+
+    // wakeup the ttydev to try and make space in the buffer
+    tty->dev_ops->tty_outwakeup(tty);
+    if (ttyoutq_space(tty->outq) < space) {
+      // that didn't work, we need to wait for space in the output queue
+      int res;
+      if ((res = tty_wait_cond(tty, &tty->outready_cond)) < 0) {
+        return res; // device is gone
+      }
+    }
+  }
+  return 0;
+}
+
 //
 
 void ttydisc_open(tty_t *tty) {
@@ -141,7 +216,7 @@ size_t ttydisc_bytesavail(tty_t *tty) {
     return ttyinq_canonbytes(tty->inq);
   } else {
     // raw mode: return the number of bytes available in the input queue
-    return tty->inq->write_pos - tty->inq->read_pos;
+    return ttyinq_linebytes(tty->inq);
   }
 }
 
@@ -338,6 +413,25 @@ void ttydisc_rint_done(tty_t *tty) {
   }
 }
 
+bool ttydisc_can_bypass(tty_t *tty) {
+  struct termios *t = &tty->termios;
+  // input goes straight into the queue when no input processing, signals,
+  // line editing or echo is enabled
+  return !(t->c_iflag & (ISTRIP | IGNCR | ICRNL | INLCR | IXON | PARMRK)) &&
+         !(t->c_lflag & (ISIG | ICANON | ECHO | ECHONL));
+}
+
+size_t ttydisc_rint_bypass(tty_t *tty, const void *buf, size_t len) {
+  tty_assert_owned(tty);
+  ASSERT(ttydisc_can_bypass(tty));
+
+  size_t n = ttyinq_write_buf(tty->inq, buf, len, /*quote=*/false);
+  if (n > 0) {
+    ttyinq_canonizalize(tty->inq);
+  }
+  return n;
+}
+
 static ssize_t ttydisc_read_canonical(tty_t *tty, kio_t *kio) {
   struct termios *t = &tty->termios;
   char cbreak[4] = {0};
@@ -504,12 +598,33 @@ ssize_t	ttydisc_write(tty_t *tty, kio_t *kio) {
   size_t initial_remaining = kio_remaining(kio);
   DPRINTF("ttydisc_write: writing %zu bytes to TTY\n", initial_remaining);
 
-  char ch;
-  while (kio_read_ch(&ch, kio) > 0) {
-    int res = ttydisc_do_write_ch(tty, ch);
+  // the data is taken in chunks that are sure to fit in the output queue once
+  // processed so that no characters are lost when it fills up. without OPOST
+  // the chunks are copied into the queue as they are.
+  bool oproc = t->c_oflag & OPOST;
+  size_t expand = oproc ? OPROC_MAX_EXPAND : 1;
+  char buf[WRITE_CHUNK];
+  while (kio_remaining(kio) > 0) {
+    int res = ttydisc_wait_outq(tty, expand);
     if (res < 0) {
+      if (kio_transfered(kio) > 0)
+        break; // report the partial write
       return res;
     }
+
+    size_t len = min(sizeof(buf), ttyoutq_space(tty->outq) / expand);
+    len = kio_read_out(buf, len, 0, kio);
+    if (len == 0) {
+      break;
+    }
+
+    if (oproc) {
+      res = ttydisc_write_oproc_buf(tty, buf, len);
+      ASSERT(res == 0);
+    } else {
+      ttyoutq_write_buf(tty->outq, buf, len);
+      ttydisc_update_column(tty, buf, len);
+    }
   }
 
   if ((t->c_cflag & CLOCAL) || (tty->flags & TTYF_DCDRDY)) {
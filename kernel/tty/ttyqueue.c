@@ -4,6 +4,7 @@
 
 #include <kernel/tty/ttyqueue.h>
 #include <kernel/mm.h>
+#include <kernel/string.h>
 
 #include <kernel/printf.h>
 #include <kernel/panic.h>
@@ -71,7 +72,7 @@ static int tty_queue_setsize(size_t size, size_t *data_size, uintptr_t *data_buf
 
     if (quote_buf != NULL) {
       ASSERT(*quote_buf == NULL);
-      *quote_buf = kmallocz(quotesz);
+      *quote_buf = kmallocz(quotesz * sizeof(uint32_t));
     }
   }
   return 0;
@@ -85,6 +86,25 @@ static int tty_queue_setsize(size_t size, size_t *data_size, uintptr_t *data_buf
 #define INQ_QUOTE_SET(inq, pos) ((inq)->quote_buf[(pos) / 32] |= (1U << ((pos) % 32)))
 #define INQ_QUOTE_CLEAR(inq, pos) ((inq)->quote_buf[(pos) / 32] &= ~(1U << ((pos) % 32)))
 
+// sets or clears the quote bits of len characters starting at pos
+static void ttyinq_set_quote(struct ttyinq *inq, uint32_t pos, size_t len, bool quote) {
+  while (len > 0 && (pos % 32) != 0) {
+    if (quote) INQ_QUOTE_SET(inq, pos); else INQ_QUOTE_CLEAR(inq, pos);
+    pos++;
+    len--;
+  }
+  while (len >= 32) {
+    inq->quote_buf[pos / 32] = quote ? UINT32_MAX : 0;
+    pos += 32;
+    len -= 32;
+  }
+  while (len > 0) {
+    if (quote) INQ_QUOTE_SET(inq, pos); else INQ_QUOTE_CLEAR(inq, pos);
+    pos++;
+    len--;
+  }
+}
+
 
 struct ttyinq *ttyinq_alloc() {
   struct ttyinq *inq = kmallocz(sizeof(struct ttyinq));
@@ -160,34 +180,51 @@ int ttyinq_write_ch(struct ttyinq *inq, char ch, bool quote) {
   // write the character to the buffer
   uintptr_t buf_addr = inq->data_buf + inq->write_pos;
   *(char *)buf_addr = ch;
-  inq->write_pos = (inq->write_pos + 1) % inq->data_size;
   if (quote) {
     INQ_QUOTE_SET(inq, inq->write_pos);
   } else {
     INQ_QUOTE_CLEAR(inq, inq->write_pos);
   }
+  inq->write_pos = (inq->write_pos + 1) % inq->data_size;
 
   return 0;
 }
 
+size_t ttyinq_write_buf(struct ttyinq *inq, const void *buf, size_t len, bool quote) {
+  ASSERT(inq != NULL);
+  ASSERT(inq->data_size > 0);
+
+  // copy in at most two runs, up to the end of the buffer and then from the start
+  size_t total = 0;
+  len = min(len, ttyinq_space(inq));
+  while (total < len) {
+    size_t n = min(len - total, inq->data_size - inq->write_pos);
+    memcpy((void *)(inq->data_buf + inq->write_pos), buf + total, n);
+    ttyinq_set_quote(inq, inq->write_pos, n, quote);
+    inq->write_pos = (inq->write_pos + n) % inq->data_size;
+    total += n;
+  }
+  return total;
+}
+
 ssize_t ttyinq_write(struct ttyinq *inq, kio_t *kio, bool quote) {
   ASSERT(inq != NULL);
   ASSERT(inq->data_size > 0);
 
-  size_t bytes_written = 0;
-  while (kio->size > 0 && (inq->write_pos + 1) % inq->data_size != inq->read_pos) {
-    // write the next character to the queue
-    char ch;
-    if (kio_read_ch(&ch, kio) <= 0) {
+  size_t total = 0;
+  size_t len = min(kio_remaining(kio), ttyinq_space(inq));
+  while (total < len) {
+    size_t n = min(len - total, inq->data_size - inq->write_pos);
+    n = kio_nread_out((void *) inq->data_buf, inq->data_size, inq->write_pos, n, kio);
+    if (n == 0) {
       break; // no more characters to write
     }
 
-    if (ttyinq_write_ch(inq, ch, quote) < 0) {
-      return -1; // error writing to the queue
-    }
-    bytes_written++;
+    ttyinq_set_quote(inq, inq->write_pos, n, quote);
+    inq->write_pos = (inq->write_pos + n) % inq->data_size;
+    total += n;
   }
-  return (ssize_t) bytes_written;
+  return (ssize_t) total;
 }
 
 ssize_t ttyinq_read(struct ttyinq *inq, kio_t *kio, size_t n) {
@@ -196,15 +233,16 @@ ssize_t ttyinq_read(struct ttyinq *inq, kio_t *kio, size_t n) {
   ASSERT(n > 0);
 
   size_t bytes_read = 0;
-  while (kio_remaining(kio) > 0 && inq->read_pos != inq->write_pos && bytes_read < n) {
-    // get the next character from the queue
-    uintptr_t buf_addr = inq->data_buf + inq->read_pos;
-    inq->read_pos = (inq->read_pos + 1) % inq->data_size;
-    char ch = *((char *)buf_addr);
-    if (kio_write_ch(kio, ch) < 0) {
-      return (ssize_t) bytes_read; // no more space
+  n = min(n, ttyinq_linebytes(inq));
+  while (bytes_read < n) {
+    size_t len = min(n - bytes_read, inq->data_size - inq->read_pos);
+    len = kio_nwrite_in(kio, (void *) inq->data_buf, inq->data_size, inq->read_pos, len);
+    if (len == 0) {
+      break; // no more space
     }
-    bytes_read++;
+
+    inq->read_pos = (inq->read_pos + len) % inq->data_size;
+    bytes_read += len;
   }
   return (ssize_t) bytes_read;
 }
@@ -214,13 +252,9 @@ size_t ttyinq_drop(struct ttyinq *inq, size_t n) {
   ASSERT(inq->data_size > 0);
   ASSERT(n > 0);
 
-  size_t bytes_dropped = 0;
-  while (n-- > 0 && inq->read_pos != inq->write_pos) {
-    // drop the next character from the queue
-    inq->read_pos = (inq->read_pos + 1) % inq->data_size;
-    bytes_dropped++;
-  }
-  return bytes_dropped;
+  n = min(n, ttyinq_linebytes(inq));
+  inq->read_pos = (inq->read_pos + n) % inq->data_size;
+  return n;
 }
 
 int ttyinq_del_ch(struct ttyinq *inq) {
@@ -347,24 +381,38 @@ int ttyoutq_get_ch(struct ttyoutq *outq) {
   return ch;
 }
 
-int ttyoutq_read(struct ttyoutq *outq, kio_t *kio) {
+size_t ttyoutq_read_buf(struct ttyoutq *outq, void *buf, size_t len) {
   ASSERT(outq != NULL);
   ASSERT(outq->data_size > 0);
 
-  size_t n = kio_remaining(kio);
-  while (n > 0 && outq->read_pos != outq->write_pos) {
-    // get the next character from the queue
-    uintptr_t buf_addr = outq->data_buf + outq->read_pos;
-    char ch = *(char *)buf_addr;
-    outq->read_pos = (outq->read_pos + 1) % outq->data_size;
+  size_t total = 0;
+  len = min(len, ttyoutq_bytes(outq));
+  while (total < len) {
+    size_t n = min(len - total, outq->data_size - outq->read_pos);
+    memcpy(buf + total, (void *)(outq->data_buf + outq->read_pos), n);
+    outq->read_pos = (outq->read_pos + n) % outq->data_size;
+    total += n;
+  }
+  return total;
+}
+
+int ttyoutq_read(struct ttyoutq *outq, kio_t *kio) {
+  ASSERT(outq != NULL);
+  ASSERT(outq->data_size > 0);
 
-    if (kio_write_ch(kio, ch) < 0) {
+  size_t len = min(kio_remaining(kio), ttyoutq_bytes(outq));
+  while (len > 0) {
+    size_t n = min(len, outq->data_size - outq->read_pos);
+    n = kio_nwrite_in(kio, (void *) outq->data_buf, outq->data_size, outq->read_pos, n);
+    if (n == 0) {
       return -1; // error writing to kio
     }
-    n--;
+
+    outq->read_pos = (outq->read_pos + n) % outq->data_size;
+    len -= n;
   }
 
-  if (n == 0 && outq->read_pos != outq->write_pos) {
+  if (outq->read_pos != outq->write_pos) {
     // we still have characters left in the queue, but kio is full
     return -EAGAIN;
   }
@@ -391,25 +439,39 @@ int ttyoutq_write_ch(struct ttyoutq *outq, char ch) {
   return 0;
 }
 
+size_t ttyoutq_write_buf(struct ttyoutq *outq, const void *buf, size_t len) {
+  ASSERT(outq != NULL);
+  ASSERT(outq->data_size > 0);
+
+  size_t total = 0;
+  len = min(len, ttyoutq_space(outq));
+  while (total < len) {
+    size_t n = min(len - total, outq->data_size - outq->write_pos);
+    memcpy((void *)(outq->data_buf + outq->write_pos), buf + total, n);
+    outq->write_pos = (outq->write_pos + n) % outq->data_size;
+    total += n;
+  }
+  return total;
+}
+
 int ttyoutq_write(struct ttyoutq *outq, kio_t *kio) {
   ASSERT(outq != NULL);
   ASSERT(outq->data_size > 0)
 
   size_t bytes_written = 0;
-  while (kio->size > 0 && (outq->write_pos + 1) % outq->data_size != outq->read_pos) {
-    // write the next character to the queue
-    char ch;
-    if (kio_read_ch(&ch, kio) <= 0) {
+  size_t len = min(kio_remaining(kio), ttyoutq_space(outq));
+  while (bytes_written < len) {
+    size_t n = min(len - bytes_written, outq->data_size - outq->write_pos);
+    n = kio_nread_out((void *) outq->data_buf, outq->data_size, outq->write_pos, n, kio);
+    if (n == 0) {
       break; // no more characters to write
     }
 
-    if (ttyoutq_write_ch(outq, ch) < 0) {
-      return -1; // error writing to the queue
-    }
-    bytes_written++;
+    outq->write_pos = (outq->write_pos + n) % outq->data_size;
+    bytes_written += n;
   }
 
-  if (bytes_written == 0 && outq->write_pos != outq->read_pos) {
+  if (bytes_written == 0 && kio_remaining(kio) > 0) {
     // we still have characters left in the kio, but the queue is full
     return -EAGAIN;
   }
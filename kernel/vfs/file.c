@@ -14,7 +14,6 @@
 #include <kernel/printf.h>
 
 #include <bitmap.h>
-#include <rb_tree_v2.h>
 
 #include <kernel/mm/pool.h>
 
@@ -25,6 +24,9 @@
 
 #define FTABLE_LOCK(ftable) mtx_spin_lock(&(ftable)->lock)
 #define FTABLE_UNLOCK(ftable) mtx_spin_unlock(&(ftable)->lock)
+#define FTABLE_LOCK_ASSERT(ftable) mtx_assert(&(ftable)->lock, MA_OWNED)
+
+#define FTABLE_INITIAL_FILES 64
 
 static pool_t *file_pool;
 static pool_t *fd_entry_pool;
@@ -34,26 +36,49 @@ extern struct file_ops vnode_file_ops;
 
 #include <kernel/pty.h>
 
+/*
+ * An array of fd entries indexed by fd.
+ *
+ * The array is replaced with a larger copy when the table grows. Lookups may
+ * still be reading the old array so retired arrays are kept on the table's
+ * retired list until the table is freed. The array only grows by doubling up
+ * to FTABLE_MAX_FILES so at most a few are ever retired.
+ */
+struct fdarray {
+  size_t size;
+  LIST_ENTRY(struct fdarray) link;
+  fd_entry_t *volatile entries[];
+};
+
 typedef struct ftable {
-  rb_tree_v2_t tree;
-  bitmap_t *bitmap;
-  size_t count;
-  mtx_t lock;
+  struct fdarray *volatile fds; // current fd array
+  bitmap_t *bitmap;             // allocated fds
+  size_t count;                 // number of entries
+  mtx_t lock;                   // serializes table updates
+  LIST_HEAD(struct fdarray) retired;
 } ftable_t;
 
-static int fd_cmp(const rb_node_v2_t *a, const rb_node_v2_t *b) {
-  fd_entry_t *fa = container_of(a, fd_entry_t, fd_node);
-  fd_entry_t *fb = container_of(b, fd_entry_t, fd_node);
-  if (fa->fd < fb->fd) return -1;
-  if (fa->fd > fb->fd) return 1;
-  return 0;
+static struct fdarray *fdarray_alloc(size_t size) {
+  struct fdarray *fds = kmallocz(sizeof(struct fdarray) + size * sizeof(fd_entry_t *));
+  fds->size = size;
+  return fds;
 }
 
-static int fd_key_cmp(uint64_t key, const rb_node_v2_t *b) {
-  fd_entry_t *fb = container_of(b, fd_entry_t, fd_node);
-  if ((int)key < fb->fd) return -1;
-  if ((int)key > fb->fd) return 1;
-  return 0;
+static void ftable_grow(ftable_t *ftable, size_t min_size) {
+  FTABLE_LOCK_ASSERT(ftable);
+  struct fdarray *old = ftable->fds;
+  if (min_size <= old->size)
+    return;
+
+  size_t size = old->size;
+  while (size < min_size)
+    size *= 2;
+  size = min(size, FTABLE_MAX_FILES);
+
+  struct fdarray *fds = fdarray_alloc(size);
+  memcpy((void *) fds->entries, (void *) old->entries, old->size * sizeof(fd_entry_t *));
+  atomic_store(&ftable->fds, fds);
+  LIST_ADD(&ftable->retired, old, link);
 }
 
 //
@@ -286,7 +311,7 @@ void _f_cleanup(__move file_t **fref) {
 
 ftable_t *ftable_alloc() {
   ftable_t *ftable = kmallocz(sizeof(ftable_t));
-  rb_tree_v2_init(&ftable->tree, fd_cmp, fd_key_cmp);
+  ftable->fds = fdarray_alloc(FTABLE_INITIAL_FILES);
   ftable->bitmap = create_bitmap(FTABLE_MAX_FILES);
   mtx_init(&ftable->lock, MTX_SPIN, "ftable_lock");
   return ftable;
@@ -294,19 +319,20 @@ ftable_t *ftable_alloc() {
 
 ftable_t *ftable_clone(ftable_t *ftable) {
   ftable_t *clone = kmallocz(sizeof(ftable_t));
-  rb_tree_v2_init(&clone->tree, fd_cmp, fd_key_cmp);
   mtx_init(&clone->lock, MTX_SPIN, "ftable_lock");
 
   FTABLE_LOCK(ftable);
+  struct fdarray *fds = ftable->fds;
+  clone->fds = fdarray_alloc(fds->size);
   clone->bitmap = clone_bitmap(ftable->bitmap);
 
-  rb_node_v2_t *rb = rb_tree_v2_first(&ftable->tree);
-  while (rb) {
-    fd_entry_t *fde = container_of(rb, fd_entry_t, fd_node);
-    fd_entry_t *dup = fde_dup(fde, -1);
-    rb_tree_v2_insert(&clone->tree, &dup->fd_node);
+  for (size_t i = 0; i < fds->size; i++) {
+    fd_entry_t *fde = fds->entries[i];
+    if (fde == NULL)
+      continue;
+
+    clone->fds->entries[i] = fde_dup(fde, -1);
     clone->count++;
-    rb = rb_tree_v2_next(rb);
   }
 
   FTABLE_UNLOCK(ftable);
@@ -316,6 +342,14 @@ ftable_t *ftable_clone(ftable_t *ftable) {
 void ftable_free(ftable_t **ftablep) {
   ftable_t *ftable = moveref(*ftablep);
   ASSERT(ftable->count == 0);
+
+  // nothing can be looking up entries anymore so the retired arrays can go
+  struct fdarray *fds;
+  while ((fds = LIST_FIRST(&ftable->retired)) != NULL) {
+    LIST_REMOVE(&ftable->retired, fds, link);
+    kfree(fds);
+  }
+  kfree(ftable->fds);
   bitmap_free(ftable->bitmap);
   kfree(ftable);
 }
@@ -362,24 +396,44 @@ void ftable_free_fd(ftable_t *ftable, int fd) {
 }
 
 __ref fd_entry_t *ftable_get_entry(ftable_t *ftable, int fd) {
-  FTABLE_LOCK(ftable);
-  rb_node_v2_t *n = rb_tree_v2_find(&ftable->tree, (uint64_t)fd);
-  fd_entry_t *fde = n ? container_of(n, fd_entry_t, fd_node) : NULL;
-  fde = fde_getref(fde);
-  FTABLE_UNLOCK(ftable);
-  return fde;
+  // lookups do not take the table lock. the entry is loaded from the current
+  // array and a reference is only taken if the entry is still live. since fd
+  // entries come from a pool the memory stays an fd_entry_t even if it has
+  // been freed and reused in the meantime, so after taking the reference we
+  // check that the slot still holds the same entry and retry if it does not.
+  if (fd < 0)
+    return NULL;
+
+  while (true) {
+    struct fdarray *fds = atomic_load(&ftable->fds);
+    if ((size_t) fd >= fds->size)
+      return NULL;
+
+    fd_entry_t *fde = atomic_load(&fds->entries[fd]);
+    if (fde == NULL)
+      return NULL;
+    if (!ref_tryget(&fde->refcount))
+      continue; // entry was closed, reload the slot
+
+    if (__expect_true(atomic_load(&ftable->fds) == fds && atomic_load(&fds->entries[fd]) == fde))
+      return fde;
+    fde_putref(&fde);
+  }
 }
 
 __ref fd_entry_t *ftable_get_remove_entry(ftable_t *ftable, int fd) {
+  if (fd < 0)
+    return NULL;
+
   FTABLE_LOCK(ftable);
-  rb_node_v2_t *n = rb_tree_v2_find(&ftable->tree, (uint64_t)fd);
-  if (n == NULL) {
+  struct fdarray *fds = ftable->fds;
+  fd_entry_t *fde = (size_t) fd < fds->size ? fds->entries[fd] : NULL;
+  if (fde == NULL) {
     FTABLE_UNLOCK(ftable);
     return NULL;
   }
 
-  fd_entry_t *fde = container_of(n, fd_entry_t, fd_node);
-  rb_tree_v2_remove(&ftable->tree, n);
+  atomic_store(&fds->entries[fd], NULL);
   ftable->count--;
   FTABLE_UNLOCK(ftable);
   return fde;
@@ -388,10 +442,12 @@ __ref fd_entry_t *ftable_get_remove_entry(ftable_t *ftable, int fd) {
 void ftable_add_entry(ftable_t *ftable, __ref fd_entry_t *fde) {
   ASSERT(fde->fd >= 0 && fde->fd < FTABLE_MAX_FILES);
   FTABLE_LOCK(ftable);
-  if (rb_tree_v2_find(&ftable->tree, (uint64_t)fde->fd) != NULL) {
+  ftable_grow(ftable, (size_t) fde->fd + 1);
+  struct fdarray *fds = ftable->fds;
+  if (fds->entries[fde->fd] != NULL) {
     panic("entry already exists");
   }
-  rb_tree_v2_insert(&ftable->tree, &fde->fd_node);
+  atomic_store(&fds->entries[fde->fd], fde);
   bitmap_set(ftable->bitmap, (index_t) fde->fd);
   ftable->count++;
   FTABLE_UNLOCK(ftable);
@@ -401,10 +457,11 @@ void ftable_close_exec(ftable_t *ftable) {
   // close directory streams and files opened with the O_CLOEXEC flag
   FTABLE_LOCK(ftable);
 
-  rb_node_v2_t *rb = rb_tree_v2_first(&ftable->tree);
-  while (rb) {
-    rb_node_v2_t *next = rb_tree_v2_next(rb);
-    fd_entry_t *fde = container_of(rb, fd_entry_t, fd_node);
+  struct fdarray *fds = ftable->fds;
+  for (size_t i = 0; i < fds->size; i++) {
+    fd_entry_t *fde = fds->entries[i];
+    if (fde == NULL)
+      continue;
 
     // check flags under lock
     mtx_lock(&fde->lock);
@@ -412,7 +469,6 @@ void ftable_close_exec(ftable_t *ftable) {
     mtx_unlock(&fde->lock);
 
     if (!should_close) {
-      rb = next;
       continue;
     }
 
@@ -425,13 +481,11 @@ void ftable_close_exec(ftable_t *ftable) {
       f_unlock(file);
     }
 
-    rb_tree_v2_remove(&ftable->tree, rb);
+    atomic_store(&fds->entries[i], NULL);
     bitmap_clear(ftable->bitmap, (index_t) fde->fd);
     ftable->count--;
     fde->fd = -1;
     fde_putref(&fde);
-
-    rb = next;
   }
 
   FTABLE_UNLOCK(ftable);
@@ -441,10 +495,11 @@ void ftable_close_all(ftable_t *ftable) {
   // close all files in the file table
   FTABLE_LOCK(ftable);
 
-  rb_node_v2_t *rb = rb_tree_v2_first(&ftable->tree);
-  while (rb) {
-    rb_node_v2_t *next = rb_tree_v2_next(rb);
-    fd_entry_t *fde = container_of(rb, fd_entry_t, fd_node);
+  struct fdarray *fds = ftable->fds;
+  for (size_t i = 0; i < fds->size; i++) {
+    fd_entry_t *fde = fds->entries[i];
+    if (fde == NULL)
+      continue;
 
     DPRINTF("close_all: closing file descriptor {:d} <{:str}>\n", fde->fd, &fde->real_path);
 
@@ -455,12 +510,10 @@ void ftable_close_all(ftable_t *ftable) {
       f_unlock(file);
     }
 
-    rb_tree_v2_remove(&ftable->tree, rb);
+    atomic_store(&fds->entries[i], NULL);
     bitmap_clear(ftable->bitmap, (index_t) fde->fd);
     ftable->count--;
     fde_putref(&fde);
-
-    rb = next;
   }
 
   FTABLE_UNLOCK(ftable);
@@ -678,6 +731,8 @@ struct filter_ops file_filter_ops = {
 
 void vnode_static_init() {
   file_pool = pool_create("file", pool_sizes(sizeof(file_t)), 0);
+  // ftable_get_entry relies on fd entry memory staying type-stable which holds
+  // because pool slabs are only released when the pool is destroyed
   fd_entry_pool = pool_create("fd_entry", pool_sizes(sizeof(fd_entry_t)), 0);
   register_filter_ops(EVFILT_READ, &file_filter_ops);
   register_filter_ops(EVFILT_WRITE, &file_filter_ops);
@@ -12,6 +12,8 @@
 #include <kernel/kio.h>
 #include <kernel/time.h>
 #include <kernel/clock.h>
+#include <kernel/io_uring.h>
+#include <kernel/shm.h>
 
 #include <kernel/vfs/file.h>
 #include <kernel/vfs/pipe.h>
@@ -266,6 +268,9 @@ int fs_unmount(cstr_t path) {
     goto_res(ret, -EINVAL);
   }
 
+  // drop cached components so they dont pin entries of the unmounted fs
+  vcache_invalidate_children(NULL);
+
   // unmount the vfs
   if ((res = vfs_unmount(vfs, mount_ve)) < 0) {
     EPRINTF("failed to unmount fs\n");
@@ -484,20 +489,32 @@ vm_file_t *fs_get_vmfile(int fd, size_t off, size_t len, int mmap_flags, int pro
   if (fde == NULL)
     return NULL;
 
+  vm_file_t *vm_file;
   file_t *file = fde->file;
+  if (F_ISIOURING(file)) {
+    // io_uring ring fds map the shared ring pages
+    vm_file = io_uring_get_vmfile(file, off, len);
+    fde_putref(&fde);
+    return vm_file;
+  }
+  if (F_ISMEMFD(file)) {
+    // memfd mappings share the object page cache
+    vm_file = memfd_get_vmfile(file, off, len, mmap_flags, prot);
+    fde_putref(&fde);
+    return vm_file;
+  }
   if (file->type != FT_VNODE)
     return NULL; // not a vnode file
   if (!f_lock(file))
     return NULL; // file is closed
 
   vnode_t *vn = file->data;
-  vm_file_t *vm_file;
 
   // to prevent sharing modified pages between processes
   if ((mmap_flags & 0x0F) == 0x02 && (prot & 0x02)) {  // MAP_PRIVATE and PROT_WRITE
-    kprintf("fs: fs_get_vmfile: MAP_PRIVATE+WRITE detected, cloning page cache (mmap_flags=0x%x, prot=0x%x)\n", mmap_flags, prot);
+    // pages are copied from the shared page cache on the first write
     vm_file_t *shared = vm_file_alloc_vnode(vn_getref(vn), off, len);
-    vm_file = vm_file_alloc_clone(shared);
+    vm_file = vm_file_alloc_cow(shared);
     vm_file_free(&shared);
   } else {
     vm_file = vm_file_alloc_vnode(vn_getref(vn), off, len);
@@ -633,7 +650,8 @@ ssize_t fs_writev(int fd, const struct iovec *iov, int iovcnt) {
   return fs_kwrite(fd, &kio);
 }
 
-ssize_t fs_pread(int fd, void *buf, size_t len, off_t offset) {
+ssize_t fs_kpread(int fd, kio_t *kio, off_t offset) {
+  ASSERT(kio->dir == KIO_WRITE);
   if (offset < 0)
     return -EINVAL;
 
@@ -641,29 +659,36 @@ ssize_t fs_pread(int fd, void *buf, size_t len, off_t offset) {
   if (fde == NULL)
     return -EBADF;
 
+  // positional reads never touch the file offset so they do not take the
+  // file lock. the fd entry reference keeps the file and vnode alive and
+  // the vnode data lock is all that is needed to read from it.
   ssize_t res;
   file_t *file = fde->file;
-  if (!f_lock(file))
+  if (atomic_load(&file->closed))
     goto_res(ret, -EBADF);
   if (file->flags & O_WRONLY)
-    goto_res(ret_unlock, -EBADF);
+    goto_res(ret, -EBADF);
+  if (F_ISMEMFD(file))
+    goto_res(ret, memfd_kpread(file, kio, offset));
   if (file->type != FT_VNODE)
-    goto_res(ret_unlock, -ESPIPE);
+    goto_res(ret, -ESPIPE);
 
   vnode_t *vn = file->data;
-  kio_t kio = kio_new_writable(buf, len);
-  vn_begin_data_read(vn);
-  res = vn_read(vn, offset, &kio);
+  if (V_ISDIR(vn))
+    goto_res(ret, -EISDIR);
+  if (!vn_begin_data_read(vn))
+    goto_res(ret, -EIO); // vnode is dead
+
+  res = vn_read(vn, offset, kio);
   vn_end_data_read(vn);
 
-LABEL(ret_unlock);
-  f_unlock(file);
 LABEL(ret);
   fde_putref(&fde);
   return res;
 }
 
-ssize_t fs_pwrite(int fd, const void *buf, size_t len, off_t offset) {
+ssize_t fs_kpwrite(int fd, kio_t *kio, off_t offset) {
+  ASSERT(kio->dir == KIO_READ);
   if (offset < 0)
     return -EINVAL;
 
@@ -673,26 +698,55 @@ ssize_t fs_pwrite(int fd, const void *buf, size_t len, off_t offset) {
 
   ssize_t res;
   file_t *file = fde->file;
-  if (!f_lock(file))
+  if (atomic_load(&file->closed))
     goto_res(ret, -EBADF);
   if (file->flags & O_RDONLY)
-    goto_res(ret_unlock, -EBADF);
+    goto_res(ret, -EBADF);
+  if (F_ISMEMFD(file))
+    goto_res(ret, memfd_kpwrite(file, kio, offset));
   if (file->type != FT_VNODE)
-    goto_res(ret_unlock, -ESPIPE);
+    goto_res(ret, -ESPIPE);
 
   vnode_t *vn = file->data;
-  kio_t kio = kio_new_readable(buf, len);
-  vn_begin_data_write(vn);
-  res = vn_write(vn, offset, &kio);
+  if (V_ISDIR(vn))
+    goto_res(ret, -EISDIR);
+  if (!vn_begin_data_write(vn))
+    goto_res(ret, -EIO); // vnode is dead
+
+  res = vn_write(vn, offset, kio);
   vn_end_data_write(vn);
 
-LABEL(ret_unlock);
-  f_unlock(file);
 LABEL(ret);
   fde_putref(&fde);
   return res;
 }
 
+ssize_t fs_pread(int fd, void *buf, size_t len, off_t offset) {
+  kio_t kio = kio_new_writable(buf, len);
+  return fs_kpread(fd, &kio, offset);
+}
+
+ssize_t fs_pwrite(int fd, const void *buf, size_t len, off_t offset) {
+  kio_t kio = kio_new_readable(buf, len);
+  return fs_kpwrite(fd, &kio, offset);
+}
+
+ssize_t fs_preadv(int fd, const struct iovec *iov, int iovcnt, off_t offset) {
+  if (iovcnt <= 0)
+    return -EINVAL;
+
+  kio_t kio = kio_new_writablev(iov, (uint32_t) iovcnt);
+  return fs_kpread(fd, &kio, offset);
+}
+
+ssize_t fs_pwritev(int fd, const struct iovec *iov, int iovcnt, off_t offset) {
+  if (iovcnt <= 0)
+    return -EINVAL;
+
+  kio_t kio = kio_new_readablev(iov, (uint32_t) iovcnt);
+  return fs_kpwrite(fd, &kio, offset);
+}
+
 ssize_t fs_readdir(int fd, void *dirp, size_t len) {
   ssize_t res;
   fd_entry_t *fde = ftable_get_entry(FTABLE, fd);
@@ -827,6 +881,13 @@ int fs_fcntl(int fd, int cmd, unsigned long arg) {
       res = 0;
       break;
     }
+    /* file sealing */
+    case F_ADD_SEALS:
+      res = memfd_add_seals(fde->file, (int)arg);
+      break;
+    case F_GET_SEALS:
+      res = memfd_get_seals(fde->file);
+      break;
     /* file/record locking */
     case F_GETLK:
     case F_SETLK:
@@ -1024,6 +1085,364 @@ LABEL(fail);
   return res;
 }
 
+//
+// MARK: Splice
+//
+
+#define SPLICE_BOUNCE_SIZE PIPE_BUFFER_SIZE
+
+struct splice_out {
+  file_t *file;
+  off_t *offset;  // offset for positional writes (NULL to use the file offset)
+};
+
+static ssize_t splice_file_write(file_t *file, off_t *offset, kio_t *kio) {
+  if (offset != NULL) {
+    vnode_t *vn = file->data;
+    if (!vn_begin_data_write(vn))
+      return -EIO; // vnode is dead
+
+    ssize_t res = vn_write(vn, *offset, kio);
+    vn_end_data_write(vn);
+    if (res > 0)
+      *offset += res;
+    return res;
+  }
+
+  bool needs_flock = !F_ISPIPE(file) && !F_ISSOCK(file);
+  if (needs_flock && !f_lock(file))
+    return -EBADF; // file is closed
+
+  ssize_t res = f_write(file, kio);
+  if (needs_flock)
+    f_unlock(file);
+  return res;
+}
+
+static ssize_t splice_write_actor(void *data, const void *buf, size_t len) {
+  struct splice_out *out = data;
+  kio_t kio = kio_new_readable(buf, len);
+  return splice_file_write(out->file, out->offset, &kio);
+}
+
+static int splice_check_out(file_t *file, off_t *offset) {
+  if (atomic_load(&file->closed))
+    return -EBADF;
+  int accmode = file->flags & O_ACCMODE;
+  if (accmode != O_WRONLY && accmode != O_RDWR)
+    return -EBADF;
+  if (file->flags & O_APPEND)
+    return -EINVAL;
+  if (offset != NULL && (file->type != FT_VNODE || !V_ISREG((vnode_t *)file->data)))
+    return -ESPIPE;
+  if (offset != NULL && *offset < 0)
+    return -EINVAL;
+  return 0;
+}
+
+static int splice_check_in(file_t *file, off_t *offset) {
+  if (atomic_load(&file->closed))
+    return -EBADF;
+  int accmode = file->flags & O_ACCMODE;
+  if (accmode != O_RDONLY && accmode != O_RDWR)
+    return -EBADF;
+  if (file->type != FT_VNODE || !V_ISREG((vnode_t *)file->data))
+    return -EINVAL;
+  if (offset != NULL && *offset < 0)
+    return -EINVAL;
+  return 0;
+}
+
+static off_t splice_begin_offset(file_t *file, off_t *offset) {
+  if (offset != NULL)
+    return *offset;
+
+  f_lock(file);
+  off_t off = file->offset;
+  f_unlock(file);
+  return off;
+}
+
+static void splice_end_offset(file_t *file, off_t *offset, off_t off) {
+  if (offset != NULL) {
+    *offset = off;
+    return;
+  }
+
+  f_lock(file);
+  file->offset = off;
+  f_unlock(file);
+}
+
+static ssize_t splice_file_to_pipe(file_t *in, off_t *offset, file_t *out, size_t len, bool nonblock) {
+  // file pages are added to the pipe by reference without copying them.
+  // files that do not support getpage are read into the pipe instead.
+  vnode_t *vn = in->data;
+  off_t off = splice_begin_offset(in, offset);
+  ssize_t total = 0;
+  void *bounce = NULL;
+  while ((size_t) total < len) {
+    size_t size = vn->size;
+    if ((size_t) off >= size)
+      break; // eof
+
+    size_t pgoff = off & (PAGE_SIZE - 1);
+    size_t n = min(min(len - total, PAGE_SIZE - pgoff), size - off);
+    ssize_t res;
+
+    page_t *page = NULL;
+    if (F_OPS(in)->f_getpage && F_OPS(in)->f_getpage(in, (off_t) page_trunc(off), &page) == 0) {
+      res = pipe_add_page(out, page, pgoff, n, nonblock || total > 0);
+      pg_putref(&page);
+    } else {
+      if (bounce == NULL)
+        bounce = kmalloc(PAGE_SIZE);
+
+      kio_t kio = kio_new_writable(bounce, n);
+      if (!vn_begin_data_read(vn)) {
+        res = -EIO;
+      } else {
+        res = vn_read(vn, off, &kio);
+        vn_end_data_read(vn);
+      }
+      if (res > 0) {
+        kio = kio_new_readable(bounce, res);
+        res = pipe_f_write(out, &kio);
+      }
+    }
+
+    if (res <= 0) {
+      if (total == 0)
+        total = res;
+      break;
+    }
+    off += res;
+    total += res;
+  }
+
+  if (total > 0)
+    splice_end_offset(in, offset, off);
+  kfree(bounce);
+  return total;
+}
+
+ssize_t fs_splice(int fd_in, off_t *off_in, int fd_out, off_t *off_out, size_t len, unsigned int flags) {
+  if (flags & ~(SPLICE_F_MOVE | SPLICE_F_NONBLOCK | SPLICE_F_MORE | SPLICE_F_GIFT))
+    return -EINVAL;
+  if (len == 0)
+    return 0;
+
+  fd_entry_t *in_fde = ftable_get_entry(FTABLE, fd_in);
+  if (in_fde == NULL)
+    return -EBADF;
+  fd_entry_t *out_fde = ftable_get_entry(FTABLE, fd_out);
+  if (out_fde == NULL) {
+    fde_putref(&in_fde);
+    return -EBADF;
+  }
+
+  ssize_t res;
+  file_t *in = in_fde->file;
+  file_t *out = out_fde->file;
+  bool nonblock = (flags & SPLICE_F_NONBLOCK) != 0;
+  if (F_ISPIPE(in) && F_ISPIPE(out)) {
+    if (off_in != NULL || off_out != NULL)
+      goto_res(ret, -ESPIPE);
+    res = pipe_splice_move(in, out, len, nonblock, /*consume=*/true);
+  } else if (F_ISPIPE(in)) {
+    if (off_in != NULL)
+      goto_res(ret, -ESPIPE);
+    if ((res = splice_check_out(out, off_out)) < 0)
+      goto ret;
+
+    struct splice_out sout = { .file = out, .offset = off_out };
+    res = pipe_splice_read(in, len, nonblock, splice_write_actor, &sout);
+  } else if (F_ISPIPE(out)) {
+    if (off_out != NULL)
+      goto_res(ret, -ESPIPE);
+    if ((res = splice_check_in(in, off_in)) < 0)
+      goto ret;
+
+    res = splice_file_to_pipe(in, off_in, out, len, nonblock);
+  } else {
+    res = -EINVAL; // one end must be a pipe
+  }
+
+LABEL(ret);
+  fde_putref(&out_fde);
+  fde_putref(&in_fde);
+  return res;
+}
+
+ssize_t fs_tee(int fd_in, int fd_out, size_t len, unsigned int flags) {
+  if (flags & ~(SPLICE_F_MOVE | SPLICE_F_NONBLOCK | SPLICE_F_MORE | SPLICE_F_GIFT))
+    return -EINVAL;
+  if (len == 0)
+    return 0;
+
+  fd_entry_t *in_fde = ftable_get_entry(FTABLE, fd_in);
+  if (in_fde == NULL)
+    return -EBADF;
+  fd_entry_t *out_fde = ftable_get_entry(FTABLE, fd_out);
+  if (out_fde == NULL) {
+    fde_putref(&in_fde);
+    return -EBADF;
+  }
+
+  ssize_t res;
+  if (!F_ISPIPE(in_fde->file) || !F_ISPIPE(out_fde->file)) {
+    res = -EINVAL;
+  } else {
+    bool nonblock = (flags & SPLICE_F_NONBLOCK) != 0;
+    res = pipe_splice_move(in_fde->file, out_fde->file, len, nonblock, /*consume=*/false);
+  }
+
+  fde_putref(&out_fde);
+  fde_putref(&in_fde);
+  return res;
+}
+
+static ssize_t vmsplice_to_pipe(file_t *file, const struct iovec *iov, size_t nr_segs, bool nonblock) {
+  // the pages of the user buffers are added to the pipe by reference. as on
+  // linux the caller must leave the buffers alone until the data is read. huge
+  // pages cannot be referenced one page at a time so their data is copied.
+  ssize_t total = 0;
+  for (size_t i = 0; i < nr_segs; i++) {
+    uintptr_t base = (uintptr_t) iov[i].iov_base;
+    size_t seglen = iov[i].iov_len;
+    size_t done = 0;
+    while (done < seglen) {
+      uintptr_t addr = base + done;
+      size_t pgoff = addr & (PAGE_SIZE - 1);
+      size_t n = min(seglen - done, PAGE_SIZE - pgoff);
+      if (addr >= USER_SPACE_END || vm_validate_ptr(addr, /*write=*/false) < 0)
+        return total > 0 ? total : -EFAULT;
+
+      ssize_t res;
+      page_t *page = vm_getpage(page_trunc(addr));
+      if (page != NULL && pg_flags_to_size(page->flags) == PAGE_SIZE) {
+        res = pipe_add_page(file, page, pgoff, n, nonblock || total > 0);
+      } else {
+        kio_t kio = kio_new_readable((void *) addr, n);
+        res = pipe_f_write(file, &kio);
+      }
+      pg_putref(&page);
+
+      if (res <= 0)
+        return total > 0 ? total : res;
+      done += res;
+      total += res;
+      if ((size_t) res < n)
+        return total;
+    }
+  }
+  return total;
+}
+
+ssize_t fs_vmsplice(int fd, const struct iovec *iov, size_t nr_segs, unsigned int flags) {
+  // writing the pipe passes it references to the user pages, reading it
+  // copies the data out like a regular read of the pipe
+  if (flags & ~(SPLICE_F_MOVE | SPLICE_F_NONBLOCK | SPLICE_F_MORE | SPLICE_F_GIFT))
+    return -EINVAL;
+  if (nr_segs == 0)
+    return 0;
+
+  fd_entry_t *fde = ftable_get_entry(FTABLE, fd);
+  if (fde == NULL)
+    return -EBADF;
+
+  ssize_t res;
+  file_t *file = fde->file;
+  if (!F_ISPIPE(file))
+    goto_res(ret, -EBADF);
+
+  int accmode = file->flags & O_ACCMODE;
+  if (accmode == O_WRONLY) {
+    res = vmsplice_to_pipe(file, iov, nr_segs, (flags & SPLICE_F_NONBLOCK) != 0);
+  } else {
+    kio_t kio = kio_new_writablev(iov, (uint32_t) nr_segs);
+    res = pipe_f_read(file, &kio);
+  }
+
+LABEL(ret);
+  fde_putref(&fde);
+  return res;
+}
+
+ssize_t fs_sendfile(int out_fd, int in_fd, off_t *offset, size_t count) {
+  if (count == 0)
+    return 0;
+
+  fd_entry_t *in_fde = ftable_get_entry(FTABLE, in_fd);
+  if (in_fde == NULL)
+    return -EBADF;
+  fd_entry_t *out_fde = ftable_get_entry(FTABLE, out_fd);
+  if (out_fde == NULL) {
+    fde_putref(&in_fde);
+    return -EBADF;
+  }
+
+  ssize_t res;
+  file_t *in = in_fde->file;
+  file_t *out = out_fde->file;
+  if ((res = splice_check_in(in, offset)) < 0)
+    goto ret;
+  if ((res = splice_check_out(out, NULL)) < 0)
+    goto ret;
+
+  if (F_ISPIPE(out)) {
+    // pages are passed to the pipe by reference
+    res = splice_file_to_pipe(in, offset, out, count, false);
+    goto ret;
+  }
+
+  // read the file straight into a kernel buffer and write it out from there
+  // without a round trip through userspace
+  vnode_t *vn = in->data;
+  void *bounce = kmalloc(SPLICE_BOUNCE_SIZE);
+  off_t off = splice_begin_offset(in, offset);
+  ssize_t total = 0;
+  while ((size_t) total < count) {
+    size_t n = min(count - total, SPLICE_BOUNCE_SIZE);
+    kio_t kio = kio_new_writable(bounce, n);
+    ssize_t nread;
+    if (!vn_begin_data_read(vn)) {
+      nread = -EIO;
+    } else {
+      nread = vn_read(vn, off, &kio);
+      vn_end_data_read(vn);
+    }
+    if (nread <= 0) {
+      if (total == 0)
+        total = nread;
+      break;
+    }
+
+    kio = kio_new_readable(bounce, nread);
+    ssize_t nwritten = splice_file_write(out, NULL, &kio);
+    if (nwritten <= 0) {
+      if (total == 0)
+        total = nwritten;
+      break;
+    }
+
+    off += nwritten;
+    total += nwritten;
+    if (nwritten < nread)
+      break;
+  }
+
+  if (total > 0)
+    splice_end_offset(in, offset, off);
+  kfree(bounce);
+  res = total;
+
+LABEL(ret);
+  fde_putref(&out_fde);
+  fde_putref(&in_fde);
+  return res;
+}
+
 int fs_poll(struct pollfd *fds, size_t nfds, struct timespec *timeout) {
   int res;
 
@@ -1689,6 +2108,37 @@ DEFINE_SYSCALL(utimensat, int, int dfd, const char *filename, struct timespec *u
   return fs_utimensat(dfd, cstr_make(filename), utimes, flags);
 }
 
+DEFINE_SYSCALL(preadv, ssize_t, unsigned long fd, const struct iovec *vec, unsigned long vlen, unsigned long pos_l, unsigned long pos_h) {
+  // on 64-bit the whole offset is passed in pos_l
+  return fs_preadv((int) fd, vec, (int) vlen, (off_t) pos_l);
+}
+
+DEFINE_SYSCALL(pwritev, ssize_t, unsigned long fd, const struct iovec *vec, unsigned long vlen, unsigned long pos_l, unsigned long pos_h) {
+  return fs_pwritev((int) fd, vec, (int) vlen, (off_t) pos_l);
+}
+
+DEFINE_SYSCALL(splice, long, int fd_in, loff_t *off_in, int fd_out, loff_t *off_out, size_t len, unsigned int flags) {
+  if (off_in != NULL && vm_validate_ptr((uintptr_t) off_in, /*write=*/true) < 0)
+    return -EFAULT;
+  if (off_out != NULL && vm_validate_ptr((uintptr_t) off_out, /*write=*/true) < 0)
+    return -EFAULT;
+  return fs_splice(fd_in, off_in, fd_out, off_out, len, flags);
+}
+
+DEFINE_SYSCALL(tee, long, int fdin, int fdout, size_t len, unsigned int flags) {
+  return fs_tee(fdin, fdout, len, flags);
+}
+
+DEFINE_SYSCALL(vmsplice, long, int fd, const struct iovec *iov, unsigned long nr_segs, unsigned int flags) {
+  return fs_vmsplice(fd, iov, nr_segs, flags);
+}
+
+DEFINE_SYSCALL(sendfile, ssize_t, int out_fd, int in_fd, off_t *offset, size_t count) {
+  if (offset != NULL && vm_validate_ptr((uintptr_t) offset, /*write=*/true) < 0)
+    return -EFAULT;
+  return fs_sendfile(out_fd, in_fd, offset, count);
+}
+
 DEFINE_SYSCALL(truncate, int, const char *path, off_t length) {
   return fs_truncate(cstr_make(path), length);
 }
@@ -11,6 +11,7 @@
 #include <kernel/proc.h>
 #include <kernel/mm.h>
 #include <kernel/mm/pool.h>
+#include <kernel/mm/pgtable.h>
 
 #include <kernel/panic.h>
 #include <kernel/printf.h>
@@ -44,12 +45,130 @@ struct file_ops pipe_file_ops = {
   .f_cleanup = pipe_f_cleanup,
 };
 
+//
+// pipe buffers
+//
+
+#define PIPE_MAP_SIZE (PIPE_MAX_BUFS * PAGE_SIZE)
+
+static inline void *pipe_slot_ptr(pipe_t *pipe, struct pipe_buf *buf) {
+  size_t slot = buf - pipe->bufs;
+  return (uint8_t *)pipe->buffer + slot * PAGE_SIZE;
+}
+
+static inline struct pipe_buf *pipe_buf_at(pipe_t *pipe, uint32_t i) {
+  return &pipe->bufs[(pipe->head + i) % PIPE_MAX_BUFS];
+}
+
+static inline struct pipe_buf *pipe_last_buf(pipe_t *pipe) {
+  return pipe->nbufs > 0 ? pipe_buf_at(pipe, pipe->nbufs - 1) : NULL;
+}
+
+static inline bool pipe_can_merge(struct pipe_buf *buf) {
+  return buf != NULL && !(buf->flags & PIPE_BUF_PAGE) && buf->offset + buf->len < PAGE_SIZE;
+}
+
+static size_t pipe_space(pipe_t *pipe) {
+  // bytes that can be copied into the pipe without waiting
+  if (pipe->count >= pipe->buffer_size)
+    return 0;
+
+  size_t space = (PIPE_MAX_BUFS - pipe->nbufs) * PAGE_SIZE;
+  struct pipe_buf *last = pipe_last_buf(pipe);
+  if (pipe_can_merge(last))
+    space += PAGE_SIZE - (last->offset + last->len);
+  return min(space, pipe->buffer_size - pipe->count);
+}
+
+static inline bool pipe_slot_free(pipe_t *pipe) {
+  return pipe->nbufs < PIPE_MAX_BUFS && pipe->count < pipe->buffer_size;
+}
+
+static struct pipe_buf *pipe_push_buf(pipe_t *pipe) {
+  ASSERT(pipe->nbufs < PIPE_MAX_BUFS);
+  struct pipe_buf *buf = pipe_buf_at(pipe, pipe->nbufs);
+  memset(buf, 0, sizeof(struct pipe_buf));
+  pipe->nbufs++;
+  return buf;
+}
+
+static void pipe_consume(pipe_t *pipe, struct pipe_buf *buf, size_t n) {
+  ASSERT(buf == pipe_buf_at(pipe, 0));
+  ASSERT(n <= buf->len);
+  buf->offset += n;
+  buf->len -= n;
+  pipe->count -= n;
+  if (buf->len > 0)
+    return;
+
+  // buffer is empty, release it
+  if (buf->flags & PIPE_BUF_PAGE) {
+    pg_putref(&buf->page);
+  }
+  memset(buf, 0, sizeof(struct pipe_buf));
+  pipe->head = (pipe->head + 1) % PIPE_MAX_BUFS;
+  pipe->nbufs--;
+}
+
+static const void *pipe_buf_data(pipe_t *pipe, struct pipe_buf *buf, size_t len, void **bounce) {
+  // returns a kernel pointer to the first len bytes of the buffer. referenced
+  // pages are not mapped so their data is copied out through a bounce buffer
+  if (!(buf->flags & PIPE_BUF_PAGE)) {
+    return (uint8_t *)pipe_slot_ptr(pipe, buf) + buf->offset;
+  }
+
+  if (*bounce == NULL) {
+    *bounce = kmalloc(PAGE_SIZE);
+  }
+  kio_t tmp = kio_new_writable(*bounce, len);
+  rw_unmapped_page(buf->page, buf->offset, &tmp);
+  return *bounce;
+}
+
+static size_t pipe_copy_in(pipe_t *pipe, kio_t *kio, size_t len) {
+  // copies up to len bytes from the kio into the pipe's own pages
+  len = min(len, pipe_space(pipe));
+  size_t total = 0;
+  while (total < len) {
+    struct pipe_buf *buf = pipe_last_buf(pipe);
+    if (!pipe_can_merge(buf)) {
+      if (pipe->nbufs == PIPE_MAX_BUFS)
+        break;
+      buf = pipe_push_buf(pipe);
+    }
+
+    size_t tail = buf->offset + buf->len;
+    size_t n = min(len - total, PAGE_SIZE - tail);
+    n = kio_read_out((uint8_t *)pipe_slot_ptr(pipe, buf) + tail, n, 0, kio);
+    if (n == 0) {
+      if (buf->len == 0)
+        pipe->nbufs--; // drop the empty buffer we just added
+      break;
+    }
+
+    buf->len += n;
+    pipe->count += n;
+    total += n;
+  }
+  return total;
+}
+
+static void pipe_signal_epipe() {
+  // send SIGPIPE to the process
+  proc_signal(curproc, &(siginfo_t){
+    .si_signo = SIGPIPE,
+    .si_code = SI_USER,
+    .si_pid = curproc->pid,
+  });
+}
+
 //
 // pipe allocation and cleanup
 //
 
 __ref pipe_t *pipe_alloc(size_t buffer_size) {
-  uintptr_t buffer = vmap_anon(buffer_size, 0, buffer_size, VM_RDWR, "pipe_buffer");
+  // each buffer slot is backed by one page of the mapping
+  uintptr_t buffer = vmap_anon(PIPE_MAP_SIZE, 0, PIPE_MAP_SIZE, VM_RDWR, "pipe_buffer");
   if (!buffer) {
     return NULL;
   }
@@ -57,7 +176,7 @@ __ref pipe_t *pipe_alloc(size_t buffer_size) {
 
   pipe_t *pipe = pool_alloc(pipe_pool, sizeof(pipe_t));
   pipe->buffer = (void *) buffer;
-  pipe->buffer_size = buffer_size;
+  pipe->buffer_size = min(buffer_size, PIPE_MAP_SIZE);
   pipe->ctime = clock_nano_time();
 
   ref_init(&pipe->refcount);
@@ -74,14 +193,20 @@ void _pipe_cleanup(__move pipe_t **piperef) {
   pipe_t *pipe = moveref(*piperef);
   ASSERT(pipe != NULL);
   ASSERT(ref_count(&pipe->refcount) == 0);
-  
+
   DPRINTF("!!! cleaning up pipe %p, buffer=%p !!!\n", pipe, pipe->buffer);
-  
+
+  // release any referenced pages
+  while (pipe->nbufs > 0) {
+    struct pipe_buf *buf = pipe_buf_at(pipe, 0);
+    pipe_consume(pipe, buf, buf->len);
+  }
+
   if (pipe->buffer) {
     DPRINTF("freeing pipe buffer at %p\n", pipe->buffer);
-    vmap_free((uintptr_t)pipe->buffer, pipe->buffer_size);
+    vmap_free((uintptr_t)pipe->buffer, PIPE_MAP_SIZE);
   }
-  
+
   knlist_destroy(&pipe->knlist);
   mtx_destroy(&pipe->lock);
   cond_destroy(&pipe->read_cond);
@@ -90,6 +215,234 @@ void _pipe_cleanup(__move pipe_t **piperef) {
   pool_free(pipe_pool, pipe);
 }
 
+//
+// pipe splice operations
+//
+
+ssize_t pipe_add_page(file_t *file, page_t *page, uint32_t offset, uint32_t len, bool nonblock) {
+  ASSERT(F_ISPIPE(file));
+  ASSERT(offset + len <= PAGE_SIZE);
+  pipe_t *pipe = (pipe_t *)file->data;
+  int accmode = file->flags & O_ACCMODE;
+  if (accmode != O_WRONLY && accmode != O_RDWR) {
+    return -EBADF;
+  }
+  nonblock |= (file->flags & O_NONBLOCK) != 0;
+
+  mtx_lock(&pipe->lock);
+  while (true) {
+    if (pipe->flags & PIPE_READ_CLOSED) {
+      mtx_unlock(&pipe->lock);
+      pipe_signal_epipe();
+      return -EPIPE;
+    }
+    if (pipe_slot_free(pipe))
+      break;
+
+    if (nonblock) {
+      mtx_unlock(&pipe->lock);
+      return -EAGAIN;
+    }
+    cond_wait(&pipe->write_cond, &pipe->lock);
+  }
+
+  // reference the page instead of copying it
+  struct pipe_buf *buf = pipe_push_buf(pipe);
+  buf->page = pg_getref(page);
+  buf->offset = offset;
+  buf->len = len;
+  buf->flags = PIPE_BUF_PAGE;
+  pipe->count += len;
+
+  cond_broadcast(&pipe->read_cond);
+  knlist_activate_notes(&pipe->knlist, 0);
+  mtx_unlock(&pipe->lock);
+  return (ssize_t) len;
+}
+
+ssize_t pipe_splice_read(file_t *file, size_t len, bool nonblock, pipe_actor_t actor, void *data) {
+  ASSERT(F_ISPIPE(file));
+  pipe_t *pipe = (pipe_t *)file->data;
+  int accmode = file->flags & O_ACCMODE;
+  if (accmode != O_RDONLY && accmode != O_RDWR) {
+    return -EBADF;
+  }
+  nonblock |= (file->flags & O_NONBLOCK) != 0;
+
+  mtx_lock(&pipe->lock);
+  while (pipe->count == 0 || (pipe->flags & PIPE_READ_BUSY)) {
+    if (!(pipe->flags & PIPE_READ_BUSY)) {
+      if (pipe->flags & PIPE_WRITE_CLOSED) {
+        mtx_unlock(&pipe->lock);
+        return 0;
+      }
+      if (nonblock) {
+        mtx_unlock(&pipe->lock);
+        return -EAGAIN;
+      }
+    }
+    cond_wait(&pipe->read_cond, &pipe->lock);
+  }
+
+  // hand each buffer to the actor. the actor may block for a long time (e.g.
+  // on a full socket) so it runs without the pipe lock. PIPE_READ_BUSY keeps
+  // other readers from consuming the buffers so the data is handed over in
+  // order, and writers only ever append after it.
+  pipe->flags |= PIPE_READ_BUSY;
+  void *bounce = NULL;
+  ssize_t total = 0;
+  while ((size_t) total < len && pipe->nbufs > 0) {
+    struct pipe_buf *buf = pipe_buf_at(pipe, 0);
+    size_t n = min(len - total, buf->len);
+    uint32_t offset = buf->offset;
+    page_t *page = NULL;
+    const void *ptr = NULL;
+    if (buf->flags & PIPE_BUF_PAGE) {
+      page = pg_getref(buf->page);
+    } else {
+      ptr = (uint8_t *)pipe_slot_ptr(pipe, buf) + offset;
+    }
+    mtx_unlock(&pipe->lock);
+
+    if (page != NULL) {
+      // referenced pages are not mapped so their data is copied out
+      if (bounce == NULL)
+        bounce = kmalloc(PAGE_SIZE);
+      kio_t tmp = kio_new_writable(bounce, n);
+      rw_unmapped_page(page, offset, &tmp);
+      pg_putref(&page);
+      ptr = bounce;
+    }
+    ssize_t res = actor(data, ptr, n);
+
+    mtx_lock(&pipe->lock);
+    if (res <= 0) {
+      if (total == 0)
+        total = res;
+      break;
+    }
+
+    pipe_consume(pipe, pipe_buf_at(pipe, 0), res);
+    total += res;
+    if ((size_t) res < n)
+      break;
+  }
+
+  pipe->flags &= ~PIPE_READ_BUSY;
+  cond_broadcast(&pipe->read_cond);
+  if (total > 0) {
+    cond_broadcast(&pipe->write_cond);
+    knlist_activate_notes(&pipe->knlist, 0);
+  }
+  mtx_unlock(&pipe->lock);
+  kfree(bounce);
+  return total;
+}
+
+ssize_t pipe_splice_move(file_t *in, file_t *out, size_t len, bool nonblock, bool consume) {
+  // moves (or with consume=false, duplicates) up to len bytes from one pipe
+  // to another. referenced pages are shared between the pipes, data held in
+  // the input pipe's own pages is copied.
+  ASSERT(F_ISPIPE(in) && F_ISPIPE(out));
+  pipe_t *ipipe = (pipe_t *)in->data;
+  pipe_t *opipe = (pipe_t *)out->data;
+  if (ipipe == opipe)
+    return -EINVAL;
+
+  int inmode = in->flags & O_ACCMODE;
+  int outmode = out->flags & O_ACCMODE;
+  if ((inmode != O_RDONLY && inmode != O_RDWR) || (outmode != O_WRONLY && outmode != O_RDWR))
+    return -EBADF;
+  nonblock |= ((in->flags | out->flags) & O_NONBLOCK) != 0;
+
+  // always lock the pipes in the same order
+  pipe_t *first = ipipe < opipe ? ipipe : opipe;
+  pipe_t *second = ipipe < opipe ? opipe : ipipe;
+  while (true) {
+    mtx_lock(&first->lock);
+    mtx_lock(&second->lock);
+
+    if (ipipe->count == 0 || (ipipe->flags & PIPE_READ_BUSY)) {
+      // wait for data or for a splice read to finish with the buffers
+      mtx_unlock(&opipe->lock);
+      if (!(ipipe->flags & PIPE_READ_BUSY) && ((ipipe->flags & PIPE_WRITE_CLOSED) || nonblock)) {
+        mtx_unlock(&ipipe->lock);
+        return (ipipe->flags & PIPE_WRITE_CLOSED) ? 0 : -EAGAIN;
+      }
+      cond_wait(&ipipe->read_cond, &ipipe->lock);
+      mtx_unlock(&ipipe->lock);
+      continue;
+    }
+
+    if (opipe->flags & PIPE_READ_CLOSED) {
+      mtx_unlock(&second->lock);
+      mtx_unlock(&first->lock);
+      pipe_signal_epipe();
+      return -EPIPE;
+    }
+
+    // referenced pages need a free slot, everything else is copied
+    struct pipe_buf *first_buf = pipe_buf_at(ipipe, 0);
+    bool full = (first_buf->flags & PIPE_BUF_PAGE) ? !pipe_slot_free(opipe) : pipe_space(opipe) == 0;
+    if (full) {
+      mtx_unlock(&ipipe->lock);
+      if (nonblock) {
+        mtx_unlock(&opipe->lock);
+        return -EAGAIN;
+      }
+      cond_wait(&opipe->write_cond, &opipe->lock);
+      mtx_unlock(&opipe->lock);
+      continue;
+    }
+    break;
+  }
+
+  size_t total = 0;
+  uint32_t i = 0;
+  while (total < len && i < ipipe->nbufs) {
+    struct pipe_buf *buf = pipe_buf_at(ipipe, i);
+    size_t n = min(len - total, buf->len);
+    if (buf->flags & PIPE_BUF_PAGE) {
+      if (!pipe_slot_free(opipe))
+        break;
+
+      struct pipe_buf *obuf = pipe_push_buf(opipe);
+      obuf->page = pg_getref(buf->page);
+      obuf->offset = buf->offset;
+      obuf->len = n;
+      obuf->flags = PIPE_BUF_PAGE;
+      opipe->count += n;
+    } else {
+      kio_t kio = kio_new_readable((uint8_t *)pipe_slot_ptr(ipipe, buf) + buf->offset, n);
+      n = pipe_copy_in(opipe, &kio, n);
+      if (n == 0)
+        break;
+    }
+
+    total += n;
+    bool partial = n < buf->len;
+    if (consume) {
+      pipe_consume(ipipe, buf, n);
+    } else {
+      i++;
+    }
+    if (partial)
+      break;
+  }
+
+  if (total > 0) {
+    cond_broadcast(&opipe->read_cond);
+    knlist_activate_notes(&opipe->knlist, 0);
+    if (consume) {
+      cond_broadcast(&ipipe->write_cond);
+      knlist_activate_notes(&ipipe->knlist, 0);
+    }
+  }
+  mtx_unlock(&second->lock);
+  mtx_unlock(&first->lock);
+  return (ssize_t) total;
+}
+
 //
 // pipe file operations
 //
@@ -170,16 +523,22 @@ ssize_t pipe_f_read(file_t *file, kio_t *kio) {
   
   size_t total_read = 0;
   size_t to_read = kio_remaining(kio);
+  void *bounce = NULL;
   
   mtx_lock(&pipe->lock);
   
   while (to_read > 0) {
     // wait for data or pipe closure
-    while (pipe->count == 0) {
+    while (pipe->count == 0 || (pipe->flags & PIPE_READ_BUSY)) {
+      if (pipe->flags & PIPE_READ_BUSY) {
+        // a splice read is handing the buffers to its output
+        cond_wait(&pipe->read_cond, &pipe->lock);
+        continue;
+      }
+
       // check if all writers have closed
       if (pipe->flags & PIPE_WRITE_CLOSED) {
-        mtx_unlock(&pipe->lock);
-        return (ssize_t) total_read;
+        goto done;
       }
 
       if (file->flags & O_NONBLOCK) {
@@ -187,6 +546,7 @@ ssize_t pipe_f_read(file_t *file, kio_t *kio) {
           break;
         }
         mtx_unlock(&pipe->lock);
+        kfree(bounce);
         return -EAGAIN;
       }
       
@@ -198,33 +558,21 @@ ssize_t pipe_f_read(file_t *file, kio_t *kio) {
       break; // no more data available
     }
     
-    // calculate how much we can read
-    size_t available = pipe->count;
-    size_t chunk = min(to_read, available);
-    
-    // handle wrap-around
-    if (pipe->read_pos + chunk > pipe->buffer_size) {
-      // read in two parts
-      size_t first_part = pipe->buffer_size - pipe->read_pos;
-      size_t second_part = chunk - first_part;
-
-      kio_write_in(kio, (uint8_t *)pipe->buffer + pipe->read_pos, first_part, 0);
-      kio_write_in(kio, pipe->buffer, second_part, 0);
-      
-      pipe->read_pos = second_part;
-    } else {
-      // read in one part
-      kio_write_in(kio, (uint8_t *)pipe->buffer + pipe->read_pos, chunk, 0);
-      pipe->read_pos += chunk;
-      
-      if (pipe->read_pos == pipe->buffer_size) {
-        pipe->read_pos = 0;
+    // read from the buffers in order
+    while (to_read > 0 && pipe->nbufs > 0) {
+      struct pipe_buf *buf = pipe_buf_at(pipe, 0);
+      size_t chunk = min(to_read, buf->len);
+      const void *ptr = pipe_buf_data(pipe, buf, chunk, &bounce);
+      size_t n = kio_write_in(kio, ptr, chunk, 0);
+
+      pipe_consume(pipe, buf, n);
+      total_read += n;
+      to_read -= n;
+      if (n < chunk) {
+        to_read = 0; // kio is full
+        break;
       }
     }
-    
-    pipe->count -= chunk;
-    total_read += chunk;
-    to_read -= chunk;
 
     // wake up waiting writers
     cond_broadcast(&pipe->write_cond);
@@ -232,8 +580,9 @@ ssize_t pipe_f_read(file_t *file, kio_t *kio) {
     knlist_activate_notes(&pipe->knlist, 0);
   }
 
+LABEL(done);
   mtx_unlock(&pipe->lock);
-  
+  kfree(bounce);
   return (ssize_t) total_read;
 }
 
@@ -255,27 +604,17 @@ ssize_t pipe_f_write(file_t *file, kio_t *kio) {
   // check if all readers have closed
   if (pipe->flags & PIPE_READ_CLOSED) {
     mtx_unlock(&pipe->lock);
-    // send SIGPIPE to the process
-    proc_signal(curproc, &(siginfo_t){
-      .si_signo = SIGPIPE,
-      .si_code = SI_USER,
-      .si_pid = curproc->pid,
-    });
+    pipe_signal_epipe();
     return -EPIPE;
   }
   
   while (to_write > 0) {
     // wait for space
-    while (pipe->count == pipe->buffer_size) {
+    while (pipe_space(pipe) == 0) {
       // check if all readers have closed
       if (pipe->flags & PIPE_READ_CLOSED) {
         mtx_unlock(&pipe->lock);
-        // send SIGPIPE to the process
-        proc_signal(curproc, &(siginfo_t){
-          .si_signo = SIGPIPE,
-          .si_code = SI_USER,
-          .si_pid = curproc->pid,
-        });
+        pipe_signal_epipe();
         return -EPIPE;
       }
       
@@ -292,34 +631,14 @@ ssize_t pipe_f_write(file_t *file, kio_t *kio) {
       cond_wait(&pipe->write_cond, &pipe->lock);
     }
     
-    if (pipe->count == pipe->buffer_size) {
+    if (pipe_space(pipe) == 0) {
       break; // no more space available
     }
 
-    size_t available = pipe->buffer_size - pipe->count;
-    size_t chunk = min(to_write, available);
-    
-    // handle wrap-around
-    if (pipe->write_pos + chunk > pipe->buffer_size) {
-      // write in two parts
-      size_t first_part = pipe->buffer_size - pipe->write_pos;
-      size_t second_part = chunk - first_part;
-      
-      kio_read_out((uint8_t *)pipe->buffer + pipe->write_pos, first_part, 0, kio);
-      kio_read_out(pipe->buffer, second_part, 0, kio);
-      
-      pipe->write_pos = second_part;
-    } else {
-      // write in one part
-      kio_read_out((uint8_t *)pipe->buffer + pipe->write_pos, chunk, 0, kio);
-      pipe->write_pos += chunk;
-      
-      if (pipe->write_pos == pipe->buffer_size) {
-        pipe->write_pos = 0;
-      }
+    size_t chunk = pipe_copy_in(pipe, kio, to_write);
+    if (chunk == 0) {
+      break; // nothing left to copy from the kio
     }
-    
-    pipe->count += chunk;
     total_written += chunk;
     to_write -= chunk;
 
@@ -375,7 +694,7 @@ int pipe_f_kqevent(file_t *file, knote_t *kn) {
       int accmode = file->flags & O_ACCMODE;
       if (accmode == O_WRONLY || accmode == O_RDWR) {
         // check if space is available
-        size_t space = pipe->buffer_size - pipe->count;
+        size_t space = pipe_space(pipe);
         if (space > 0) {
           kn->event.data = (intptr_t)space;
           ret = 1;
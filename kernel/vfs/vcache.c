@@ -68,10 +68,45 @@ static inline struct vcache_dir *vcache_dir_find(vcache_t *vcache, uint64_t key)
 
 #define VCACHE_INITIAL_SIZE 1024
 
+#define VCHILD_NBUCKETS     1024
+#define VCHILD_MAX_ENTRIES  4096
+#define VCHILD_NAME_MAX     47
+#define VCHILD_MAX_CHAIN    64  // bound on lock-free chain walks
+
+struct vcache_child {
+  struct vcache_child *next;  // bucket chain (must be first)
+  ventry_t *parent;           // parent ventry reference
+  ventry_t *ve;               // child ventry reference (NULL for negative entries)
+  hash_t hash;                // hash of the name
+  uint8_t namelen;
+  char name[VCHILD_NAME_MAX+1];
+  volatile bool referenced;   // set on lookup hits, cleared by the reclaimer
+  LIST_ENTRY(struct vcache_child) lru;
+};
+
+struct vcache_child_bucket {
+  volatile uint32_t seq;      // odd while the chain is being modified
+  struct vcache_child *first;
+};
+
 static pool_t *vcache_entry_pool;
+static pool_t *vcache_child_pool;
+
+// component cache
+typedef LIST_HEAD(struct vcache_child) vchild_list_t;
+
+static struct vcache_child_bucket vchild_buckets[VCHILD_NBUCKETS];
+static vchild_list_t vchild_lru;
+static size_t vchild_count;
+static mtx_t vchild_lock;
+
+#define VCHILD_LOCK() mtx_spin_lock(&vchild_lock)
+#define VCHILD_UNLOCK() mtx_spin_unlock(&vchild_lock)
 
 static void vcache_pool_init() {
   vcache_entry_pool = pool_create("vcache_entry", pool_sizes(sizeof(struct vcache_entry)), 0);
+  vcache_child_pool = pool_create("vcache_child", pool_sizes(sizeof(struct vcache_child)), 0);
+  mtx_init(&vchild_lock, MTX_SPIN, "vchild_lock");
 }
 STATIC_INIT(vcache_pool_init);
 
@@ -330,9 +365,211 @@ int vcache_invalidate_all(vcache_t *vcache) {
   VCACHE_LOCK(vcache);
   int res = vcache_invalidate_all_nolock(vcache);
   VCACHE_UNLOCK(vcache);
+  vcache_invalidate_children(NULL);
   return res;
 }
 
+//
+// MARK: Component cache
+//
+// The component cache is keyed by the parent ventry pointer and the hash of a
+// single path component. Writers are serialized by vchild_lock and bump the
+// bucket sequence count around every change to a chain. Readers never take a
+// lock; they walk the chain and retry if the sequence count changed under them.
+// Entries come from a pool so memory is never returned to the system while a
+// reader may still be looking at a stale entry.
+//
+
+static inline struct vcache_child_bucket *vchild_bucket(ventry_t *dve, hash_t hash) {
+  uint64_t key = hash ^ ((uintptr_t) dve >> 4) * 0x9E3779B97F4A7C15ULL;
+  return &vchild_buckets[(key ^ (key >> 32)) % VCHILD_NBUCKETS];
+}
+
+static inline bool vchild_dir_cacheable(ventry_t *dve) {
+  // directories with dynamic entries or custom name comparison are never cached
+  return VE_OPS(dve)->v_validate == NULL && VE_OPS(dve)->v_cmp == NULL;
+}
+
+static inline uint32_t vchild_read_begin(struct vcache_child_bucket *bucket) {
+  uint32_t seq;
+  while ((seq = atomic_load(&bucket->seq)) & 1)
+    cpu_pause();
+  return seq;
+}
+
+static inline bool vchild_read_retry(struct vcache_child_bucket *bucket, uint32_t seq) {
+  atomic_thread_fence();
+  return atomic_load(&bucket->seq) != seq;
+}
+
+static struct vcache_child *vchild_find(struct vcache_child_bucket *bucket, ventry_t *dve, cstr_t name, hash_t hash) {
+  size_t len = cstr_len(name);
+  size_t n = 0;
+  struct vcache_child *entry = atomic_load(&bucket->first);
+  while (entry != NULL && n++ < VCHILD_MAX_CHAIN) {
+    if (entry->parent == dve && entry->hash == hash && entry->namelen == len &&
+        memcmp(entry->name, cstr_ptr(name), len) == 0) {
+      return entry;
+    }
+    entry = atomic_load(&entry->next);
+  }
+  return NULL;
+}
+
+static void vchild_unlink_nolock(struct vcache_child *entry, vchild_list_t *freelist) {
+  // the entry is moved to the freelist but its chain pointer is left intact
+  // so that concurrent readers standing on it can still make progress
+  struct vcache_child_bucket *bucket = vchild_bucket(entry->parent, entry->hash);
+  atomic_fetch_add(&bucket->seq, 1);
+  struct vcache_child **pp = &bucket->first;
+  while (*pp != entry) {
+    ASSERT(*pp != NULL);
+    pp = &(*pp)->next;
+  }
+  atomic_store(pp, entry->next);
+  atomic_fetch_add(&bucket->seq, 1);
+
+  LIST_REMOVE(&vchild_lru, entry, lru);
+  LIST_ADD(freelist, entry, lru);
+  vchild_count--;
+}
+
+static void vchild_evict_nolock(vchild_list_t *freelist) {
+  // second chance reclaim from the cold end of the lru list
+  size_t scanned = 0;
+  struct vcache_child *entry;
+  while ((entry = LIST_LAST(&vchild_lru)) != NULL) {
+    if (entry->referenced && scanned++ < vchild_count) {
+      entry->referenced = false;
+      LIST_REMOVE(&vchild_lru, entry, lru);
+      LIST_ADD_FRONT(&vchild_lru, entry, lru);
+      continue;
+    }
+    vchild_unlink_nolock(entry, freelist);
+    return;
+  }
+}
+
+static void vchild_release(vchild_list_t *freelist) {
+  // references are dropped outside of the lock since releasing the last
+  // reference to a ventry can call into the filesystem
+  struct vcache_child *entry;
+  while ((entry = LIST_FIRST(freelist)) != NULL) {
+    LIST_REMOVE(freelist, entry, lru);
+    ve_putref(&entry->ve);
+    ve_putref(&entry->parent);
+    pool_free(vcache_child_pool, entry);
+  }
+}
+
+int vcache_lookup_child(ventry_t *dve, cstr_t name, __move ventry_t **result) {
+  if (cstr_len(name) > VCHILD_NAME_MAX || !vchild_dir_cacheable(dve))
+    return -EAGAIN;
+
+  hash_t hash = ve_hash_cstr(dve, name);
+  struct vcache_child_bucket *bucket = vchild_bucket(dve, hash);
+  for (;;) {
+    uint32_t seq = vchild_read_begin(bucket);
+    struct vcache_child *entry = vchild_find(bucket, dve, name, hash);
+    ventry_t *ve = entry ? atomic_load(&entry->ve) : NULL;
+    if (vchild_read_retry(bucket, seq))
+      continue;
+
+    if (entry == NULL) {
+      return -EAGAIN;
+    } else if (ve == NULL) {
+      entry->referenced = true;
+      return -ENOENT; // negative entry
+    }
+
+    // the entry owned a reference to ve when we read it, so if the sequence is
+    // still unchanged after taking our own reference the ventry was never freed
+    if (!ref_tryget(&ve->refcount))
+      continue;
+    if (vchild_read_retry(bucket, seq)) {
+      ve_putref(&ve);
+      continue;
+    }
+
+    entry->referenced = true;
+    if (!V_ISALIVE(ve) || ve->parent != dve) {
+      ve_putref(&ve);
+      return -EAGAIN;
+    }
+    *result = moveref(ve);
+    return 0;
+  }
+}
+
+void vcache_put_child(ventry_t *dve, cstr_t name, ventry_t *ve) {
+  if (cstr_len(name) > VCHILD_NAME_MAX || !vchild_dir_cacheable(dve))
+    return;
+  if (ve != NULL && (!V_ISALIVE(ve) || VE_ISNOCACHE(ve) || VE_ISNOSAVE(ve) || ve->parent != dve))
+    return;
+
+  struct vcache_child *entry = pool_alloc(vcache_child_pool, sizeof(struct vcache_child));
+  entry->next = NULL;
+  entry->parent = ve_getref(dve);
+  entry->ve = ve_getref(ve);
+  entry->hash = ve_hash_cstr(dve, name);
+  entry->namelen = cstr_len(name);
+  memcpy(entry->name, cstr_ptr(name), entry->namelen);
+  entry->name[entry->namelen] = '\0';
+  entry->referenced = false;
+  entry->lru.prev = entry->lru.next = NULL;
+
+  vchild_list_t freelist = LIST_HEAD_INITR;
+  struct vcache_child_bucket *bucket = vchild_bucket(dve, entry->hash);
+  VCHILD_LOCK();
+  struct vcache_child *old = vchild_find(bucket, dve, name, entry->hash);
+  if (old != NULL)
+    vchild_unlink_nolock(old, &freelist);
+  while (vchild_count >= VCHILD_MAX_ENTRIES)
+    vchild_evict_nolock(&freelist);
+
+  entry->next = bucket->first;
+  atomic_fetch_add(&bucket->seq, 1);
+  atomic_store(&bucket->first, entry);
+  atomic_fetch_add(&bucket->seq, 1);
+  LIST_ADD_FRONT(&vchild_lru, entry, lru);
+  vchild_count++;
+  VCHILD_UNLOCK();
+
+  vchild_release(&freelist);
+}
+
+void vcache_invalidate_child(ventry_t *dve, cstr_t name) {
+  if (cstr_len(name) > VCHILD_NAME_MAX || !vchild_dir_cacheable(dve))
+    return;
+
+  vchild_list_t freelist = LIST_HEAD_INITR;
+  hash_t hash = ve_hash_cstr(dve, name);
+  struct vcache_child_bucket *bucket = vchild_bucket(dve, hash);
+  VCHILD_LOCK();
+  struct vcache_child *entry = vchild_find(bucket, dve, name, hash);
+  if (entry != NULL)
+    vchild_unlink_nolock(entry, &freelist);
+  VCHILD_UNLOCK();
+
+  vchild_release(&freelist);
+}
+
+void vcache_invalidate_children(ventry_t *dve) {
+  // drops every entry that lives under dve (or all entries if dve is NULL)
+  vchild_list_t freelist = LIST_HEAD_INITR;
+  VCHILD_LOCK();
+  struct vcache_child *entry = LIST_FIRST(&vchild_lru);
+  while (entry != NULL) {
+    struct vcache_child *next = LIST_NEXT(entry, lru);
+    if (dve == NULL || entry->parent == dve)
+      vchild_unlink_nolock(entry, &freelist);
+    entry = next;
+  }
+  VCHILD_UNLOCK();
+
+  vchild_release(&freelist);
+}
+
 void vcache_dump(vcache_t *vcache) {
   VCACHE_LOCK(vcache);
   kprintf("{:$=<34} vcache dump {:$=>34}\n");
@@ -407,4 +644,13 @@ void vcache_dump(vcache_t *vcache) {
   }
   kprintf("{:$-<64}\n");
   VCACHE_UNLOCK(vcache);
+
+  VCHILD_LOCK();
+  size_t negative = 0;
+  LIST_FOR_IN(entry, &vchild_lru, lru) {
+    if (entry->ve == NULL)
+      negative++;
+  }
+  kprintf("component cache: %zu entries (%zu negative, max %d)\n", vchild_count, negative, VCHILD_MAX_ENTRIES);
+  VCHILD_UNLOCK();
 }
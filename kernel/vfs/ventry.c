@@ -4,6 +4,7 @@
 
 #include <kernel/vfs/ventry.h>
 #include <kernel/vfs/vnode.h>
+#include <kernel/vfs/vcache.h>
 
 #include <kernel/mm.h>
 #include <kernel/mm/pool.h>
@@ -135,6 +136,8 @@ void ve_replace_root(ventry_t *root_ve, ventry_t *newroot_ve) {
 
 void ve_add_child(ventry_t *parent, ventry_t *child) {
   ASSERT(!VE_ISMOUNT(parent));
+  // drop any negative entry for the name
+  vcache_invalidate_child(parent, cstr_from_str(child->name));
   child = ve_getref(child); // add child ref to parent->children
   child->parent = ve_getref(parent);
   LIST_ADD(&parent->children, child, list);
@@ -145,6 +148,9 @@ void ve_add_child(ventry_t *parent, ventry_t *child) {
 }
 
 void ve_remove_child(ventry_t *parent, ventry_t *child) {
+  vcache_invalidate_child(parent, cstr_from_str(child->name));
+  if (V_ISDIR(child))
+    vcache_invalidate_children(child);
   LIST_REMOVE(&parent->children, child, list);
   ve_putref(&child->parent);
   ve_putref(&child); // release parent->children ref
@@ -10,6 +10,8 @@
 #include <kernel/proc.h>
 #include <kernel/mm.h>
 #include <kernel/mm/pool.h>
+#include <kernel/mm/pgcache.h>
+#include <kernel/mm/reclaim.h>
 #include <kernel/kevent.h>
 #include <kernel/printf.h>
 
@@ -53,6 +55,8 @@ __ref vnode_t *vn_alloc_empty(enum vtype type) {
   vnode->type = type;
   vnode->state = V_EMPTY;
   vnode->flags = 0;
+  vnode->pgcache = NULL;
+  vnode->lru.prev = vnode->lru.next = NULL;
   mtx_init(&vnode->lock, MTX_RECURSIVE, "vnode_lock");
   rw_init(&vnode->data_lock, 0, "vnode_data_lock");
   ref_init(&vnode->refcount);
@@ -121,9 +125,12 @@ void _vn_cleanup(__move vnode_t **vnref) {
   // filesystems with transient files (e.g. procfs).
 
   DPRINTF("!!! vnode cleanup !!! {:+vn}\n", vn);
+  reclaim_untrack_vnode(vn);
   if (VN_OPS(vn)->v_cleanup)
     VN_OPS(vn)->v_cleanup(vn);
 
+  pgcache_free(&vn->pgcache);
+
   ASSERT(vn->data == NULL);
   vfs_putref(&vn->vfs);
   mtx_destroy(&vn->lock);
@@ -181,6 +188,9 @@ int vn_getpage(vnode_t *vn, off_t off, bool cached, __move page_t **result) {
 
   page_t *page;
   if (cached && vn->pgcache && (page = pgcache_lookup(vn->pgcache, off)) != NULL) {
+    // a cache hit counts as a use of the page for reclaim
+    atomic_fetch_or(&page->flags, PG_REFERENCED);
+    reclaim_track_vnode(vn);
     *result = page;
     return 0;
   }
@@ -762,29 +772,45 @@ ssize_t vn_f_read(file_t *file, kio_t *kio) {
   vnode_t *vn = file->data;
   if (V_ISDIR(vn)) {
     return -EISDIR; // file is a directory
-  } else if (!vn_lock(vn)) {
-    return -EIO; // vnode is dead
   }
 
   //DPRINTF("vn_f_read: reading from file %p at offset %lld [vn {:+vn}]\n", file, file->offset, vn);
 
+  // claim the range being read by advancing the offset before the read so
+  // that concurrent readers of a shared file read consecutive ranges without
+  // holding the file lock across the read. reads only need the vnode data
+  // lock so they can run in parallel.
+  off_t off = file->offset;
+  off_t end = off;
+  if (V_ISREG(vn)) {
+    size_t size = vn->size;
+    if ((size_t) off < size)
+      end = off + (off_t) min(kio_remaining(kio), size - (size_t) off);
+  }
+  file->offset = end;
+
   // this operation can block so we unlock the file during the read
   f_unlock(file);
   // vnode read
-  vn_begin_data_read(vn);
-  ssize_t res = vn_read(vn, file->offset, kio);
-  vn_end_data_read(vn);
+  ssize_t res;
+  if (vn_begin_data_read(vn)) {
+    res = vn_read(vn, off, kio);
+    vn_end_data_read(vn);
+  } else {
+    res = -EIO; // vnode is dead
+  }
   // and re-lock the file
   f_lock(file);
 
   if (res < 0) {
-    EPRINTF("failed to read from file %p at offset %lld [vn {:+vn}] {:err}\n", file, file->offset, vn, (int)res);
+    EPRINTF("failed to read from file %p at offset %lld [vn {:+vn}] {:err}\n", file, off, vn, (int)res);
   }
 
-  vn_unlock(vn);
-  if (res > 0) {
-    // update the file offset
-    file->offset += res;
+  // fix up the offset if the read was short, unless someone else has moved
+  // it since we claimed the range
+  off_t new_end = off + max(res, 0);
+  if (new_end != end && file->offset == end) {
+    file->offset = new_end;
   }
   return res;
 }
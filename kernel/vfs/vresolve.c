@@ -8,6 +8,7 @@
 #include <kernel/vfs/vcache.h>
 
 #include <kernel/panic.h>
+#include <kernel/atomic.h>
 #include <kernel/sbuf.h>
 #include <kernel/str.h>
 #include <kernel/printf.h>
@@ -36,12 +37,21 @@ static size_t vresolve_get_ve_path(ventry_t *ve, sbuf_t *sb) {
   return res;
 }
 
+static int vresolve_fastwalk(vcache_t *vc, ventry_t *at, cstr_t path, int flags, sbuf_t *fullpath, __move ventry_t **result);
+
 static int vresolve_internal(vcache_t *vcache, ventry_t *at, cstr_t path, int flags, int depth, __out sbuf_t *fullpath, __move ventry_t **result) {
+  int res;
   if (depth > MAX_LOOP) {
     return -ELOOP;
   }
 
-  // try the cache first
+  // try the lock-free component walk first
+  if ((res = vresolve_fastwalk(vcache, at, path, flags, fullpath, result)) != -EAGAIN) {
+    DPRINTF_FUNC("fastwalk: {:cstr} -> %d\n", &path, res);
+    return res;
+  }
+
+  // then the full path cache
   if (vresolve_cache(vcache, path, flags, depth, result) == 0) {
     DPRINTF_FUNC("cache hit: {:cstr} -> {:ve}\n", &path, *result);
 
@@ -140,6 +150,93 @@ LABEL(error);
   return res;
 }
 
+static int vresolve_fast_mount(__inout ventry_t **veref) {
+  // steps from a mount point onto the mounted root without locking it. the
+  // mount is checked again once we hold a reference to the root in case it
+  // was unmounted in between.
+  ventry_t *ve = *veref;
+  ventry_t *root = atomic_load(&ve->mount);
+  if (root == NULL || !ref_tryget(&root->refcount))
+    return -EAGAIN;
+  if (!VE_ISMOUNT(ve) || ve->mount != root) {
+    ve_putref(&root);
+    return -EAGAIN;
+  }
+  ve_putref_swap(veref, &root);
+  return 0;
+}
+
+static int vresolve_fastwalk(vcache_t *vc, ventry_t *at, cstr_t path, int flags, sbuf_t *fullpath, __move ventry_t **result) {
+  // walks the path using only the component cache. no ventry locks are taken
+  // until the final entry is reached. -EAGAIN is returned whenever part of the
+  // walk cannot be answered from the cache and a full walk is needed instead.
+  ventry_t *ve = NULL; // ref
+  ventry_t *next_ve = NULL; // ref
+  int res;
+  if (cstr_isnull(path) || (flags & (VR_PARENT|VR_EXCLUSV)))
+    return -EAGAIN;
+
+  char tmp[PATH_MAX + 1] = {0};
+  sbuf_t curpath = sbuf_init(tmp, PATH_MAX + 1);
+
+  path_t part = path_from_cstr(path);
+  if (path_is_absolute(part)) {
+    ve = vcache_get_root(vc);
+  } else {
+    if (fullpath != NULL)
+      vresolve_get_ve_path(at, &curpath);
+    ve = ve_getref(at);
+  }
+
+  while (!path_is_null(part = path_next_part(part))) {
+    if (VE_ISMOUNT(ve) && (res = vresolve_fast_mount(&ve)) < 0)
+      goto error;
+    if (!V_ISDIR(ve) || !V_ISALIVE(ve))
+      goto_res(-EAGAIN);
+    if (path_len(part) > NAME_MAX)
+      goto_res(-EAGAIN);
+
+    bool is_last = path_iter_end(part);
+    if (path_is_dot(part)) {
+      continue;
+    } else if (path_is_dotdot(part)) {
+      next_ve = ve_getref(ve->parent);
+    } else if ((res = vcache_lookup_child(ve, cstr_from_path(part), &next_ve)) < 0) {
+      goto error; // -ENOENT for a negative entry, -EAGAIN on a miss
+    }
+    ve_putref_swap(&ve, &next_ve);
+
+    if (fullpath != NULL) {
+      sbuf_write_char(&curpath, '/');
+      sbuf_write(&curpath, path_start(part), path_len(part));
+    }
+
+    if (V_ISLNK(ve) && !(is_last && (flags & VR_NOFOLLOW)))
+      goto_res(-EAGAIN); // symlinks are resolved by the full walk
+  }
+
+  if (VE_ISMOUNT(ve) && !(flags & VR_NOFOLLOW) && (res = vresolve_fast_mount(&ve)) < 0)
+    goto error;
+  if (VN_ISROOT(VN(ve)) && (flags & VR_NOFOLLOW) && !VE_ISFSROOT(ve))
+    goto_res(-EAGAIN);
+  if (!VN_ISLOADED(VN(ve)))
+    goto_res(-EAGAIN);
+  if ((res = vresolve_validate_result(ve, flags)) < 0)
+    goto error;
+
+  if (!(flags & VR_UNLOCKED) && !ve_lock(ve))
+    goto_res(-EAGAIN);
+
+  if (fullpath != NULL) sbuf_transfer(&curpath, fullpath); // return the fullpath
+  *result = moveref(ve); // return the ventry reference
+  return 0;
+
+LABEL(error);
+  ve_putref(&next_ve);
+  ve_putref(&ve);
+  return res;
+}
+
 //
 //
 //
@@ -241,6 +338,12 @@ int vresolve_fullwalk(vcache_t *vc, ventry_t *at, cstr_t path, int flags, int de
     vn_begin_data_read(vn);
     res = vn_lookup(ve, vn, cstr_from_path(part), &next_ve);
     vn_end_data_read(vn);
+    if (res == 0) {
+      vcache_put_child(ve, cstr_from_path(part), next_ve);
+    } else if (res == -ENOENT) {
+      vcache_put_child(ve, cstr_from_path(part), NULL); // negative entry
+    }
+
     if (res < 0) {
       if (is_last && res == -ENOENT) {
         if (flags & VR_EXCLUSV) {
@@ -0,0 +1,50 @@
+#!/bin/sh
+#
+# Block device read benchmark.
+#
+# Reads a block device sequentially with dd at a few block sizes and then
+# with cat, printing the readahead stats from /proc/blkcache after each pass.
+# The first pass runs against a cold cache, later passes show the hit rate of
+# the page cache. Attach a disk to the vm to get a virtio-blk device:
+#   -drive file=disk.img,if=virtio,format=raw
+#
+# To run it inside the os add it to the initrd with a .initrdrc directive:
+#   scripts/bench/blkread.sh:/usr/bin/blkread.sh
+#
+# usage: blkread.sh [device] [size in MB]
+#
+
+DEV=${1:-/dev/vda}
+SIZE_MB=${2:-64}
+
+if [ ! -b $DEV ]; then
+  echo "blkread: $DEV is not a block device"
+  exit 1
+fi
+
+stats() {
+  grep "^$(basename $DEV) " /proc/blkcache
+}
+
+run() {
+  label=$1
+  shift
+  start=$(date +%s)
+  "$@" >/dev/null 2>&1
+  end=$(date +%s)
+  elapsed=$((end - start))
+  if [ $elapsed -gt 0 ]; then
+    echo "blkread: $label: ${SIZE_MB}MB in ${elapsed}s ($((SIZE_MB / elapsed)) MB/s)"
+  else
+    echo "blkread: $label: ${SIZE_MB}MB in <1s"
+  fi
+  echo "blkread:   $(stats)"
+}
+
+echo "blkread: reading ${SIZE_MB}MB from $DEV"
+echo "blkread:   $(stats)"
+for bs in 4 16 64; do
+  count=$((SIZE_MB * 1024 / bs))
+  run "dd bs=${bs}k" dd if=$DEV of=/dev/null bs=${bs}k count=$count
+done
+run "cat" sh -c "cat $DEV | head -c $((SIZE_MB * 1024 * 1024))"
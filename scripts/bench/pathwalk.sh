@@ -0,0 +1,47 @@
+#!/bin/sh
+#
+# Path resolution benchmark.
+#
+# Runs busybox applets through a long PATH so that every command lookup walks
+# several missing directories before it finds the binary. This exercises both
+# the positive and negative entries of the vfs component cache.
+#
+# To run it inside the os add it to the initrd with a .initrdrc directive:
+#   scripts/bench/pathwalk.sh:/usr/bin/pathwalk.sh
+#
+# usage: pathwalk.sh [iterations]
+#
+
+ITERATIONS=${1:-1000}
+APPLETS="true echo basename dirname"
+
+LONG_PATH=""
+for d in /opt/bin /usr/local/sbin /usr/local/bin /usr/games /usr/X11/bin \
+         /opt/local/bin /home/bin /var/bin /usr/lib/bin /nix/bin; do
+  LONG_PATH="$LONG_PATH$d:"
+done
+LONG_PATH="$LONG_PATH/usr/sbin:/usr/bin:/sbin:/bin"
+
+run() {
+  i=0
+  while [ $i -lt $ITERATIONS ]; do
+    for applet in $APPLETS; do
+      # use env so the lookup goes through execvp and not the shell's builtins
+      env $applet x >/dev/null
+    done
+    i=$((i + 1))
+  done
+}
+
+echo "pathwalk: $ITERATIONS iterations of '$APPLETS'"
+echo "pathwalk: PATH=$LONG_PATH"
+start=$(date +%s)
+(PATH=$LONG_PATH; export PATH; run)
+end=$(date +%s)
+
+total=$((ITERATIONS * $(echo $APPLETS | wc -w)))
+elapsed=$((end - start))
+echo "pathwalk: $total execs in ${elapsed}s"
+if [ $elapsed -gt 0 ]; then
+  echo "pathwalk: $((total / elapsed)) execs/s"
+fi
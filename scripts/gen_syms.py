@@ -5,8 +5,13 @@ Generate combined symbol table from kernel and program ELF files
 This script extracts symbols from ELF files and creates a unified symbol
 table suitable for use with the QEMU profile resolver.
 
+With --kallsyms it instead writes a C source file containing a compact sorted
+table of the kernel function symbols. This is compiled and linked into the
+final kernel image for in-kernel symbol lookups (see kernel/debug/ksyms.c).
+
 Usage:
     ./generate-syms.py -k kernel.elf -p prog1 -p lib.so@0x7ff000000000 -o system.syms
+    ./generate-syms.py -k kernel.elf --kallsyms -o ksyms.c
 """
 
 import argparse
@@ -18,9 +23,11 @@ from pathlib import Path
 class SymbolExtractor:
     """Extract symbols from ELF files using nm"""
 
-    def __init__(self, annotate_source=False):
+    def __init__(self, annotate_source=False, text_only=False):
         self.symbols = []
         self.annotate_source = annotate_source
+        self.text_only = text_only
+        self.all_addrs = {}
 
     def extract_symbols(self, elf_path, base_address=0, source_name=None):
         """Extract symbols from an ELF file with optional base address adjustment"""
@@ -75,6 +82,12 @@ class SymbolExtractor:
 
                     try:
                         addr = int(addr_str, 16)
+                        self.all_addrs[sym_name] = addr
+
+                        # only keep function symbols if requested
+                        if self.text_only and sym_type not in ['T', 't', 'W']:
+                            continue
+
                         # apply base address adjustment
                         adjusted_addr = addr + base_address
 
@@ -102,6 +115,40 @@ class SymbolExtractor:
         return sorted(self.symbols, key=lambda x: x[0])
 
 
+def write_kallsyms(out_file, symbols, base):
+    """
+    Write a C source file with the kernel symbol table. Addresses are stored as
+    32-bit offsets from base and names as offsets into a single string table.
+    Only one symbol is kept for each address.
+    """
+    entries = []
+    names = []
+    name_off = 0
+    last_addr = None
+    for addr, name in symbols:
+        if addr < base or addr - base >= (1 << 32) or addr == last_addr:
+            continue
+        last_addr = addr
+        entries.append((addr - base, name_off, name))
+        names.append(name)
+        name_off += len(name.encode()) + 1
+
+    with open(out_file, 'w') as f:
+        f.write("// generated by scripts/gen_syms.py - do not edit\n")
+        f.write("#include <kernel/debug/ksyms.h>\n\n")
+        f.write(f"const uint32_t __ksym_count = {len(entries)};\n\n")
+        f.write("const struct ksym __ksym_table[] = {\n")
+        for off, noff, name in entries:
+            f.write(f"  {{0x{off:08x}, {noff}}}, // {name}\n")
+        f.write("};\n\n")
+        f.write("const char __ksym_names[] =\n")
+        for name in names:
+            escaped = name.replace('\\', '\\\\').replace('"', '\\"')
+            f.write(f"  \"{escaped}\\0\"\n")
+        f.write("  \"\";\n")
+    return len(entries)
+
+
 def parse_program_spec(spec):
     """
     Parse program specification in format:
@@ -162,12 +209,15 @@ Examples:
                         help='Output symbol file (default: out.syms)')
     parser.add_argument('-a', '--annotate-source', action='store_true',
                         help='Annotate symbols with source file name (e.g., symbol[libc.so])')
+    parser.add_argument('--kallsyms', action='store_true',
+                        help='Write the kernel function symbols as a C source table (programs are ignored)')
     parser.add_argument('-v', '--verbose', action='store_true',
                         help='Verbose output')
 
     args = parser.parse_args()
 
-    extractor = SymbolExtractor(annotate_source=args.annotate_source)
+    extractor = SymbolExtractor(annotate_source=args.annotate_source and not args.kallsyms,
+                                text_only=args.kallsyms)
 
     # extract kernel symbols first
     if args.verbose:
@@ -181,6 +231,22 @@ Examples:
     if args.verbose:
         print(f"  Found {kernel_sym_count} kernel symbols", file=sys.stderr)
 
+    if args.kallsyms:
+        base = extractor.all_addrs.get('__kernel_code_start')
+        if base is None:
+            print("Error: __kernel_code_start not found in kernel symbols", file=sys.stderr)
+            return 1
+
+        try:
+            count = write_kallsyms(args.out_file, extractor.get_sorted_symbols(), base)
+        except IOError as e:
+            print(f"Error writing output file: {e}", file=sys.stderr)
+            return 1
+
+        if args.verbose:
+            print(f"\nWrote {count} kernel symbols to {args.out_file}", file=sys.stderr)
+        return 0
+
     # extract program symbols
     for prog_spec in args.program:
         try:
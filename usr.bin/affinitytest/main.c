@@ -0,0 +1,204 @@
+//
+// affinitytest - cpu affinity test
+//
+// Starts one spinning thread per online cpu and pins each thread to its own
+// cpu with sched_setaffinity. The placement of every thread is then checked
+// against the Cpu and Cpus_allowed fields reported in /proc/self/status. In a
+// second pass the main thread rotates the pinned threads to the next cpu while
+// they are running and waits for each of them to be migrated.
+//
+// usage: affinitytest [timeout_ms]
+//
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <time.h>
+
+#define MAX_THREADS 32
+
+struct worker {
+  pthread_t thread;
+  int cpu;
+  volatile pid_t tid;
+  volatile int pinned;
+};
+
+static struct worker workers[MAX_THREADS];
+static volatile int stop;
+
+static double now_secs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void sleep_ms(int ms) {
+  struct timespec ts = { .tv_sec = ms / 1000, .tv_nsec = (ms % 1000) * 1000000L };
+  nanosleep(&ts, NULL);
+}
+
+static int pin_thread(pid_t tid, int cpu) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if (syscall(SYS_sched_setaffinity, tid, sizeof(set), &set) < 0) {
+    fprintf(stderr, "sched_setaffinity(%d, cpu %d): %s\n", tid, cpu, strerror(errno));
+    return -1;
+  }
+  return 0;
+}
+
+static void *worker_main(void *arg) {
+  struct worker *w = arg;
+  w->tid = (pid_t)syscall(SYS_gettid);
+  if (pin_thread(0, w->cpu) < 0) {
+    w->pinned = -1;
+    return NULL;
+  }
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (syscall(SYS_sched_getaffinity, 0, sizeof(set), &set) < 0 ||
+      CPU_COUNT(&set) != 1 || !CPU_ISSET(w->cpu, &set)) {
+    fprintf(stderr, "thread %d: sched_getaffinity does not match cpu %d\n", w->tid, w->cpu);
+    w->pinned = -1;
+    return NULL;
+  }
+
+  w->pinned = 1;
+  while (!stop) {
+    // spin so the thread stays on its cpu
+  }
+  return NULL;
+}
+
+// reads the current cpu and allowed cpu list of a thread from /proc/self/status
+static int read_thread_status(pid_t tid, int *cpu, char *allowed, size_t len) {
+  FILE *f = fopen("/proc/self/status", "r");
+  if (f == NULL) {
+    perror("fopen /proc/self/status");
+    return -1;
+  }
+
+  char line[256];
+  int found = 0;
+  while (fgets(line, sizeof(line), f) != NULL) {
+    int t;
+    if (sscanf(line, " TID: %d", &t) == 1) {
+      found = (t == tid);
+      continue;
+    }
+
+    char buf[64];
+    if (found && sscanf(line, " Cpu: %d Cpus_allowed: %63s", cpu, buf) == 2) {
+      snprintf(allowed, len, "%s", buf);
+      fclose(f);
+      return 0;
+    }
+  }
+
+  fclose(f);
+  return -1;
+}
+
+// waits until the thread is reported on the expected cpu
+static int check_placement(struct worker *w, int timeout_ms) {
+  char expected[16];
+  snprintf(expected, sizeof(expected), "%d", w->cpu);
+
+  double deadline = now_secs() + timeout_ms / 1000.0;
+  int cpu = -1;
+  char allowed[64] = "";
+  for (;;) {
+    if (read_thread_status(w->tid, &cpu, allowed, sizeof(allowed)) < 0) {
+      fprintf(stderr, "thread %d: not found in /proc/self/status\n", w->tid);
+      return -1;
+    }
+    if (cpu == w->cpu && strcmp(allowed, expected) == 0)
+      return 0;
+    if (now_secs() > deadline)
+      break;
+    sleep_ms(10);
+  }
+
+  fprintf(stderr, "thread %d: expected cpu %d allowed %s, got cpu %d allowed %s\n",
+          w->tid, w->cpu, expected, cpu, allowed);
+  return -1;
+}
+
+int main(int argc, char **argv) {
+  int timeout_ms = argc > 1 ? atoi(argv[1]) : 1000;
+
+  cpu_set_t online;
+  CPU_ZERO(&online);
+  if (syscall(SYS_sched_getaffinity, 0, sizeof(online), &online) < 0) {
+    perror("sched_getaffinity");
+    return 1;
+  }
+
+  int ncpus = CPU_COUNT(&online);
+  if (ncpus > MAX_THREADS)
+    ncpus = MAX_THREADS;
+  printf("affinitytest: %d cpus\n", ncpus);
+
+  // start one thread pinned to each cpu
+  for (int i = 0; i < ncpus; i++) {
+    struct worker *w = &workers[i];
+    w->cpu = i;
+    if (pthread_create(&w->thread, NULL, worker_main, w) != 0) {
+      perror("pthread_create");
+      return 1;
+    }
+  }
+
+  int failed = 0;
+  for (int i = 0; i < ncpus; i++) {
+    while (workers[i].pinned == 0)
+      sleep_ms(1);
+    if (workers[i].pinned < 0)
+      failed++;
+  }
+
+  printf("%-10s %12s %12s\n", "pass", "threads", "misplaced");
+  if (!failed) {
+    int misplaced = 0;
+    for (int i = 0; i < ncpus; i++) {
+      if (check_placement(&workers[i], timeout_ms) < 0)
+        misplaced++;
+    }
+    printf("%-10s %12d %12d\n", "pin", ncpus, misplaced);
+    failed += misplaced;
+  }
+
+  // move every thread to the next cpu while it is running
+  if (!failed && ncpus > 1) {
+    int misplaced = 0;
+    for (int i = 0; i < ncpus; i++) {
+      struct worker *w = &workers[i];
+      w->cpu = (w->cpu + 1) % ncpus;
+      if (pin_thread(w->tid, w->cpu) < 0)
+        misplaced++;
+    }
+    for (int i = 0; i < ncpus; i++) {
+      if (check_placement(&workers[i], timeout_ms) < 0)
+        misplaced++;
+    }
+    printf("%-10s %12d %12d\n", "migrate", ncpus, misplaced);
+    failed += misplaced;
+  }
+
+  stop = 1;
+  for (int i = 0; i < ncpus; i++) {
+    pthread_join(workers[i].thread, NULL);
+  }
+
+  printf("affinitytest: %s\n", failed ? "FAILED" : "passed");
+  return failed ? 1 : 0;
+}
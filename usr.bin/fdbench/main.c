@@ -0,0 +1,113 @@
+//
+// fdbench - file descriptor lookup scaling benchmark
+//
+// Each thread opens its own descriptor for /dev/zero and does 1-byte reads
+// from it for a fixed amount of time. Every read looks up the descriptor in
+// the shared process file table so the total syscall rate shows how well
+// fd lookups scale with the number of threads.
+//
+// usage: fdbench [max threads] [seconds per run]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#define MAX_THREADS 32
+#define CHECK_INTERVAL 1024
+
+struct worker {
+  pthread_t thread;
+  int fd;
+  unsigned long count;
+};
+
+static volatile int start_flag;
+static volatile int stop_flag;
+
+static double now_secs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void *worker_main(void *arg) {
+  struct worker *w = arg;
+  char c;
+
+  while (!start_flag)
+    ;
+
+  unsigned long count = 0;
+  while (!stop_flag) {
+    for (int i = 0; i < CHECK_INTERVAL; i++) {
+      if (read(w->fd, &c, 1) != 1) {
+        fprintf(stderr, "fdbench: read: %s\n", strerror(errno));
+        w->count = count;
+        return NULL;
+      }
+    }
+    count += CHECK_INTERVAL;
+  }
+
+  w->count = count;
+  return NULL;
+}
+
+static int run(int nthreads, int seconds) {
+  struct worker workers[MAX_THREADS];
+  memset(workers, 0, sizeof(workers));
+  start_flag = 0;
+  stop_flag = 0;
+
+  for (int i = 0; i < nthreads; i++) {
+    workers[i].fd = open("/dev/zero", O_RDONLY);
+    if (workers[i].fd < 0) {
+      fprintf(stderr, "fdbench: open /dev/zero: %s\n", strerror(errno));
+      return -1;
+    }
+    if (pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]) != 0) {
+      fprintf(stderr, "fdbench: pthread_create failed\n");
+      return -1;
+    }
+  }
+
+  double start = now_secs();
+  start_flag = 1;
+  sleep(seconds);
+  stop_flag = 1;
+
+  unsigned long total = 0;
+  for (int i = 0; i < nthreads; i++) {
+    pthread_join(workers[i].thread, NULL);
+    close(workers[i].fd);
+    total += workers[i].count;
+  }
+  double elapsed = now_secs() - start;
+
+  printf("fdbench: %2d threads: %10lu reads in %.2fs, %10.0f syscalls/sec (%.0f per thread)\n",
+         nthreads, total, elapsed, (double)total / elapsed, (double)total / elapsed / nthreads);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  int max_threads = argc > 1 ? atoi(argv[1]) : 8;
+  int seconds = argc > 2 ? atoi(argv[2]) : 2;
+  if (max_threads < 1 || max_threads > MAX_THREADS) {
+    fprintf(stderr, "fdbench: thread count must be between 1 and %d\n", MAX_THREADS);
+    return 1;
+  }
+  if (seconds < 1)
+    seconds = 1;
+
+  for (int n = 1; n <= max_threads; n *= 2) {
+    if (run(n, seconds) < 0)
+      return 1;
+  }
+  return 0;
+}
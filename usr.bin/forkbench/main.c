@@ -0,0 +1,154 @@
+//
+// forkbench - fork latency benchmark
+//
+// Measures the latency of fork for a process with a growing amount of touched
+// private memory. For each size the parent maps and touches an anonymous
+// buffer and then times three cases: fork followed by an immediate _exit in
+// the child, fork followed by an exec of this program (the common shell
+// pattern), and fork where the child writes one byte to every page before
+// exiting. The child of the last case also checks the data it inherited, and
+// the parent checks that its own copy was not changed by the child.
+//
+// usage: forkbench [max size in MB] [iterations]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+
+#define PAGE_SZ 4096
+
+enum mode {
+  MODE_EXIT,
+  MODE_EXEC,
+  MODE_TOUCH,
+};
+
+static const char *mode_names[] = {
+  [MODE_EXIT] = "fork+exit",
+  [MODE_EXEC] = "fork+exec",
+  [MODE_TOUCH] = "fork+touch",
+};
+
+static const char *self_path;
+
+static double now_secs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void fill(char *buf, size_t size, char v) {
+  for (size_t off = 0; off < size; off += PAGE_SZ)
+    buf[off] = (char)(off / PAGE_SZ) + v;
+}
+
+static int check(const char *buf, size_t size, char v) {
+  for (size_t off = 0; off < size; off += PAGE_SZ) {
+    if (buf[off] != (char)(off / PAGE_SZ) + v)
+      return -1;
+  }
+  return 0;
+}
+
+static void run_child(enum mode mode, char *buf, size_t size) {
+  switch (mode) {
+    case MODE_EXIT:
+      _exit(0);
+    case MODE_EXEC:
+      execl(self_path, self_path, "--child", NULL);
+      _exit(127);
+    case MODE_TOUCH:
+      if (check(buf, size, 0) < 0)
+        _exit(2);
+      fill(buf, size, 1);
+      _exit(check(buf, size, 1) < 0 ? 3 : 0);
+  }
+  _exit(1);
+}
+
+// returns the average latency of a fork and wait in microseconds or a negative
+// value on failure. the fork latency alone is returned in fork_us.
+static double run(enum mode mode, char *buf, size_t size, int iterations, double *fork_us) {
+  double fork_total = 0;
+  double start = now_secs();
+  for (int i = 0; i < iterations; i++) {
+    double t = now_secs();
+    pid_t pid = fork();
+    if (pid < 0) {
+      fprintf(stderr, "forkbench: fork: %s\n", strerror(errno));
+      return -1;
+    } else if (pid == 0) {
+      run_child(mode, buf, size);
+    }
+    fork_total += now_secs() - t;
+
+    int status;
+    if (waitpid(pid, &status, 0) < 0) {
+      fprintf(stderr, "forkbench: waitpid: %s\n", strerror(errno));
+      return -1;
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      fprintf(stderr, "forkbench: %s: child failed with status %#x\n", mode_names[mode], status);
+      return -1;
+    }
+  }
+  double elapsed = now_secs() - start;
+
+  if (check(buf, size, 0) < 0) {
+    fprintf(stderr, "forkbench: %s: parent data changed by the child\n", mode_names[mode]);
+    return -1;
+  }
+
+  *fork_us = fork_total * 1e6 / iterations;
+  return elapsed * 1e6 / iterations;
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1 && strcmp(argv[1], "--child") == 0)
+    return 0;
+
+  size_t max_mb = 256;
+  int iterations = 20;
+  if (argc > 1)
+    max_mb = strtoul(argv[1], NULL, 10);
+  if (argc > 2)
+    iterations = atoi(argv[2]);
+  if (max_mb == 0 || iterations <= 0) {
+    fprintf(stderr, "usage: forkbench [max size in MB] [iterations]\n");
+    return 1;
+  }
+  self_path = argv[0];
+
+  printf("forkbench: up to %zuMB, %d iterations\n", max_mb, iterations);
+  printf("%-10s %8s %12s %12s\n", "mode", "size MB", "fork us", "total us");
+  for (size_t mb = 0; mb <= max_mb; mb = mb ? mb * 4 : 1) {
+    size_t size = mb * 1024 * 1024;
+    char *buf = NULL;
+    if (size > 0) {
+      buf = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (buf == MAP_FAILED) {
+        fprintf(stderr, "forkbench: mmap %zuMB: %s\n", mb, strerror(errno));
+        return 1;
+      }
+      fill(buf, size, 0);
+    }
+
+    for (int m = MODE_EXIT; m <= MODE_TOUCH; m++) {
+      double fork_us;
+      double total_us = run(m, buf, size, iterations, &fork_us);
+      if (total_us < 0)
+        return 1;
+      printf("%-10s %8zu %12.1f %12.1f\n", mode_names[m], mb, fork_us, total_us);
+    }
+
+    if (buf != NULL)
+      munmap(buf, size);
+  }
+  return 0;
+}
@@ -0,0 +1,171 @@
+//
+// preadbench - parallel positional read benchmark
+//
+// Creates a large file (on the ramfs root by default) and has 1..N threads
+// read it through a single shared descriptor, first with pread at per-thread
+// offsets and then with read on the shared file offset. Reports the total
+// throughput for each thread count.
+//
+// usage: preadbench [file] [size in MB] [max threads] [seconds per run]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#define MAX_THREADS 32
+#define BLOCK_SIZE 4096
+
+enum mode {
+  MODE_PREAD,
+  MODE_READ,
+};
+
+struct worker {
+  pthread_t thread;
+  int index;
+  unsigned long bytes;
+};
+
+static int fd;
+static off_t file_size;
+static int nthreads;
+static enum mode mode;
+static volatile int start_flag;
+static volatile int stop_flag;
+
+static double now_secs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void *worker_main(void *arg) {
+  struct worker *w = arg;
+  char buf[BLOCK_SIZE];
+
+  while (!start_flag)
+    ;
+
+  // each pread worker walks its own slice of the file
+  off_t nblocks = file_size / BLOCK_SIZE;
+  off_t block = (nblocks / nthreads) * w->index;
+  unsigned long bytes = 0;
+  while (!stop_flag) {
+    ssize_t n;
+    if (mode == MODE_PREAD) {
+      n = pread(fd, buf, BLOCK_SIZE, block * BLOCK_SIZE);
+      if (++block >= nblocks)
+        block = 0;
+    } else {
+      n = read(fd, buf, BLOCK_SIZE);
+      if (n == 0) {
+        // whoever hits the end rewinds the shared offset
+        lseek(fd, 0, SEEK_SET);
+        continue;
+      }
+    }
+
+    if (n < 0) {
+      fprintf(stderr, "preadbench: read: %s\n", strerror(errno));
+      break;
+    }
+    bytes += (unsigned long)n;
+  }
+
+  w->bytes = bytes;
+  return NULL;
+}
+
+static int run(enum mode m, int n, int seconds) {
+  struct worker workers[MAX_THREADS];
+  memset(workers, 0, sizeof(workers));
+  mode = m;
+  nthreads = n;
+  start_flag = 0;
+  stop_flag = 0;
+  lseek(fd, 0, SEEK_SET);
+
+  for (int i = 0; i < n; i++) {
+    workers[i].index = i;
+    if (pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]) != 0) {
+      fprintf(stderr, "preadbench: pthread_create failed\n");
+      return -1;
+    }
+  }
+
+  double start = now_secs();
+  start_flag = 1;
+  sleep(seconds);
+  stop_flag = 1;
+
+  unsigned long total = 0;
+  for (int i = 0; i < n; i++) {
+    pthread_join(workers[i].thread, NULL);
+    total += workers[i].bytes;
+  }
+  double elapsed = now_secs() - start;
+
+  printf("preadbench: %-5s %2d threads: %8.1f MB/s\n", m == MODE_PREAD ? "pread" : "read",
+         n, (double)total / elapsed / (1024 * 1024));
+  return 0;
+}
+
+static int create_file(const char *path, size_t size) {
+  char buf[BLOCK_SIZE];
+  int wfd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (wfd < 0) {
+    fprintf(stderr, "preadbench: open %s: %s\n", path, strerror(errno));
+    return -1;
+  }
+
+  for (size_t off = 0; off < size; off += BLOCK_SIZE) {
+    memset(buf, (int)(off / BLOCK_SIZE), sizeof(buf));
+    if (write(wfd, buf, BLOCK_SIZE) != BLOCK_SIZE) {
+      fprintf(stderr, "preadbench: write: %s\n", strerror(errno));
+      close(wfd);
+      return -1;
+    }
+  }
+  close(wfd);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  const char *path = argc > 1 ? argv[1] : "/tmp/preadbench.dat";
+  int size_mb = argc > 2 ? atoi(argv[2]) : 64;
+  int max_threads = argc > 3 ? atoi(argv[3]) : 8;
+  int seconds = argc > 4 ? atoi(argv[4]) : 2;
+  if (size_mb < 1 || max_threads < 1 || max_threads > MAX_THREADS) {
+    fprintf(stderr, "usage: preadbench [file] [size in MB] [max threads <= %d] [seconds]\n", MAX_THREADS);
+    return 1;
+  }
+  if (seconds < 1)
+    seconds = 1;
+
+  file_size = (off_t)size_mb * 1024 * 1024;
+  printf("preadbench: creating %dMB file %s\n", size_mb, path);
+  if (create_file(path, (size_t)file_size) < 0)
+    return 1;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "preadbench: open %s: %s\n", path, strerror(errno));
+    return 1;
+  }
+
+  int res = 0;
+  for (int n = 1; n <= max_threads && res == 0; n *= 2)
+    res = run(MODE_PREAD, n, seconds);
+  for (int n = 1; n <= max_threads && res == 0; n *= 2)
+    res = run(MODE_READ, n, seconds);
+
+  close(fd);
+  unlink(path);
+  return res == 0 ? 0 : 1;
+}
@@ -0,0 +1,149 @@
+//
+// reallocbench - large buffer growth benchmark
+//
+// Grows a buffer by doubling from 64KB up to a maximum size, touching every
+// page after each step. Each step is done three ways: with mremap (which moves
+// the page table entries when the mapping cannot grow in place), with realloc,
+// and with a fresh mmap plus memcpy and munmap of the old buffer. Reports the
+// total time and the effective growth rate for each method.
+//
+// usage: reallocbench [max size in MB] [iterations]
+//
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#define MIN_SIZE (64 * 1024)
+#define PAGE_SZ  4096
+
+enum method {
+  METHOD_MREMAP,
+  METHOD_REALLOC,
+  METHOD_COPY,
+};
+
+static const char *method_names[] = {
+  [METHOD_MREMAP] = "mremap",
+  [METHOD_REALLOC] = "realloc",
+  [METHOD_COPY] = "mmap+copy",
+};
+
+static double now_secs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void touch(char *buf, size_t start, size_t end) {
+  for (size_t off = start; off < end; off += PAGE_SZ)
+    buf[off] = (char)(off / PAGE_SZ);
+}
+
+static int check(const char *buf, size_t size) {
+  for (size_t off = 0; off < size; off += PAGE_SZ) {
+    if (buf[off] != (char)(off / PAGE_SZ))
+      return -1;
+  }
+  return 0;
+}
+
+static void *map_anon(size_t size) {
+  void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  return p == MAP_FAILED ? NULL : p;
+}
+
+// grows a buffer from MIN_SIZE to max_size and returns the number of bytes that
+// ended up being grown, or 0 on failure.
+static size_t run_once(enum method method, size_t max_size) {
+  size_t size = MIN_SIZE;
+  char *buf = method == METHOD_REALLOC ? malloc(size) : map_anon(size);
+  if (buf == NULL) {
+    fprintf(stderr, "reallocbench: %s: alloc: %s\n", method_names[method], strerror(errno));
+    return 0;
+  }
+  touch(buf, 0, size);
+
+  size_t grown = 0;
+  while (size < max_size) {
+    size_t new_size = size * 2;
+    char *new_buf;
+    switch (method) {
+      case METHOD_MREMAP:
+        new_buf = mremap(buf, size, new_size, MREMAP_MAYMOVE);
+        if (new_buf == MAP_FAILED)
+          new_buf = NULL;
+        break;
+      case METHOD_REALLOC:
+        new_buf = realloc(buf, new_size);
+        break;
+      case METHOD_COPY:
+        new_buf = map_anon(new_size);
+        if (new_buf != NULL) {
+          memcpy(new_buf, buf, size);
+          munmap(buf, size);
+        }
+        break;
+    }
+
+    if (new_buf == NULL) {
+      fprintf(stderr, "reallocbench: %s: grow to %zu: %s\n", method_names[method], new_size, strerror(errno));
+      method == METHOD_REALLOC ? free(buf) : munmap(buf, size);
+      return 0;
+    }
+
+    buf = new_buf;
+    touch(buf, size, new_size);
+    grown += new_size - size;
+    size = new_size;
+  }
+
+  if (check(buf, size) < 0) {
+    fprintf(stderr, "reallocbench: %s: data mismatch\n", method_names[method]);
+    grown = 0;
+  }
+
+  if (method == METHOD_REALLOC)
+    free(buf);
+  else
+    munmap(buf, size);
+  return grown;
+}
+
+int main(int argc, char **argv) {
+  size_t max_mb = 64;
+  int iterations = 10;
+  if (argc > 1)
+    max_mb = strtoul(argv[1], NULL, 10);
+  if (argc > 2)
+    iterations = atoi(argv[2]);
+  if (max_mb == 0 || iterations <= 0) {
+    fprintf(stderr, "usage: reallocbench [max size in MB] [iterations]\n");
+    return 1;
+  }
+
+  size_t max_size = max_mb * 1024 * 1024;
+  printf("reallocbench: %dKB -> %zuMB, %d iterations\n", MIN_SIZE / 1024, max_mb, iterations);
+  printf("%-10s %12s %12s\n", "method", "ms/iter", "MB/s");
+
+  for (int m = METHOD_MREMAP; m <= METHOD_COPY; m++) {
+    size_t total = 0;
+    double start = now_secs();
+    for (int i = 0; i < iterations; i++) {
+      size_t grown = run_once(m, max_size);
+      if (grown == 0)
+        return 1;
+      total += grown;
+    }
+    double elapsed = now_secs() - start;
+
+    printf("%-10s %12.3f %12.1f\n", method_names[m],
+           elapsed * 1000.0 / iterations, (double)total / (1024.0 * 1024.0) / elapsed);
+  }
+  return 0;
+}
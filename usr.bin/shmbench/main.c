@@ -0,0 +1,274 @@
+//
+// shmbench - frame presentation benchmark
+//
+// Models an X11 client presenting frames to the server. A child process
+// renders frames and hands them to the parent, which copies each frame into
+// its own framebuffer and acknowledges it. Frames are presented three ways:
+// written through a unix stream socket (like XPutImage), through a memfd that
+// is passed to the server once with SCM_RIGHTS, and through a sysv shared
+// memory segment whose id is sent over the socket (like MIT-SHM). Reports the
+// frame rate and bandwidth for each method.
+//
+// usage: shmbench [width] [height] [frames]
+//
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/shm.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+
+enum method {
+  METHOD_SOCKET,
+  METHOD_MEMFD,
+  METHOD_SYSV,
+};
+
+static const char *method_names[] = {
+  [METHOD_SOCKET] = "socket",
+  [METHOD_MEMFD] = "memfd",
+  [METHOD_SYSV] = "sysv shm",
+};
+
+static double now_secs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int read_full(int fd, void *buf, size_t len) {
+  size_t off = 0;
+  while (off < len) {
+    ssize_t n = read(fd, (char *)buf + off, len - off);
+    if (n <= 0)
+      return -1;
+    off += n;
+  }
+  return 0;
+}
+
+static int write_full(int fd, const void *buf, size_t len) {
+  size_t off = 0;
+  while (off < len) {
+    ssize_t n = write(fd, (const char *)buf + off, len - off);
+    if (n <= 0)
+      return -1;
+    off += n;
+  }
+  return 0;
+}
+
+static int send_fd(int sock, int fd) {
+  char byte = 0;
+  struct iovec iov = { .iov_base = &byte, .iov_len = 1 };
+  char control[CMSG_SPACE(sizeof(int))];
+  struct msghdr msg = {
+    .msg_iov = &iov,
+    .msg_iovlen = 1,
+    .msg_control = control,
+    .msg_controllen = sizeof(control),
+  };
+
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+  return sendmsg(sock, &msg, 0) == 1 ? 0 : -1;
+}
+
+static int recv_fd(int sock) {
+  char byte;
+  struct iovec iov = { .iov_base = &byte, .iov_len = 1 };
+  char control[CMSG_SPACE(sizeof(int))];
+  struct msghdr msg = {
+    .msg_iov = &iov,
+    .msg_iovlen = 1,
+    .msg_control = control,
+    .msg_controllen = sizeof(control),
+  };
+
+  if (recvmsg(sock, &msg, 0) != 1)
+    return -1;
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  if (cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+    return -1;
+
+  int fd;
+  memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+  return fd;
+}
+
+static void render(uint32_t *frame, size_t npixels, uint32_t n) {
+  for (size_t i = 0; i < npixels; i++)
+    frame[i] = n + (uint32_t)i;
+}
+
+//
+// client side - renders and presents the frames
+//
+
+static int client(enum method method, int sock, size_t size, int frames) {
+  uint32_t *frame = NULL;
+  switch (method) {
+    case METHOD_SOCKET:
+      frame = malloc(size);
+      break;
+    case METHOD_MEMFD: {
+      int fd = memfd_create("shmbench", MFD_CLOEXEC);
+      if (fd < 0 || ftruncate(fd, (off_t)size) < 0) {
+        perror("shmbench: memfd");
+        return 1;
+      }
+      frame = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      if (frame == MAP_FAILED || send_fd(sock, fd) < 0) {
+        perror("shmbench: memfd: share");
+        return 1;
+      }
+      close(fd);
+      break;
+    }
+    case METHOD_SYSV: {
+      int id = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+      if (id < 0) {
+        perror("shmbench: shmget");
+        return 1;
+      }
+      frame = shmat(id, NULL, 0);
+      if (frame == (void *)-1 || write_full(sock, &id, sizeof(id)) < 0) {
+        perror("shmbench: shmat");
+        return 1;
+      }
+      break;
+    }
+  }
+  if (frame == NULL || frame == MAP_FAILED) {
+    fprintf(stderr, "shmbench: %s: no frame buffer\n", method_names[method]);
+    return 1;
+  }
+
+  for (uint32_t n = 0; n < (uint32_t)frames; n++) {
+    render(frame, size / sizeof(uint32_t), n);
+    int res = method == METHOD_SOCKET ? write_full(sock, frame, size) : write_full(sock, &n, sizeof(n));
+    char ack;
+    if (res < 0 || read_full(sock, &ack, 1) < 0) {
+      fprintf(stderr, "shmbench: %s: present: %s\n", method_names[method], strerror(errno));
+      return 1;
+    }
+  }
+  return 0;
+}
+
+//
+// server side - copies each frame into its framebuffer
+//
+
+static int server(enum method method, int sock, size_t size, int frames) {
+  uint32_t *fb = malloc(size);
+  uint32_t *shared = NULL;
+  int shmid = -1;
+  if (method == METHOD_MEMFD) {
+    int fd = recv_fd(sock);
+    if (fd < 0) {
+      fprintf(stderr, "shmbench: memfd: no fd received\n");
+      return -1;
+    }
+    shared = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+  } else if (method == METHOD_SYSV) {
+    if (read_full(sock, &shmid, sizeof(shmid)) < 0)
+      return -1;
+    shared = shmat(shmid, NULL, SHM_RDONLY);
+    // the segment goes away once both sides have detached
+    shmctl(shmid, IPC_RMID, NULL);
+  }
+  if (fb == NULL || shared == MAP_FAILED || shared == (void *)-1) {
+    fprintf(stderr, "shmbench: %s: cannot map frame: %s\n", method_names[method], strerror(errno));
+    return -1;
+  }
+
+  int res = 0;
+  for (uint32_t n = 0; n < (uint32_t)frames; n++) {
+    if (method == METHOD_SOCKET) {
+      res = read_full(sock, fb, size);
+    } else {
+      uint32_t seq;
+      res = read_full(sock, &seq, sizeof(seq));
+      if (res == 0)
+        memcpy(fb, shared, size);
+    }
+    if (res < 0 || fb[0] != n || fb[size / sizeof(uint32_t) - 1] != n + (uint32_t)(size / sizeof(uint32_t) - 1)) {
+      fprintf(stderr, "shmbench: %s: bad frame %u\n", method_names[method], n);
+      return -1;
+    }
+    char ack = 0;
+    if (write_full(sock, &ack, 1) < 0)
+      return -1;
+  }
+
+  if (method == METHOD_MEMFD)
+    munmap(shared, size);
+  else if (method == METHOD_SYSV)
+    shmdt(shared);
+  free(fb);
+  return res;
+}
+
+int main(int argc, char **argv) {
+  int width = 640;
+  int height = 400;
+  int frames = 500;
+  if (argc > 1)
+    width = atoi(argv[1]);
+  if (argc > 2)
+    height = atoi(argv[2]);
+  if (argc > 3)
+    frames = atoi(argv[3]);
+  if (width <= 0 || height <= 0 || frames <= 0) {
+    fprintf(stderr, "usage: shmbench [width] [height] [frames]\n");
+    return 1;
+  }
+
+  size_t size = (size_t)width * height * sizeof(uint32_t);
+  printf("shmbench: %dx%d frames (%zuKB), %d frames\n", width, height, size / 1024, frames);
+  printf("%-10s %12s %12s\n", "method", "frames/s", "MB/s");
+
+  for (int m = METHOD_SOCKET; m <= METHOD_SYSV; m++) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+      perror("shmbench: socketpair");
+      return 1;
+    }
+
+    double start = now_secs();
+    pid_t pid = fork();
+    if (pid < 0) {
+      perror("shmbench: fork");
+      return 1;
+    } else if (pid == 0) {
+      close(sv[0]);
+      _exit(client(m, sv[1], size, frames));
+    }
+
+    close(sv[1]);
+    int res = server(m, sv[0], size, frames);
+    close(sv[0]);
+
+    int status;
+    waitpid(pid, &status, 0);
+    double elapsed = now_secs() - start;
+    if (res < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+      return 1;
+
+    printf("%-10s %12.1f %12.1f\n", method_names[m],
+           frames / elapsed, (double)size * frames / (1024.0 * 1024.0) / elapsed);
+  }
+  return 0;
+}
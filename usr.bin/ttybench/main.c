@@ -0,0 +1,188 @@
+//
+// ttybench - tty throughput benchmark
+//
+// Measures the throughput of a pty pair. For the output direction a thread
+// drains the master while the main thread writes blocks to the slave, once
+// with the default (cooked, OPOST|ONLCR) settings and once in raw mode. For
+// the input direction the main thread writes blocks to the master while a
+// thread reads them from a raw slave. The data read back is checked against
+// what was written (with NL expanded to CRLF in the cooked case).
+//
+// usage: ttybench [size in MB] [block size]
+//
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <termios.h>
+#include <time.h>
+
+enum mode {
+  MODE_COOKED_OUT,
+  MODE_RAW_OUT,
+  MODE_RAW_IN,
+};
+
+static const char *mode_names[] = {
+  [MODE_COOKED_OUT] = "cooked out",
+  [MODE_RAW_OUT] = "raw out",
+  [MODE_RAW_IN] = "raw in",
+};
+
+struct reader {
+  int fd;
+  size_t expected;  // bytes to read
+  size_t nread;
+  int cooked;       // data is expected with NL expanded to CRLF
+  int errors;
+};
+
+static double now_secs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// the byte at a position of the written stream. lines of 79 printable
+// characters and a newline, like text output.
+static char pattern_at(size_t pos) {
+  size_t col = pos % 80;
+  return col == 79 ? '\n' : (char)('!' + (pos / 80 + col) % 94);
+}
+
+static void *reader_main(void *arg) {
+  struct reader *r = arg;
+  char buf[8192];
+  size_t pos = 0;   // position in the written stream
+  int pending_cr = 0;
+  while (r->nread < r->expected) {
+    ssize_t n = read(r->fd, buf, sizeof(buf));
+    if (n <= 0) {
+      if (n < 0 && errno == EINTR)
+        continue;
+      fprintf(stderr, "read: %s\n", n < 0 ? strerror(errno) : "eof");
+      r->errors++;
+      break;
+    }
+
+    for (ssize_t i = 0; i < n; i++) {
+      char expected = pattern_at(pos);
+      if (r->cooked && expected == '\n' && !pending_cr) {
+        if (buf[i] != '\r')
+          r->errors++;
+        pending_cr = 1;
+        continue;
+      }
+      if (buf[i] != expected)
+        r->errors++;
+      pending_cr = 0;
+      pos++;
+    }
+    r->nread += (size_t)n;
+  }
+  return NULL;
+}
+
+static int open_pty(int *master, int *slave) {
+  *master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (*master < 0) {
+    perror("posix_openpt");
+    return -1;
+  }
+  if (grantpt(*master) < 0 || unlockpt(*master) < 0) {
+    perror("grantpt/unlockpt");
+    close(*master);
+    return -1;
+  }
+
+  char *name = ptsname(*master);
+  *slave = name ? open(name, O_RDWR | O_NOCTTY) : -1;
+  if (*slave < 0) {
+    perror("open slave");
+    close(*master);
+    return -1;
+  }
+  return 0;
+}
+
+static int run(enum mode mode, size_t total, size_t block) {
+  int master, slave;
+  if (open_pty(&master, &slave) < 0)
+    return -1;
+
+  struct termios t;
+  tcgetattr(slave, &t);
+  if (mode != MODE_COOKED_OUT)
+    cfmakeraw(&t);
+  tcsetattr(slave, TCSANOW, &t);
+
+  char *buf = malloc(block);
+  size_t lines = total / 80;
+  total = lines * 80;
+
+  struct reader r = {
+    .fd = mode == MODE_RAW_IN ? slave : master,
+    .expected = mode == MODE_COOKED_OUT ? total + lines : total,
+    .cooked = mode == MODE_COOKED_OUT,
+  };
+  int wfd = mode == MODE_RAW_IN ? master : slave;
+
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, reader_main, &r) != 0) {
+    perror("pthread_create");
+    return -1;
+  }
+
+  int errors = 0;
+  double start = now_secs();
+  for (size_t pos = 0; pos < total; ) {
+    size_t len = total - pos < block ? total - pos : block;
+    for (size_t i = 0; i < len; i++)
+      buf[i] = pattern_at(pos + i);
+
+    ssize_t n = write(wfd, buf, len);
+    if (n < 0) {
+      if (errno == EINTR || errno == EAGAIN)
+        continue;
+      perror("write");
+      errors++;
+      break;
+    }
+    pos += (size_t)n;
+  }
+  pthread_join(thread, NULL);
+  double secs = now_secs() - start;
+  errors += r.errors;
+
+  printf("%-12s %10zu %12.2f %8d\n", mode_names[mode], total,
+         secs > 0 ? (double)total / secs / (1024 * 1024) : 0.0, errors);
+
+  free(buf);
+  close(slave);
+  close(master);
+  return errors ? -1 : 0;
+}
+
+int main(int argc, char **argv) {
+  size_t total = (argc > 1 ? (size_t)atoi(argv[1]) : 16) * 1024 * 1024;
+  size_t block = argc > 2 ? (size_t)atoi(argv[2]) : 4096;
+  if (block == 0) {
+    fprintf(stderr, "invalid block size\n");
+    return 1;
+  }
+
+  int failed = 0;
+  printf("%-12s %10s %12s %8s\n", "mode", "bytes", "MB/s", "errors");
+  for (int mode = MODE_COOKED_OUT; mode <= MODE_RAW_IN; mode++) {
+    if (run(mode, total, block) < 0)
+      failed++;
+  }
+
+  printf("ttybench: %s\n", failed ? "FAILED" : "passed");
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,223 @@
+//
+// udpbench - batched UDP packet rate benchmark
+//
+// Sends small datagrams over loopback from one thread to a receiver thread
+// and reports the received packets per second for batch sizes 1..64. Each
+// batch size is run three ways:
+//   msg    one sendto()/recvfrom() per datagram
+//   mmsg   sendmmsg()/recvmmsg() with the whole batch in one call
+//   gso    one send() with UDP_SEGMENT that the kernel splits into the
+//          batch of datagrams, received with recvmmsg()
+// The sender stops when it gets too far ahead of the receiver so that the
+// socket queue does not grow without bound.
+//
+// usage: udpbench [packet size] [seconds per run]
+//
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <arpa/inet.h>
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+
+#define MAX_BATCH 64
+#define MAX_PKT_SIZE 1400
+#define WINDOW 512
+
+enum mode {
+  MODE_MSG,
+  MODE_MMSG,
+  MODE_GSO,
+};
+
+static const char *mode_names[] = { "msg", "mmsg", "gso" };
+
+static int tx_fd;
+static int rx_fd;
+static int pkt_size = 64;
+static int seconds = 2;
+
+static enum mode mode;
+static int batch;
+static volatile unsigned long sent;
+static volatile unsigned long received;
+static volatile int stop_flag;
+
+static char tx_bufs[MAX_BATCH][MAX_PKT_SIZE];
+static char rx_bufs[MAX_BATCH][MAX_PKT_SIZE];
+
+static double now_secs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void die(const char *what) {
+  fprintf(stderr, "udpbench: %s: %s\n", what, strerror(errno));
+  exit(1);
+}
+
+static void *receiver(void *arg) {
+  struct mmsghdr msgs[MAX_BATCH];
+  struct iovec iovs[MAX_BATCH];
+  memset(msgs, 0, sizeof(msgs));
+  for (int i = 0; i < MAX_BATCH; i++) {
+    iovs[i].iov_base = rx_bufs[i];
+    iovs[i].iov_len = MAX_PKT_SIZE;
+    msgs[i].msg_hdr.msg_iov = &iovs[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  for (;;) {
+    int n;
+    if (mode == MODE_MSG) {
+      n = recvfrom(rx_fd, rx_bufs[0], MAX_PKT_SIZE, 0, NULL, NULL) < 0 ? -1 : 1;
+    } else {
+      struct timespec timeout = { 0, 100 * 1000 * 1000 };
+      n = recvmmsg(rx_fd, msgs, batch, MSG_WAITFORONE, &timeout);
+    }
+
+    if (n < 0) {
+      if (errno == EAGAIN || errno == EINTR) {
+        if (stop_flag && received >= sent)
+          break;
+        continue;
+      }
+      die("recv");
+    }
+    __atomic_add_fetch(&received, n, __ATOMIC_RELAXED);
+    if (stop_flag && received >= sent)
+      break;
+  }
+  return NULL;
+}
+
+static int send_batch(struct mmsghdr *msgs) {
+  switch (mode) {
+    case MODE_MSG:
+      for (int i = 0; i < batch; i++) {
+        if (send(tx_fd, tx_bufs[i], pkt_size, 0) < 0)
+          return -1;
+      }
+      return batch;
+    case MODE_MMSG:
+      return sendmmsg(tx_fd, msgs, batch, 0);
+    case MODE_GSO: {
+      // the batch is contiguous in tx_bufs so send it as one buffer
+      struct iovec iov = { .iov_base = tx_bufs[0], .iov_len = (size_t)batch * pkt_size };
+      char control[CMSG_SPACE(sizeof(uint16_t))];
+      struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control,
+        .msg_controllen = sizeof(control),
+      };
+      struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+      cmsg->cmsg_level = SOL_UDP;
+      cmsg->cmsg_type = UDP_SEGMENT;
+      cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+      *(uint16_t *)CMSG_DATA(cmsg) = (uint16_t)pkt_size;
+      if (sendmsg(tx_fd, &msg, 0) < 0)
+        return -1;
+      return batch;
+    }
+  }
+  return -1;
+}
+
+static double run(void) {
+  struct mmsghdr msgs[MAX_BATCH];
+  struct iovec iovs[MAX_BATCH];
+  memset(msgs, 0, sizeof(msgs));
+  for (int i = 0; i < MAX_BATCH; i++) {
+    // pack the payloads back to back so gso can send them in one buffer
+    iovs[i].iov_base = (char *)tx_bufs + (size_t)i * pkt_size;
+    iovs[i].iov_len = pkt_size;
+    msgs[i].msg_hdr.msg_iov = &iovs[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  sent = 0;
+  received = 0;
+  stop_flag = 0;
+
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, receiver, NULL) != 0)
+    die("pthread_create");
+
+  double start = now_secs();
+  double end = start + seconds;
+  while (now_secs() < end) {
+    while (sent - received > WINDOW && now_secs() < end)
+      sched_yield();
+
+    int n = send_batch(msgs);
+    if (n < 0)
+      die("send");
+    __atomic_add_fetch(&sent, n, __ATOMIC_RELAXED);
+  }
+  stop_flag = 1;
+  pthread_join(thread, NULL);
+
+  return (double)received / (now_secs() - start);
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1)
+    pkt_size = atoi(argv[1]);
+  if (argc > 2)
+    seconds = atoi(argv[2]);
+  if (pkt_size <= 0 || pkt_size > MAX_PKT_SIZE || seconds <= 0) {
+    fprintf(stderr, "usage: udpbench [packet size] [seconds per run]\n");
+    return 1;
+  }
+
+  struct sockaddr_in addr = {
+    .sin_family = AF_INET,
+    .sin_port = 0,
+    .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+  };
+  socklen_t addrlen = sizeof(addr);
+
+  if ((rx_fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+    die("socket");
+  if (bind(rx_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    die("bind");
+  if (getsockname(rx_fd, (struct sockaddr *)&addr, &addrlen) < 0)
+    die("getsockname");
+
+  if ((tx_fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+    die("socket");
+  if (connect(tx_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    die("connect");
+
+  memset(tx_bufs, 'x', sizeof(tx_bufs));
+  printf("udpbench: %d byte packets, %ds per run\n", pkt_size, seconds);
+  printf("udpbench: batch %12s %12s %12s  (packets/s)\n", mode_names[MODE_MSG], mode_names[MODE_MMSG], mode_names[MODE_GSO]);
+  for (batch = 1; batch <= MAX_BATCH; batch *= 2) {
+    double rates[3];
+    for (mode = MODE_MSG; mode <= MODE_GSO; mode++) {
+      rates[mode] = run();
+    }
+    printf("udpbench: %5d %12.0f %12.0f %12.0f\n", batch, rates[MODE_MSG], rates[MODE_MMSG], rates[MODE_GSO]);
+  }
+
+  close(tx_fd);
+  close(rx_fd);
+  return 0;
+}
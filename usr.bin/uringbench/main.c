@@ -0,0 +1,212 @@
+//
+// uringbench - io_uring vs blocking syscall benchmark
+//
+// Runs the same operations through plain blocking system calls and through
+// an io_uring instance with a batch of requests in flight, and reports the
+// operations per second for each. The tests are
+//   nop    getppid() against IORING_OP_NOP (the raw submission overhead)
+//   read   4K pread() of a cached file against IORING_OP_READ
+//   sock   send()+recv() on a socketpair against IORING_OP_SEND/RECV
+//   pipe   write()+read() on a pipe against IORING_OP_WRITE/READ (these
+//          can block so they go through the ring's worker threads)
+//
+// usage: uringbench [-s] [-d depth] [-t seconds] [test...]
+//   -s  use a kernel submission polling thread (IORING_SETUP_SQPOLL)
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+
+#include "uring.h"
+
+#define BLK_SIZE 4096
+#define FILE_BLOCKS 256
+#define MSG_SIZE 64
+#define MAX_DEPTH 256
+
+static struct io_uring ring;
+static int depth = 32;
+static int seconds = 2;
+static int sqpoll;
+
+static int file_fd = -1;
+static int sock_fds[2] = {-1, -1};
+static int pipe_fds[2] = {-1, -1};
+static char bufs[MAX_DEPTH][BLK_SIZE];
+
+static double now_secs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void die(const char *what, int err) {
+  fprintf(stderr, "uringbench: %s: %s\n", what, strerror(err));
+  exit(1);
+}
+
+//
+// blocking syscall loops
+//
+
+static int sync_op(const char *test, unsigned long i) {
+  char *buf = bufs[0];
+  if (strcmp(test, "nop") == 0) {
+    getppid();
+  } else if (strcmp(test, "read") == 0) {
+    off_t off = (off_t)(i % FILE_BLOCKS) * BLK_SIZE;
+    if (pread(file_fd, buf, BLK_SIZE, off) != BLK_SIZE)
+      return -1;
+  } else if (strcmp(test, "sock") == 0) {
+    if (send(sock_fds[0], buf, MSG_SIZE, 0) != MSG_SIZE || recv(sock_fds[1], buf, MSG_SIZE, 0) != MSG_SIZE)
+      return -1;
+  } else if (strcmp(test, "pipe") == 0) {
+    if (write(pipe_fds[1], buf, MSG_SIZE) != MSG_SIZE || read(pipe_fds[0], buf, MSG_SIZE) != MSG_SIZE)
+      return -1;
+  }
+  return 0;
+}
+
+static double run_sync(const char *test) {
+  unsigned long ops = 0;
+  double start = now_secs();
+  double end = start + seconds;
+  double t;
+  do {
+    for (int i = 0; i < 256; i++) {
+      if (sync_op(test, ops) < 0)
+        die(test, errno);
+      ops++;
+    }
+  } while ((t = now_secs()) < end);
+  return (double)ops / (t - start);
+}
+
+//
+// io_uring loops
+//
+
+// queues one operation, returns the number of sqes used
+static int queue_op(const char *test, unsigned long i, int slot) {
+  char *buf = bufs[slot];
+  struct io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+  if (strcmp(test, "nop") == 0) {
+    io_uring_prep_nop(sqe);
+  } else if (strcmp(test, "read") == 0) {
+    io_uring_prep_read(sqe, file_fd, buf, BLK_SIZE, (i % FILE_BLOCKS) * BLK_SIZE);
+  } else if (strcmp(test, "sock") == 0) {
+    io_uring_prep_send(sqe, sock_fds[0], buf, MSG_SIZE, 0);
+    sqe = io_uring_get_sqe(&ring);
+    io_uring_prep_recv(sqe, sock_fds[1], buf, MSG_SIZE, 0);
+    return 2;
+  } else if (strcmp(test, "pipe") == 0) {
+    io_uring_prep_write(sqe, pipe_fds[1], buf, MSG_SIZE, -1);
+    sqe = io_uring_get_sqe(&ring);
+    io_uring_prep_read(sqe, pipe_fds[0], buf, MSG_SIZE, -1);
+    return 2;
+  }
+  return 1;
+}
+
+static double run_uring(const char *test) {
+  unsigned long ops = 0;
+  int per_op = (strcmp(test, "sock") == 0 || strcmp(test, "pipe") == 0) ? 2 : 1;
+  int batch = depth / per_op;
+  double start = now_secs();
+  double end = start + seconds;
+  double t;
+  do {
+    int queued = 0;
+    for (int i = 0; i < batch; i++)
+      queued += queue_op(test, ops + i, i);
+
+    int res = io_uring_submit_and_wait(&ring, queued);
+    if (res < 0)
+      die("io_uring_submit", -res);
+
+    for (int i = 0; i < queued; i++) {
+      struct io_uring_cqe *cqe;
+      if ((res = io_uring_wait_cqe(&ring, &cqe)) < 0)
+        die("io_uring_wait_cqe", -res);
+      if (cqe->res < 0)
+        die(test, -cqe->res);
+      io_uring_cqe_seen(&ring, cqe);
+    }
+    ops += batch;
+  } while ((t = now_secs()) < end);
+  return (double)ops / (t - start);
+}
+
+//
+
+static void setup_files(void) {
+  char path[] = "/tmp/uringbench.XXXXXX";
+  if ((file_fd = mkstemp(path)) < 0)
+    die("mkstemp", errno);
+  unlink(path);
+
+  memset(bufs[0], 'x', BLK_SIZE);
+  for (int i = 0; i < FILE_BLOCKS; i++) {
+    if (write(file_fd, bufs[0], BLK_SIZE) != BLK_SIZE)
+      die("write", errno);
+  }
+
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sock_fds) < 0)
+    die("socketpair", errno);
+  if (pipe(pipe_fds) < 0)
+    die("pipe", errno);
+}
+
+static void usage(void) {
+  fprintf(stderr, "usage: uringbench [-s] [-d depth] [-t seconds] [nop|read|sock|pipe...]\n");
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  int opt;
+  while ((opt = getopt(argc, argv, "sd:t:")) != -1) {
+    switch (opt) {
+      case 's': sqpoll = 1; break;
+      case 'd': depth = atoi(optarg); break;
+      case 't': seconds = atoi(optarg); break;
+      default: usage();
+    }
+  }
+  if (depth < 2 || depth > MAX_DEPTH || seconds <= 0)
+    usage();
+
+  static const char *all_tests[] = {"nop", "read", "sock", "pipe"};
+  const char **tests = all_tests;
+  int ntests = 4;
+  if (optind < argc) {
+    tests = (const char **)&argv[optind];
+    ntests = argc - optind;
+  }
+
+  setup_files();
+
+  int res = io_uring_queue_init((unsigned)depth, &ring, sqpoll ? IORING_SETUP_SQPOLL : 0);
+  if (res < 0)
+    die("io_uring_queue_init", -res);
+
+  printf("uringbench: depth %d, %ds per run%s\n", depth, seconds, sqpoll ? ", sqpoll" : "");
+  for (int i = 0; i < ntests; i++) {
+    const char *test = tests[i];
+    if (strcmp(test, "nop") && strcmp(test, "read") && strcmp(test, "sock") && strcmp(test, "pipe"))
+      usage();
+
+    double sync_rate = run_sync(test);
+    double uring_rate = run_uring(test);
+    printf("uringbench: %-4s  syscall %10.0f ops/s  io_uring %10.0f ops/s  (%.2fx)\n",
+           test, sync_rate, uring_rate, uring_rate / sync_rate);
+  }
+
+  io_uring_queue_exit(&ring);
+  return 0;
+}
@@ -0,0 +1,313 @@
+//
+// uring.h - minimal liburing compatible interface
+//
+// Implements the subset of the liburing api used by uringbench directly on
+// top of the io_uring system calls so that programs written against liburing
+// can be built without it. Function names, arguments and semantics follow
+// liburing.
+//
+
+#ifndef URINGBENCH_URING_H
+#define URINGBENCH_URING_H
+
+#include <errno.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+struct io_uring_sq {
+  unsigned *khead;
+  unsigned *ktail;
+  unsigned *kring_mask;
+  unsigned *kring_entries;
+  unsigned *kflags;
+  unsigned *kdropped;
+  unsigned *array;
+  struct io_uring_sqe *sqes;
+
+  unsigned sqe_head;
+  unsigned sqe_tail;
+
+  size_t ring_sz;
+  void *ring_ptr;
+};
+
+struct io_uring_cq {
+  unsigned *khead;
+  unsigned *ktail;
+  unsigned *kring_mask;
+  unsigned *kring_entries;
+  unsigned *koverflow;
+  struct io_uring_cqe *cqes;
+
+  size_t ring_sz;
+  void *ring_ptr;
+};
+
+struct io_uring {
+  struct io_uring_sq sq;
+  struct io_uring_cq cq;
+  unsigned flags;
+  int ring_fd;
+};
+
+#define io_uring_smp_store_release(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define io_uring_smp_load_acquire(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+
+static inline int __sys_io_uring_setup(unsigned entries, struct io_uring_params *p) {
+  long res = syscall(SYS_io_uring_setup, entries, p);
+  return res < 0 ? -errno : (int) res;
+}
+
+static inline int __sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+  long res = syscall(SYS_io_uring_enter, fd, to_submit, min_complete, flags, NULL, _NSIG / 8);
+  return res < 0 ? -errno : (int) res;
+}
+
+//
+// setup and teardown
+//
+
+static inline int io_uring_queue_init_params(unsigned entries, struct io_uring *ring, struct io_uring_params *p) {
+  memset(ring, 0, sizeof(*ring));
+  int fd = __sys_io_uring_setup(entries, p);
+  if (fd < 0)
+    return fd;
+
+  struct io_uring_sq *sq = &ring->sq;
+  struct io_uring_cq *cq = &ring->cq;
+  sq->ring_sz = p->sq_off.array + p->sq_entries * sizeof(unsigned);
+  cq->ring_sz = p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+  if (p->features & IORING_FEAT_SINGLE_MMAP) {
+    if (cq->ring_sz > sq->ring_sz)
+      sq->ring_sz = cq->ring_sz;
+    cq->ring_sz = sq->ring_sz;
+  }
+
+  sq->ring_ptr = mmap(NULL, sq->ring_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (sq->ring_ptr == MAP_FAILED)
+    goto fail;
+  if (p->features & IORING_FEAT_SINGLE_MMAP) {
+    cq->ring_ptr = sq->ring_ptr;
+  } else {
+    cq->ring_ptr = mmap(NULL, cq->ring_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if (cq->ring_ptr == MAP_FAILED)
+      goto fail_sq;
+  }
+
+  size_t sqes_sz = p->sq_entries * sizeof(struct io_uring_sqe);
+  sq->sqes = mmap(NULL, sqes_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (sq->sqes == MAP_FAILED)
+    goto fail_cq;
+
+  char *sp = sq->ring_ptr;
+  sq->khead = (unsigned *) (sp + p->sq_off.head);
+  sq->ktail = (unsigned *) (sp + p->sq_off.tail);
+  sq->kring_mask = (unsigned *) (sp + p->sq_off.ring_mask);
+  sq->kring_entries = (unsigned *) (sp + p->sq_off.ring_entries);
+  sq->kflags = (unsigned *) (sp + p->sq_off.flags);
+  sq->kdropped = (unsigned *) (sp + p->sq_off.dropped);
+  sq->array = (unsigned *) (sp + p->sq_off.array);
+
+  char *cp = cq->ring_ptr;
+  cq->khead = (unsigned *) (cp + p->cq_off.head);
+  cq->ktail = (unsigned *) (cp + p->cq_off.tail);
+  cq->kring_mask = (unsigned *) (cp + p->cq_off.ring_mask);
+  cq->kring_entries = (unsigned *) (cp + p->cq_off.ring_entries);
+  cq->koverflow = (unsigned *) (cp + p->cq_off.overflow);
+  cq->cqes = (struct io_uring_cqe *) (cp + p->cq_off.cqes);
+
+  // the sq index array maps slots to sqes one to one
+  for (unsigned i = 0; i < p->sq_entries; i++)
+    sq->array[i] = i;
+
+  ring->flags = p->flags;
+  ring->ring_fd = fd;
+  return 0;
+
+fail_cq:
+  if (cq->ring_ptr != sq->ring_ptr)
+    munmap(cq->ring_ptr, cq->ring_sz);
+fail_sq:
+  munmap(sq->ring_ptr, sq->ring_sz);
+fail:
+  close(fd);
+  return -errno;
+}
+
+static inline int io_uring_queue_init(unsigned entries, struct io_uring *ring, unsigned flags) {
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  p.flags = flags;
+  return io_uring_queue_init_params(entries, ring, &p);
+}
+
+static inline void io_uring_queue_exit(struct io_uring *ring) {
+  struct io_uring_sq *sq = &ring->sq;
+  struct io_uring_cq *cq = &ring->cq;
+  munmap(sq->sqes, *sq->kring_entries * sizeof(struct io_uring_sqe));
+  if (cq->ring_ptr != sq->ring_ptr)
+    munmap(cq->ring_ptr, cq->ring_sz);
+  munmap(sq->ring_ptr, sq->ring_sz);
+  close(ring->ring_fd);
+}
+
+//
+// submission
+//
+
+static inline struct io_uring_sqe *io_uring_get_sqe(struct io_uring *ring) {
+  struct io_uring_sq *sq = &ring->sq;
+  unsigned head = io_uring_smp_load_acquire(sq->khead);
+  if (sq->sqe_tail - head >= *sq->kring_entries)
+    return NULL;
+
+  struct io_uring_sqe *sqe = &sq->sqes[sq->sqe_tail & *sq->kring_mask];
+  sq->sqe_tail++;
+  return sqe;
+}
+
+// publishes the prepared sqes and returns how many are waiting in the ring
+static inline unsigned __io_uring_flush_sq(struct io_uring *ring) {
+  struct io_uring_sq *sq = &ring->sq;
+  if (sq->sqe_head != sq->sqe_tail) {
+    sq->sqe_head = sq->sqe_tail;
+    io_uring_smp_store_release(sq->ktail, sq->sqe_tail);
+  }
+  return sq->sqe_tail - io_uring_smp_load_acquire(sq->khead);
+}
+
+static inline int io_uring_submit_and_wait(struct io_uring *ring, unsigned wait_nr) {
+  unsigned submitted = __io_uring_flush_sq(ring);
+  unsigned flags = wait_nr ? IORING_ENTER_GETEVENTS : 0;
+  if (ring->flags & IORING_SETUP_SQPOLL) {
+    // the sq thread only needs a syscall if it went to sleep
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(ring->sq.kflags, __ATOMIC_RELAXED) & IORING_SQ_NEED_WAKEUP)
+      flags |= IORING_ENTER_SQ_WAKEUP;
+    if (flags == 0)
+      return (int) submitted;
+  }
+  return __sys_io_uring_enter(ring->ring_fd, submitted, wait_nr, flags);
+}
+
+static inline int io_uring_submit(struct io_uring *ring) {
+  return io_uring_submit_and_wait(ring, 0);
+}
+
+//
+// completion
+//
+
+static inline int io_uring_peek_cqe(struct io_uring *ring, struct io_uring_cqe **cqe_ptr) {
+  struct io_uring_cq *cq = &ring->cq;
+  unsigned head = *cq->khead;
+  if (head == io_uring_smp_load_acquire(cq->ktail)) {
+    *cqe_ptr = NULL;
+    return -EAGAIN;
+  }
+  *cqe_ptr = &cq->cqes[head & *cq->kring_mask];
+  return 0;
+}
+
+static inline int io_uring_wait_cqe_nr(struct io_uring *ring, struct io_uring_cqe **cqe_ptr, unsigned wait_nr) {
+  for (;;) {
+    if (io_uring_peek_cqe(ring, cqe_ptr) == 0)
+      return 0;
+    int res = __sys_io_uring_enter(ring->ring_fd, 0, wait_nr, IORING_ENTER_GETEVENTS);
+    if (res < 0 && res != -EINTR)
+      return res;
+  }
+}
+
+static inline int io_uring_wait_cqe(struct io_uring *ring, struct io_uring_cqe **cqe_ptr) {
+  return io_uring_wait_cqe_nr(ring, cqe_ptr, 1);
+}
+
+static inline void io_uring_cq_advance(struct io_uring *ring, unsigned nr) {
+  io_uring_smp_store_release(ring->cq.khead, *ring->cq.khead + nr);
+}
+
+static inline void io_uring_cqe_seen(struct io_uring *ring, struct io_uring_cqe *cqe) {
+  (void) cqe;
+  io_uring_cq_advance(ring, 1);
+}
+
+static inline void *io_uring_cqe_get_data(const struct io_uring_cqe *cqe) {
+  return (void *) (uintptr_t) cqe->user_data;
+}
+
+//
+// request preparation
+//
+
+static inline void io_uring_prep_rw(int op, struct io_uring_sqe *sqe, int fd, const void *addr, unsigned len, uint64_t offset) {
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = (uint8_t) op;
+  sqe->fd = fd;
+  sqe->off = offset;
+  sqe->addr = (uint64_t) (uintptr_t) addr;
+  sqe->len = len;
+}
+
+static inline void io_uring_sqe_set_data(struct io_uring_sqe *sqe, void *data) {
+  sqe->user_data = (uint64_t) (uintptr_t) data;
+}
+
+static inline void io_uring_sqe_set_flags(struct io_uring_sqe *sqe, unsigned flags) {
+  sqe->flags = (uint8_t) flags;
+}
+
+static inline void io_uring_prep_nop(struct io_uring_sqe *sqe) {
+  io_uring_prep_rw(IORING_OP_NOP, sqe, -1, NULL, 0, 0);
+}
+
+static inline void io_uring_prep_read(struct io_uring_sqe *sqe, int fd, void *buf, unsigned nbytes, uint64_t offset) {
+  io_uring_prep_rw(IORING_OP_READ, sqe, fd, buf, nbytes, offset);
+}
+
+static inline void io_uring_prep_write(struct io_uring_sqe *sqe, int fd, const void *buf, unsigned nbytes, uint64_t offset) {
+  io_uring_prep_rw(IORING_OP_WRITE, sqe, fd, buf, nbytes, offset);
+}
+
+static inline void io_uring_prep_readv(struct io_uring_sqe *sqe, int fd, const struct iovec *iovecs, unsigned nr_vecs, uint64_t offset) {
+  io_uring_prep_rw(IORING_OP_READV, sqe, fd, iovecs, nr_vecs, offset);
+}
+
+static inline void io_uring_prep_writev(struct io_uring_sqe *sqe, int fd, const struct iovec *iovecs, unsigned nr_vecs, uint64_t offset) {
+  io_uring_prep_rw(IORING_OP_WRITEV, sqe, fd, iovecs, nr_vecs, offset);
+}
+
+static inline void io_uring_prep_recv(struct io_uring_sqe *sqe, int sockfd, void *buf, size_t len, int flags) {
+  io_uring_prep_rw(IORING_OP_RECV, sqe, sockfd, buf, (unsigned) len, 0);
+  sqe->msg_flags = (uint32_t) flags;
+}
+
+static inline void io_uring_prep_send(struct io_uring_sqe *sqe, int sockfd, const void *buf, size_t len, int flags) {
+  io_uring_prep_rw(IORING_OP_SEND, sqe, sockfd, buf, (unsigned) len, 0);
+  sqe->msg_flags = (uint32_t) flags;
+}
+
+static inline void io_uring_prep_accept(struct io_uring_sqe *sqe, int fd, struct sockaddr *addr, socklen_t *addrlen, int flags) {
+  io_uring_prep_rw(IORING_OP_ACCEPT, sqe, fd, addr, 0, (uint64_t) (uintptr_t) addrlen);
+  sqe->accept_flags = (uint32_t) flags;
+}
+
+static inline void io_uring_prep_poll_add(struct io_uring_sqe *sqe, int fd, unsigned poll_mask) {
+  io_uring_prep_rw(IORING_OP_POLL_ADD, sqe, fd, NULL, 0, 0);
+  sqe->poll32_events = poll_mask;
+}
+
+static inline void io_uring_prep_timeout(struct io_uring_sqe *sqe, struct __kernel_timespec *ts, unsigned count, unsigned flags) {
+  io_uring_prep_rw(IORING_OP_TIMEOUT, sqe, -1, ts, 1, count);
+  sqe->timeout_flags = flags;
+}
+
+#endif